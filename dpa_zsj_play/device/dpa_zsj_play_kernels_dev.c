@@ -1,32 +1,17 @@
 #include <stdint.h>                          
+#ifndef DPA_EMU
 #include <doca_dpa_dev_buf.h>
+/* 每个 rank 的迭代数只有 emulator 能记下来（dpa_emu_dev.h），DPA 上什么都不做 */
+#define L2_DEV_TRACE_ITERS(n) ((void)(n))
+/* 展开提示只给 dpacc，host gcc 不认 #pragma unroll */
+#define L2_UNROLL _Pragma("unroll")
+#else
+#define L2_UNROLL
+#endif
 
 #include "../include/args.h"
-
-typedef __dpa_global__ struct {
-    doca_dpa_dev_mmap_t handle;               // 共享内存的handle，DPA凭借这个来访问host mmap出来的内存
-    uint64_t a_offset;                        // a's offset
-    uint64_t b_offset;                        // b's offset
-    uint64_t out_offset;                      // dist(a,b)'s offset
-    uint64_t dim;                      // e.g. 32
-    uint64_t frac_bits;                // q (e.g. 16)
-}l2_single_dist_args;
-
-typedef __dpa_global__ struct {
-    doca_dpa_dev_mmap_t handle;
-
-    uint64_t a_base;
-    uint64_t b_base;
-    uint64_t out_base;
-
-    uint64_t a_stride;     // 每个向量 a 的步长（字节）
-    uint64_t b_stride;     // 每个向量 b 的步长（字节）
-    uint64_t out_stride;   // 每个输出 dist 的步长（字节）
-
-    uint32_t dim;          // 向量维度（例如 32）
-    uint32_t frac_bits;    // 定点位（例如 16）
-    uint32_t batch_size;   // 这一批里有多少个距离要算
-} l2_batch_args;
+#include "../include/l2_qvec.h"
+#include "../include/l2_topk.h"
 
 __dpa_global__ void l2_single_kernel(l2_single_dist_args args)
 {
@@ -45,12 +30,77 @@ __dpa_global__ void l2_single_kernel(l2_single_dist_args args)
     DOCA_DPA_DEV_LOG_INFO("End l2 single kernel\n");
 }
 
-__dpa_global__ void l2_batch_kernel(l2_batch_args args)
+/* emulator 会把 kernel 符号统一加前缀，见 dpa_emu_kernels.c */
+#ifndef L2_KERNEL_SYM
+#define L2_KERNEL_SYM(name) name
+#endif
+
+/* 从 start 开始按 step 跨步走到 end 之前的迭代次数 */
+static inline __attribute__((always_inline)) uint64_t l2_stride_iters(uint64_t start, uint64_t end, uint32_t step)
+{
+    return start < end ? (end - start - 1) / step + 1 : 0;
+}
+
+/*
+ * ||a - b||^2，2Q(2q)。dim 为编译期常量时循环可以完全展开，累加器留在寄存器里；
+ * 各个 kernel 都用 always_inline 把它和 dim 一起展开。
+ */
+static inline __attribute__((always_inline)) int64_t l2_sq_dev(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+    int64_t dist = 0;
+
+    L2_UNROLL
+    for (uint32_t i = 0; i < dim; ++i) {
+        int64_t da = (int64_t)a[i] - (int64_t)b[i];
+        dist += da * da;
+    }
+    return dist;
+}
+
+/*
+ * 提前放弃版本：每 block 维把部分和和 thresh 比一次，超过就不算剩下的维。
+ * 不回绕时部分和单调不减，被放弃的候选最终距离也一定 > thresh；返回值此时只是部分和。
+ */
+static inline __attribute__((always_inline)) uint64_t l2_sq_abandon_dev(const int32_t *a, const int32_t *b,
+                                                                         uint32_t dim, uint32_t block,
+                                                                         uint64_t thresh, uint64_t *dims)
+{
+    uint64_t dist = 0;
+    uint32_t i = 0;
+
+    while (i < dim) {
+        uint32_t end = dim - i > block ? i + block : dim;
+
+        for (; i < end; ++i) {
+            int64_t da = (int64_t)a[i] - (int64_t)b[i];
+            dist += (uint64_t)(da * da);
+        }
+        if (dist > thresh)
+            break;
+    }
+    *dims += i;
+    return dist;
+}
+
+/* 每个线程一行计数，stats_base == 0 时不写 */
+static inline __attribute__((always_inline)) void l2_abandon_stats_dev(doca_dpa_dev_mmap_t handle,
+                                                                        uint64_t stats_base, unsigned int rank,
+                                                                        uint64_t dims, uint64_t cands)
+{
+    if (stats_base == 0)
+        return;
+    uint64_t *stats = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+        handle, stats_base + (uint64_t)rank * L2_ABANDON_STATS * sizeof(uint64_t));
+    stats[L2_ABANDON_DIMS] = dims;
+    stats[L2_ABANDON_CANDS] = cands;
+}
+
+static inline __attribute__((always_inline)) void l2_batch_body(l2_batch_args args, uint32_t dim)
 {
-    // DOCA_DPA_DEV_LOG_INFO("start batch kernel\n");
     unsigned int rank = doca_dpa_dev_thread_rank() % doca_dpa_dev_num_threads();
     unsigned int num_threads = doca_dpa_dev_num_threads();
 
+    L2_DEV_TRACE_ITERS(l2_stride_iters(rank, args.batch_size, num_threads));
     for (uint32_t idx = rank; idx < args.batch_size; idx += num_threads) {
         const int32_t *a = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
             args.handle, args.a_base + (uint64_t)idx * args.a_stride);
@@ -59,12 +109,475 @@ __dpa_global__ void l2_batch_kernel(l2_batch_args args)
         uint64_t *out = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
             args.handle, args.out_base + (uint64_t)idx * args.out_stride);
 
-        int64_t dist = 0;
-        #pragma unroll
-        for (uint32_t i = 0; i < args.dim; ++i) {
-            int64_t da = (int64_t)a[i] - (int64_t)b[i];
-            dist += da * da;
+        *out = (uint64_t)l2_sq_dev(a, b, dim);
+    }
+}
+
+/* 一个候选：不提前放弃就算满 dim，否则和堆顶比 */
+static inline __attribute__((always_inline)) void l2_search_cand(const l2_search_args *args, struct l2_hit *heap,
+                                                                  uint32_t *n, uint32_t k, const int32_t *qv,
+                                                                  uint32_t idx, uint32_t dim, uint64_t *dims,
+                                                                  uint64_t *cands)
+{
+    const int32_t *v = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+        args->handle, args->db_base + (uint64_t)idx * args->db_stride);
+
+    if (args->abandon_block == 0) {
+        l2_topk_push(heap, n, k, (uint64_t)l2_sq_dev(qv, v, dim), args->id_base + idx);
+        return;
+    }
+    /* 堆满以后阈值就是堆顶，堆没满不能放弃 */
+    uint64_t thresh = l2_topk_bound(heap, *n, k);
+    uint64_t dist = l2_sq_abandon_dev(qv, v, dim, args->abandon_block, thresh, dims);
+
+    ++*cands;
+    if (dist <= thresh)
+        l2_topk_push(heap, n, k, dist, args->id_base + idx);
+}
+
+static inline __attribute__((always_inline)) void l2_search_body(l2_search_args args, uint32_t dim)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    struct l2_hit heap[L2_SEARCH_MAX_K];   // 线程本地 top-k，只有 k 个结果写回 host
+    uint32_t k = args.k < L2_SEARCH_MAX_K ? args.k : L2_SEARCH_MAX_K;
+    uint64_t dims = 0, cands = 0;
+    uint64_t first = (uint64_t)args.db_size * rank / num_threads;
+    uint64_t last = (uint64_t)args.db_size * (rank + 1) / num_threads;
+
+    if (rank >= args.num_parts)
+        return;
+
+    L2_DEV_TRACE_ITERS(args.nq * (args.filter_base == 0 ? l2_stride_iters(rank, args.db_size, num_threads) :
+                                                          last - first));
+    for (uint32_t q = 0; q < args.nq; ++q) {
+        const int32_t *qv = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.q_base + (uint64_t)q * args.q_stride);
+        uint32_t n = 0;
+
+        if (args.filter_base == 0) {
+            for (uint32_t idx = rank; idx < args.db_size; idx += num_threads)
+                l2_search_cand(&args, heap, &n, k, qv, idx, dim, &dims, &cands);
+        } else {
+            /* b 是 bitmap 里的 bit 号；每次取一个字里 [b, 字尾) 的位，只对置位的行算距离 */
+            uint64_t b = args.filter_bit + first, b_end = args.filter_bit + last;
+
+            while (b < b_end) {
+                const uint64_t *w = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+                    args.handle, args.filter_base + (b / 64) * sizeof(uint64_t));
+                uint64_t span = 64 - b % 64 < b_end - b ? 64 - b % 64 : b_end - b;
+                uint64_t word = *w >> (b % 64);
+
+                if (span < 64)
+                    word &= (1ULL << span) - 1;
+                while (word != 0) {
+                    l2_search_cand(&args, heap, &n, k, qv,
+                                   (uint32_t)(b + __builtin_ctzll(word) - args.filter_bit), dim, &dims, &cands);
+                    word &= word - 1;
+                }
+                b += span;
+            }
         }
-        *out = (uint64_t)dist;
+
+        l2_topk_pad(heap, n, k);
+        struct l2_hit *out = (struct l2_hit*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + ((uint64_t)q * args.num_parts + rank) * k * sizeof(struct l2_hit));
+        for (uint32_t j = 0; j < k; ++j)
+            out[j] = heap[j];
+    }
+    l2_abandon_stats_dev(args.handle, args.stats_base, rank, dims, cands);
+}
+
+/*
+ * Blocked 布局：rank 拿 [nblocks * rank / T, nblocks * (rank + 1) / T) 这段连续的 block，
+ * 每个 block 只做一次地址转换，16 个 lane 的累加器放在寄存器里，a / b 都是顺序读。
+ */
+static inline __attribute__((always_inline)) void l2_batch_blocked_body(l2_batch_blocked_args args, uint32_t dim)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    uint32_t nblocks = (args.batch_size + L2_BLOCK_VECS - 1) / L2_BLOCK_VECS;
+    uint32_t first = (uint32_t)((uint64_t)nblocks * rank / num_threads);
+    uint32_t last = (uint32_t)((uint64_t)nblocks * (rank + 1) / num_threads);
+    uint64_t block_bytes = (uint64_t)dim * L2_BLOCK_VECS * sizeof(int32_t);
+
+    L2_DEV_TRACE_ITERS(last - first);
+    for (uint32_t blk = first; blk < last; ++blk) {
+        const int32_t *a = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.a_base + (uint64_t)blk * block_bytes);
+        const int32_t *b = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.b_base + (uint64_t)blk * block_bytes);
+        uint64_t *out = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + (uint64_t)blk * L2_BLOCK_VECS * sizeof(uint64_t));
+        int64_t acc[L2_BLOCK_VECS] = {0};
+        uint32_t n = args.batch_size - blk * L2_BLOCK_VECS;
+
+        for (uint32_t i = 0; i < dim; ++i) {
+            L2_UNROLL
+            for (uint32_t l = 0; l < L2_BLOCK_VECS; ++l) {
+                int64_t d = (int64_t)a[i * L2_BLOCK_VECS + l] - (int64_t)b[i * L2_BLOCK_VECS + l];
+                acc[l] += d * d;
+            }
+        }
+
+        if (n > L2_BLOCK_VECS)
+            n = L2_BLOCK_VECS;
+        for (uint32_t l = 0; l < n; ++l)
+            out[l] = (uint64_t)acc[l];
+    }
+}
+
+/*
+ * 距离矩阵：rank 拿 [ntiles * rank / T, ntiles * (rank + 1) / T) 这段连续的 4x4 tile，
+ * tile 按行优先编号，相邻 tile 共用同一组 a 行。每个 tile 读 4 行 a、4 行 b，
+ * 16 个点积一起累加，访存从每对 2 * dim 降到每对 dim / 2。
+ * 边界 tile 把越界的行夹到最后一行，多算的结果不写回。
+ */
+static inline __attribute__((always_inline)) void l2_matrix_body(l2_matrix_args args, uint32_t dim)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    uint32_t tiles_n = (args.n + L2_MATRIX_TILE - 1) / L2_MATRIX_TILE;
+    uint64_t ntiles = (uint64_t)((args.m + L2_MATRIX_TILE - 1) / L2_MATRIX_TILE) * tiles_n;
+    uint64_t first = ntiles * rank / num_threads;
+    uint64_t last = ntiles * (rank + 1) / num_threads;
+    const uint64_t *a_norm = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.a_norm_base);
+    const uint64_t *b_norm = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.b_norm_base);
+
+    L2_DEV_TRACE_ITERS(last - first);
+    for (uint64_t t = first; t < last; ++t) {
+        uint32_t i0 = (uint32_t)(t / tiles_n) * L2_MATRIX_TILE;
+        uint32_t j0 = (uint32_t)(t % tiles_n) * L2_MATRIX_TILE;
+        const int32_t *a[L2_MATRIX_TILE], *b[L2_MATRIX_TILE];
+        int64_t dot[L2_MATRIX_TILE][L2_MATRIX_TILE] = {{0}};
+
+        L2_UNROLL
+        for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r) {
+            uint32_t i = i0 + r < args.m ? i0 + r : args.m - 1;
+            uint32_t j = j0 + r < args.n ? j0 + r : args.n - 1;
+
+            a[r] = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.a_base + (uint64_t)i * args.a_stride);
+            b[r] = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.b_base + (uint64_t)j * args.b_stride);
+        }
+
+        for (uint32_t d = 0; d < dim; ++d) {
+            L2_UNROLL
+            for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r) {
+                L2_UNROLL
+                for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+                    dot[r][c] += (int64_t)a[r][d] * (int64_t)b[c][d];
+            }
+        }
+
+        for (uint32_t r = 0; r < L2_MATRIX_TILE && i0 + r < args.m; ++r) {
+            uint64_t *out = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+                args.handle, args.out_base + (uint64_t)(i0 + r) * args.out_stride + (uint64_t)j0 * sizeof(uint64_t));
+
+            for (uint32_t c = 0; c < L2_MATRIX_TILE && j0 + c < args.n; ++c)
+                out[c] = a_norm[i0 + r] + b_norm[j0 + c] - 2 * (uint64_t)dot[r][c];
+        }
+    }
+}
+
+/*
+ * IVF 细查：每个 query 只扫 nprobe 个倒排表。pos 是已经扫过的表的总行数，
+ * 表内第一行 g = pos + i 满足 g % T == rank 的 i 就是这个线程的起点。
+ */
+static inline __attribute__((always_inline)) void l2_ivf_body(l2_ivf_args args, uint32_t dim)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    struct l2_hit heap[L2_SEARCH_MAX_K];
+    uint32_t k = args.k < L2_SEARCH_MAX_K ? args.k : L2_SEARCH_MAX_K;
+    const uint32_t *offsets = (uint32_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.offsets_base);
+    const uint32_t *ids = (uint32_t*)doca_dpa_dev_mmap_get_external_ptr(args.handle, args.ids_base);
+    uint64_t iters = 0;
+
+    if (rank >= args.num_parts)
+        return;
+
+    for (uint32_t q = 0; q < args.nq; ++q) {
+        const int32_t *qv = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.q_base + (uint64_t)q * args.q_stride);
+        const uint32_t *probes = (uint32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.probes_base + (uint64_t)q * args.nprobe * sizeof(uint32_t));
+        uint64_t pos = 0;
+        uint32_t n = 0;
+
+        for (uint32_t p = 0; p < args.nprobe; ++p) {
+            uint32_t begin = offsets[probes[p]], end = offsets[probes[p] + 1];
+            uint32_t skip = (uint32_t)((rank + num_threads - pos % num_threads) % num_threads);
+
+            for (uint32_t idx = begin + skip; idx < end; idx += num_threads) {
+                const int32_t *v = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+                    args.handle, args.db_base + (uint64_t)idx * args.db_stride);
+
+                l2_topk_push(heap, &n, k, (uint64_t)l2_sq_dev(qv, v, dim), ids[idx]);
+            }
+            iters += l2_stride_iters(begin + skip, end, num_threads);
+            pos += end - begin;
+        }
+
+        l2_topk_pad(heap, n, k);
+        struct l2_hit *out = (struct l2_hit*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + ((uint64_t)q * args.num_parts + rank) * k * sizeof(struct l2_hit));
+        for (uint32_t j = 0; j < k; ++j)
+            out[j] = heap[j];
     }
-}
\ No newline at end of file
+    L2_DEV_TRACE_ITERS(iters);
+}
+
+/*
+ * ADC 扫描：每个 code 只读 m 字节，距离是 m 次查表之和。表是每个 query 几 KB，
+ * 会留在 DPA 的 cache 里；线程拿连续的一段 code，code 流是顺序读。
+ */
+static inline __attribute__((always_inline)) void l2_pq_body(l2_pq_args args)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    struct l2_hit heap[L2_SEARCH_MAX_K];
+    uint32_t k = args.k < L2_SEARCH_MAX_K ? args.k : L2_SEARCH_MAX_K;
+    uint32_t first = (uint32_t)((uint64_t)args.n * rank / num_threads);
+    uint32_t last = (uint32_t)((uint64_t)args.n * (rank + 1) / num_threads);
+
+    if (rank >= args.num_parts)
+        return;
+
+    const uint8_t *codes = (uint8_t*)doca_dpa_dev_mmap_get_external_ptr(
+        args.handle, args.codes_base + (uint64_t)first * args.m);
+
+    L2_DEV_TRACE_ITERS((uint64_t)args.nq * (last - first));
+    for (uint32_t q = 0; q < args.nq; ++q) {
+        const uint16_t *lut = (uint16_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.lut_base + (uint64_t)q * args.lut_stride);
+        uint32_t n = 0;
+
+        for (uint32_t idx = first; idx < last; ++idx) {
+            const uint8_t *code = codes + (uint64_t)(idx - first) * args.m;
+            uint32_t dist = 0;
+
+            for (uint32_t j = 0; j < args.m; ++j)
+                dist += lut[j * L2_PQ_KSUB + code[j]];
+            l2_topk_push(heap, &n, k, dist, args.id_base + idx);
+        }
+
+        l2_topk_pad(heap, n, k);
+        struct l2_hit *out = (struct l2_hit*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + ((uint64_t)q * args.num_parts + rank) * k * sizeof(struct l2_hit));
+        for (uint32_t j = 0; j < k; ++j)
+            out[j] = heap[j];
+    }
+}
+
+/*
+ * int8 / int16 code 的 raw 点积。int8 的积 |qa * qb| <= 2^14，每 L2_Q8_DOT_CHUNK 个元素
+ * 才需要并进 int64，内层循环是 32 位乘加；int16 的积接近 2^30，直接用 int64 累加。
+ */
+static inline __attribute__((always_inline)) int64_t l2_qdot_dev(const void *a, const void *b, uint32_t dim,
+                                                                  uint32_t elem)
+{
+    int64_t dot = 0;
+
+    if (elem == L2_QELEM_I8) {
+        const int8_t *qa = (const int8_t*)a, *qb = (const int8_t*)b;
+
+        for (uint32_t i = 0; i < dim; i += L2_Q8_DOT_CHUNK) {
+            uint32_t end = dim - i < L2_Q8_DOT_CHUNK ? dim : i + L2_Q8_DOT_CHUNK;
+            int32_t acc = 0;
+
+            for (uint32_t j = i; j < end; ++j)
+                acc += (int32_t)qa[j] * (int32_t)qb[j];
+            dot += acc;
+        }
+    } else {
+        const int16_t *qa = (const int16_t*)a, *qb = (const int16_t*)b;
+
+        for (uint32_t j = 0; j < dim; ++j)
+            dot += (int32_t)qa[j] * (int32_t)qb[j];
+    }
+    return dot;
+}
+
+static inline __attribute__((always_inline)) void l2_qbatch_body(l2_qbatch_args args)
+{
+    unsigned int rank = doca_dpa_dev_thread_rank() % doca_dpa_dev_num_threads();
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+
+    L2_DEV_TRACE_ITERS(l2_stride_iters(rank, args.batch_size, num_threads));
+    for (uint32_t idx = rank; idx < args.batch_size; idx += num_threads) {
+        const struct l2_qvec_hdr *a = (struct l2_qvec_hdr*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.a_base + (uint64_t)idx * args.a_stride);
+        const struct l2_qvec_hdr *b = (struct l2_qvec_hdr*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.b_base + (uint64_t)idx * args.b_stride);
+        uint64_t *out = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + (uint64_t)idx * args.out_stride);
+        int64_t dot = l2_qdot_dev(l2_qvec_codes(a), l2_qvec_codes(b), args.dim, args.elem);
+
+        *out = l2_qvec_dist(a, b, dot, args.dim);
+    }
+}
+
+/* SWAR popcount：不依赖 DPA 上有没有 Zbb 的 cpop 指令 */
+static inline __attribute__((always_inline)) uint32_t l2_popcount32_dev(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0f0f0f0fu;
+    return (x * 0x01010101u) >> 24;
+}
+
+/*
+ * Hamming 预筛：每个 code 只读 words * 4 字节，query 的 code 很短，留在 cache 里。
+ * 和 PQ 一样线程拿连续的一段 code，code 流是顺序读。
+ */
+static inline __attribute__((always_inline)) void l2_hamming_body(l2_hamming_args args)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    struct l2_hit heap[L2_SEARCH_MAX_K];
+    uint32_t k = args.k < L2_SEARCH_MAX_K ? args.k : L2_SEARCH_MAX_K;
+    uint32_t first = (uint32_t)((uint64_t)args.n * rank / num_threads);
+    uint32_t last = (uint32_t)((uint64_t)args.n * (rank + 1) / num_threads);
+
+    if (rank >= args.num_parts)
+        return;
+
+    const uint32_t *codes = (uint32_t*)doca_dpa_dev_mmap_get_external_ptr(
+        args.handle, args.codes_base + (uint64_t)first * args.words * sizeof(uint32_t));
+
+    L2_DEV_TRACE_ITERS((uint64_t)args.nq * (last - first));
+    for (uint32_t q = 0; q < args.nq; ++q) {
+        const uint32_t *qc = (uint32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.q_base + (uint64_t)q * args.words * sizeof(uint32_t));
+        uint32_t n = 0;
+
+        for (uint32_t idx = first; idx < last; ++idx) {
+            const uint32_t *code = codes + (uint64_t)(idx - first) * args.words;
+            uint32_t dist = 0;
+
+            for (uint32_t w = 0; w < args.words; ++w)
+                dist += l2_popcount32_dev(qc[w] ^ code[w]);
+            l2_topk_push(heap, &n, k, dist, args.id_base + idx);
+        }
+
+        l2_topk_pad(heap, n, k);
+        struct l2_hit *out = (struct l2_hit*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.out_base + ((uint64_t)q * args.num_parts + rank) * k * sizeof(struct l2_hit));
+        for (uint32_t j = 0; j < k; ++j)
+            out[j] = heap[j];
+    }
+}
+
+/*
+ * 半径搜索：命中追加到 rank 自己的段里，写回量和命中数成正比而不是 nq * db_size。
+ * 段满以后只计数不写，count 留着真实值让 host 知道溢出了多少。
+ */
+static inline __attribute__((always_inline)) void l2_range_body(l2_range_args args, uint32_t dim)
+{
+    unsigned int num_threads = doca_dpa_dev_num_threads();
+    unsigned int rank = doca_dpa_dev_thread_rank() % num_threads;
+    uint32_t first = (uint32_t)((uint64_t)args.db_size * rank / num_threads);
+    uint32_t last = (uint32_t)((uint64_t)args.db_size * (rank + 1) / num_threads);
+    uint64_t count = 0, dims = 0, cands = 0;
+
+    if (rank >= args.num_parts)
+        return;
+
+    struct l2_range_hit *out = (struct l2_range_hit*)doca_dpa_dev_mmap_get_external_ptr(
+        args.handle, args.out_base + (uint64_t)rank * args.cap * sizeof(struct l2_range_hit));
+    uint64_t *counts = (uint64_t*)doca_dpa_dev_mmap_get_external_ptr(
+        args.handle, args.counts_base + (uint64_t)rank * sizeof(uint64_t));
+
+    L2_DEV_TRACE_ITERS((uint64_t)args.nq * (last - first));
+    for (uint32_t q = 0; q < args.nq; ++q) {
+        const int32_t *qv = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+            args.handle, args.q_base + (uint64_t)q * args.q_stride);
+
+        for (uint32_t idx = first; idx < last; ++idx) {
+            const int32_t *v = (int32_t*)doca_dpa_dev_mmap_get_external_ptr(
+                args.handle, args.db_base + (uint64_t)idx * args.db_stride);
+            uint64_t dist;
+
+            if (args.abandon_block == 0) {
+                dist = (uint64_t)l2_sq_dev(qv, v, dim);
+            } else {
+                dist = l2_sq_abandon_dev(qv, v, dim, args.abandon_block, args.radius, &dims);
+                ++cands;
+            }
+            if (dist > args.radius)
+                continue;
+            if (count < args.cap) {
+                out[count].dist = dist;
+                out[count].id = args.id_base + idx;
+                out[count].q = q;
+            }
+            ++count;
+        }
+    }
+    *counts = count;
+    l2_abandon_stats_dev(args.handle, args.stats_base, rank, dims, cands);
+}
+
+/* 通用版本：任意 dim */
+__dpa_global__ void l2_batch_kernel(l2_batch_args args)
+{
+    l2_batch_body(args, args.dim);
+}
+
+__dpa_global__ void l2_search_kernel(l2_search_args args)
+{
+    l2_search_body(args, args.dim);
+}
+
+/* 内层是固定 16 个 lane，已经是编译期常量，不再按 dim 特化 */
+__dpa_global__ void l2_batch_blocked_kernel(l2_batch_blocked_args args)
+{
+    l2_batch_blocked_body(args, args.dim);
+}
+
+/* 内层是 4x4 的寄存器块，dim 只影响外层循环次数，同样不特化 */
+__dpa_global__ void l2_matrix_kernel(l2_matrix_args args)
+{
+    l2_matrix_body(args, args.dim);
+}
+
+__dpa_global__ void l2_ivf_kernel(l2_ivf_args args)
+{
+    l2_ivf_body(args, args.dim);
+}
+
+/* code 宽度在 launch 时才知道，int8 / int16 共用一个 kernel */
+__dpa_global__ void l2_qbatch_kernel(l2_qbatch_args args)
+{
+    l2_qbatch_body(args);
+}
+
+/* ADC 只查表，和 dim 无关 */
+__dpa_global__ void l2_pq_kernel(l2_pq_args args)
+{
+    l2_pq_body(args);
+}
+
+__dpa_global__ void l2_range_kernel(l2_range_args args)
+{
+    l2_range_body(args, args.dim);
+}
+
+/* 内层按 32 位字走，dim 只决定字数 */
+__dpa_global__ void l2_hamming_kernel(l2_hamming_args args)
+{
+    l2_hamming_body(args);
+}
+
+/* 定长版本：host 只在 args.dim == D 时 launch（l2_variant_select） */
+#define L2_DEV_SPECIALIZE(D)                                                        \
+    __dpa_global__ void L2_KERNEL_SYM(l2_batch_kernel_d##D)(l2_batch_args args)     \
+    {                                                                               \
+        l2_batch_body(args, D);                                                     \
+    }                                                                               \
+    __dpa_global__ void L2_KERNEL_SYM(l2_search_kernel_d##D)(l2_search_args args)   \
+    {                                                                               \
+        l2_search_body(args, D);                                                    \
+    }
+
+L2_SPEC_DIMS(L2_DEV_SPECIALIZE)
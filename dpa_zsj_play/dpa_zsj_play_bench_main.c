@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2022-2023 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include <doca_argp.h>
+
+#include "dpa_common.h"
+#include "include/l2_argp.h"
+#include "include/l2_bench.h"
+#include "include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::BENCH_MAIN);
+
+/* dpa 是第一个成员，register_dpa_params() 的回调把 config 当 struct dpa_config 用 */
+struct zsj_bench_config {
+	struct dpa_config dpa;
+	struct l2_bench_cfg bench;
+	char trace_path[PATH_MAX];	/* 非空: sweep 结束后写 Chrome trace JSON */
+};
+
+/*
+ * ARGP Callback - Handle backends parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t backends_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	char buf[256], *save = NULL;
+	uint32_t n = 0;
+
+	snprintf(buf, sizeof(buf), "%s", (const char *)param);
+	for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		enum l2_backend_type type = l2_backend_type_from_name(tok);
+
+		if (type == L2_BACKEND_MAX || n == L2_BENCH_MAX_LIST) {
+			DOCA_LOG_ERR("Bad backend list %s, expected names from dpa, cpu, emu, host",
+				     (const char *)param);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		cfg->backends[n++] = type;
+	}
+	cfg->num_backends = n;
+	return n != 0 ? DOCA_SUCCESS : DOCA_ERROR_INVALID_VALUE;
+}
+
+/*
+ * ARGP Callback - Handle elems parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t elems_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	char buf[256], *save = NULL;
+	uint32_t n = 0;
+
+	snprintf(buf, sizeof(buf), "%s", (const char *)param);
+	for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		enum l2_elem elem = l2_elem_from_name(tok);
+
+		if (elem == L2_ELEM_MAX || n == L2_BENCH_MAX_LIST) {
+			DOCA_LOG_ERR("Bad element type list %s", (const char *)param);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		cfg->elems[n++] = elem;
+	}
+	cfg->num_elems = n;
+	return n != 0 ? DOCA_SUCCESS : DOCA_ERROR_INVALID_VALUE;
+}
+
+/*
+ * ARGP Callback - Handle layouts parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t layouts_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	char buf[256], *save = NULL;
+	uint32_t n = 0;
+
+	snprintf(buf, sizeof(buf), "%s", (const char *)param);
+	for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		enum l2_layout layout = l2_layout_from_name(tok);
+
+		if (layout == L2_LAYOUT_MAX || n == L2_BENCH_MAX_LIST) {
+			DOCA_LOG_ERR("Bad layout list %s", (const char *)param);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		cfg->layouts[n++] = layout;
+	}
+	cfg->num_layouts = n;
+	return n != 0 ? DOCA_SUCCESS : DOCA_ERROR_INVALID_VALUE;
+}
+
+/*
+ * ARGP Callback - Handle dims parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t dims_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	doca_error_t result = l2_bench_parse_u32_list(param, cfg->dims, &cfg->num_dims);
+
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Bad dim list %s", (const char *)param);
+	return result;
+}
+
+/*
+ * ARGP Callback - Handle batch parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t batch_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	doca_error_t result = l2_bench_parse_u32_list(param, cfg->batches, &cfg->num_batches);
+
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Bad batch size list %s", (const char *)param);
+	return result;
+}
+
+/*
+ * ARGP Callback - Handle threads parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t threads_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	doca_error_t result = l2_bench_parse_u32_list(param, cfg->threads, &cfg->num_threads);
+
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Bad thread count list %s", (const char *)param);
+	return result;
+}
+
+/*
+ * ARGP Callback - Handle warmup parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t warmup_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	int v = *(int *)param;
+
+	if (v < 0)
+		return DOCA_ERROR_INVALID_VALUE;
+	cfg->warmup = (uint32_t)v;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle repeats parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t repeats_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+	int v = *(int *)param;
+
+	if (v <= 0)
+		return DOCA_ERROR_INVALID_VALUE;
+	cfg->repeats = (uint32_t)v;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle generic parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t generic_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+
+	cfg->compare_generic = *(bool *)param;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle host-stride parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t host_stride_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+
+	cfg->host_stride = *(bool *)param;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle csv parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t csv_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+
+	snprintf(cfg->csv_path, sizeof(cfg->csv_path), "%s", (const char *)param);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle json parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t json_callback(void *param, void *config)
+{
+	struct l2_bench_cfg *cfg = &((struct zsj_bench_config *)config)->bench;
+
+	snprintf(cfg->json_path, sizeof(cfg->json_path), "%s", (const char *)param);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle trace parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t trace_callback(void *param, void *config)
+{
+	struct zsj_bench_config *cfg = (struct zsj_bench_config *)config;
+
+	if (!l2_trace_enabled()) {
+		DOCA_LOG_ERR("--trace needs a build with -Dtrace=true");
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	snprintf(cfg->trace_path, sizeof(cfg->trace_path), "%s", (const char *)param);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Register the benchmark's command line parameters
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t register_bench_params(void)
+{
+	static const struct l2_argp_param params[] = {
+		{"b", "backends", "<list>", "Backends to sweep, from dpa,cpu,emu,host (default cpu,host,emu)",
+		 DOCA_ARGP_TYPE_STRING, backends_callback},
+		{"n", "dims", "<list>", "Vector dimensions, e.g. 32,128,768", DOCA_ARGP_TYPE_STRING, dims_callback},
+		{"B", "batch", "<list>", "Batch sizes (default 65536)", DOCA_ARGP_TYPE_STRING, batch_callback},
+		{"t", "threads", "<list>", "Kernel threads for dpa / emu, worker threads for host (default 64)", DOCA_ARGP_TYPE_STRING,
+		 threads_callback},
+		{"e", "elems", "<list>", "Element types: q16_16, int16, int8 (default q16_16)", DOCA_ARGP_TYPE_STRING, elems_callback},
+		{"l", "layouts", "<list>", "Batch layouts, from aos,blocked (default aos)", DOCA_ARGP_TYPE_STRING,
+		 layouts_callback},
+		{"w", "warmup", "<n>", "Untimed runs per point (default 2)", DOCA_ARGP_TYPE_INT, warmup_callback},
+		{"r", "repeats", "<n>", "Timed runs per point (default 10)", DOCA_ARGP_TYPE_INT, repeats_callback},
+		{"g", "generic", NULL, "Also run every point with the generic (non-specialized) kernels",
+		 DOCA_ARGP_TYPE_BOOLEAN, generic_callback},
+		{NULL, "host-stride", NULL, "Split host launches by DPA-style rank striding instead of contiguous chunks",
+		 DOCA_ARGP_TYPE_BOOLEAN, host_stride_callback},
+		{NULL, "csv", "<path>", "Write results as CSV", DOCA_ARGP_TYPE_STRING, csv_callback},
+		{NULL, "json", "<path>", "Write results as JSON", DOCA_ARGP_TYPE_STRING, json_callback},
+		{NULL, "trace", "<path>", "Write a Chrome trace JSON of the sweep and print a per-span summary "
+		 "(build with -Dtrace=true)", DOCA_ARGP_TYPE_STRING, trace_callback},
+	};
+
+	return l2_argp_register(params, sizeof(params) / sizeof(params[0]));
+}
+
+/*
+ * Benchmark main function
+ *
+ * @argc [in]: command line arguments size
+ * @argv [in]: array of command line arguments
+ * @return: EXIT_SUCCESS on success and EXIT_FAILURE otherwise
+ */
+int main(int argc, char **argv)
+{
+	struct zsj_bench_config cfg = {0};
+	struct dpa_resources resources = {0};
+	struct doca_log_backend *sdk_log;
+	bool use_dpa = false;
+	doca_error_t result;
+	int exit_status = EXIT_FAILURE;
+
+	strcpy(cfg.dpa.device_name, "mlx5_1");
+	l2_bench_cfg_init(&cfg.bench);
+
+	result = doca_log_backend_create_standard();
+	if (result != DOCA_SUCCESS)
+		goto bench_exit;
+	result = doca_log_backend_create_with_file_sdk(stderr, &sdk_log);
+	if (result != DOCA_SUCCESS)
+		goto bench_exit;
+	result = doca_log_backend_set_sdk_level(sdk_log, DOCA_LOG_LEVEL_WARNING);
+	if (result != DOCA_SUCCESS)
+		goto bench_exit;
+
+	result = doca_argp_init("doca_dpa_zsj_play_bench", &cfg);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to init ARGP resources: %s", doca_error_get_descr(result));
+		goto bench_exit;
+	}
+	result = register_dpa_params();
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to register DPA parameters: %s", doca_error_get_descr(result));
+		goto argp_cleanup;
+	}
+	result = register_bench_params();
+	if (result != DOCA_SUCCESS)
+		goto argp_cleanup;
+	result = doca_argp_start(argc, argv);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to parse benchmark input: %s", doca_error_get_descr(result));
+		goto argp_cleanup;
+	}
+
+	/* 只有 sweep 里有 dpa 时才去打开设备，cpu / host / emu 不需要 BlueField */
+	for (uint32_t i = 0; i < cfg.bench.num_backends; i++)
+		use_dpa |= cfg.bench.backends[i] == L2_BACKEND_DPA;
+	if (use_dpa) {
+		result = allocate_dpa_resources(&cfg.dpa, &resources);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to Allocate DPA Resources: %s", doca_error_get_descr(result));
+			goto argp_cleanup;
+		}
+	}
+
+	result = l2_bench_run(&cfg.bench, use_dpa ? &resources : NULL);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Benchmark encountered an error: %s", doca_error_get_descr(result));
+	else
+		exit_status = EXIT_SUCCESS;
+	if (cfg.trace_path[0] != '\0' && l2_trace_dump(cfg.trace_path) != DOCA_SUCCESS)
+		exit_status = EXIT_FAILURE;
+
+	if (use_dpa) {
+		result = destroy_dpa_resources(&resources);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to destroy DOCA DPA resources: %s", doca_error_get_descr(result));
+			exit_status = EXIT_FAILURE;
+		}
+	}
+argp_cleanup:
+	doca_argp_destroy();
+bench_exit:
+	return exit_status;
+}
@@ -13,16 +13,781 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
 
 #include <doca_error.h>
 #include <doca_log.h>
 
+#include <doca_argp.h>
+
 #include "dpa_common.h"
+#include "include/l2_argp.h"
+#include "include/l2_backend.h"
+#include "include/l2_shards.h"
+#include "include/l2_trace.h"
 
 DOCA_LOG_REGISTER(ZSJ_PLAY::MAIN);
 
+/* dpa 是第一个成员，register_dpa_params() 的回调把 config 当 struct dpa_config 用 */
+struct zsj_play_config {
+	struct dpa_config dpa;
+	enum l2_backend_type backend;
+	int search;		/* 1: k-NN search sample，0: pairwise batch sample */
+	int matrix;		/* 1: M x N 距离矩阵 sample */
+	uint32_t pipeline_slots;	/* > 0: 用 K 个 slot 的流水线跑 batch sample */
+	uint32_t async_depth;		/* > 0: 通过异步 engine 分块提交 batch sample */
+	uint32_t hybrid_runs;		/* > 0: batch 在 device 和 host 之间自适应切分，跑这么多轮 */
+	uint32_t server_batch;		/* > 0: query server sample，一次 launch 最多这么多 query */
+	uint32_t deadline_us;		/* query server 凑 batch 的最长等待，0 = 默认 */
+	char socket_path[PATH_MAX];	/* 非空: query server 的客户端走 Unix socket */
+	uint32_t session_jobs;		/* > 0: session sample，热 session 上跑的 job 数 */
+	double range_radius;		/* > 0: 半径搜索 sample，距离阈值（不平方） */
+	uint32_t abandon_block;		/* > 0: 提前放弃 sample，每这么多维比一次阈值 */
+	uint32_t num_shards;		/* > 0: 分片 sample，库切到这么多个设备上 */
+	double filter_selectivity;	/* > 0: 过滤 search sample，通过过滤的行的比例 */
+	char shard_devices[PATH_MAX];	/* 逗号分隔的设备名；只给数字时为空，shard 用默认名 */
+	char base_path[PATH_MAX];	/* 非空: 在 .fvecs / .bvecs 数据集上跑 search */
+	char query_path[PATH_MAX];
+	char gt_path[PATH_MAX];		/* 可以为空，不算 recall */
+	double min_recall;		/* > 0: recall@10 低于它时 sample 失败，需要 --gt */
+	uint32_t nlist;			/* > 0: 数据集 search 改用 IVF index */
+	uint32_t nprobe;		/* 0: 从 1 开始按 2 的幂扫到 nlist / 4 */
+	char index_path[PATH_MAX];	/* 非空: 给了 nlist 就训练完存到这里，否则从这里加载 */
+	uint32_t pq_m;			/* > 0: 数据集 search 改用 m 字节的 PQ code */
+	uint32_t bin_rerank;		/* > 0: 数据集 search 改用二值 code 预筛，每个 query 重排这么多候选 */
+	char trace_path[PATH_MAX];	/* 非空: 结束时把 trace 写成 Chrome JSON 并打印汇总 */
+};
+
 /* Sample's Logic */
-doca_error_t kernel_launch(struct dpa_resources *resources);
+doca_error_t kernel_launch(struct dpa_resources *resources, enum l2_backend_type type);
+doca_error_t search_launch(struct dpa_resources *resources, enum l2_backend_type type);
+doca_error_t matrix_launch(struct dpa_resources *resources, enum l2_backend_type type);
+doca_error_t pipeline_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t num_slots);
+doca_error_t async_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t depth);
+doca_error_t hybrid_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t runs);
+doca_error_t server_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t max_batch,
+			   uint32_t deadline_us, const char *socket_path);
+doca_error_t session_launch(struct dpa_resources *resources, enum l2_backend_type type, struct dpa_config *dpa_cfg,
+			    uint32_t jobs);
+doca_error_t range_launch(struct dpa_resources *resources, enum l2_backend_type type, double radius);
+doca_error_t abandon_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t block);
+doca_error_t filter_launch(struct dpa_resources *resources, enum l2_backend_type type, double selectivity);
+doca_error_t shards_launch(enum l2_backend_type type, struct dpa_config *dpa_cfg, uint32_t num_shards,
+			   const char *devices);
+doca_error_t dataset_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			    const char *query_path, const char *gt_path, double min_recall);
+doca_error_t ivf_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			const char *query_path, const char *gt_path, uint32_t nlist, uint32_t nprobe,
+			const char *index_path, double min_recall);
+doca_error_t pq_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+		       const char *query_path, const char *gt_path, uint32_t m, double min_recall);
+doca_error_t bin_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			const char *query_path, const char *gt_path, uint32_t rerank, double min_recall);
+
+/*
+ * Reject command lines that select more than one sample, or more than one search over --base
+ *
+ * @cfg [in]: program configuration
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR_INVALID_VALUE otherwise
+ */
+static doca_error_t check_modes(const struct zsj_play_config *cfg)
+{
+	const struct {
+		int on;
+		const char *flag;
+	} modes[] = {
+		{cfg->base_path[0] != '\0', "--base"},
+		{cfg->search, "--search"},
+		{cfg->matrix, "--matrix"},
+		{cfg->pipeline_slots > 0, "--pipeline"},
+		{cfg->async_depth > 0, "--async"},
+		{cfg->hybrid_runs > 0, "--hybrid"},
+		{cfg->server_batch > 0, "--server"},
+		{cfg->session_jobs > 0, "--session"},
+		{cfg->range_radius > 0, "--range"},
+		{cfg->abandon_block > 0, "--abandon"},
+		{cfg->filter_selectivity > 0, "--filter"},
+		{cfg->num_shards > 0, "--shards"},
+	}, searches[] = {
+		{cfg->nlist > 0 || cfg->index_path[0] != '\0', "--nlist / --index"},
+		{cfg->pq_m > 0, "--pq"},
+		{cfg->bin_rerank > 0, "--binary"},
+	};
+	const char *mode = NULL, *search = NULL;
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		if (!modes[i].on)
+			continue;
+		if (mode != NULL) {
+			DOCA_LOG_ERR("%s and %s select different samples, give only one", mode, modes[i].flag);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		mode = modes[i].flag;
+	}
+	for (size_t i = 0; i < sizeof(searches) / sizeof(searches[0]); i++) {
+		if (!searches[i].on)
+			continue;
+		if (search != NULL) {
+			DOCA_LOG_ERR("%s and %s select different searches over --base, give only one", search,
+				     searches[i].flag);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		search = searches[i].flag;
+	}
+	/* 只对 --base 有意义的参数 */
+	if (cfg->base_path[0] == '\0' && (search != NULL || cfg->nprobe > 0 || cfg->query_path[0] != '\0' ||
+					  cfg->gt_path[0] != '\0' || cfg->min_recall > 0)) {
+		DOCA_LOG_ERR("--queries, --gt, --min-recall, --nlist, --nprobe, --index, --pq and --binary need --base");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (cfg->server_batch == 0 && (cfg->deadline_us > 0 || cfg->socket_path[0] != '\0')) {
+		DOCA_LOG_ERR("--deadline-us and --socket need --server");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Run the sample selected on the command line
+ *
+ * @cfg [in]: program configuration
+ * @resources [in]: DPA resources, NULL for host-only backends
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t run_sample(struct zsj_play_config *cfg, struct dpa_resources *resources)
+{
+	doca_error_t result = check_modes(cfg);
+
+	if (result != DOCA_SUCCESS)
+		return result;
+	if (cfg->base_path[0] != '\0') {
+		if (cfg->query_path[0] == '\0') {
+			DOCA_LOG_ERR("--base needs --queries");
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		if (cfg->min_recall > 0 && cfg->gt_path[0] == '\0') {
+			DOCA_LOG_ERR("--min-recall needs --gt");
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		if (cfg->bin_rerank > 0)
+			return bin_launch(resources, cfg->backend, cfg->base_path, cfg->query_path, cfg->gt_path,
+					  cfg->bin_rerank, cfg->min_recall);
+		if (cfg->pq_m > 0)
+			return pq_launch(resources, cfg->backend, cfg->base_path, cfg->query_path, cfg->gt_path,
+					 cfg->pq_m, cfg->min_recall);
+		if (cfg->nlist > 0 || cfg->index_path[0] != '\0')
+			return ivf_launch(resources, cfg->backend, cfg->base_path, cfg->query_path, cfg->gt_path,
+					  cfg->nlist, cfg->nprobe, cfg->index_path, cfg->min_recall);
+		return dataset_launch(resources, cfg->backend, cfg->base_path, cfg->query_path, cfg->gt_path,
+				      cfg->min_recall);
+	}
+	if (cfg->search)
+		return search_launch(resources, cfg->backend);
+	if (cfg->matrix)
+		return matrix_launch(resources, cfg->backend);
+	if (cfg->pipeline_slots > 0)
+		return pipeline_launch(resources, cfg->backend, cfg->pipeline_slots);
+	if (cfg->async_depth > 0)
+		return async_launch(resources, cfg->backend, cfg->async_depth);
+	if (cfg->hybrid_runs > 0)
+		return hybrid_launch(resources, cfg->backend, cfg->hybrid_runs);
+	if (cfg->server_batch > 0)
+		return server_launch(resources, cfg->backend, cfg->server_batch, cfg->deadline_us, cfg->socket_path);
+	if (cfg->session_jobs > 0)
+		return session_launch(resources, cfg->backend, &cfg->dpa, cfg->session_jobs);
+	if (cfg->range_radius > 0)
+		return range_launch(resources, cfg->backend, cfg->range_radius);
+	if (cfg->abandon_block > 0)
+		return abandon_launch(resources, cfg->backend, cfg->abandon_block);
+	if (cfg->filter_selectivity > 0)
+		return filter_launch(resources, cfg->backend, cfg->filter_selectivity);
+	if (cfg->num_shards > 0)
+		return shards_launch(cfg->backend, &cfg->dpa, cfg->num_shards, cfg->shard_devices);
+	return kernel_launch(resources, cfg->backend);
+}
+
+/*
+ * ARGP Callback - Handle backend parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t backend_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	const char *name = (const char *)param;
+
+	cfg->backend = l2_backend_type_from_name(name);
+	if (cfg->backend == L2_BACKEND_MAX) {
+		DOCA_LOG_ERR("Unknown backend %s, expected dpa, cpu, emu or host", name);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle search parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t search_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	cfg->search = *(bool *)param;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle matrix parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t matrix_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	cfg->matrix = *(bool *)param;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle pipeline parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t pipeline_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int slots = *(int *)param;
+
+	if (slots <= 0) {
+		DOCA_LOG_ERR("Pipeline needs at least one slot, got %d", slots);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->pipeline_slots = (uint32_t)slots;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle async parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t async_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int depth = *(int *)param;
+
+	if (depth <= 0) {
+		DOCA_LOG_ERR("Async depth must be positive, got %d", depth);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->async_depth = (uint32_t)depth;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle hybrid parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t hybrid_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int runs = *(int *)param;
+
+	if (runs <= 0) {
+		DOCA_LOG_ERR("Hybrid run count must be positive, got %d", runs);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->hybrid_runs = (uint32_t)runs;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle query server batch size parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t server_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int max_batch = *(int *)param;
+
+	if (max_batch <= 0) {
+		DOCA_LOG_ERR("Server batch size must be positive, got %d", max_batch);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->server_batch = (uint32_t)max_batch;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle query server deadline parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t deadline_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int deadline = *(int *)param;
+
+	if (deadline <= 0) {
+		DOCA_LOG_ERR("Deadline must be positive, got %d us", deadline);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->deadline_us = (uint32_t)deadline;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Copy a path parameter into a fixed-size config field
+ *
+ * @param [in]: Input parameter
+ * @dst [out]: PATH_MAX bytes
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t copy_path(void *param, char *dst)
+{
+	const char *path = (const char *)param;
+
+	if (strnlen(path, PATH_MAX) == PATH_MAX) {
+		DOCA_LOG_ERR("Path is too long, at most %d characters", PATH_MAX - 1);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	strcpy(dst, path);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle base path parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t base_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	return copy_path(param, cfg->base_path);
+}
+
+/*
+ * ARGP Callback - Handle queries path parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t queries_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	return copy_path(param, cfg->query_path);
+}
+
+/*
+ * ARGP Callback - Handle ground truth path parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t gt_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	return copy_path(param, cfg->gt_path);
+}
+
+/*
+ * ARGP Callback - Handle minimum recall parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t min_recall_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	const char *str = (const char *)param;
+	char *end;
+	double recall;
+
+	errno = 0;
+	recall = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' || !(recall > 0) || recall > 1) {
+		DOCA_LOG_ERR("Minimum recall must be in (0, 1], got \"%s\"", str);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->min_recall = recall;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle nlist parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t nlist_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int nlist = *(int *)param;
+
+	if (nlist <= 0) {
+		DOCA_LOG_ERR("IVF needs at least one list, got %d", nlist);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->nlist = (uint32_t)nlist;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle nprobe parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t nprobe_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int nprobe = *(int *)param;
+
+	if (nprobe <= 0) {
+		DOCA_LOG_ERR("nprobe must be positive, got %d", nprobe);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->nprobe = (uint32_t)nprobe;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle IVF index path parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t index_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	return copy_path(param, cfg->index_path);
+}
+
+/*
+ * ARGP Callback - Handle PQ subquantizer count parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t pq_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int m = *(int *)param;
+
+	if (m <= 0) {
+		DOCA_LOG_ERR("PQ needs at least one subquantizer, got %d", m);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->pq_m = (uint32_t)m;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle binary code re-rank depth parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t binary_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int rerank = *(int *)param;
+
+	if (rerank <= 0) {
+		DOCA_LOG_ERR("Binary search needs at least one re-rank candidate, got %d", rerank);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->bin_rerank = (uint32_t)rerank;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle query server socket parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t socket_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	return copy_path(param, cfg->socket_path);
+}
+
+/*
+ * ARGP Callback - Handle session sample parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t session_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int jobs = *(int *)param;
+
+	if (jobs <= 0) {
+		DOCA_LOG_ERR("Session sample needs at least one job, got %d", jobs);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->session_jobs = (uint32_t)jobs;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle radius search parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t range_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	const char *str = (const char *)param;
+	char *end;
+	double radius;
+
+	errno = 0;
+	radius = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' || !(radius > 0)) {
+		DOCA_LOG_ERR("Range radius must be a positive number, got \"%s\"", str);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->range_radius = radius;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle early-abandon sample parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t abandon_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	int block = *(int *)param;
+
+	if (block <= 0) {
+		DOCA_LOG_ERR("Early-abandon block must be at least one dimension, got %d", block);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->abandon_block = (uint32_t)block;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle filtered search parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t filter_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	const char *str = (const char *)param;
+	char *end;
+	double sel;
+
+	errno = 0;
+	sel = strtod(str, &end);
+	if (errno != 0 || end == str || *end != '\0' || !(sel > 0) || sel > 1) {
+		DOCA_LOG_ERR("Filter selectivity must be in (0, 1], got \"%s\"", str);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->filter_selectivity = sel;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle sharding parameter: a shard count or a comma-separated device list
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t shards_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+	const char *str = (const char *)param, *p = str;
+	uint32_t count = 1;
+	size_t len = 0;
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(str, &end, 10);
+	if (errno == 0 && end != str && *end == '\0') {
+		if (n <= 0 || n > L2_SHARD_MAX) {
+			DOCA_LOG_ERR("Number of shards must be in [1, %d], got %ld", L2_SHARD_MAX, n);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		cfg->num_shards = (uint32_t)n;
+		cfg->shard_devices[0] = '\0';
+		return DOCA_SUCCESS;
+	}
+	/* 设备列表：每个名字非空且放得进 IB 设备名 */
+	for (;; p++) {
+		if (*p != ',' && *p != '\0') {
+			len++;
+			continue;
+		}
+		if (len == 0 || len >= DOCA_DEVINFO_IBDEV_NAME_SIZE) {
+			DOCA_LOG_ERR("Invalid device name in shard list \"%s\"", str);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		if (*p == '\0')
+			break;
+		len = 0;
+		count++;
+	}
+	if (count > L2_SHARD_MAX) {
+		DOCA_LOG_ERR("At most %d shards, got %u devices", L2_SHARD_MAX, count);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->num_shards = count;
+	return copy_path(param, cfg->shard_devices);
+}
+
+/*
+ * ARGP Callback - Handle trace output parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t trace_callback(void *param, void *config)
+{
+	struct zsj_play_config *cfg = (struct zsj_play_config *)config;
+
+	if (!l2_trace_enabled()) {
+		DOCA_LOG_ERR("--trace needs a build with -Dtrace=true");
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	return copy_path(param, cfg->trace_path);
+}
+
+/*
+ * Register the sample's own command line parameters
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t register_sample_params(void)
+{
+	static const struct l2_argp_param params[] = {
+		{"b", "backend", "<dpa|cpu|emu|host>",
+		 "Distance backend: DPA launch, scalar CPU reference, host DPA emulator or host SIMD (default dpa)",
+		 DOCA_ARGP_TYPE_STRING, backend_callback},
+		{"s", "search", NULL, "Run the k-NN search sample instead of the pairwise batch",
+		 DOCA_ARGP_TYPE_BOOLEAN, search_callback},
+		{"m", "matrix", NULL, "Run the all-pairs distance matrix sample (queries x centroids)",
+		 DOCA_ARGP_TYPE_BOOLEAN, matrix_callback},
+		{"p", "pipeline", "<slots>",
+		 "Stream the batch sample through a ring of <slots> staging slots with chained launches",
+		 DOCA_ARGP_TYPE_INT, pipeline_callback},
+		{"a", "async", "<depth>",
+		 "Submit the batch sample in chunks through the async engine, at most <depth> in flight",
+		 DOCA_ARGP_TYPE_INT, async_callback},
+		{NULL, "hybrid", "<runs>",
+		 "Split the batch sample between the device backend and the host, <runs> times, rebalancing by "
+		 "measured throughput",
+		 DOCA_ARGP_TYPE_INT, hybrid_callback},
+		{NULL, "server", "<max-batch>",
+		 "Run the query server sample: single queries from concurrent clients coalesced into launches of at "
+		 "most <max-batch>",
+		 DOCA_ARGP_TYPE_INT, server_callback},
+		{NULL, "deadline-us", "<us>",
+		 "Query server: dispatch a partial batch once its oldest query has waited <us> (default 200)",
+		 DOCA_ARGP_TYPE_INT, deadline_callback},
+		{NULL, "socket", "<path>",
+		 "Query server: clients connect over a Unix domain socket at <path> instead of calling in-process",
+		 DOCA_ARGP_TYPE_STRING, socket_callback},
+		{NULL, "session", "<jobs>",
+		 "Run the session sample: cold one-shot jobs vs <jobs> jobs on one warm session",
+		 DOCA_ARGP_TYPE_INT, session_callback},
+		{NULL, "range", "<radius>",
+		 "Run the radius search sample: near-duplicate detection with distance threshold <radius>",
+		 DOCA_ARGP_TYPE_STRING, range_callback},
+		{NULL, "abandon", "<block>",
+		 "Run the early-abandon sample: k-NN / radius search checking the threshold every <block> dims",
+		 DOCA_ARGP_TYPE_INT, abandon_callback},
+		{NULL, "shards", "<devices|n>",
+		 "Run the sharding sample: database split over the comma-separated <devices> (or <n> emulated ones)",
+		 DOCA_ARGP_TYPE_STRING, shards_callback},
+		{NULL, "filter", "<selectivity>",
+		 "Run the filtered search sample: a category filter passing <selectivity> (0, 1] of the rows",
+		 DOCA_ARGP_TYPE_STRING, filter_callback},
+		{NULL, "base", "<path>",
+		 "Search the .fvecs / .bvecs base set at <path>, streamed in chunks (needs --queries)",
+		 DOCA_ARGP_TYPE_STRING, base_callback},
+		{NULL, "queries", "<path>", "Query vectors for --base", DOCA_ARGP_TYPE_STRING, queries_callback},
+		{NULL, "gt", "<path>", ".ivecs ground truth for --base / --queries, reports recall@10",
+		 DOCA_ARGP_TYPE_STRING, gt_callback},
+		{NULL, "min-recall", "<r>", "Fail when recall@10 against --gt is below <r>",
+		 DOCA_ARGP_TYPE_STRING, min_recall_callback},
+		{NULL, "nlist", "<n>", "Search --base through an IVF index with <n> lists instead of a full scan",
+		 DOCA_ARGP_TYPE_INT, nlist_callback},
+		{NULL, "nprobe", "<n>", "IVF lists scanned per query (default: sweep powers of two up to nlist / 4)",
+		 DOCA_ARGP_TYPE_INT, nprobe_callback},
+		{NULL, "index", "<path>",
+		 "IVF index file: with --nlist trained, saved there and checked after reloading, otherwise loaded "
+		 "from there",
+		 DOCA_ARGP_TYPE_STRING, index_callback},
+		{NULL, "pq", "<m>", "Search --base as <m>-byte PQ codes with ADC tables instead of a full scan",
+		 DOCA_ARGP_TYPE_INT, pq_callback},
+		{NULL, "binary", "<rerank>",
+		 "Search --base with a 1-bit-per-dim Hamming prefilter, re-ranking <rerank> candidates per query "
+		 "exactly",
+		 DOCA_ARGP_TYPE_INT, binary_callback},
+		{NULL, "trace", "<path>",
+		 "Write a Chrome trace JSON of the run to <path> and print a per-span summary (build with "
+		 "-Dtrace=true)",
+		 DOCA_ARGP_TYPE_STRING, trace_callback},
+	};
+
+	return l2_argp_register(params, sizeof(params) / sizeof(params[0]));
+}
 
 /*
  * Sample main function
@@ -33,7 +798,7 @@ doca_error_t kernel_launch(struct dpa_resources *resources);
  */
 int main(int argc, char **argv)
 {
-	struct dpa_config cfg = {{0}};
+	struct zsj_play_config cfg = {.backend = L2_BACKEND_DPA};
 	struct dpa_resources resources = {0};
 	doca_error_t result;
 	struct doca_log_backend *sdk_log;
@@ -41,7 +806,7 @@ int main(int argc, char **argv)
 
 	/* Set default value for device name */
 	// strcpy(cfg.device_name, DEVICE_DEFAULT_NAME);
-	strcpy(cfg.device_name, "mlx5_1");
+	strcpy(cfg.dpa.device_name, "mlx5_1");
 	// 敢情之前测的时候这个device就是本机
 	// 要改成DPA再用！
 	// mlx5_1是对的 mlx5_0找不到设备，mlx5_2没有分配EU（其中原理暂时还不太懂）
@@ -75,21 +840,37 @@ int main(int argc, char **argv)
 		goto argp_cleanup;
 	}
 
+	result = register_sample_params();
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to register sample parameters: %s", doca_error_get_descr(result));
+		goto argp_cleanup;
+	}
+
 	result = doca_argp_start(argc, argv);
 	if (result != DOCA_SUCCESS) {
 		DOCA_LOG_ERR("Failed to parse sample input: %s", doca_error_get_descr(result));
 		goto argp_cleanup;
 	}
 
+	/* cpu / emu 不需要 BlueField，直接跑；分片 sample 自己打开每个设备 */
+	if (cfg.backend != L2_BACKEND_DPA || cfg.num_shards > 0) {
+		result = run_sample(&cfg, NULL);
+		if (result != DOCA_SUCCESS)
+			DOCA_LOG_ERR("kernel_launch() encountered an error: %s", doca_error_get_descr(result));
+		else
+			exit_status = EXIT_SUCCESS;
+		goto trace_dump;
+	}
+
 	/* Allocating resources */ // resources里面有doca_dev(设备信息)和doca_dpa(context)
-	result = allocate_dpa_resources(&cfg, &resources);
+	result = allocate_dpa_resources(&cfg.dpa, &resources);
 	if (result != DOCA_SUCCESS) {
 		DOCA_LOG_ERR("Failed to Allocate DPA Resources: %s", doca_error_get_descr(result));
 		goto argp_cleanup;
 	}
 
 	/* Running sample */
-	result = kernel_launch(&resources);
+	result = run_sample(&cfg, &resources);
 	if (result != DOCA_SUCCESS) {
 		DOCA_LOG_ERR("kernel_launch() encountered an error: %s", doca_error_get_descr(result));
 		goto dpa_cleanup;
@@ -104,6 +885,10 @@ dpa_cleanup:
 		DOCA_LOG_ERR("Failed to destroy DOCA DPA resources: %s", doca_error_get_descr(result));
 		exit_status = EXIT_FAILURE;
 	}
+trace_dump:
+	/* 出错时也写，trace 正好用来看卡在哪一步 */
+	if (cfg.trace_path[0] != '\0' && l2_trace_dump(cfg.trace_path) != DOCA_SUCCESS)
+		exit_status = EXIT_FAILURE;
 argp_cleanup:
 	doca_argp_destroy();
 sample_exit:
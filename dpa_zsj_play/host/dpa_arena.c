@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_dev.h>
+#include <doca_mmap.h>
+
+#include "../include/dpa_arena.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::ARENA);
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define ARENA_DEFAULT_ALIGN 64
+
+/* bump 以下的空洞，按 offset 升序、相邻的总是已合并 */
+struct free_block {
+	struct free_block *next;
+	size_t offset;
+	size_t len;
+};
+
+struct dpa_arena {
+	pthread_mutex_t lock;
+	uint8_t *base;
+	size_t capacity;
+	size_t map_len;
+	size_t align;
+	enum dpa_arena_page page;
+
+	struct dpa_arena_reg_ops reg;
+	void *reg_obj;
+	doca_dpa_dev_mmap_t handle;
+
+	size_t bump;
+	size_t used;
+	size_t peak;
+	struct free_block *free_list;
+};
+
+static const size_t page_sizes[] = {
+	[DPA_ARENA_PAGE_4K] = 4096,
+	[DPA_ARENA_PAGE_2M] = 2UL << 20,
+	[DPA_ARENA_PAGE_1G] = 1UL << 30,
+};
+
+static inline size_t align_up(size_t v, size_t a)
+{
+	return (v + a - 1) & ~(a - 1);
+}
+
+/*
+ * mmap the backing memory, falling back to smaller pages if hugepages are not available
+ *
+ * @arena [in/out]: arena, base / map_len / page are filled in
+ * @size [in]: requested size
+ * @page [in]: requested page size
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t arena_map(struct dpa_arena *arena, size_t size, enum dpa_arena_page page)
+{
+	for (int p = page; p >= DPA_ARENA_PAGE_4K; p--) {
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+		size_t len = align_up(size, page_sizes[p]);
+		void *addr;
+
+		if (p == DPA_ARENA_PAGE_2M)
+			flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+		else if (p == DPA_ARENA_PAGE_1G)
+			flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+
+		addr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (addr == MAP_FAILED) {
+			DOCA_LOG_WARN("Failed to map %zu bytes with %zu byte pages, trying smaller pages",
+				      len, page_sizes[p]);
+			continue;
+		}
+		if (p == DPA_ARENA_PAGE_4K)
+			(void)madvise(addr, len, MADV_HUGEPAGE);
+
+		arena->base = addr;
+		arena->map_len = len;
+		arena->capacity = len;
+		arena->page = (enum dpa_arena_page)p;
+		return DOCA_SUCCESS;
+	}
+	return DOCA_ERROR_NO_MEMORY;
+}
+
+doca_error_t dpa_arena_create(const struct dpa_arena_cfg *cfg, struct dpa_arena **arena)
+{
+	struct dpa_arena *a;
+	doca_error_t result;
+
+	if (cfg->size == 0 || cfg->page > DPA_ARENA_PAGE_1G || (cfg->align & (cfg->align - 1)) != 0)
+		return DOCA_ERROR_INVALID_VALUE;
+
+	a = calloc(1, sizeof(*a));
+	if (a == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	pthread_mutex_init(&a->lock, NULL);
+	a->align = cfg->align != 0 ? cfg->align : ARENA_DEFAULT_ALIGN;
+	a->reg = cfg->reg;
+
+	L2_TRACE_BEGIN(t_map);
+	result = arena_map(a, cfg->size, cfg->page);
+	L2_TRACE_END(t_map, "arena.map", a->capacity);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to map arena of %zu bytes", cfg->size);
+		goto free_arena;
+	}
+
+	if (a->reg.reg != NULL) {
+		L2_TRACE_BEGIN(t_reg);
+		result = a->reg.reg(a->reg.ctx, a->base, a->capacity, &a->handle, &a->reg_obj);
+		L2_TRACE_END(t_reg, "arena.register", a->capacity);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to register arena: %s", doca_error_get_descr(result));
+			goto unmap;
+		}
+	}
+
+	DOCA_LOG_INFO("Arena ready: %zu bytes at %p, %zu byte pages, handle %u",
+		      a->capacity, (void *)a->base, page_sizes[a->page], a->handle);
+	*arena = a;
+	return DOCA_SUCCESS;
+
+unmap:
+	munmap(a->base, a->map_len);
+free_arena:
+	pthread_mutex_destroy(&a->lock);
+	free(a);
+	return result;
+}
+
+static void free_list_clear(struct dpa_arena *arena)
+{
+	struct free_block *fb = arena->free_list;
+
+	while (fb != NULL) {
+		struct free_block *next = fb->next;
+
+		free(fb);
+		fb = next;
+	}
+	arena->free_list = NULL;
+}
+
+void dpa_arena_destroy(struct dpa_arena *arena)
+{
+	if (arena == NULL)
+		return;
+	if (arena->reg.unreg != NULL && arena->reg_obj != NULL)
+		arena->reg.unreg(arena->reg.ctx, arena->reg_obj);
+	munmap(arena->base, arena->map_len);
+	free_list_clear(arena);
+	pthread_mutex_destroy(&arena->lock);
+	free(arena);
+}
+
+static void fill_region(struct dpa_arena *arena, size_t offset, size_t len, struct dpa_region *region)
+{
+	region->addr = arena->base + offset;
+	region->len = len;
+	region->handle = arena->handle;
+	region->offset = offset;
+}
+
+doca_error_t dpa_arena_alloc(struct dpa_arena *arena, size_t len, struct dpa_region *region)
+{
+	struct free_block **pp, *fb;
+	size_t need;
+
+	if (len == 0)
+		return DOCA_ERROR_INVALID_VALUE;
+	need = align_up(len, arena->align);
+
+	pthread_mutex_lock(&arena->lock);
+	/* first fit：free list 里都是已经对齐的块 */
+	for (pp = &arena->free_list; (fb = *pp) != NULL; pp = &fb->next) {
+		if (fb->len < need)
+			continue;
+		fill_region(arena, fb->offset, need, region);
+		fb->offset += need;
+		fb->len -= need;
+		if (fb->len == 0) {
+			*pp = fb->next;
+			free(fb);
+		}
+		goto done;
+	}
+
+	if (need > arena->capacity - arena->bump) {
+		pthread_mutex_unlock(&arena->lock);
+		DOCA_LOG_ERR("Arena out of memory: need %zu, %zu left", need, arena->capacity - arena->bump);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	fill_region(arena, arena->bump, need, region);
+	arena->bump += need;
+
+done:
+	arena->used += need;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+	pthread_mutex_unlock(&arena->lock);
+	return DOCA_SUCCESS;
+}
+
+/* bump 刚好落在最后一个空洞的末尾时，把它吃回 bump */
+static void pull_back_bump(struct dpa_arena *arena)
+{
+	struct free_block **pp = &arena->free_list, *fb;
+
+	if (*pp == NULL)
+		return;
+	while ((*pp)->next != NULL)
+		pp = &(*pp)->next;
+	fb = *pp;
+	if (fb->offset + fb->len == arena->bump) {
+		arena->bump = fb->offset;
+		*pp = NULL;
+		free(fb);
+	}
+}
+
+void dpa_arena_free(struct dpa_arena *arena, struct dpa_region *region)
+{
+	struct free_block *prev = NULL, *next, *fb;
+	size_t offset = region->offset, len = region->len;
+
+	if (region->addr == NULL || len == 0)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	arena->used -= len;
+
+	if (offset + len == arena->bump) {
+		arena->bump = offset;
+		pull_back_bump(arena);
+		goto done;
+	}
+
+	for (next = arena->free_list; next != NULL && next->offset < offset; next = next->next)
+		prev = next;
+
+	/* 和前后的空洞合并 */
+	if (prev != NULL && prev->offset + prev->len == offset) {
+		prev->len += len;
+		if (next != NULL && offset + len == next->offset) {
+			prev->len += next->len;
+			prev->next = next->next;
+			free(next);
+		}
+		goto done;
+	}
+	if (next != NULL && offset + len == next->offset) {
+		next->offset = offset;
+		next->len += len;
+		goto done;
+	}
+
+	fb = malloc(sizeof(*fb));
+	if (fb == NULL) {
+		/* 记不下来就泄漏这一块，arena reset/destroy 时会回收 */
+		DOCA_LOG_WARN("Failed to track freed arena block at offset %zu", offset);
+		goto done;
+	}
+	fb->offset = offset;
+	fb->len = len;
+	fb->next = next;
+	if (prev != NULL)
+		prev->next = fb;
+	else
+		arena->free_list = fb;
+
+done:
+	pthread_mutex_unlock(&arena->lock);
+	memset(region, 0, sizeof(*region));
+}
+
+void dpa_arena_reset(struct dpa_arena *arena)
+{
+	pthread_mutex_lock(&arena->lock);
+	free_list_clear(arena);
+	arena->bump = 0;
+	arena->used = 0;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void dpa_arena_get_stats(struct dpa_arena *arena, struct dpa_arena_stats *stats)
+{
+	struct free_block *fb;
+
+	memset(stats, 0, sizeof(*stats));
+	pthread_mutex_lock(&arena->lock);
+	stats->capacity = arena->capacity;
+	stats->used = arena->used;
+	stats->peak = arena->peak;
+	stats->bump = arena->bump;
+	stats->page = arena->page;
+	for (fb = arena->free_list; fb != NULL; fb = fb->next) {
+		stats->free_bytes += fb->len;
+		stats->free_blocks++;
+	}
+	pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * doca_mmap registration: create -> set_permissions -> add_dev -> set_memrange -> start -> dpa handle
+ *
+ * @ctx [in]: struct doca_dev
+ * @addr [in]: start of the arena
+ * @len [in]: arena size
+ * @handle [out]: DPA mmap handle
+ * @reg_obj [out]: the started doca_mmap
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t doca_reg(void *ctx, void *addr, size_t len, doca_dpa_dev_mmap_t *handle, void **reg_obj)
+{
+	struct doca_dev *dev = ctx;
+	struct doca_mmap *mm = NULL;
+	doca_error_t st;
+
+	st = doca_mmap_create(&mm);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create doca_mmap");
+		return st;
+	}
+	st = doca_mmap_set_permissions(mm, DOCA_ACCESS_FLAG_LOCAL_READ_WRITE | DOCA_ACCESS_FLAG_PCI_READ_WRITE);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to set permissions");
+		goto destroy_mmap;
+	}
+	st = doca_mmap_add_dev(mm, dev);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to add dev");
+		goto destroy_mmap;
+	}
+	st = doca_mmap_set_memrange(mm, addr, len);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to set memrange");
+		goto destroy_mmap;
+	}
+	st = doca_mmap_start(mm);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to start mmap");
+		goto destroy_mmap;
+	}
+	st = doca_mmap_dev_get_dpa_handle(mm, dev, handle);
+	if (st != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to get DPA handle of mmap");
+		doca_mmap_stop(mm);
+		goto destroy_mmap;
+	}
+	*reg_obj = mm;
+	return DOCA_SUCCESS;
+
+destroy_mmap:
+	doca_mmap_destroy(mm);
+	return st;
+}
+
+static void doca_unreg(void *ctx, void *reg_obj)
+{
+	struct doca_mmap *mm = reg_obj;
+
+	(void)ctx;
+	doca_mmap_stop(mm);
+	doca_mmap_destroy(mm);
+}
+
+void dpa_arena_doca_reg_ops(struct doca_dev *dev, struct dpa_arena_reg_ops *ops)
+{
+	ops->reg = doca_reg;
+	ops->unreg = doca_unreg;
+	ops->ctx = dev;
+}
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/dpa_emu.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::EMU);
+
+__thread unsigned int dpa_emu_tls_rank;
+__thread unsigned int dpa_emu_tls_num_threads;
+__thread uint64_t dpa_emu_tls_iters;
+
+struct dpa_emu_event {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t value;
+};
+
+struct dpa_emu_launch {
+	struct dpa_emu_launch *next;
+	struct dpa_emu_event *wait_event;
+	uint64_t wait_thresh;
+	struct dpa_emu_event *comp_event;
+	uint64_t comp_val;
+	bool comp_add;
+	unsigned int num_threads;
+	dpa_emu_kernel_fn kernel;
+	size_t args_size;
+	uint64_t args[]; /* 按 8 字节对齐存放 *_args */
+};
+
+struct dpa_emu {
+	pthread_mutex_t lock;
+	pthread_cond_t queue_cond;	/* dispatcher: 有新的 launch / 退出 */
+	pthread_cond_t work_cond;	/* workers: 有新一轮 rank 要跑 / 退出 */
+	pthread_cond_t done_cond;	/* dispatcher: 本轮 rank 全部完成 */
+	struct dpa_emu_launch *head;
+	struct dpa_emu_launch *tail;
+	bool stop;		/* 不再接受新的 launch，dispatcher 跑完队列后退出 */
+	bool stop_workers;	/* dispatcher 已退出，workers 可以退出 */
+
+	/* 当前正在执行的 launch */
+	struct dpa_emu_launch *cur;
+	uint64_t generation;
+	unsigned int next_rank;
+	unsigned int ranks_left;
+
+	pthread_t dispatcher;
+	bool dispatcher_started;	/* pthread_t 没有"无线程"的值，destroy 靠这个决定要不要 join */
+	unsigned int num_workers;
+	pthread_t *workers;
+};
+
+doca_error_t dpa_emu_event_create(struct dpa_emu_event **event)
+{
+	struct dpa_emu_event *ev = calloc(1, sizeof(*ev));
+
+	if (ev == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	pthread_mutex_init(&ev->lock, NULL);
+	pthread_cond_init(&ev->cond, NULL);
+	*event = ev;
+	return DOCA_SUCCESS;
+}
+
+void dpa_emu_event_destroy(struct dpa_emu_event *event)
+{
+	if (event == NULL)
+		return;
+	pthread_cond_destroy(&event->cond);
+	pthread_mutex_destroy(&event->lock);
+	free(event);
+}
+
+uint64_t dpa_emu_event_get(struct dpa_emu_event *event)
+{
+	uint64_t value;
+
+	pthread_mutex_lock(&event->lock);
+	value = event->value;
+	pthread_mutex_unlock(&event->lock);
+	return value;
+}
+
+void dpa_emu_event_update_set(struct dpa_emu_event *event, uint64_t value)
+{
+	pthread_mutex_lock(&event->lock);
+	event->value = value;
+	pthread_cond_broadcast(&event->cond);
+	pthread_mutex_unlock(&event->lock);
+}
+
+uint64_t dpa_emu_event_update_add(struct dpa_emu_event *event, uint64_t value)
+{
+	uint64_t fetched;
+
+	pthread_mutex_lock(&event->lock);
+	fetched = event->value;
+	event->value += value;
+	pthread_cond_broadcast(&event->cond);
+	pthread_mutex_unlock(&event->lock);
+	return fetched;
+}
+
+void dpa_emu_event_wait_gt(struct dpa_emu_event *event, uint64_t value)
+{
+	pthread_mutex_lock(&event->lock);
+	while (event->value <= value)
+		pthread_cond_wait(&event->cond, &event->lock);
+	pthread_mutex_unlock(&event->lock);
+}
+
+/*
+ * Worker thread: picks ranks of the current launch until none are left
+ *
+ * @arg [in]: struct dpa_emu
+ * @return: NULL
+ */
+static void *emu_worker(void *arg)
+{
+	struct dpa_emu *emu = arg;
+	uint64_t seen = 0;
+
+	L2_TRACE_THREAD("emu worker");
+	pthread_mutex_lock(&emu->lock);
+	for (;;) {
+		while (!emu->stop_workers && emu->generation == seen)
+			pthread_cond_wait(&emu->work_cond, &emu->lock);
+		if (emu->stop_workers)
+			break;
+		seen = emu->generation;
+
+		while (emu->cur != NULL && emu->next_rank < emu->cur->num_threads) {
+			struct dpa_emu_launch *l = emu->cur;
+			unsigned int rank = emu->next_rank++;
+
+			pthread_mutex_unlock(&emu->lock);
+			dpa_emu_tls_rank = rank;
+			dpa_emu_tls_num_threads = l->num_threads;
+			dpa_emu_tls_iters = 0;
+			L2_TRACE_BEGIN(t0);
+			l->kernel(l->args);
+			/* count 是 kernel 报告的本 rank 迭代数，看各 rank 之间是否均衡 */
+			L2_TRACE_END(t0, "emu.rank", dpa_emu_tls_iters);
+			pthread_mutex_lock(&emu->lock);
+
+			if (--emu->ranks_left == 0)
+				pthread_cond_signal(&emu->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&emu->lock);
+	return NULL;
+}
+
+/*
+ * Dispatcher thread: executes queued launches one at a time, in order
+ *
+ * @arg [in]: struct dpa_emu
+ * @return: NULL
+ */
+static void *emu_dispatcher(void *arg)
+{
+	struct dpa_emu *emu = arg;
+	struct dpa_emu_launch *l;
+
+	L2_TRACE_THREAD("emu dispatcher");
+	pthread_mutex_lock(&emu->lock);
+	for (;;) {
+		while (emu->head == NULL && !emu->stop)
+			pthread_cond_wait(&emu->queue_cond, &emu->lock);
+		if (emu->head == NULL)
+			break;
+		l = emu->head;
+		emu->head = l->next;
+		if (emu->head == NULL)
+			emu->tail = NULL;
+		pthread_mutex_unlock(&emu->lock);
+
+		if (l->wait_event != NULL) {
+			L2_TRACE_BEGIN(tw);
+			dpa_emu_event_wait_gt(l->wait_event, l->wait_thresh);
+			L2_TRACE_END(tw, "emu.event_wait", 0);
+		}
+
+		L2_TRACE_BEGIN(t0);
+		pthread_mutex_lock(&emu->lock);
+		if (l->num_threads > 0) {
+			emu->cur = l;
+			emu->next_rank = 0;
+			emu->ranks_left = l->num_threads;
+			emu->generation++;
+			pthread_cond_broadcast(&emu->work_cond);
+			while (emu->ranks_left > 0)
+				pthread_cond_wait(&emu->done_cond, &emu->lock);
+			emu->cur = NULL;
+		}
+		pthread_mutex_unlock(&emu->lock);
+		L2_TRACE_END(t0, "emu.launch", l->num_threads);
+
+		if (l->comp_event != NULL) {
+			if (l->comp_add)
+				dpa_emu_event_update_add(l->comp_event, l->comp_val);
+			else
+				dpa_emu_event_update_set(l->comp_event, l->comp_val);
+		}
+		free(l);
+		pthread_mutex_lock(&emu->lock);
+	}
+	pthread_mutex_unlock(&emu->lock);
+	return NULL;
+}
+
+doca_error_t dpa_emu_create(unsigned int num_workers, struct dpa_emu **emu)
+{
+	struct dpa_emu *e;
+	long ncpu;
+
+	if (num_workers == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		num_workers = ncpu > 0 ? (unsigned int)ncpu : 1;
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	e->workers = calloc(num_workers, sizeof(*e->workers));
+	if (e->workers == NULL) {
+		free(e);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->queue_cond, NULL);
+	pthread_cond_init(&e->work_cond, NULL);
+	pthread_cond_init(&e->done_cond, NULL);
+
+	for (e->num_workers = 0; e->num_workers < num_workers; e->num_workers++) {
+		if (pthread_create(&e->workers[e->num_workers], NULL, emu_worker, e) != 0) {
+			DOCA_LOG_ERR("Failed to create emulator worker %u", e->num_workers);
+			dpa_emu_destroy(e);
+			return DOCA_ERROR_OPERATING_SYSTEM;
+		}
+	}
+	if (pthread_create(&e->dispatcher, NULL, emu_dispatcher, e) != 0) {
+		DOCA_LOG_ERR("Failed to create emulator dispatcher");
+		dpa_emu_destroy(e);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	e->dispatcher_started = true;
+
+	DOCA_LOG_INFO("DPA emulator started with %u host workers", e->num_workers);
+	*emu = e;
+	return DOCA_SUCCESS;
+}
+
+void dpa_emu_destroy(struct dpa_emu *emu)
+{
+	if (emu == NULL)
+		return;
+
+	pthread_mutex_lock(&emu->lock);
+	emu->stop = true;
+	pthread_cond_broadcast(&emu->queue_cond);
+	pthread_mutex_unlock(&emu->lock);
+	/* dispatcher 先把队列跑完，之后才能停 workers */
+	if (emu->dispatcher_started)
+		pthread_join(emu->dispatcher, NULL);
+
+	pthread_mutex_lock(&emu->lock);
+	emu->stop_workers = true;
+	pthread_cond_broadcast(&emu->work_cond);
+	pthread_mutex_unlock(&emu->lock);
+	for (unsigned int i = 0; i < emu->num_workers; i++)
+		pthread_join(emu->workers[i], NULL);
+
+	pthread_cond_destroy(&emu->done_cond);
+	pthread_cond_destroy(&emu->work_cond);
+	pthread_cond_destroy(&emu->queue_cond);
+	pthread_mutex_destroy(&emu->lock);
+	free(emu->workers);
+	free(emu);
+}
+
+/*
+ * Queue one launch on the dispatcher
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t emu_enqueue(struct dpa_emu *emu,
+				struct dpa_emu_event *wait_event,
+				uint64_t wait_thresh,
+				struct dpa_emu_event *comp_event,
+				uint64_t comp_val,
+				bool comp_add,
+				unsigned int num_threads,
+				dpa_emu_kernel_fn kernel,
+				const void *args,
+				size_t args_size)
+{
+	struct dpa_emu_launch *l;
+
+	if (kernel == NULL)
+		return DOCA_ERROR_INVALID_VALUE;
+
+	l = malloc(sizeof(*l) + args_size);
+	if (l == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	l->next = NULL;
+	l->wait_event = wait_event;
+	l->wait_thresh = wait_thresh;
+	l->comp_event = comp_event;
+	l->comp_val = comp_val;
+	l->comp_add = comp_add;
+	l->num_threads = num_threads;
+	l->kernel = kernel;
+	l->args_size = args_size;
+	memcpy(l->args, args, args_size);
+
+	pthread_mutex_lock(&emu->lock);
+	if (emu->stop) {
+		pthread_mutex_unlock(&emu->lock);
+		free(l);
+		return DOCA_ERROR_BAD_STATE;
+	}
+	if (emu->tail != NULL)
+		emu->tail->next = l;
+	else
+		emu->head = l;
+	emu->tail = l;
+	pthread_cond_signal(&emu->queue_cond);
+	pthread_mutex_unlock(&emu->lock);
+	return DOCA_SUCCESS;
+}
+
+doca_error_t dpa_emu_kernel_launch_update_set(struct dpa_emu *emu,
+					      struct dpa_emu_event *wait_event,
+					      uint64_t wait_thresh,
+					      struct dpa_emu_event *comp_event,
+					      uint64_t comp_val,
+					      unsigned int num_threads,
+					      dpa_emu_kernel_fn kernel,
+					      const void *args,
+					      size_t args_size)
+{
+	return emu_enqueue(emu, wait_event, wait_thresh, comp_event, comp_val, false,
+			   num_threads, kernel, args, args_size);
+}
+
+doca_error_t dpa_emu_kernel_launch_update_add(struct dpa_emu *emu,
+					      struct dpa_emu_event *wait_event,
+					      uint64_t wait_thresh,
+					      struct dpa_emu_event *comp_event,
+					      uint64_t comp_val,
+					      unsigned int num_threads,
+					      dpa_emu_kernel_fn kernel,
+					      const void *args,
+					      size_t args_size)
+{
+	return emu_enqueue(emu, wait_event, wait_thresh, comp_event, comp_val, true,
+			   num_threads, kernel, args, args_size);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+/*
+ * 把 device 端的 kernel 源码原样编进 host 程序，由 dpa_emu.c 在 pthread 上执行。
+ * dpacc 生成的 host stub 已经占用了 kernel 的符号名，这里统一加 emu_ 前缀。
+ */
+#define DPA_EMU
+
+#define l2_single_kernel emu_l2_single_kernel
+#define l2_batch_kernel emu_l2_batch_kernel
+#define l2_search_kernel emu_l2_search_kernel
+#define l2_batch_blocked_kernel emu_l2_batch_blocked_kernel
+#define l2_matrix_kernel emu_l2_matrix_kernel
+#define l2_ivf_kernel emu_l2_ivf_kernel
+#define l2_pq_kernel emu_l2_pq_kernel
+#define l2_qbatch_kernel emu_l2_qbatch_kernel
+#define l2_hamming_kernel emu_l2_hamming_kernel
+#define l2_range_kernel emu_l2_range_kernel
+#define L2_KERNEL_SYM(name) emu_##name
+
+#include "../device/dpa_zsj_play_kernels_dev.c"
+
+#include "../include/dpa_emu.h"
+
+void dpa_emu_l2_single_kernel(const void *args)
+{
+	emu_l2_single_kernel(*(const l2_single_dist_args *)args);
+}
+
+void dpa_emu_l2_batch_kernel(const void *args)
+{
+	emu_l2_batch_kernel(*(const l2_batch_args *)args);
+}
+
+void dpa_emu_l2_search_kernel(const void *args)
+{
+	emu_l2_search_kernel(*(const l2_search_args *)args);
+}
+
+void dpa_emu_l2_batch_blocked_kernel(const void *args)
+{
+	emu_l2_batch_blocked_kernel(*(const l2_batch_blocked_args *)args);
+}
+
+void dpa_emu_l2_matrix_kernel(const void *args)
+{
+	emu_l2_matrix_kernel(*(const l2_matrix_args *)args);
+}
+
+void dpa_emu_l2_ivf_kernel(const void *args)
+{
+	emu_l2_ivf_kernel(*(const l2_ivf_args *)args);
+}
+
+void dpa_emu_l2_pq_kernel(const void *args)
+{
+	emu_l2_pq_kernel(*(const l2_pq_args *)args);
+}
+
+void dpa_emu_l2_qbatch_kernel(const void *args)
+{
+	emu_l2_qbatch_kernel(*(const l2_qbatch_args *)args);
+}
+
+void dpa_emu_l2_hamming_kernel(const void *args)
+{
+	emu_l2_hamming_kernel(*(const l2_hamming_args *)args);
+}
+
+void dpa_emu_l2_range_kernel(const void *args)
+{
+	emu_l2_range_kernel(*(const l2_range_args *)args);
+}
+
+#define EMU_SPECIALIZE(D)                                               \
+	void dpa_emu_l2_batch_kernel_d##D(const void *args)             \
+	{                                                               \
+		emu_l2_batch_kernel_d##D(*(const l2_batch_args *)args); \
+	}                                                               \
+	void dpa_emu_l2_search_kernel_d##D(const void *args)            \
+	{                                                               \
+		emu_l2_search_kernel_d##D(*(const l2_search_args *)args); \
+	}
+
+L2_SPEC_DIMS(EMU_SPECIALIZE)
@@ -12,11 +12,14 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
 #include <doca_error.h>
 #include <doca_log.h>
 #include <doca_dev.h>
@@ -24,39 +27,27 @@
 #include "dpa_common.h"
 #include "../include/utils.h"
 #include "../include/args.h"
+#include "../include/l2_backend.h"
+#include "../include/l2_search.h"
+#include "../include/l2_range.h"
+#include "../include/l2_filter.h"
+#include "../include/l2_topk.h"
+#include "../include/l2_simd.h"
+#include "../include/l2_matrix.h"
+#include "../include/l2_pipeline.h"
+#include "../include/l2_engine.h"
+#include "../include/l2_hybrid.h"
+#include "../include/l2_server.h"
+#include "../include/l2_session.h"
+#include "../include/l2_shards.h"
+#include "../include/l2_dataset.h"
+#include "../include/l2_ivf.h"
+#include "../include/l2_pq.h"
+#include "../include/l2_bin.h"
+#include "../include/l2_trace.h"
 
 DOCA_LOG_REGISTER(ZSJ_PLAY::SAMPLE);
 
-/* Kernel function decleration */
-// extern doca_dpa_func_t l2_batch_kernel;
-extern doca_dpa_func_t l2_single_kernel;
-extern doca_dpa_func_t l2_batch_kernel;
-
-struct l2_single_dist_args {
-    doca_dpa_dev_mmap_t handle;               // 共享内存的handle，DPA凭借这个来访问host mmap出来的内存
-    uint64_t a_offset;                        // a的存储地址
-    uint64_t b_offset;                        // b的存储地址
-    uint64_t out_offset;                      // 计算结果 dist(a,b)的存储地址
-    uint64_t dim;                      // e.g. 32
-    uint64_t frac_bits;                // q (e.g. 16)
-};
-
-struct l2_batch_args {
-    doca_dpa_dev_mmap_t handle;
-
-    uint64_t a_base;
-    uint64_t b_base;
-    uint64_t out_base;
-
-    uint64_t a_stride;     // 每个向量 a 的步长（字节）
-    uint64_t b_stride;     // 每个向量 b 的步长（字节）
-    uint64_t out_stride;   // 每个输出 dist 的步长（字节）
-
-    uint32_t dim;          // 向量维度（例如 32）
-    uint32_t frac_bits;    // 定点位（例如 16）
-    uint32_t batch_size;   // 这一批里有多少个距离要算
-};
-
 static inline uint64_t diff_ns(struct timespec a, struct timespec b) {
     int64_t sec  = (int64_t)b.tv_sec  - (int64_t)a.tv_sec;
     int64_t nsec = (int64_t)b.tv_nsec - (int64_t)a.tv_nsec;
@@ -64,38 +55,136 @@ static inline uint64_t diff_ns(struct timespec a, struct timespec b) {
     return (uint64_t)sec * 1000000000ULL + (uint64_t)nsec;
 }
 
+/*
+ * Compare batch distances with the double-precision l2_distance() of the raw vectors
+ *
+ * @batch [in]: finished batch, out in 2Q(2 * frac_bits)
+ * @a_raw [in]: batch_size * dim doubles the a side was quantized from
+ * @b_raw [in]: same for b
+ * @kernel_ns [in]: submit + wait time of the batch
+ */
+static void report_accuracy(const struct l2_batch *batch, const double *a_raw, const double *b_raw,
+			    uint64_t kernel_ns)
+{
+	const uint64_t *out = l2_batch_results(batch);
+	double max_err = 0, sum_err = 0;
+
+	for (uint32_t i = 0; i < batch->batch_size; i++) {
+		double ref = l2_distance(a_raw + (size_t)i * batch->dim, b_raw + (size_t)i * batch->dim, batch->dim);
+		double got = sqrt(ldexp((double)out[i], -2 * (int)batch->frac_bits));
+		double err = ref > 0 ? fabs(got - ref) / ref : fabs(got);
+
+		max_err = err > max_err ? err : max_err;
+		sum_err += err;
+	}
+	printf("%-7s %4u B/vector, kernel %8.3f ms, relative error vs l2_distance(): max %.3e, mean %.3e\n",
+	       l2_elem_name(batch->elem), batch->row_bytes, kernel_ns / 1e6, max_err, sum_err / batch->batch_size);
+}
+
+/*
+ * Run the int16 / int8 formats on the same raw data, check them against l2_cpu_qbatch()
+ * and report their accuracy
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t qformat_launch(struct l2_backend *be, enum l2_elem elem, const double *a_raw,
+				   const double *b_raw, uint32_t dim, uint32_t batch_size)
+{
+	struct l2_batch batch;
+	struct l2_qbatch_args ref_args;
+	struct timespec t0, t1;
+	uint64_t *ref, mismatches = 0;
+	doca_error_t result;
+
+	result = l2_batch_alloc_elem(be, dim, batch_size, elem, &batch);
+	if (result != DOCA_SUCCESS)
+		return result;
+	ref = malloc(sizeof(uint64_t) * batch_size);
+	if (ref == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_batch;
+	}
+	if (elem == L2_ELEM_I8) {
+		quantize_vectors_int8(a_raw, dim, batch_size, batch.a, batch.row_bytes, batch.frac_bits);
+		quantize_vectors_int8(b_raw, dim, batch_size, batch.b, batch.row_bytes, batch.frac_bits);
+	} else {
+		quantize_vectors_int16(a_raw, dim, batch_size, batch.a, batch.row_bytes, batch.frac_bits);
+		quantize_vectors_int16(b_raw, dim, batch_size, batch.b, batch.row_bytes, batch.frac_bits);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_batch_submit(be, &batch);
+	if (result == DOCA_SUCCESS)
+		result = l2_batch_wait(be, &batch);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (result != DOCA_SUCCESS)
+		goto free_ref;
+
+	l2_batch_fill_qargs(&batch, 0, batch_size, &ref_args);
+	ref_args.out_base = (uint64_t)(uintptr_t)ref;
+	l2_cpu_qbatch(&ref_args);
+	for (uint32_t i = 0; i < batch_size; ++i)
+		mismatches += batch.out[i] != ref[i];
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu of %u %s distances differ from the CPU reference", mismatches, batch_size,
+			     l2_elem_name(elem));
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+	report_accuracy(&batch, a_raw, b_raw, diff_ns(t0, t1));
+
+free_ref:
+	free(ref);
+free_batch:
+	l2_batch_free(be, &batch);
+	return result;
+}
+
 /*
  * Run kernel_launch sample
  *
- * @resources [in]: DOCA DPA resources that the DPA sample will use
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_batch_kernel
  * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
  */
-doca_error_t kernel_launch(struct dpa_resources *resources)
+doca_error_t kernel_launch(struct dpa_resources *resources, enum l2_backend_type type)
 {
-	struct doca_sync_event *wait_event = NULL;
-	struct doca_sync_event *comp_event = NULL;
-	/* Wait event threshold */
-	uint64_t wait_thresh = 0;
-	/* Completion event val */
-	uint64_t comp_event_val = 64;
-	/* Number of DPA threads */
-	const unsigned int num_dpa_threads = 64;
-	doca_error_t result, tmp_result;
+	const uint32_t dim = 32, batch_size = 1024 * 1024; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		/* Number of DPA threads */
+		.num_threads = 64,
+		/* a + b + out，再加一个 int16 batch（比 int8 大），2M 大页（不可用时自动退回 4K） */
+		.arena_size = (size_t)batch_size * (2 * dim * sizeof(int32_t) + sizeof(uint64_t)) +
+			      (size_t)batch_size * (2 * l2_elem_row_bytes(L2_ELEM_I16, dim) + sizeof(uint64_t)) + 4096,
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct dpa_arena_stats arena_stats;
+	struct l2_batch batch;
+	doca_error_t result;
 	struct timespec t0, t1;
+	uint64_t mismatches = 0;
 
-	/* Creating DOCA sync event for DPA kernel completion */
-	result = create_doca_dpa_completion_sync_event(resources->doca_dpa, resources->doca_device, &comp_event);
-	if (result != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to create DOCA sync event for DPA kernel completion: %s",
-			     doca_error_get_descr(result));
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
 		return result;
+
+	/* a, b, out 直接放在 backend 的内存里（DPA 时就是 doca_mmap 注册过的那块） */
+	result = l2_batch_alloc(be, dim, batch_size, &batch);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to allocate batch memory: %s", doca_error_get_descr(result));
+		goto destroy_backend;
 	}
-	const uint32_t dim = 32, q = 16, batch_size = 1024 * 1024; // params
-	
-	/* allocate host memory for input and output */
-	/* single vector distance calc */
+
 	double *a_raw = malloc(dim * sizeof(double) * batch_size);
 	double *b_raw = malloc(dim * sizeof(double) * batch_size);
+	// 准备用来存 CPU 参考结果的内存空间
+	uint64_t *out_local = malloc(sizeof(uint64_t) * batch_size);
+	if (a_raw == NULL || b_raw == NULL || out_local == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
 
 	for(size_t i = 0; i < dim * batch_size; i++)
 	{
@@ -103,193 +192,2175 @@ doca_error_t kernel_launch(struct dpa_resources *resources)
 		b_raw[i] = rand_double(-100.0, 100.0);
 	}
 
-	// double dist_cpu = l2_distance(a_raw, b_raw, dim); // 计算一组a,b的L2 distance
-
-
-	// 准备a和b的Q16.16格式，位于host memory
-	int32_t *a_local = malloc(dim * sizeof(int32_t) * batch_size); // a vector(Quantized)
-	int32_t *b_local = malloc(dim * sizeof(int32_t) * batch_size); // b vector(Quantized)
-
-	double_array_to_q16_16(a_raw, a_local, dim * batch_size);
-	double_array_to_q16_16(b_raw, b_local, dim * batch_size);
+	// 准备a和b的Q16.16格式：直接量化进 backend 的 buffer，不再经过 a_local/b_local + memcpy
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	q16_16_quantize_double(a_raw, batch.a, (size_t)dim * batch_size, 0);
+	q16_16_quantize_double(b_raw, batch.b, (size_t)dim * batch_size, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t quant_time_ns = diff_ns(t0, t1);
 
-	// 准备用来存dist(a,b)的内存空间
-	uint64_t *out_local = malloc(sizeof(uint64_t) * batch_size);
-	// 置0
-	memset(out_local, 0, sizeof(uint64_t));
-
-	struct doca_mmap *mm = NULL; // mm
-    doca_dpa_dev_mmap_t dpa_h = 0;  // DPA访问mmap内存时用到的handler
-	// size_t total_bytes = 2 * dim * sizeof(int32_t) + sizeof(uint64_t) + sizeof(l2_single_dist_args); // 大小
-	size_t total_bytes = 3 * batch_size * dim * sizeof(int32_t);
-
-	DOCA_LOG_INFO("Start allocating mmap for DPA");
-	doca_error_t st;
-	// 1. mmap_create
-	st = doca_mmap_create(&mm);
-    if (st != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to create doca_mmap");
-		return st;
-	}
-	DOCA_LOG_INFO("mmap created");
-	// 2. mmap_set_permissions
-	st = doca_mmap_set_permissions(mm, DOCA_ACCESS_FLAG_LOCAL_READ_WRITE | DOCA_ACCESS_FLAG_PCI_READ_WRITE);
-    if (st != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to set permissions");
-		doca_mmap_destroy(mm); 
-		return st; 
-	}
-	DOCA_LOG_INFO("mmap oermission set");
-	// 3. mmap_add_dev
-	st = doca_mmap_add_dev(mm, resources->doca_device);
-	if (st != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to add dev");
-		doca_mmap_destroy(mm);
-		return st; 
-	}
-	DOCA_LOG_INFO("mmap dev added");
-	// 4. allocate host memory
-	void *buf = NULL;
-    if (posix_memalign(&buf, 64, total_bytes) != 0) {
-		DOCA_LOG_ERR("Failed to memalign");
-        doca_mmap_destroy(mm);
-        return DOCA_ERROR_NO_MEMORY;
-    }
-    memset(buf, 0, total_bytes);
-	DOCA_LOG_INFO("host memory allocated");
-	// 5. set memrange
-    st = doca_mmap_set_memrange(mm, buf, total_bytes);
-    if (st != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to set memrange");
-		free(buf); 
-		doca_mmap_destroy(mm);
-		return st; 
-	}
-	DOCA_LOG_INFO("memrange set");
-    // 6. start mmap
-    st = doca_mmap_start(mm);
-    if (st != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to start mmap");
-        (void)doca_mmap_set_free_cb(mm, NULL, NULL);
-        free(buf);
-        doca_mmap_destroy(mm);
-        return st;
-    }
-	DOCA_LOG_INFO("mmap started");
-	// check 1. check mmap 属性
-	uint8_t exported = 0, from_export = 0;
-	void *chk_addr = NULL; size_t chk_len = 0;
-	doca_error_t st2 = doca_mmap_get_memrange(mm, &chk_addr, &chk_len);
-	DOCA_LOG_INFO("mmap memrange addr=%p len=%zu st=%s", chk_addr, chk_len, doca_error_get_descr(st2));
-
-	// check 2. 是否支持 export PCI
-	struct doca_devinfo *info = doca_dev_as_devinfo(resources->doca_device);
-	uint8_t ok = 0;
-	doca_error_t st3 = doca_mmap_cap_is_export_pci_supported(info, &ok);
-	DOCA_LOG_INFO("export_pci_supported=%u (%s)", ok, doca_error_get_descr(st3));
-
-    // 拿到 DPA 侧 mmap 句柄：传给 kernel
-    st = doca_mmap_dev_get_dpa_handle(mm, resources->doca_device, &dpa_h);
-    if (st != DOCA_SUCCESS) {
-        doca_mmap_stop(mm);
-        (void)doca_mmap_set_free_cb(mm, NULL, NULL);
-        free(buf);
-        doca_mmap_destroy(mm);
-        return st;
-    }
-
-	// 把a,b,out拷贝到mmap出来的host memory里面
-	memcpy((uint8_t*)buf, a_local, dim * batch_size * sizeof(int32_t));
-	memcpy((uint8_t*)buf + dim * batch_size * sizeof(int32_t), b_local, dim * batch_size * sizeof(int32_t));
-	memcpy((uint8_t*)buf + dim * batch_size * sizeof(int32_t), out_local, 8 * batch_size);
-
-    /* single kernel args */
-    // struct l2_single_dist_args args;
-	// args.handle = dpa_h;
-	// args.a_offset = buf;
-	// args.b_offset = buf + dim * sizeof(int32_t);
-	// args.out_offset = buf + 2 * dim * sizeof(int32_t);
-	// args.frac_bits = 16;
-	// args.dim = 32;
-
-	/* batch kernel args */
-	struct l2_batch_args args;
-	args.handle = dpa_h;
-	args.a_base = buf;
-	args.b_base = buf + batch_size * dim * sizeof(int32_t);
-	args.out_base = buf + 2 * batch_size * dim * sizeof(int32_t);
-	args.a_stride = dim * sizeof(int32_t);
-	args.b_stride = dim * sizeof(int32_t);
-	args.out_stride = sizeof(int64_t);
-	args.frac_bits = 16;
-	args.dim = 32;
-	args.batch_size = batch_size;
-
-	DOCA_LOG_INFO("All DPA resources have been created\n");
-	DOCA_LOG_INFO("args.handle = %u", args.handle);
-	DOCA_LOG_INFO("args.dim = %u", args.dim);
-	DOCA_LOG_INFO("args.frac_bits = %u", args.frac_bits);
-	DOCA_LOG_INFO("args.batch_size = %u", args.batch_size);
-
-
-	doca_sync_event_get(comp_event, &comp_event_val);
-	printf("comp_event_val = %ld\n", comp_event_val);
+	dpa_arena_get_stats(be->arena, &arena_stats);
+	DOCA_LOG_INFO("Arena: %zu of %zu bytes in use", arena_stats.used, arena_stats.capacity);
+	DOCA_LOG_INFO("Running l2_batch_kernel on %s backend", l2_backend_type_name(type));
+	DOCA_LOG_INFO("dim = %u, frac_bits = %u, batch_size = %u, threads = %u, kernel variant = %s",
+		      batch.dim, batch.frac_bits, batch.batch_size, cfg.num_threads,
+		      l2_variant_name(l2_variant_select(batch.dim, L2_METRIC_L2SQ, L2_ELEM_Q16_16)));
 
 	/* kernel launch */
 	clock_gettime(CLOCK_MONOTONIC, &t0);
-	result = doca_dpa_kernel_launch_update_set(resources->doca_dpa,
-						   wait_event,
-						   wait_thresh,
-						   comp_event,
-						   comp_event_val + 1,
-						   num_dpa_threads,
-						   &l2_batch_kernel,
-						   args);
+	result = l2_batch_submit(be, &batch);
 	if (result != DOCA_SUCCESS) {
 		DOCA_LOG_ERR("Failed to launch zsj's play kernel: %s", doca_error_get_descr(result));
-		goto destroy_event;
+		goto free_local;
+	}
+	result = l2_batch_wait(be, &batch);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	uint64_t kernel_time_ns = diff_ns(t0, t1);
+
+	/* CPU 参考结果 */
+	struct l2_batch_args ref_args;
+
+	l2_batch_fill_args(&batch, 0, batch_size, &ref_args);
+	ref_args.out_base = (uint64_t)(uintptr_t)out_local;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	L2_TRACE_BEGIN(tr);
+	l2_cpu_batch(&ref_args);
+	L2_TRACE_END(tr, "cpu.reference", batch_size);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t cpu_time_ns = diff_ns(t0, t1);
+
+	const uint64_t *out = l2_batch_results(&batch);
+
+	for (uint32_t i = 0; i < batch_size; ++i) {
+		if (out[i] != out_local[i]) {
+			if (mismatches == 0)
+				DOCA_LOG_ERR("Mismatch at %u: %s = %lu, cpu = %lu", i, l2_backend_type_name(type),
+					     out[i], out_local[i]);
+			mismatches++;
+		}
+	}
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu of %u distances differ from the CPU reference", mismatches, batch_size);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+	printf("Kernel wall time (%s): %.3f ms %lu ns\n", l2_backend_type_name(type), kernel_time_ns / 1e6, kernel_time_ns);
+	printf("CPU wall time: %.3f ms %lu ns\n", cpu_time_ns / 1e6, cpu_time_ns);
+	printf("Quantize wall time: %.3f ms %lu ns\n", quant_time_ns / 1e6, quant_time_ns);
+
+	/* 同一份数据换成 int16 / int8 行，看字节数、时间和精度 */
+	report_accuracy(&batch, a_raw, b_raw, kernel_time_ns);
+	for (enum l2_elem elem = L2_ELEM_I16; elem <= L2_ELEM_I8 && result == DOCA_SUCCESS; elem++)
+		result = qformat_launch(be, elem, a_raw, b_raw, dim, batch_size);
+
+free_local:
+	free(out_local);
+	free(b_raw);
+	free(a_raw);
+	l2_batch_free(be, &batch);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run the k-NN search sample: a few queries against a random database,
+ * checked against the scalar CPU reference
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_search_kernel
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t search_launch(struct dpa_resources *resources, enum l2_backend_type type)
+{
+	const uint32_t dim = 32, db_size = 1024 * 1024, nq = 4, k = 10; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)db_size * dim * sizeof(int32_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_db db;
+	struct l2_search search;
+	struct l2_hit *hits = NULL, *ref_hits = NULL, *ref_parts = NULL;
+	struct l2_search_args ref_args;
+	struct timespec t0, t1;
+	doca_error_t result;
+	uint32_t mismatches = 0;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	result = l2_db_alloc(be, dim, db_size, &db);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+	result = l2_search_alloc(be, dim, nq, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+
+	hits = calloc((size_t)nq * k, sizeof(*hits));
+	ref_hits = calloc((size_t)nq * k, sizeof(*ref_hits));
+	ref_parts = calloc((size_t)nq * search.num_parts * k, sizeof(*ref_parts));
+	double *raw = malloc((size_t)db_size * dim * sizeof(double));
+	if (hits == NULL || ref_hits == NULL || ref_parts == NULL || raw == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
 	}
 
-	/* Wait until completion event reach completion val */
-	result = doca_sync_event_wait_gt(comp_event, comp_event_val, SYNC_EVENT_MASK_FFS);
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, db.vecs, (size_t)db_size * dim, 0);
+	for (size_t i = 0; i < (size_t)nq * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, search.queries, (size_t)nq * dim, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_search_submit(be, &db, &search, nq);
 	if (result != DOCA_SUCCESS)
-		DOCA_LOG_ERR("Failed to wait for host completion event: %s", doca_error_get_descr(result));
+		goto free_local;
+	result = l2_search_wait(be, &search, hits);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
 	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t search_time_ns = diff_ns(t0, t1);
 
-	uint64_t dpa_time_ns = diff_ns(t0, t1);
-	
+	/* CPU 参考结果 */
+	l2_search_fill_args(&db, 0, db_size, &search, nq, &ref_args);
+	ref_args.out_base = (uint64_t)(uintptr_t)ref_parts;
 	clock_gettime(CLOCK_MONOTONIC, &t0);
-	for(uint32_t i = 0; i < batch_size; ++i)
-	{
-		int32_t *a = a_local + i * dim;
-		int32_t *b = b_local + i * dim;
-		int64_t dist = 0;
-		for (uint32_t j = 0; j < dim; ++j) {
-            int64_t da = (int64_t)a[j] - (int64_t)b[j];
-            dist += da * da;
-        }
-		out_local[i] = (uint64_t)dist;
+	l2_cpu_search(&ref_args);
+	for (uint32_t q = 0; q < nq; q++)
+		l2_topk_merge(ref_parts + (size_t)q * search.num_parts * k, search.num_parts, k, ref_hits + (size_t)q * k);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t cpu_time_ns = diff_ns(t0, t1);
+
+	for (uint32_t i = 0; i < nq * k; i++) {
+		if (hits[i].id != ref_hits[i].id || hits[i].dist != ref_hits[i].dist)
+			mismatches++;
+	}
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%u of %u top-%u hits differ from the CPU reference", mismatches, nq * k, k);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+	for (uint32_t q = 0; q < nq; q++)
+		printf("query %u: nearest id %u dist %.6f\n", q, hits[(size_t)q * k].id,
+		       sqrt((double)hits[(size_t)q * k].dist) / (double)(1u << 16));
+	printf("Search wall time (%s): %.3f ms, %u x %u vectors, k = %u, %zu bytes of partial results\n",
+	       l2_backend_type_name(type), search_time_ns / 1e6, nq, db_size, k,
+	       (size_t)nq * search.num_parts * k * sizeof(struct l2_hit));
+	printf("CPU wall time: %.3f ms\n", cpu_time_ns / 1e6);
+
+free_local:
+	free(raw);
+	free(ref_parts);
+	free(ref_hits);
+	free(hits);
+	l2_search_free(be, &search);
+free_db:
+	l2_db_free(be, &db);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run the distance matrix sample: M queries x N centroids
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend that runs l2_matrix_kernel
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t matrix_launch(struct dpa_resources *resources, enum l2_backend_type type)
+{
+	const uint32_t dim = 128, m = 1024, n = 4096; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)m * n * sizeof(uint64_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_matrix mat;
+	struct l2_matrix_args ref_args;
+	struct timespec t0, t1;
+	uint64_t *ref = NULL, mismatches = 0;
+	double *raw = NULL;
+	doca_error_t result;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_matrix_alloc(be, dim, m, n, &mat);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+
+	ref = malloc((size_t)m * mat.out_stride);
+	raw = malloc((size_t)(m > n ? m : n) * dim * sizeof(double));
+	if (ref == NULL || raw == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
 	}
+	for (size_t i = 0; i < (size_t)n * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, mat.b, (size_t)n * dim, 0);
+	for (size_t i = 0; i < (size_t)m * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, mat.a, (size_t)m * dim, 0);
+
+	/* 范数算在计时里：换一批 query 时 a 的范数每次都要重算 */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	l2_matrix_update_norms(&mat, m, L2_MATRIX_A | L2_MATRIX_B);
+	result = l2_matrix_submit(be, &mat, m);
+	if (result == DOCA_SUCCESS)
+		result = l2_matrix_wait(be, &mat);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t matrix_time_ns = diff_ns(t0, t1);
+
+	/* CPU 参考：直接累加 (a - b)^2，同时验证展开式是精确的 */
+	l2_matrix_fill_args(&mat, m, &ref_args);
+	ref_args.out_base = (uint64_t)(uintptr_t)ref;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	l2_cpu_matrix(&ref_args);
 	clock_gettime(CLOCK_MONOTONIC, &t1);
 	uint64_t cpu_time_ns = diff_ns(t0, t1);
-	// uint64_t dist_sq_q2q = *(uint64_t *)args.out_offset;
-    // double dist_dpa = sqrt((double)dist_sq_q2q) / (double)(1u << q);
 
-    // printf("CPU L2 = %.8f, DPA L2 = %.8f, abs=%.3e, rel=%.3e\n",
-    //        dist_cpu, dist_dpa, fabs(dist_dpa - dist_cpu), (dist_cpu>0 ? fabs(dist_dpa-dist_cpu)/dist_cpu : 0.0));
-	printf("Kernel wall time: %.3f ms %lu ns\n", dpa_time_ns / 1e6, dpa_time_ns);
-	printf("CPU wall time: %.3f ms %lu ns\n", cpu_time_ns / 1e6, cpu_time_ns);
+	for (uint32_t i = 0; i < m; i++) {
+		const uint64_t *row = l2_matrix_row(&mat, i);
+		const uint64_t *ref_row = (const uint64_t *)((const uint8_t *)ref + (size_t)i * mat.out_stride);
+
+		for (uint32_t j = 0; j < n; j++)
+			mismatches += row[j] != ref_row[j];
+	}
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu of %lu distances differ from the CPU reference", mismatches, (uint64_t)m * n);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+	printf("d(a0, b0) = %.6f\n", sqrt((double)l2_matrix_row(&mat, 0)[0]) / (double)(1u << 16));
+	printf("Matrix wall time (%s): %.3f ms, %u x %u x dim %u, %.3f G distances/s\n", l2_backend_type_name(type),
+	       matrix_time_ns / 1e6, m, n, dim, (double)m * n / matrix_time_ns);
+	printf("Input bytes: %.1f MB (pairwise batch would read %.1f MB)\n",
+	       (double)(m + n) * dim * sizeof(int32_t) / 1e6, 2.0 * m * n * dim * sizeof(int32_t) / 1e6);
+	printf("CPU wall time: %.3f ms\n", cpu_time_ns / 1e6);
+
+free_local:
+	free(raw);
+	free(ref);
+	l2_matrix_free(be, &mat);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/* pipeline sample 的输入和输出：stage 从 raw 量化进 slot，drain 把结果拷出来 */
+struct pipeline_stream {
+	const double *a_raw;
+	const double *b_raw;
+	uint64_t *out;
+	uint32_t dim;
+};
+
+static doca_error_t pipeline_stage(void *ctx, uint64_t first, uint32_t count, int32_t *a, int32_t *b)
+{
+	struct pipeline_stream *st = ctx;
+	size_t off = (size_t)first * st->dim, len = (size_t)count * st->dim;
+
+	q16_16_quantize_double(st->a_raw + off, a, len, 0);
+	q16_16_quantize_double(st->b_raw + off, b, len, 0);
+	return DOCA_SUCCESS;
+}
+
+static void pipeline_drain(void *ctx, uint64_t first, uint32_t count, const uint64_t *out)
+{
+	struct pipeline_stream *st = ctx;
+
+	memcpy(st->out + first, out, (size_t)count * sizeof(*out));
+}
+
+/*
+ * Run the pipelined streaming sample: quantize + launch + wait of consecutive
+ * slots overlap through a ring of num_slots staging slots
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_batch_kernel
+ * @num_slots [in]: ring depth K, 1 runs the stages back to back
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t pipeline_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t num_slots)
+{
+	const uint32_t dim = 32, total = 1024 * 1024, slot_vectors = 64 * 1024; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)num_slots * slot_vectors * (2 * dim * sizeof(int32_t) + sizeof(uint64_t)) +
+			      (2UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct pipeline_stream st = {.dim = dim};
+	struct l2_pipeline_cfg pl_cfg = {
+		.dim = dim,
+		.slot_vectors = slot_vectors,
+		.num_slots = num_slots,
+		.stage = pipeline_stage,
+		.drain = pipeline_drain,
+		.ctx = &st,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_pipeline pl;
+	struct l2_batch_args ref_args = {0};
+	int32_t *a_q = NULL, *b_q = NULL;
+	uint64_t *ref = NULL, mismatches = 0;
+	double *a_raw = NULL, *b_raw = NULL;
+	doca_error_t result;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_pipeline_create(be, &pl_cfg, &pl);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+
+	a_raw = malloc((size_t)total * dim * sizeof(double));
+	b_raw = malloc((size_t)total * dim * sizeof(double));
+	a_q = malloc((size_t)total * dim * sizeof(int32_t));
+	b_q = malloc((size_t)total * dim * sizeof(int32_t));
+	st.out = malloc((size_t)total * sizeof(uint64_t));
+	ref = malloc((size_t)total * sizeof(uint64_t));
+	if (a_raw == NULL || b_raw == NULL || a_q == NULL || b_q == NULL || st.out == NULL || ref == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)total * dim; i++) {
+		a_raw[i] = rand_double(-100.0, 100.0);
+		b_raw[i] = rand_double(-100.0, 100.0);
+	}
+	st.a_raw = a_raw;
+	st.b_raw = b_raw;
+
+	DOCA_LOG_INFO("Streaming %u pairs through %u slots of %u on %s backend (%s launches)", total, num_slots,
+		      slot_vectors, l2_backend_type_name(type), l2_backend_can_defer(be) ? "chained" : "inline");
+	result = l2_pipeline_run(&pl, total);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Pipeline failed: %s", doca_error_get_descr(result));
+		goto free_local;
+	}
+
+	/* CPU 参考结果 */
+	q16_16_quantize_double(a_raw, a_q, (size_t)total * dim, 0);
+	q16_16_quantize_double(b_raw, b_q, (size_t)total * dim, 0);
+	ref_args.a_base = (uint64_t)(uintptr_t)a_q;
+	ref_args.b_base = (uint64_t)(uintptr_t)b_q;
+	ref_args.out_base = (uint64_t)(uintptr_t)ref;
+	ref_args.a_stride = ref_args.b_stride = dim * sizeof(int32_t);
+	ref_args.out_stride = sizeof(uint64_t);
+	ref_args.dim = dim;
+	ref_args.frac_bits = 16;
+	ref_args.batch_size = total;
+	l2_cpu_batch(&ref_args);
+	for (uint32_t i = 0; i < total; i++)
+		mismatches += st.out[i] != ref[i];
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu of %u distances differ from the CPU reference", mismatches, total);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+	printf("Pipeline wall time (%s, K = %u): %.3f ms, %.2f Mvec/s\n", l2_backend_type_name(type), num_slots,
+	       pl.stats.total_ns / 1e6, total / (pl.stats.total_ns / 1e3));
+	printf("  %lu launches, host staging %.3f ms, host blocked on slots %.3f ms\n", pl.stats.launches,
+	       pl.stats.stage_ns / 1e6, pl.stats.slot_wait_ns / 1e6);
+
+free_local:
+	free(ref);
+	free(st.out);
+	free(b_q);
+	free(a_q);
+	free(b_raw);
+	free(a_raw);
+	l2_pipeline_destroy(&pl);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/* completion 回调只在 completion thread 上跑，计数不需要加锁 */
+struct async_progress {
+	uint64_t vectors_done;
+	uint32_t chunk;
+	uint32_t callbacks;
+};
+
+static void async_done(void *ctx, uint64_t ticket, doca_error_t status)
+{
+	struct async_progress *p = ctx;
+
+	(void)ticket;
+	if (status == DOCA_SUCCESS)
+		p->vectors_done += p->chunk;
+	p->callbacks++;
+}
+
+/*
+ * Run the batch sample through the async engine: the batch is cut into chunks
+ * that are all submitted up front, with at most depth launches in flight
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_batch_kernel
+ * @depth [in]: max in-flight launches
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t async_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t depth)
+{
+	const uint32_t dim = 32, batch_size = 1024 * 1024, chunk = 32 * 1024; // params
+	const uint32_t chunks = batch_size / chunk;
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)batch_size * (2 * dim * sizeof(int32_t) + sizeof(uint64_t)),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_engine_cfg eng_cfg = {.max_inflight = depth};
+	struct async_progress progress = {.chunk = chunk};
+	struct l2_engine_stats stats;
+	struct l2_backend *be = NULL;
+	struct l2_engine *eng = NULL;
+	struct l2_batch batch;
+	struct l2_batch_args args;
+	struct timespec t0, t1;
+	uint64_t *ref = NULL, mismatches = 0, last = 0;
+	double *raw = NULL;
+	doca_error_t result;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_batch_alloc(be, dim, batch_size, &batch);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+
+	raw = malloc((size_t)batch_size * dim * sizeof(double));
+	ref = malloc((size_t)batch_size * sizeof(uint64_t));
+	if (raw == NULL || ref == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)batch_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, batch.a, (size_t)batch_size * dim, 0);
+	for (size_t i = 0; i < (size_t)batch_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, batch.b, (size_t)batch_size * dim, 0);
+
+	result = l2_engine_create(be, &eng_cfg, &eng);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t first = 0; first < batch_size; first += chunk) {
+		l2_batch_fill_args(&batch, first, chunk, &args);
+		result = l2_engine_submit(eng, L2_KERNEL_BATCH, &args, async_done, &progress, &last);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to submit chunk at %u: %s", first, doca_error_get_descr(result));
+			break;
+		}
+	}
+	if (last != 0) {
+		doca_error_t wait_result = l2_engine_wait(eng, last);
+
+		if (result == DOCA_SUCCESS)
+			result = wait_result;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	l2_engine_get_stats(eng, &stats);
+	l2_engine_destroy(eng);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+
+	l2_batch_fill_args(&batch, 0, batch_size, &args);
+	args.out_base = (uint64_t)(uintptr_t)ref;
+	l2_cpu_batch(&args);
+	for (uint32_t i = 0; i < batch_size; i++)
+		mismatches += batch.out[i] != ref[i];
+	if (mismatches != 0 || progress.vectors_done != batch_size) {
+		DOCA_LOG_ERR("%lu of %u distances differ from the CPU reference, %lu reported done", mismatches,
+			     batch_size, progress.vectors_done);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+	/* 窗口比 chunk 数小时 submit 一定会被挡住，否则说明上限没生效 */
+	if (stats.submitted != chunks || stats.completed != chunks || stats.max_inflight_seen > depth ||
+	    (depth < chunks && stats.backpressure_waits == 0)) {
+		DOCA_LOG_ERR("Engine stats off for %u chunks at depth %u: submitted %lu, completed %lu, max in flight %u, %lu backpressure waits",
+			     chunks, depth, stats.submitted, stats.completed, stats.max_inflight_seen,
+			     stats.backpressure_waits);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+	printf("Async wall time (%s, depth %u): %.3f ms, %u callbacks\n", l2_backend_type_name(type), depth,
+	       diff_ns(t0, t1) / 1e6, progress.callbacks);
+	printf("  submitted %lu, completed %lu, max in flight %u, blocked on backpressure %lu times\n",
+	       stats.submitted, stats.completed, stats.max_inflight_seen, stats.backpressure_waits);
+
+free_local:
+	free(ref);
+	free(raw);
+	l2_batch_free(be, &batch);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run the batch sample split between a device backend and the host SIMD backend,
+ * several times so the split can be seen settling on the measured throughput ratio
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: device side, dpa or emu
+ * @runs [in]: number of runs over the same batch
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t hybrid_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t runs)
+{
+	const uint32_t dim = 32, batch_size = 1024 * 1024; // params
+	struct l2_backend_cfg dev_cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)batch_size * (2 * dim * sizeof(int32_t) + sizeof(uint64_t)),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	/* host backend 只读 device arena 里的 batch，自己的 arena 用不上 */
+	struct l2_backend_cfg host_cfg = {
+		.type = L2_BACKEND_HOST,
+		.num_threads = 64,
+		.arena_size = 4096,
+		.arena_page = DPA_ARENA_PAGE_4K,
+	};
+	struct l2_backend *dev = NULL, *host = NULL;
+	struct l2_hybrid_cfg hy_cfg;
+	struct l2_hybrid *hybrid = NULL;
+	struct l2_hybrid_stats stats;
+	struct l2_batch batch;
+	struct l2_batch_args args;
+	uint64_t *ref = NULL, mismatches = 0;
+	double *raw = NULL;
+	doca_error_t result;
+
+	if (type != L2_BACKEND_DPA && type != L2_BACKEND_EMU) {
+		DOCA_LOG_ERR("--hybrid needs a device backend (dpa or emu), got %s", l2_backend_type_name(type));
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	result = l2_backend_create(&dev_cfg, &dev);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_backend_create(&host_cfg, &host);
+	if (result != DOCA_SUCCESS)
+		goto destroy_dev;
+	result = l2_batch_alloc(dev, dim, batch_size, &batch);
+	if (result != DOCA_SUCCESS)
+		goto destroy_host;
+
+	raw = malloc((size_t)batch_size * dim * sizeof(double));
+	ref = malloc((size_t)batch_size * sizeof(uint64_t));
+	if (raw == NULL || ref == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)batch_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, batch.a, (size_t)batch_size * dim, 0);
+	for (size_t i = 0; i < (size_t)batch_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, batch.b, (size_t)batch_size * dim, 0);
+
+	l2_batch_fill_args(&batch, 0, batch_size, &args);
+	args.out_base = (uint64_t)(uintptr_t)ref;
+	l2_cpu_batch(&args);
+
+	hy_cfg = (struct l2_hybrid_cfg){.dev = dev, .host = host};
+	result = l2_hybrid_create(&hy_cfg, &hybrid);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+
+	printf("Hybrid %s + host, %u pairs of dim %u\n", l2_backend_type_name(type), batch_size, dim);
+	printf("  run  share  dev pairs  host pairs  chunks d/h  dev Mp/s  host Mp/s  host idle ms  wall ms\n");
+	for (uint32_t r = 0; r < runs; r++) {
+		/* 每轮先把结果写脏，漏算的 pair 一定对不上 */
+		memset(batch.out, 0xff, (size_t)batch_size * sizeof(uint64_t));
+		result = l2_hybrid_run(hybrid, &batch, &stats);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Hybrid run %u failed: %s", r, doca_error_get_descr(result));
+			break;
+		}
+		mismatches = 0;
+		for (uint32_t i = 0; i < batch_size; i++)
+			mismatches += batch.out[i] != ref[i];
+		printf("  %3u  %5.3f  %9lu  %10lu  %5u/%-4u  %8.2f  %9.2f  %12.3f  %7.3f\n", r, stats.dev_share,
+		       stats.dev_vectors, stats.host_vectors, stats.dev_chunks, stats.host_chunks, stats.dev_vps / 1e6,
+		       stats.host_vps / 1e6, stats.host_idle_ns / 1e6, stats.total_ns / 1e6);
+		if (mismatches != 0) {
+			DOCA_LOG_ERR("Run %u: %lu of %u distances differ from the CPU reference", r, mismatches,
+				     batch_size);
+			result = DOCA_ERROR_UNEXPECTED;
+			break;
+		}
+	}
+	printf("  next run would start from device share %.3f\n", l2_hybrid_dev_share(hybrid));
+	l2_hybrid_destroy(hybrid);
+
+free_local:
+	free(ref);
+	free(raw);
+	l2_batch_free(dev, &batch);
+destroy_host:
+	l2_backend_destroy(host);
+destroy_dev:
+	l2_backend_destroy(dev);
+	return result;
+}
+
+/* 一个闭环客户端：发一个 query，拿到结果再发下一个 */
+struct server_client {
+	struct l2_server *srv;
+	const char *socket_path;	/* 非空: 走 socket 而不是进程内调用 */
+	const int32_t *queries;
+	struct l2_hit *hits;
+	uint32_t nq;
+	uint32_t dim;
+	uint32_t k;
+	doca_error_t result;
+};
+
+static void *server_client_run(void *arg)
+{
+	struct server_client *c = arg;
+	struct l2_server_hello hello;
+	int fd = -1;
+
+	c->result = DOCA_SUCCESS;
+	if (c->socket_path[0] != '\0') {
+		c->result = l2_server_connect(c->socket_path, &fd, &hello);
+		if (c->result != DOCA_SUCCESS)
+			return NULL;
+		if (hello.dim != c->dim || hello.k != c->k) {
+			close(fd);
+			c->result = DOCA_ERROR_UNEXPECTED;
+			return NULL;
+		}
+	}
+	for (uint32_t q = 0; q < c->nq && c->result == DOCA_SUCCESS; q++) {
+		if (fd >= 0)
+			c->result = l2_server_remote_query(fd, &hello, c->queries + (size_t)q * c->dim,
+							   c->hits + (size_t)q * c->k);
+		else
+			c->result = l2_server_query(c->srv, c->queries + (size_t)q * c->dim, c->hits + (size_t)q * c->k);
+	}
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+/*
+ * Run the query server sample: closed-loop clients send single queries that the
+ * server coalesces into search launches, each client checked against a brute-force scan
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_search_kernel
+ * @max_batch [in]: most queries per launch
+ * @deadline_us [in]: longest a query waits for its batch to fill, 0 = server default
+ * @socket_path [in]: when not empty the clients go through a Unix socket at this path
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t server_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t max_batch,
+			   uint32_t deadline_us, const char *socket_path)
+{
+	const uint32_t dim = 32, db_size = 16 * 1024, k = 10, num_clients = 16, per_client = 64; // params
+	const uint32_t nq = num_clients * per_client;
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)db_size * dim * sizeof(int32_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_server_cfg srv_cfg = {.k = k, .max_batch = max_batch, .deadline_us = deadline_us};
+	struct server_client clients[num_clients];
+	pthread_t threads[num_clients];
+	struct l2_backend *be = NULL;
+	struct l2_server *srv = NULL;
+	struct l2_server_stats stats;
+	struct l2_db db;
+	struct l2_hit *hits = NULL, *ref_hits = NULL;
+	struct l2_hit sorted[k];
+	int32_t *queries = NULL;
+	double *raw = NULL;
+	struct timespec t0, t1;
+	uint32_t started = 0, bad_clients = 0;
+	doca_error_t result;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(be, dim, db_size, &db);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+
+	raw = malloc((size_t)db_size * dim * sizeof(double));
+	queries = malloc((size_t)nq * dim * sizeof(int32_t));
+	hits = calloc((size_t)nq * k, sizeof(*hits));
+	ref_hits = calloc((size_t)nq * k, sizeof(*ref_hits));
+	if (raw == NULL || queries == NULL || hits == NULL || ref_hits == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, db.vecs, (size_t)db_size * dim, 0);
+	for (size_t i = 0; i < (size_t)nq * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, queries, (size_t)nq * dim, 0);
+
+	srv_cfg.be = be;
+	srv_cfg.db = &db;
+	result = l2_server_create(&srv_cfg, &srv);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	if (socket_path[0] != '\0') {
+		result = l2_server_listen(srv, socket_path);
+		if (result != DOCA_SUCCESS)
+			goto destroy_server;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (; started < num_clients; started++) {
+		clients[started] = (struct server_client){
+			.srv = srv,
+			.socket_path = socket_path,
+			.queries = queries + (size_t)started * per_client * dim,
+			.hits = hits + (size_t)started * per_client * k,
+			.nq = per_client,
+			.dim = dim,
+			.k = k,
+		};
+		if (pthread_create(&threads[started], NULL, server_client_run, &clients[started]) != 0) {
+			DOCA_LOG_ERR("Failed to start client thread %u", started);
+			result = DOCA_ERROR_OPERATING_SYSTEM;
+			break;
+		}
+	}
+	for (uint32_t i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+		if (clients[i].result != DOCA_SUCCESS && result == DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Client %u failed: %s", i, doca_error_get_descr(clients[i].result));
+			result = clients[i].result;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	l2_server_get_stats(srv, &stats);
+	if (result != DOCA_SUCCESS)
+		goto destroy_server;
 
-recycle_event:
-	doca_mmap_stop(mm);
-	doca_mmap_destroy(mm);
+	printf("Query server (%s, max batch %u, %s): %u queries from %u clients in %.3f ms, %.0f queries/s\n",
+	       l2_backend_type_name(type), max_batch, socket_path[0] != '\0' ? "unix socket" : "in-process", nq,
+	       num_clients, diff_ns(t0, t1) / 1e6, nq / (diff_ns(t0, t1) / 1e9));
+	l2_server_print_stats(&stats);
 
-destroy_event:
-	/* destroy events */
-	tmp_result = doca_sync_event_destroy(comp_event);
-	if (tmp_result != DOCA_SUCCESS) {
-		DOCA_LOG_ERR("Failed to destroy DOCA sync event: %s", doca_error_get_descr(tmp_result));
-		DOCA_ERROR_PROPAGATE(result, tmp_result);
+	/* 参考答案：host 上暴力扫整个库，每个客户端分开对 */
+	for (uint32_t q = 0; q < nq; q++) {
+		struct l2_hit *r = ref_hits + (size_t)q * k;
+		uint32_t n = 0;
+
+		for (uint32_t i = 0; i < db_size; i++)
+			l2_topk_push(r, &n, k, l2_sq_q16_16(queries + (size_t)q * dim, db.vecs + (size_t)i * dim, dim), i);
+		l2_topk_pad(r, n, k);
+		memcpy(sorted, r, k * sizeof(*sorted));
+		l2_topk_merge(sorted, 1, k, r);
+	}
+	for (uint32_t c = 0; c < num_clients; c++) {
+		uint32_t mismatches = 0;
+
+		for (uint32_t i = c * per_client * k; i < (c + 1) * per_client * k; i++) {
+			if (hits[i].id != ref_hits[i].id || hits[i].dist != ref_hits[i].dist)
+				mismatches++;
+		}
+		if (mismatches != 0) {
+			DOCA_LOG_ERR("Client %u: %u of %u top-%u hits differ from the brute-force scan", c, mismatches,
+				     per_client * k, k);
+			bad_clients++;
+		}
 	}
+	if (bad_clients != 0) {
+		DOCA_LOG_ERR("%u of %u clients got wrong hits", bad_clients, num_clients);
+		result = DOCA_ERROR_UNEXPECTED;
+	} else
+		printf("  every client's hits match brute force\n");
+
+destroy_server:
+	l2_server_destroy(srv);
+free_local:
+	free(ref_hits);
+	free(hits);
+	free(queries);
+	free(raw);
+	l2_db_free(be, &db);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run the session sample: the same batch job first the one-shot way (open, run, close per job)
+ * and then repeatedly on one warm session, to compare cold and warm start latency
+ *
+ * @resources [in]: DOCA DPA resources for the warm session, NULL to let it open its own device
+ * @type [in]: backend for both variants
+ * @dpa_cfg [in]: device the cold jobs open and close themselves (dpa only)
+ * @jobs [in]: jobs served by the warm session
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t session_launch(struct dpa_resources *resources, enum l2_backend_type type, struct dpa_config *dpa_cfg,
+			    uint32_t jobs)
+{
+	const uint32_t dim = 32, job_pairs = 256 * 1024, cold_jobs = 3; // params
+	struct l2_session_cfg cfg = {
+		.type = type,
+		.dpa = dpa_cfg,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+		.dim = dim,
+		.slot_vectors = 64 * 1024,
+		.num_slots = 2,
+	};
+	struct l2_session *session = NULL;
+	struct l2_session_stats stats;
+	int32_t *a = NULL, *b = NULL;
+	uint64_t *out = NULL, *ref = NULL;
+	double *raw = NULL;
+	uint64_t job_ns, cold_ns = 0, warm_min = UINT64_MAX;
+	struct timespec t0, t1, t2, t3;
+	doca_error_t result = DOCA_SUCCESS;
+
+	a = malloc((size_t)job_pairs * dim * sizeof(int32_t));
+	b = malloc((size_t)job_pairs * dim * sizeof(int32_t));
+	out = malloc((size_t)job_pairs * sizeof(uint64_t));
+	ref = malloc((size_t)job_pairs * sizeof(uint64_t));
+	raw = malloc((size_t)job_pairs * dim * sizeof(double));
+	if (a == NULL || b == NULL || out == NULL || ref == NULL || raw == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)job_pairs * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, a, (size_t)job_pairs * dim, 0);
+	for (size_t i = 0; i < (size_t)job_pairs * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, b, (size_t)job_pairs * dim, 0);
+	for (uint32_t i = 0; i < job_pairs; i++)
+		ref[i] = l2_sq_q16_16(a + (size_t)i * dim, b + (size_t)i * dim, dim);
+
+	printf("Session (%s): jobs of %u pairs, dim %u\n", l2_backend_type_name(type), job_pairs, dim);
+
+	/* 冷：每个 job 自己打开设备、注册 arena、建 event，跑完全部拆掉，和每次起一个进程一样 */
+	cfg.no_warmup = 1;
+	for (uint32_t j = 0; j < cold_jobs; j++) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		result = l2_session_open(&cfg, &session);
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		memset(out, 0, (size_t)job_pairs * sizeof(uint64_t));
+		result = l2_session_run(session, a, b, job_pairs, out, &job_ns);
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		l2_session_get_stats(session, &stats);
+		l2_session_close(session);
+		session = NULL;
+		clock_gettime(CLOCK_MONOTONIC, &t3);
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		if (memcmp(out, ref, (size_t)job_pairs * sizeof(uint64_t)) != 0) {
+			DOCA_LOG_ERR("Cold job %u differs from the reference", j);
+			result = DOCA_ERROR_UNEXPECTED;
+			goto free_local;
+		}
+		cold_ns += diff_ns(t0, t3);
+		printf("  cold job %u: open %.3f ms (device %.3f, backend %.3f, staging %.3f), run %.3f ms, close %.3f ms\n",
+		       j, diff_ns(t0, t1) / 1e6, stats.open.device_ns / 1e6, stats.open.backend_ns / 1e6,
+		       stats.open.staging_ns / 1e6, job_ns / 1e6, diff_ns(t2, t3) / 1e6);
+	}
+
+	/* 热：打开一次并预热，之后的 job 只剩 staging + launch */
+	cfg.resources = resources;
+	cfg.no_warmup = 0;
+	result = l2_session_open(&cfg, &session);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	/* 预热必须真的跑过 launch，之后的 job 才算热的 */
+	l2_session_get_stats(session, &stats);
+	if (stats.open.warmup_ns == 0) {
+		DOCA_LOG_ERR("Session opened without running its warmup launches");
+		result = DOCA_ERROR_UNEXPECTED;
+		goto close_session;
+	}
+	for (uint32_t j = 0; j < jobs; j++) {
+		memset(out, 0, (size_t)job_pairs * sizeof(uint64_t));
+		result = l2_session_run(session, a, b, job_pairs, out, &job_ns);
+		if (result != DOCA_SUCCESS)
+			goto close_session;
+		if (memcmp(out, ref, (size_t)job_pairs * sizeof(uint64_t)) != 0) {
+			DOCA_LOG_ERR("Warm job %u differs from the reference", j);
+			result = DOCA_ERROR_UNEXPECTED;
+			goto close_session;
+		}
+		if (job_ns < warm_min)
+			warm_min = job_ns;
+	}
+	l2_session_get_stats(session, &stats);
+	printf("  warm session: open %.3f ms (device %.3f, backend %.3f, staging %.3f, warmup %.3f), paid once\n",
+	       stats.open.total_ns / 1e6, stats.open.device_ns / 1e6, stats.open.backend_ns / 1e6,
+	       stats.open.staging_ns / 1e6, stats.open.warmup_ns / 1e6);
+	if (stats.jobs > 0)
+		printf("  warm jobs: %lu, first %.3f ms, mean %.3f ms, min %.3f ms, %lu launches; cold job mean %.3f ms end to end (%.1fx)\n",
+		       stats.jobs, stats.first_job_ns / 1e6, stats.job_ns / 1e6 / stats.jobs, warm_min / 1e6,
+		       stats.launches, cold_ns / 1e6 / cold_jobs,
+		       (double)cold_ns / cold_jobs / ((double)stats.job_ns / stats.jobs));
+
+close_session:
+	l2_session_close(session);
+free_local:
+	free(raw);
+	free(ref);
+	free(out);
+	free(b);
+	free(a);
+	return result;
+}
+
+/*
+ * Run the radius search sample: near-duplicate detection on a random database with planted
+ * duplicates, checked hit for hit against a brute-force scan
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend that runs l2_range_kernel
+ * @radius [in]: distance threshold (not squared), same units as the vector values
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t range_launch(struct dpa_resources *resources, enum l2_backend_type type, double radius)
+{
+	const uint32_t dim = 32, db_size = 128 * 1024, nq = 128, cap = 256; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)db_size * dim * sizeof(int32_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_db db;
+	struct l2_range range;
+	struct l2_range_stats stats;
+	struct l2_range_hit *hits = NULL;
+	uint64_t *offsets = NULL, radius_sq, pos = 0, mismatches = 0, dups = 0, written;
+	double *raw = NULL, r_fixed = radius * (double)(1u << 16);
+	struct timespec t0, t1;
+	doca_error_t result;
+
+	radius_sq = (uint64_t)(r_fixed * r_fixed);
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(be, dim, db_size, &db);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+	result = l2_range_alloc(be, dim, nq, cap, &range);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+
+	hits = malloc((size_t)range.num_parts * cap * sizeof(*hits));
+	offsets = malloc((nq + 1) * sizeof(*offsets));
+	raw = malloc((size_t)db_size * dim * sizeof(double));
+	if (hits == NULL || offsets == NULL || raw == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+
+	/* query 就是库的前 nq 行；偶数 query 在库的后半段各埋一个加了 ±0.5 噪声的副本 */
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	for (uint32_t q = 0; q < nq; q += 2) {
+		double *dup = raw + ((size_t)db_size / 2 + (size_t)q * 97) * dim;
+
+		for (uint32_t i = 0; i < dim; i++)
+			dup[i] = raw[(size_t)q * dim + i] + rand_double(-0.5, 0.5);
+	}
+	q16_16_quantize_double(raw, db.vecs, (size_t)db_size * dim, 0);
+	memcpy(range.queries, db.vecs, (size_t)nq * dim * sizeof(int32_t));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_range_submit(be, &db, &range, nq, radius_sq);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	result = l2_range_wait(be, &range, hits, offsets, &stats);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* 暴力扫一遍，命中必须按 (q, id) 逐个对上 */
+	if (stats.dropped == 0) {
+		for (uint32_t q = 0; q < nq; q++) {
+			for (uint32_t idx = 0; idx < db_size; idx++) {
+				uint64_t d = l2_sq_q16_16(range.queries + (size_t)q * dim, db.vecs + (size_t)idx * dim, dim);
+
+				if (d > radius_sq)
+					continue;
+				if (pos >= offsets[q + 1] || hits[pos].id != idx || hits[pos].dist != d)
+					mismatches++;
+				else
+					pos++;
+			}
+			if (pos != offsets[q + 1]) {
+				mismatches += offsets[q + 1] - pos;
+				pos = offsets[q + 1];
+			}
+		}
+		if (mismatches != 0) {
+			DOCA_LOG_ERR("%lu range hits differ from the brute-force scan", mismatches);
+			result = DOCA_ERROR_UNEXPECTED;
+		}
+	}
+
+	/* query q 就是库的第 q 行，它自己总在半径内 */
+	for (uint32_t q = 0; q < nq; q++)
+		for (uint64_t i = offsets[q]; i < offsets[q + 1]; i++)
+			dups += hits[i].id != q;
+	written = stats.hits * sizeof(struct l2_range_hit) + range.num_parts * sizeof(uint64_t);
+	printf("Range search (%s): %u queries x %u vectors, dim %u, radius %.3f, %.3f ms\n", l2_backend_type_name(type),
+	       nq, db_size, dim, radius, diff_ns(t0, t1) / 1e6);
+	printf("  %lu hits, %lu besides the query rows themselves; %lu dropped in %u overflowed segments of %u\n",
+	       stats.hits, dups, stats.dropped, stats.overflowed, cap);
+	printf("  writeback %lu bytes vs %lu bytes for a full distance batch (%.0fx less)%s\n", written,
+	       (uint64_t)nq * db_size * sizeof(uint64_t), (double)nq * db_size * sizeof(uint64_t) / written,
+	       stats.dropped == 0 ? ", matches brute force" : "");
+
+free_local:
+	free(raw);
+	free(offsets);
+	free(hits);
+	l2_range_free(be, &range);
+free_db:
+	l2_db_free(be, &db);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * One timed search / range pass for abandon_launch(), with the search context's current abandon_block
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t abandon_pass(struct l2_backend *be, struct l2_db *db, struct l2_search *search, uint32_t nq,
+				 struct l2_hit *results, struct l2_abandon_stats *st, uint64_t *ns)
+{
+	struct timespec t0, t1;
+	doca_error_t result;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_search_submit(be, db, search, nq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_search_wait(be, search, results);
+	if (result != DOCA_SUCCESS)
+		return result;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*ns = diff_ns(t0, t1);
+	l2_search_abandon_stats(search, st);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Run the early-abandon sample: the same k-NN and radius searches with full distances, with
+ * early abandoning, and with early abandoning after reordering dimensions by variance; the
+ * results must be identical, the counters show the fraction of dimensions evaluated
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend that runs l2_search_kernel / l2_range_kernel
+ * @block [in]: dimensions summed between threshold checks
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t abandon_launch(struct dpa_resources *resources, enum l2_backend_type type, uint32_t block)
+{
+	const uint32_t dim = 128, db_size = 64 * 1024, nq = 32, k = 10, cap = 1024; // params
+	static const char *const names[] = {"full", "abandon", "abandon + reorder"};
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_size = (size_t)db_size * dim * sizeof(int32_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_db db;
+	struct l2_search search;
+	struct l2_range range;
+	struct l2_hit *ref = NULL, *hits = NULL;
+	struct l2_range_hit *rhits = NULL, *rref = NULL;
+	uint64_t *roffsets = NULL, *rref_offsets = NULL, radius_sq = 0, ns;
+	struct l2_abandon_stats st;
+	struct l2_range_stats rst;
+	uint32_t *perm = NULL;
+	int32_t *tmp = NULL;
+	double *raw = NULL, *scale = NULL;
+	uint64_t mismatches = 0;
+	doca_error_t result;
+
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(be, dim, db_size, &db);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+	result = l2_search_alloc(be, dim, nq, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+	result = l2_range_alloc(be, dim, nq, cap, &range);
+	if (result != DOCA_SUCCESS)
+		goto free_search;
+
+	ref = malloc((size_t)nq * k * sizeof(*ref));
+	hits = malloc((size_t)nq * k * sizeof(*hits));
+	rref = malloc((size_t)range.num_parts * cap * sizeof(*rref));
+	rhits = malloc((size_t)range.num_parts * cap * sizeof(*rhits));
+	rref_offsets = malloc((nq + 1) * sizeof(*rref_offsets));
+	roffsets = malloc((nq + 1) * sizeof(*roffsets));
+	perm = malloc(dim * sizeof(*perm));
+	tmp = malloc((size_t)db_size * dim * sizeof(*tmp));
+	raw = malloc((size_t)db_size * dim * sizeof(double));
+	scale = malloc(dim * sizeof(*scale));
+	if (ref == NULL || hits == NULL || rref == NULL || rhits == NULL || rref_offsets == NULL || roffsets == NULL ||
+	    perm == NULL || tmp == NULL || raw == NULL || scale == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+
+	/* 每维的幅度按几何级数衰减，再打乱到随机的维度上：方差大的维度不在前面 */
+	for (uint32_t j = 0; j < dim; j++)
+		scale[j] = 100.0 * pow(0.95, j);
+	for (uint32_t j = dim - 1; j > 0; j--) {
+		uint32_t r = (uint32_t)rand() % (j + 1);
+		double t = scale[j];
+
+		scale[j] = scale[r];
+		scale[r] = t;
+	}
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-scale[i % dim], scale[i % dim]);
+	q16_16_quantize_double(raw, db.vecs, (size_t)db_size * dim, 0);
+	/* query q 是库里某一行加小噪声，第 k 近的距离远小于随机两行的距离 */
+	for (uint32_t q = 0; q < nq; q++)
+		for (uint32_t j = 0; j < dim; j++)
+			raw[(size_t)q * dim + j] = raw[((size_t)q * 997 % db_size) * dim + j] +
+						   rand_double(-0.05, 0.05) * scale[j];
+	q16_16_quantize_double(raw, search.queries, (size_t)nq * dim, 0);
+	memcpy(range.queries, search.queries, (size_t)nq * dim * sizeof(int32_t));
+
+	printf("Early abandon (%s): %u queries x %u vectors, dim %u, k %u, check every %u dims\n",
+	       l2_backend_type_name(type), nq, db_size, dim, k, block);
+	for (int pass = 0; pass < 3; pass++) {
+		struct l2_hit *out = pass == 0 ? ref : hits;
+
+		if (pass == 2) {
+			/* 库和 query 用同一个排列，距离不变 */
+			result = l2_dim_order_compute(db.vecs, db_size, dim, perm);
+			if (result != DOCA_SUCCESS)
+				goto free_local;
+			l2_dim_order_apply(perm, db.vecs, tmp, db_size, dim);
+			memcpy(db.vecs, tmp, (size_t)db_size * dim * sizeof(int32_t));
+			l2_dim_order_apply(perm, range.queries, search.queries, nq, dim);
+		}
+		search.abandon_block = pass == 0 ? 0 : block;
+		result = abandon_pass(be, &db, &search, nq, out, &st, &ns);
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		if (pass != 0) {
+			for (uint64_t i = 0; i < (uint64_t)nq * k; i++)
+				mismatches += hits[i].id != ref[i].id || hits[i].dist != ref[i].dist;
+		}
+		if (st.candidates != 0)
+			printf("  k-NN %-18s %8.3f ms, %.1f%% of dims evaluated (%.1f of %u per candidate)\n", names[pass],
+			       ns / 1e6, 100.0 * st.dims / ((double)st.candidates * dim),
+			       (double)st.dims / st.candidates, dim);
+		else
+			printf("  k-NN %-18s %8.3f ms, all dims evaluated\n", names[pass], ns / 1e6);
+	}
+
+	/* 半径取所有 query 第 k 近距离的最大值，每个 query 至少 k 个命中 */
+	for (uint32_t q = 0; q < nq; q++)
+		if (ref[(uint64_t)q * k + k - 1].dist > radius_sq)
+			radius_sq = ref[(uint64_t)q * k + k - 1].dist;
+	memcpy(range.queries, search.queries, (size_t)nq * dim * sizeof(int32_t));
+	for (int pass = 0; pass < 2; pass++) {
+		struct timespec t0, t1;
+
+		range.abandon_block = pass == 0 ? 0 : block;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		result = l2_range_submit(be, &db, &range, nq, radius_sq);
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		result = l2_range_wait(be, &range, pass == 0 ? rref : rhits, pass == 0 ? rref_offsets : roffsets, &rst);
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (rst.dropped != 0)
+			DOCA_LOG_WARN("Range pass dropped %lu hits, raise cap", rst.dropped);
+		if (pass != 0) {
+			if (memcmp(roffsets, rref_offsets, (nq + 1) * sizeof(*roffsets)) != 0)
+				mismatches++;
+			else
+				for (uint64_t i = 0; i < roffsets[nq]; i++)
+					mismatches += rhits[i].id != rref[i].id || rhits[i].dist != rref[i].dist;
+		}
+		if (rst.abandon.candidates != 0)
+			printf("  range %-17s %8.3f ms, %lu hits, %.1f%% of dims evaluated\n", names[pass * 2],
+			       diff_ns(t0, t1) / 1e6, rst.hits, 100.0 * rst.abandon.dims / ((double)rst.abandon.candidates * dim));
+		else
+			printf("  range %-17s %8.3f ms, %lu hits, all dims evaluated\n", names[pass * 2],
+			       diff_ns(t0, t1) / 1e6, rst.hits);
+	}
+
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu results differ from the full-distance scan", mismatches);
+		result = DOCA_ERROR_UNEXPECTED;
+	} else {
+		printf("  all passes return identical results\n");
+	}
+
+free_local:
+	free(scale);
+	free(raw);
+	free(tmp);
+	free(perm);
+	free(roffsets);
+	free(rref_offsets);
+	free(rhits);
+	free(rref);
+	free(hits);
+	free(ref);
+	l2_range_free(be, &range);
+free_search:
+	l2_search_free(be, &search);
+free_db:
+	l2_db_free(be, &db);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run a query batch `iters` times on a shard group, mean wall time per batch in *ns
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t shards_time(struct l2_shards *shards, const int32_t *queries, uint32_t nq, uint32_t iters,
+				struct l2_hit *results, uint64_t *ns)
+{
+	struct timespec t0, t1;
+	doca_error_t result;
+
+	/* 第一轮只预热 */
+	result = l2_shards_search(shards, queries, nq, results);
+	if (result != DOCA_SUCCESS)
+		return result;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t i = 0; i < iters; i++) {
+		result = l2_shards_search(shards, queries, nq, results);
+		if (result != DOCA_SUCCESS)
+			return result;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*ns = diff_ns(t0, t1) / iters;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Run the sharding sample: the same database on one device and split over num_shards devices,
+ * k-NN and full-distance results checked against the single device, per-shard timing printed
+ *
+ * @type [in]: backend of every shard
+ * @dpa_cfg [in]: DPA parameters, the device name is replaced per shard
+ * @num_shards [in]: number of shards
+ * @devices [in]: comma-separated device per shard, empty to use default names (not for dpa)
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t shards_launch(enum l2_backend_type type, struct dpa_config *dpa_cfg, uint32_t num_shards,
+			   const char *devices)
+{
+	const uint32_t dim = 64, db_size = 64 * 1024, nq = 32, k = 10, iters = 3; // params
+	struct l2_shards_cfg cfg = {
+		.type = type,
+		.num_shards = 1,
+		.dpa = dpa_cfg,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+		.dim = dim,
+		.db_size = db_size,
+		.max_nq = nq,
+		.k = k,
+	};
+	struct l2_shard_stats shard_stats[L2_SHARD_MAX];
+	struct l2_shards_stats stats;
+	struct l2_shards *shards = NULL;
+	struct l2_hit *ref = NULL, *hits = NULL;
+	uint64_t *dist = NULL, one_ns = 0, n_ns = 0, mismatches = 0;
+	int32_t *vecs = NULL, *queries = NULL;
+	double *raw = NULL;
+	char list[PATH_MAX], *save = NULL, *name;
+	doca_error_t result;
+
+	if (devices[0] != '\0') {
+		uint32_t n = 0;
+
+		snprintf(list, sizeof(list), "%s", devices);
+		for (name = strtok_r(list, ",", &save); name != NULL && n < L2_SHARD_MAX; name = strtok_r(NULL, ",", &save))
+			cfg.devices[n++] = name;
+	} else if (type == L2_BACKEND_DPA) {
+		DOCA_LOG_ERR("DPA shards need device names, e.g. --shards mlx5_0,mlx5_1");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	vecs = malloc((size_t)db_size * dim * sizeof(*vecs));
+	queries = malloc((size_t)nq * dim * sizeof(*queries));
+	raw = malloc((size_t)db_size * dim * sizeof(*raw));
+	ref = malloc((size_t)nq * k * sizeof(*ref));
+	hits = malloc((size_t)nq * k * sizeof(*hits));
+	dist = malloc((size_t)db_size * sizeof(*dist));
+	if (vecs == NULL || queries == NULL || raw == NULL || ref == NULL || hits == NULL || dist == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, vecs, (size_t)db_size * dim, 0);
+	for (size_t i = 0; i < (size_t)nq * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, queries, (size_t)nq * dim, 0);
+
+	/* 基线：整个库放在第一个设备上 */
+	cfg.num_shards = 1;
+	result = l2_shards_open(&cfg, &shards);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	result = l2_shards_load(shards, vecs);
+	if (result == DOCA_SUCCESS)
+		result = shards_time(shards, queries, nq, iters, ref, &one_ns);
+	l2_shards_close(shards);
+	shards = NULL;
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+
+	cfg.num_shards = num_shards;
+	result = l2_shards_open(&cfg, &shards);
+	if (result != DOCA_SUCCESS)
+		goto free_local;
+	result = l2_shards_load(shards, vecs);
+	if (result != DOCA_SUCCESS)
+		goto close_shards;
+	result = shards_time(shards, queries, nq, iters, hits, &n_ns);
+	if (result != DOCA_SUCCESS)
+		goto close_shards;
+	for (uint64_t i = 0; i < (uint64_t)nq * k; i++)
+		mismatches += hits[i].id != ref[i].id || hits[i].dist != ref[i].dist;
+	l2_shards_get_stats(shards, shard_stats, &stats);
+
+	/* 拼接的距离按全局行号对上 */
+	result = l2_shards_distances(shards, queries, dist);
+	if (result != DOCA_SUCCESS)
+		goto close_shards;
+	for (uint32_t i = 0; i < db_size; i++)
+		mismatches += dist[i] != l2_sq_q16_16(queries, vecs + (size_t)i * dim, dim);
+
+	printf("Sharded search (%s): %u queries x %u vectors, dim %u, k %u\n", l2_backend_type_name(type), nq,
+	       db_size, dim, k);
+	printf("  1 shard:  %8.3f ms per batch\n", one_ns / 1e6);
+	printf("  %u shards: %8.3f ms per batch (%.2fx), merge %.3f ms per batch, last imbalance %.2f\n", num_shards,
+	       n_ns / 1e6, (double)one_ns / n_ns, stats.merge_ns / 1e6 / stats.batches, stats.imbalance);
+	for (uint32_t s = 0; s < num_shards; s++)
+		printf("    shard %2u %-12s rows [%u, %u)  mean %.3f ms  last %.3f ms\n", s, shard_stats[s].device,
+		       shard_stats[s].first, shard_stats[s].first + shard_stats[s].rows,
+		       shard_stats[s].busy_ns / 1e6 / shard_stats[s].batches, shard_stats[s].last_ns / 1e6);
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu sharded results differ from the single device", mismatches);
+		result = DOCA_ERROR_UNEXPECTED;
+	} else {
+		printf("  top-k and concatenated distances match the single device\n");
+	}
+
+close_shards:
+	l2_shards_close(shards);
+free_local:
+	free(dist);
+	free(hits);
+	free(ref);
+	free(raw);
+	free(queries);
+	free(vecs);
+	return result;
+}
+
+/*
+ * Run the filtered search sample: every row gets a random category, queries only want rows whose
+ * category falls in the first `selectivity` of the range; the filtered scan, gather-then-scan
+ * and the automatic choice are checked against a brute-force scan of the allowed rows
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend that runs l2_search_kernel / l2_ivf_kernel
+ * @selectivity [in]: fraction of rows that pass the filter, (0, 1]
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t filter_launch(struct dpa_resources *resources, enum l2_backend_type type, double selectivity)
+{
+	const uint32_t dim = 64, db_size = 256 * 1024, nq = 32, k = 10, categories = 1000; // params
+	static const char *const names[] = {"unfiltered scan", "filtered scan", "gather + scan", "auto"};
+	const double gather_below[] = {0, 0, 2.0, L2_FILTER_GATHER_DEFAULT};
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		/* 库 + gather 区最多一份库的拷贝 */
+		.arena_size = 2 * (size_t)db_size * dim * sizeof(int32_t) + (64UL << 20),
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_backend *be = NULL;
+	struct l2_db db;
+	struct l2_search search;
+	struct l2_filter filter;
+	struct l2_filter_stats st;
+	struct l2_hit *ref = NULL, *hits = NULL;
+	uint32_t *attrs = NULL, hi = (uint32_t)(selectivity * categories + 0.5);
+	uint64_t mismatches = 0;
+	double *raw = NULL;
+	struct timespec t0, t1;
+	doca_error_t result;
+
+	if (hi == 0)
+		hi = 1;
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(be, dim, db_size, &db);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+	result = l2_search_alloc(be, dim, nq, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+	/* gather 区按整个库分配，下面每一轮自己定走哪条路 */
+	result = l2_filter_alloc(be, &db, nq, 1.0, &filter);
+	if (result != DOCA_SUCCESS)
+		goto free_search;
+
+	ref = malloc((size_t)nq * k * sizeof(*ref));
+	hits = malloc((size_t)nq * k * sizeof(*hits));
+	attrs = malloc((size_t)db_size * sizeof(*attrs));
+	raw = malloc((size_t)db_size * dim * sizeof(*raw));
+	if (ref == NULL || hits == NULL || attrs == NULL || raw == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_local;
+	}
+	for (size_t i = 0; i < (size_t)db_size * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, db.vecs, (size_t)db_size * dim, 0);
+	for (size_t i = 0; i < (size_t)nq * dim; i++)
+		raw[i] = rand_double(-100.0, 100.0);
+	q16_16_quantize_double(raw, search.queries, (size_t)nq * dim, 0);
+	for (uint32_t i = 0; i < db_size; i++)
+		attrs[i] = (uint32_t)rand() % categories;
+
+	/* 允许 category < hi 的行 */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	l2_filter_from_attr(&filter, attrs, 0, hi - 1);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* 参考答案：host 上暴力扫允许的行 */
+	for (uint32_t q = 0; q < nq; q++) {
+		struct l2_hit *r = ref + (size_t)q * k;
+		uint32_t n = 0;
+
+		for (uint32_t i = 0; i < db_size; i++)
+			if (attrs[i] < hi)
+				l2_topk_push(r, &n, k, l2_sq_q16_16(search.queries + (size_t)q * dim,
+								     db.vecs + (size_t)i * dim, dim), i);
+		l2_topk_pad(r, n, k);
+		memcpy(hits, r, k * sizeof(*hits));
+		l2_topk_merge(hits, 1, k, r);
+	}
+
+	printf("Filtered search (%s): %u queries x %u vectors, dim %u, k %u, category < %u of %u\n",
+	       l2_backend_type_name(type), nq, db_size, dim, k, hi, categories);
+	printf("  bitmap built in %.3f ms, %lu rows allowed (%.2f%%)\n", diff_ns(t0, t1) / 1e6,
+	       l2_filter_count(&filter), 100.0 * l2_filter_count(&filter) / db_size);
+	for (int pass = 0; pass < 4; pass++) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (pass == 0) {
+			/* 对照：不带过滤扫全库，过滤只能事后做 */
+			result = l2_search_submit(be, &db, &search, nq);
+			if (result == DOCA_SUCCESS)
+				result = l2_search_wait(be, &search, hits);
+		} else {
+			filter.gather_below = gather_below[pass];
+			result = l2_filter_search(be, &db, &search, &filter, nq, hits, &st);
+		}
+		if (result != DOCA_SUCCESS)
+			goto free_local;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (pass == 0) {
+			printf("  %-16s %8.3f ms (top-k before filtering)\n", names[pass], diff_ns(t0, t1) / 1e6);
+			continue;
+		}
+		for (uint64_t i = 0; i < (uint64_t)nq * k; i++)
+			mismatches += hits[i].id != ref[i].id || hits[i].dist != ref[i].dist;
+		printf("  %-16s %8.3f ms (%s: gather %.3f ms, scan %.3f ms)\n", names[pass], diff_ns(t0, t1) / 1e6,
+		       st.gathered ? "gathered" : "bitmap scan", st.gather_ns / 1e6, st.scan_ns / 1e6);
+	}
+	if (mismatches != 0) {
+		DOCA_LOG_ERR("%lu filtered hits differ from the brute-force scan", mismatches);
+		result = DOCA_ERROR_UNEXPECTED;
+	} else {
+		printf("  filtered results match brute force\n");
+	}
+
+free_local:
+	free(raw);
+	free(attrs);
+	free(hits);
+	free(ref);
+	l2_filter_free(be, &filter);
+free_search:
+	l2_search_free(be, &search);
+free_db:
+	l2_db_free(be, &db);
+destroy_backend:
+	l2_backend_destroy(be);
+	return result;
+}
+
+/*
+ * Run k-NN search on a TEXMEX-format dataset: the base set is streamed from the
+ * mmap'ed file through two registered chunk buffers, recall is checked against
+ * the ground truth when one is given
+ *
+ * @resources [in]: DOCA DPA resources that the DPA sample will use, NULL for host-only backends
+ * @type [in]: backend that runs l2_search_kernel
+ * @base_path [in]: .fvecs / .bvecs base vectors
+ * @query_path [in]: query vectors, same format family and dim as the base
+ * @gt_path [in]: .ivecs ground truth, may be empty
+ * @min_recall [in]: fail when recall@k is below this, 0 = only report it
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t dataset_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			    const char *query_path, const char *gt_path, double min_recall)
+{
+	const uint32_t k = 10, chunk_vectors = 64 * 1024; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_vecs base, queries, gt = {0};
+	struct l2_vecs_search_stats stats;
+	struct l2_backend *be = NULL;
+	struct l2_hit *hits = NULL;
+	doca_error_t result;
+	double recall;
+
+	result = l2_vecs_open(base_path, &base);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_vecs_open(query_path, &queries);
+	if (result != DOCA_SUCCESS)
+		goto close_base;
+	if (gt_path[0] != '\0') {
+		result = l2_vecs_open(gt_path, &gt);
+		if (result != DOCA_SUCCESS)
+			goto close_queries;
+	}
+
+	/* 两块 chunk + search 的 query / parts 区 */
+	cfg.arena_size = 2 * (size_t)chunk_vectors * base.dim * sizeof(int32_t) + (64UL << 20);
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		goto close_gt;
+
+	hits = calloc(queries.count * k, sizeof(*hits));
+	if (hits == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto destroy_backend;
+	}
+
+	result = l2_vecs_search(be, &base, &queries, k, chunk_vectors, hits, &stats);
+	if (result != DOCA_SUCCESS)
+		goto free_hits;
+
+	for (uint32_t q = 0; q < queries.count && q < 4; q++)
+		printf("query %u: nearest id %u dist %.6f\n", q, hits[(size_t)q * k].id,
+		       sqrt((double)hits[(size_t)q * k].dist) / (double)(1u << 16));
+	printf("Dataset search (%s): %lu queries x %lu base vectors, dim %u, k = %u\n", l2_backend_type_name(type),
+	       queries.count, base.count, base.dim, k);
+	printf("  wall %.3f ms, %.1f QPS, %.3f G distances/s; %lu chunks, %lu launches, quantize %.3f ms, wait %.3f ms\n",
+	       stats.total_ns / 1e6, queries.count / (stats.total_ns / 1e9),
+	       (double)queries.count * base.count / stats.total_ns, stats.chunks, stats.launches,
+	       stats.quantize_ns / 1e6, stats.wait_ns / 1e6);
+	if (gt.count > 0) {
+		recall = l2_recall_at_k(hits, (uint32_t)queries.count, k, &gt);
+		if (recall < 0) {
+			DOCA_LOG_ERR("Ground truth %s does not cover %lu queries with %u neighbours", gt_path,
+				     queries.count, k);
+			result = DOCA_ERROR_INVALID_VALUE;
+		} else {
+			printf("  recall@%u: %.4f\n", k, recall);
+			if (recall < min_recall) {
+				DOCA_LOG_ERR("recall@%u %.4f is below the required %.4f", k, recall, min_recall);
+				result = DOCA_ERROR_UNEXPECTED;
+			}
+		}
+	}
+
+free_hits:
+	free(hits);
+destroy_backend:
+	l2_backend_destroy(be);
+close_gt:
+	l2_vecs_close(&gt);
+close_queries:
+	l2_vecs_close(&queries);
+close_base:
+	l2_vecs_close(&base);
+	return result;
+}
+
+/*
+ * Open an IVF index for base: with nlist train that many lists on base, build, and save to
+ * index_path when one was given; without nlist load the index saved at index_path
+ */
+static doca_error_t ivf_prepare(struct l2_backend *be, const struct l2_vecs *base, uint32_t nlist,
+				const char *index_path, struct l2_ivf *ivf)
+{
+	struct l2_ivf_train_cfg train = {.nlist = nlist};
+	int32_t *vecs = NULL, *centroids = NULL;
+	struct timespec t0, t1;
+	doca_error_t result;
+
+	if (nlist == 0) {
+		result = l2_ivf_load(be, index_path, ivf);
+		if (result != DOCA_SUCCESS)
+			return result;
+		if (ivf->dim != base->dim || ivf->ntotal != base->count) {
+			DOCA_LOG_ERR("Index %s holds %u vectors of dim %u, base has %lu of dim %u", index_path,
+				     ivf->ntotal, ivf->dim, base->count, base->dim);
+			l2_ivf_free(be, ivf);
+			return DOCA_ERROR_INVALID_VALUE;
+		}
+		printf("Loaded IVF index %s: %u lists over %u vectors\n", index_path, ivf->nlist, ivf->ntotal);
+		return DOCA_SUCCESS;
+	}
+
+	vecs = malloc(base->count * base->dim * sizeof(int32_t));
+	centroids = malloc((size_t)nlist * base->dim * sizeof(int32_t));
+	if (vecs == NULL || centroids == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto out;
+	}
+	result = l2_vecs_quantize(base, 0, (uint32_t)base->count, vecs, 0);
+	if (result != DOCA_SUCCESS)
+		goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_ivf_train(be, vecs, (uint32_t)base->count, base->dim, &train, centroids);
+	if (result != DOCA_SUCCESS)
+		goto out;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t train_ns = diff_ns(t0, t1);
+	result = l2_ivf_build(be, base->dim, nlist, centroids, vecs, (uint32_t)base->count, ivf);
+	if (result != DOCA_SUCCESS)
+		goto out;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	printf("Built IVF index: %u lists over %u vectors, train %.3f ms, build %.3f ms\n", nlist, ivf->ntotal,
+	       train_ns / 1e6, diff_ns(t1, t0) / 1e6);
+	if (index_path[0] != '\0') {
+		result = l2_ivf_save(ivf, index_path);
+		if (result != DOCA_SUCCESS)
+			l2_ivf_free(be, ivf);
+	}
+out:
+	free(centroids);
+	free(vecs);
+	return result;
+}
+
+/*
+ * Run the IVF sample: dataset search through an inverted-file index, swept over nprobe.
+ * An index that was just built and saved is loaded back and must return the same hits
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend for the coarse matrix and the list scan
+ * @base_path [in]: .fvecs / .bvecs base set
+ * @query_path [in]: query set of the same dim
+ * @gt_path [in]: .ivecs ground truth, may be empty
+ * @nlist [in]: lists to train, 0 = load the index at index_path
+ * @nprobe [in]: lists per query, 0 = sweep powers of two up to nlist / 4
+ * @index_path [in]: index file to save after training, or to load when nlist is 0; may be empty
+ * @min_recall [in]: fail when recall@k at the last nprobe is below this, 0 = only report it
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t ivf_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			const char *query_path, const char *gt_path, uint32_t nlist, uint32_t nprobe,
+			const char *index_path, double min_recall)
+{
+	const uint32_t k = 10, max_nq = 256; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_vecs base, queries, gt = {0};
+	struct l2_backend *be = NULL;
+	struct l2_ivf ivf, saved;
+	struct l2_ivf_search search, saved_search;
+	struct l2_hit *hits = NULL, *saved_hits = NULL;
+	/* 刚训练完存盘的 index 再读回来，同样的 query 必须得到同样的结果 */
+	const int reload = nlist > 0 && index_path[0] != '\0';
+	uint64_t mismatches = 0;
+	double recall = -1;
+	doca_error_t result;
+
+	result = l2_vecs_open(base_path, &base);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_vecs_open(query_path, &queries);
+	if (result != DOCA_SUCCESS)
+		goto close_base;
+	if (gt_path[0] != '\0') {
+		result = l2_vecs_open(gt_path, &gt);
+		if (result != DOCA_SUCCESS)
+			goto close_queries;
+	}
+	if (queries.dim != base.dim) {
+		DOCA_LOG_ERR("Queries have dim %u, base has %u", queries.dim, base.dim);
+		result = DOCA_ERROR_INVALID_VALUE;
+		goto close_gt;
+	}
+
+	/* 整个 base 常驻（读回来的 index 再一份）+ assignment / coarse 矩阵和 parts 区 */
+	cfg.arena_size = (reload ? 2 : 1) * (base.count * base.dim * sizeof(int32_t) + base.count * sizeof(uint32_t)) +
+			 (128UL << 20);
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		goto close_gt;
+	result = ivf_prepare(be, &base, nlist, index_path, &ivf);
+	if (result != DOCA_SUCCESS)
+		goto destroy_backend;
+	result = l2_ivf_search_alloc(be, &ivf, max_nq, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_ivf;
+	hits = calloc(queries.count * k, sizeof(*hits));
+	if (hits == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_search;
+	}
+	if (reload) {
+		result = l2_ivf_load(be, index_path, &saved);
+		if (result != DOCA_SUCCESS)
+			goto free_hits;
+		result = l2_ivf_search_alloc(be, &saved, max_nq, k, &saved_search);
+		if (result != DOCA_SUCCESS)
+			goto free_saved;
+		saved_hits = calloc(queries.count * k, sizeof(*saved_hits));
+		if (saved_hits == NULL) {
+			result = DOCA_ERROR_NO_MEMORY;
+			goto free_saved_search;
+		}
+	}
+
+	printf("IVF search (%s): %lu queries x %u base vectors, dim %u, k = %u, %u lists\n", l2_backend_type_name(type),
+	       queries.count, ivf.ntotal, ivf.dim, k, ivf.nlist);
+	/* 给了 --nprobe 就只跑这一个，否则 1, 2, 4, ... 一直到 nlist / 4 */
+	uint32_t last = nprobe != 0 ? (nprobe < ivf.nlist ? nprobe : ivf.nlist) : (ivf.nlist >= 4 ? ivf.nlist / 4 : 1);
+
+	for (uint32_t probe = nprobe != 0 ? last : 1; probe <= last; probe *= 2) {
+		struct l2_ivf_search_stats stats = {0};
+		struct timespec t0, t1;
+
+		recall = -1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (uint64_t first = 0; first < queries.count; first += max_nq) {
+			uint32_t nq = queries.count - first < max_nq ? (uint32_t)(queries.count - first) : max_nq;
+
+			result = l2_vecs_quantize(&queries, first, nq, search.queries, 1);
+			if (result == DOCA_SUCCESS)
+				result = l2_ivf_search(be, &ivf, &search, nq, probe, hits + first * k, &stats);
+			if (result != DOCA_SUCCESS)
+				goto free_saved_hits;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		uint64_t wall_ns = diff_ns(t0, t1);
+
+		/* 不计时：读回来的 index 跑同样的 query */
+		for (uint64_t first = 0; reload && first < queries.count; first += max_nq) {
+			uint32_t nq = queries.count - first < max_nq ? (uint32_t)(queries.count - first) : max_nq;
+
+			result = l2_vecs_quantize(&queries, first, nq, saved_search.queries, 1);
+			if (result == DOCA_SUCCESS)
+				result = l2_ivf_search(be, &saved, &saved_search, nq, probe, saved_hits + first * k, NULL);
+			if (result != DOCA_SUCCESS)
+				goto free_saved_hits;
+		}
+		for (uint64_t i = 0; reload && i < queries.count * k; i++)
+			mismatches += hits[i].id != saved_hits[i].id || hits[i].dist != saved_hits[i].dist;
+
+		if (gt.count > 0) {
+			recall = l2_recall_at_k(hits, (uint32_t)queries.count, k, &gt);
+			if (recall < 0) {
+				DOCA_LOG_ERR("Ground truth %s does not cover %lu queries with %u neighbours", gt_path,
+					     queries.count, k);
+				result = DOCA_ERROR_INVALID_VALUE;
+				goto free_saved_hits;
+			}
+		}
+		printf("  nprobe %4u: %.1f QPS, scanned %.2f%% of base, coarse %.3f ms, scan %.3f ms", probe,
+		       queries.count / (wall_ns / 1e9), 100.0 * stats.scanned / ((double)queries.count * ivf.ntotal),
+		       stats.coarse_ns / 1e6, stats.scan_ns / 1e6);
+		if (recall >= 0)
+			printf(", recall@%u %.4f", k, recall);
+		printf("\n");
+	}
+	if (reload && mismatches != 0) {
+		DOCA_LOG_ERR("%lu hits from the index reloaded from %s differ from the one just built", mismatches,
+			     index_path);
+		result = DOCA_ERROR_UNEXPECTED;
+	} else if (reload) {
+		printf("  index reloaded from %s returns the same hits\n", index_path);
+	}
+	if (recall >= 0 && recall < min_recall) {
+		DOCA_LOG_ERR("recall@%u %.4f at the last nprobe is below the required %.4f", k, recall, min_recall);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+free_saved_hits:
+	free(saved_hits);
+free_saved_search:
+	if (reload)
+		l2_ivf_search_free(be, &saved_search);
+free_saved:
+	if (reload)
+		l2_ivf_free(be, &saved);
+free_hits:
+	free(hits);
+free_search:
+	l2_ivf_search_free(be, &search);
+free_ivf:
+	l2_ivf_free(be, &ivf);
+destroy_backend:
+	l2_backend_destroy(be);
+close_gt:
+	l2_vecs_close(&gt);
+close_queries:
+	l2_vecs_close(&queries);
+close_base:
+	l2_vecs_close(&base);
+	return result;
+}
+
+/*
+ * Run the PQ sample: train m sub-codebooks on the base set, encode it to m-byte codes and
+ * search with ADC tables
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend for k-means, encoding and the code scan
+ * @base_path [in]: .fvecs / .bvecs base set
+ * @query_path [in]: query set of the same dim
+ * @gt_path [in]: .ivecs ground truth, may be empty
+ * @m [in]: subquantizers, must divide dim
+ * @min_recall [in]: fail when recall@k is below this, 0 = only report it
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t pq_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+		       const char *query_path, const char *gt_path, uint32_t m, double min_recall)
+{
+	const uint32_t k = 10, max_nq = 256; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_pq_train_cfg train = {.m = m};
+	struct l2_vecs base, queries, gt = {0};
+	struct l2_backend *be = NULL;
+	struct l2_pq pq;
+	struct l2_pq_codes codes;
+	struct l2_pq_search search;
+	struct l2_pq_search_stats stats = {0};
+	struct l2_hit *hits = NULL;
+	int32_t *vecs = NULL, *qvecs = NULL;
+	struct timespec t0, t1, t2;
+	double recall = -1;
+	doca_error_t result;
+
+	result = l2_vecs_open(base_path, &base);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_vecs_open(query_path, &queries);
+	if (result != DOCA_SUCCESS)
+		goto close_base;
+	if (gt_path[0] != '\0') {
+		result = l2_vecs_open(gt_path, &gt);
+		if (result != DOCA_SUCCESS)
+			goto close_queries;
+	}
+	if (queries.dim != base.dim) {
+		DOCA_LOG_ERR("Queries have dim %u, base has %u", queries.dim, base.dim);
+		result = DOCA_ERROR_INVALID_VALUE;
+		goto close_gt;
+	}
+
+	/* 只有 code 常驻 + assignment 矩阵、LUT 和 parts 区 */
+	cfg.arena_size = base.count * m + (128UL << 20);
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		goto close_gt;
+	vecs = malloc(base.count * base.dim * sizeof(int32_t));
+	qvecs = malloc((size_t)max_nq * base.dim * sizeof(int32_t));
+	hits = calloc(queries.count * k, sizeof(*hits));
+	if (vecs == NULL || qvecs == NULL || hits == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_host;
+	}
+	result = l2_vecs_quantize(&base, 0, (uint32_t)base.count, vecs, 0);
+	if (result != DOCA_SUCCESS)
+		goto free_host;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_pq_train(be, vecs, (uint32_t)base.count, base.dim, &train, &pq);
+	if (result != DOCA_SUCCESS)
+		goto free_host;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	result = l2_pq_encode(be, &pq, vecs, (uint32_t)base.count, &codes);
+	if (result != DOCA_SUCCESS)
+		goto free_pq;
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	printf("PQ (%s): %lu vectors, dim %u -> %u-byte codes (%.0fx smaller), train %.3f ms, encode %.3f ms\n",
+	       l2_backend_type_name(type), base.count, base.dim, m, (double)base.dim * sizeof(int32_t) / m,
+	       diff_ns(t0, t1) / 1e6, diff_ns(t1, t2) / 1e6);
+
+	result = l2_pq_search_alloc(be, &pq, max_nq, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_codes;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint64_t first = 0; first < queries.count; first += max_nq) {
+		uint32_t nq = queries.count - first < max_nq ? (uint32_t)(queries.count - first) : max_nq;
+
+		result = l2_vecs_quantize(&queries, first, nq, qvecs, 1);
+		if (result == DOCA_SUCCESS)
+			result = l2_pq_search(be, &pq, &codes, &search, qvecs, nq, hits + first * k, &stats);
+		if (result != DOCA_SUCCESS)
+			goto free_search;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (gt.count > 0) {
+		recall = l2_recall_at_k(hits, (uint32_t)queries.count, k, &gt);
+		if (recall < 0) {
+			DOCA_LOG_ERR("Ground truth %s does not cover %lu queries with %u neighbours", gt_path,
+				     queries.count, k);
+			result = DOCA_ERROR_INVALID_VALUE;
+			goto free_search;
+		}
+	}
+	printf("  ADC search: %lu queries, %.1f QPS, %.1f MB of codes per query, tables %.3f ms, scan %.3f ms",
+	       queries.count, queries.count / (diff_ns(t0, t1) / 1e9), (double)base.count * m / 1e6,
+	       stats.lut_ns / 1e6, stats.scan_ns / 1e6);
+	if (recall >= 0)
+		printf(", recall@%u %.4f", k, recall);
+	printf("\n");
+	if (recall >= 0 && recall < min_recall) {
+		DOCA_LOG_ERR("recall@%u %.4f is below the required %.4f", k, recall, min_recall);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+free_search:
+	l2_pq_search_free(be, &search);
+free_codes:
+	l2_pq_codes_free(be, &codes);
+free_pq:
+	l2_pq_free(&pq);
+free_host:
+	free(hits);
+	free(qvecs);
+	free(vecs);
+	l2_backend_destroy(be);
+close_gt:
+	l2_vecs_close(&gt);
+close_queries:
+	l2_vecs_close(&queries);
+close_base:
+	l2_vecs_close(&base);
+	return result;
+}
+
+/*
+ * Run the binary code sample: encode the base set to 1 bit per dimension, search it with a
+ * Hamming prefilter plus exact re-rank, and compare against an exact scan of the same queries
+ *
+ * @resources [in]: DOCA DPA resources, NULL for host-only backends
+ * @type [in]: backend for the Hamming scan, the re-rank and the exact reference scan
+ * @base_path [in]: .fvecs / .bvecs base set
+ * @query_path [in]: query set of the same dim
+ * @gt_path [in]: .ivecs ground truth, may be empty
+ * @rerank [in]: Hamming candidates re-ranked per query
+ * @min_recall [in]: fail when recall@k against gt_path is below this, 0 = only report it
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t bin_launch(struct dpa_resources *resources, enum l2_backend_type type, const char *base_path,
+			const char *query_path, const char *gt_path, uint32_t rerank, double min_recall)
+{
+	const uint32_t k = 10, max_nq = 64, chunk_vectors = 64 * 1024; // params
+	struct l2_backend_cfg cfg = {
+		.type = type,
+		.resources = resources,
+		.num_threads = 64,
+		.arena_page = DPA_ARENA_PAGE_2M,
+	};
+	struct l2_vecs base, queries, gt = {0};
+	struct l2_backend *be = NULL;
+	struct l2_bin bin;
+	struct l2_bin_codes codes;
+	struct l2_bin_search search;
+	struct l2_bin_search_stats stats = {0};
+	struct l2_vecs_search_stats exact_stats;
+	struct l2_hit *hits = NULL, *exact = NULL;
+	int32_t *vecs = NULL, *qvecs = NULL;
+	struct timespec t0, t1, t2;
+	double recall;
+	doca_error_t result;
+
+	result = l2_vecs_open(base_path, &base);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_vecs_open(query_path, &queries);
+	if (result != DOCA_SUCCESS)
+		goto close_base;
+	if (gt_path[0] != '\0') {
+		result = l2_vecs_open(gt_path, &gt);
+		if (result != DOCA_SUCCESS)
+			goto close_queries;
+	}
+	if (queries.dim != base.dim) {
+		DOCA_LOG_ERR("Queries have dim %u, base has %u", queries.dim, base.dim);
+		result = DOCA_ERROR_INVALID_VALUE;
+		goto close_gt;
+	}
+
+	/* code 常驻 + 重排区 + 精确对照扫描的两块 chunk */
+	cfg.arena_size = base.count * L2_BIN_WORDS(base.dim) * sizeof(uint32_t) +
+			 (size_t)max_nq * rerank * (base.dim + 1) * sizeof(int32_t) +
+			 2 * (size_t)chunk_vectors * base.dim * sizeof(int32_t) + (64UL << 20);
+	result = l2_backend_create(&cfg, &be);
+	if (result != DOCA_SUCCESS)
+		goto close_gt;
+	vecs = malloc(base.count * base.dim * sizeof(int32_t));
+	qvecs = malloc((size_t)max_nq * base.dim * sizeof(int32_t));
+	hits = calloc(queries.count * k, sizeof(*hits));
+	exact = calloc(queries.count * k, sizeof(*exact));
+	if (vecs == NULL || qvecs == NULL || hits == NULL || exact == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_host;
+	}
+	result = l2_vecs_quantize(&base, 0, (uint32_t)base.count, vecs, 0);
+	if (result != DOCA_SUCCESS)
+		goto free_host;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	result = l2_bin_train(vecs, (uint32_t)base.count, base.dim, &bin);
+	if (result != DOCA_SUCCESS)
+		goto free_host;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	result = l2_bin_encode(be, &bin, vecs, (uint32_t)base.count, &codes);
+	if (result != DOCA_SUCCESS)
+		goto free_bin;
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	printf("Binary codes (%s): %lu vectors, dim %u -> %u-byte codes (%.0fx smaller), train %.3f ms, encode %.3f ms\n",
+	       l2_backend_type_name(type), base.count, base.dim, bin.words * (uint32_t)sizeof(uint32_t),
+	       (double)base.dim / bin.words, diff_ns(t0, t1) / 1e6, diff_ns(t1, t2) / 1e6);
+
+	result = l2_bin_search_alloc(be, &bin, max_nq, k, rerank, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_codes;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint64_t first = 0; first < queries.count; first += max_nq) {
+		uint32_t nq = queries.count - first < max_nq ? (uint32_t)(queries.count - first) : max_nq;
+
+		result = l2_vecs_quantize(&queries, first, nq, qvecs, 1);
+		if (result == DOCA_SUCCESS)
+			result = l2_bin_search(be, &bin, &codes, vecs, &search, qvecs, nq, hits + first * k, &stats);
+		if (result != DOCA_SUCCESS)
+			goto free_search;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* 对照：同一个 backend 上的全精度扫描 */
+	result = l2_vecs_search(be, &base, &queries, k, chunk_vectors, exact, &exact_stats);
+	if (result != DOCA_SUCCESS)
+		goto free_search;
+
+	printf("  Hamming + re-rank %u: %lu queries, %.1f QPS, %.2f MB of codes per query, scan %.3f ms, gather %.3f ms, re-rank %.3f ms\n",
+	       rerank, queries.count, queries.count / (diff_ns(t0, t1) / 1e9),
+	       (double)base.count * bin.words * sizeof(uint32_t) / 1e6, stats.scan_ns / 1e6, stats.gather_ns / 1e6,
+	       stats.rerank_ns / 1e6);
+	printf("  exact scan: %.1f QPS, %.2f MB per query; recall@%u vs exact %.4f",
+	       queries.count / (exact_stats.total_ns / 1e9), (double)base.count * base.dim * sizeof(int32_t) / 1e6, k,
+	       l2_recall_vs_exact(hits, exact, (uint32_t)queries.count, k));
+	if (gt.count > 0) {
+		recall = l2_recall_at_k(hits, (uint32_t)queries.count, k, &gt);
+		if (recall < 0) {
+			printf("\n");
+			DOCA_LOG_ERR("Ground truth %s does not cover %lu queries with %u neighbours", gt_path,
+				     queries.count, k);
+			result = DOCA_ERROR_INVALID_VALUE;
+			goto free_search;
+		}
+		printf(", recall@%u vs ground truth %.4f", k, recall);
+	}
+	printf("\n");
+	if (gt.count > 0 && recall < min_recall) {
+		DOCA_LOG_ERR("recall@%u %.4f is below the required %.4f", k, recall, min_recall);
+		result = DOCA_ERROR_UNEXPECTED;
+	}
+
+free_search:
+	l2_bin_search_free(be, &search);
+free_codes:
+	l2_bin_codes_free(be, &codes);
+free_bin:
+	l2_bin_free(&bin);
+free_host:
+	free(exact);
+	free(hits);
+	free(qvecs);
+	free(vecs);
+	l2_backend_destroy(be);
+close_gt:
+	l2_vecs_close(&gt);
+close_queries:
+	l2_vecs_close(&queries);
+close_base:
+	l2_vecs_close(&base);
 	return result;
 }
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <doca_log.h>
+
+#include "../include/l2_argp.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::ARGP);
+
+/*
+ * Create and register one ARGP parameter
+ *
+ * @p [in]: parameter description
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t register_param(const struct l2_argp_param *p)
+{
+	struct doca_argp_param *param;
+	doca_error_t result;
+
+	result = doca_argp_param_create(&param);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_error_get_descr(result));
+		return result;
+	}
+	if (p->short_name != NULL)
+		doca_argp_param_set_short_name(param, p->short_name);
+	doca_argp_param_set_long_name(param, p->long_name);
+	if (p->arguments != NULL)
+		doca_argp_param_set_arguments(param, p->arguments);
+	doca_argp_param_set_description(param, p->description);
+	doca_argp_param_set_callback(param, p->cb);
+	doca_argp_param_set_type(param, p->type);
+	result = doca_argp_register_param(param);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to register program param %s: %s", p->long_name, doca_error_get_descr(result));
+	return result;
+}
+
+doca_error_t l2_argp_register(const struct l2_argp_param *params, size_t count)
+{
+	doca_error_t result;
+
+	for (size_t i = 0; i < count; i++) {
+		result = register_param(&params[i]);
+		if (result != DOCA_SUCCESS)
+			return result;
+	}
+	return DOCA_SUCCESS;
+}
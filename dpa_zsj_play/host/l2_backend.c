@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_backend.h"
+#include "../include/dpa_emu.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::BACKEND);
+
+static const struct l2_backend_ops *const backend_ops[L2_BACKEND_MAX] = {
+	[L2_BACKEND_DPA] = &l2_backend_dpa_ops,
+	[L2_BACKEND_CPU] = &l2_backend_cpu_ops,
+	[L2_BACKEND_EMU] = &l2_backend_emu_ops,
+	[L2_BACKEND_HOST] = &l2_backend_host_ops,
+};
+
+static const char *const backend_names[L2_BACKEND_MAX] = {
+	[L2_BACKEND_DPA] = "dpa",
+	[L2_BACKEND_CPU] = "cpu",
+	[L2_BACKEND_EMU] = "emu",
+	[L2_BACKEND_HOST] = "host",
+};
+
+#ifdef ZSJ_TRACE
+static const char *const launch_span_names[L2_KERNEL_MAX] = {
+	[L2_KERNEL_SINGLE] = "launch.single",
+	[L2_KERNEL_BATCH] = "launch.batch",
+	[L2_KERNEL_SEARCH] = "launch.search",
+	[L2_KERNEL_BATCH_BLOCKED] = "launch.batch_blocked",
+	[L2_KERNEL_MATRIX] = "launch.matrix",
+	[L2_KERNEL_IVF] = "launch.ivf",
+	[L2_KERNEL_PQ] = "launch.pq",
+	[L2_KERNEL_QBATCH] = "launch.qbatch",
+	[L2_KERNEL_HAMMING] = "launch.hamming",
+	[L2_KERNEL_RANGE] = "launch.range",
+};
+#endif
+
+enum l2_backend_type l2_backend_type_from_name(const char *name)
+{
+	for (int i = 0; i < L2_BACKEND_MAX; i++) {
+		if (strcmp(name, backend_names[i]) == 0)
+			return (enum l2_backend_type)i;
+	}
+	return L2_BACKEND_MAX;
+}
+
+const char *l2_backend_type_name(enum l2_backend_type type)
+{
+	return type < L2_BACKEND_MAX ? backend_names[type] : "unknown";
+}
+
+doca_error_t l2_backend_create(const struct l2_backend_cfg *cfg, struct l2_backend **be)
+{
+	struct l2_backend *b;
+	doca_error_t result;
+	L2_TRACE_SCOPE("backend.create");
+
+	if (cfg->type >= L2_BACKEND_MAX || cfg->num_threads == 0) {
+		DOCA_LOG_ERR("Invalid backend configuration");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (b == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	b->ops = backend_ops[cfg->type];
+	b->cfg = *cfg;
+	if (b->cfg.arena_size == 0)
+		b->cfg.arena_size = L2_ARENA_DEFAULT_SIZE;
+
+	result = b->ops->init(b);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to init %s backend: %s", b->ops->name, doca_error_get_descr(result));
+		free(b);
+		return result;
+	}
+
+	/* 注册一次，之后所有 batch 都从 arena 里切 */
+	struct dpa_arena_cfg arena_cfg = {
+		.size = b->cfg.arena_size,
+		.page = b->cfg.arena_page,
+	};
+
+	if (b->ops->arena_reg != NULL)
+		b->ops->arena_reg(b, &arena_cfg.reg);
+	result = dpa_arena_create(&arena_cfg, &b->arena);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create %s backend arena: %s", b->ops->name, doca_error_get_descr(result));
+		b->ops->fini(b);
+		free(b);
+		return result;
+	}
+#ifdef ZSJ_TRACE
+	pthread_mutex_init(&b->trace_lock, NULL);
+#endif
+	*be = b;
+	return DOCA_SUCCESS;
+}
+
+void l2_backend_destroy(struct l2_backend *be)
+{
+	if (be == NULL)
+		return;
+	if (be->launched > 0)
+		(void)be->ops->wait(be, be->launched);
+	dpa_arena_destroy(be->arena);
+	be->ops->fini(be);
+#ifdef ZSJ_TRACE
+	pthread_mutex_destroy(&be->trace_lock);
+#endif
+	free(be);
+}
+
+doca_error_t l2_backend_mem_alloc(struct l2_backend *be, size_t len, struct dpa_region *mem)
+{
+	memset(mem, 0, sizeof(*mem));
+	return dpa_arena_alloc(be->arena, len, mem);
+}
+
+void l2_backend_mem_touch(struct l2_backend *be, void *addr, size_t len)
+{
+	if (be->ops->mem_touch != NULL) {
+		L2_TRACE_BEGIN(t0);
+		be->ops->mem_touch(be, addr, len);
+		L2_TRACE_END(t0, "mem.first_touch", len);
+	}
+}
+
+void l2_backend_mem_free(struct l2_backend *be, struct dpa_region *mem)
+{
+	dpa_arena_free(be->arena, mem);
+}
+
+enum l2_variant l2_backend_variant(const struct l2_backend *be, enum l2_kernel_id kernel, const void *args)
+{
+	uint32_t dim;
+
+	if (be->cfg.generic_kernels)
+		return L2_VARIANT_GENERIC;
+
+	switch (kernel) {
+	case L2_KERNEL_BATCH:
+		dim = ((const struct l2_batch_args *)args)->dim;
+		break;
+	case L2_KERNEL_SEARCH:
+		dim = ((const struct l2_search_args *)args)->dim;
+		break;
+	default:
+		/* single 只算一对向量，不值得特化 */
+		return L2_VARIANT_GENERIC;
+	}
+	return l2_variant_select(dim, L2_METRIC_L2SQ, L2_ELEM_Q16_16);
+}
+
+doca_error_t l2_backend_launch_after(struct l2_backend *be, enum l2_kernel_id kernel, const void *args,
+				     struct l2_event *wait_event, uint64_t wait_thresh, uint64_t *seq)
+{
+	doca_error_t result;
+
+	if (kernel >= L2_KERNEL_MAX)
+		return DOCA_ERROR_INVALID_VALUE;
+
+	/* inline backend（cpu / host）的 launch 里就把 kernel 跑完了，span 包含计算 */
+	L2_TRACE_BEGIN(t0);
+	result = be->ops->launch(be, kernel, l2_backend_variant(be, kernel, args), args, wait_event, wait_thresh,
+				 be->launched + 1);
+	if (result != DOCA_SUCCESS)
+		return result;
+	be->launched++;
+#ifdef ZSJ_TRACE
+	pthread_mutex_lock(&be->trace_lock);
+	be->trace_launch_ns[be->launched % L2_TRACE_INFLIGHT] = l2_trace_now();
+	be->trace_launched = be->launched;
+	pthread_mutex_unlock(&be->trace_lock);
+#endif
+	L2_TRACE_END(t0, launch_span_names[kernel], 0);
+	if (seq != NULL)
+		*seq = be->launched;
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_backend_launch(struct l2_backend *be, enum l2_kernel_id kernel, const void *args, uint64_t *seq)
+{
+	return l2_backend_launch_after(be, kernel, args, NULL, 0, seq);
+}
+
+doca_error_t l2_event_create(struct l2_backend *be, struct l2_event **event)
+{
+	return be->ops->event_create(be, event);
+}
+
+void l2_event_destroy(struct l2_backend *be, struct l2_event *event)
+{
+	if (event != NULL)
+		be->ops->event_destroy(be, event);
+}
+
+doca_error_t l2_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value)
+{
+	return be->ops->event_set(be, event, value);
+}
+
+doca_error_t l2_inline_event_create(struct l2_backend *be, struct l2_event **event)
+{
+	(void)be;
+	return dpa_emu_event_create((struct dpa_emu_event **)event);
+}
+
+void l2_inline_event_destroy(struct l2_backend *be, struct l2_event *event)
+{
+	(void)be;
+	dpa_emu_event_destroy((struct dpa_emu_event *)event);
+}
+
+doca_error_t l2_inline_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value)
+{
+	(void)be;
+	dpa_emu_event_update_set((struct dpa_emu_event *)event, value);
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_inline_check_wait(struct l2_event *wait_event, uint64_t wait_thresh)
+{
+	if (wait_event == NULL || dpa_emu_event_get((struct dpa_emu_event *)wait_event) > wait_thresh)
+		return DOCA_SUCCESS;
+	DOCA_LOG_ERR("Inline backend cannot defer a launch until its wait event exceeds %lu", wait_thresh);
+	return DOCA_ERROR_BAD_STATE;
+}
+
+int l2_backend_poll(struct l2_backend *be, uint64_t seq)
+{
+	if (seq == 0)
+		return 1;
+	if (be->ops->poll != NULL && !be->ops->poll(be, seq))
+		return 0;
+#ifdef ZSJ_TRACE
+	l2_backend_trace_completed(be, seq);
+#endif
+	return 1;
+}
+
+#ifdef ZSJ_TRACE
+void l2_backend_trace_completed(struct l2_backend *be, uint64_t seq)
+{
+	uint64_t t1 = l2_trace_now();
+	uint64_t first;
+
+	pthread_mutex_lock(&be->trace_lock);
+	if (seq <= be->trace_waited) {
+		pthread_mutex_unlock(&be->trace_lock);
+		return;
+	}
+	first = be->trace_waited + 1;
+	if (be->trace_launched > L2_TRACE_INFLIGHT && first <= be->trace_launched - L2_TRACE_INFLIGHT)
+		first = be->trace_launched - L2_TRACE_INFLIGHT + 1;
+	for (uint64_t s = first; s <= seq; s++)
+		l2_trace_async("inflight", be->trace_launch_ns[s % L2_TRACE_INFLIGHT], t1, s);
+	be->trace_waited = seq;
+	pthread_mutex_unlock(&be->trace_lock);
+}
+#endif
+
+doca_error_t l2_backend_wait(struct l2_backend *be, uint64_t seq)
+{
+	doca_error_t result;
+
+	if (seq == 0 || seq > be->launched)
+		return DOCA_ERROR_INVALID_VALUE;
+	L2_TRACE_BEGIN(t0);
+	result = be->ops->wait(be, seq);
+	L2_TRACE_END(t0, "wait", 0);
+#ifdef ZSJ_TRACE
+	if (result == DOCA_SUCCESS)
+		l2_backend_trace_completed(be, seq);
+#endif
+	return result;
+}
+
+doca_error_t l2_batch_alloc(struct l2_backend *be, uint32_t dim, uint32_t batch_size, struct l2_batch *batch)
+{
+	return l2_batch_alloc_layout(be, dim, batch_size, L2_LAYOUT_AOS, batch);
+}
+
+doca_error_t l2_batch_alloc_layout(struct l2_backend *be, uint32_t dim, uint32_t batch_size, enum l2_layout layout,
+				   struct l2_batch *batch)
+{
+	/* blocked 时最后一个 block 补齐到 16 个向量 */
+	size_t vec_bytes = l2_layout_vec_bytes(layout, dim, batch_size);
+	size_t total_bytes = 2 * vec_bytes + (size_t)batch_size * sizeof(uint64_t);
+	doca_error_t result;
+
+	memset(batch, 0, sizeof(*batch));
+	result = l2_backend_mem_alloc(be, total_bytes, &batch->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* 布局: [a: batch*dim][b: batch*dim][out: batch]，blocked 时 a / b 各自补齐 */
+	batch->a = (int32_t *)batch->mem.addr;
+	batch->b = (int32_t *)((uint8_t *)batch->mem.addr + vec_bytes);
+	batch->out = (uint64_t *)((uint8_t *)batch->mem.addr + 2 * vec_bytes);
+	/* 三段分别按 pair 下标切给 worker */
+	l2_backend_mem_touch(be, batch->a, vec_bytes);
+	l2_backend_mem_touch(be, batch->b, vec_bytes);
+	l2_backend_mem_touch(be, batch->out, (size_t)batch_size * sizeof(uint64_t));
+	batch->dim = dim;
+	batch->frac_bits = 16;
+	batch->batch_size = batch_size;
+	batch->layout = layout;
+	batch->elem = L2_ELEM_Q16_16;
+	batch->row_bytes = dim * sizeof(int32_t);
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_batch_alloc_elem(struct l2_backend *be, uint32_t dim, uint32_t batch_size, enum l2_elem elem,
+				 struct l2_batch *batch)
+{
+	uint32_t row_bytes = l2_elem_row_bytes(elem, dim);
+	size_t vec_bytes = ((size_t)batch_size * row_bytes + 63) & ~(size_t)63;
+	doca_error_t result;
+
+	if (elem == L2_ELEM_Q16_16)
+		return l2_batch_alloc_layout(be, dim, batch_size, L2_LAYOUT_AOS, batch);
+	memset(batch, 0, sizeof(*batch));
+	if (row_bytes == 0) {
+		DOCA_LOG_ERR("Unknown element format %d", elem);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	result = l2_backend_mem_alloc(be, 2 * vec_bytes + (size_t)batch_size * sizeof(uint64_t), &batch->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* 和 Q16.16 一样是 [a][b][out]，只是每行变成 header + code */
+	batch->a = (int32_t *)batch->mem.addr;
+	batch->b = (int32_t *)((uint8_t *)batch->mem.addr + vec_bytes);
+	batch->out = (uint64_t *)((uint8_t *)batch->mem.addr + 2 * vec_bytes);
+	l2_backend_mem_touch(be, batch->a, vec_bytes);
+	l2_backend_mem_touch(be, batch->b, vec_bytes);
+	l2_backend_mem_touch(be, batch->out, (size_t)batch_size * sizeof(uint64_t));
+	batch->dim = dim;
+	batch->frac_bits = 16;
+	batch->batch_size = batch_size;
+	batch->layout = L2_LAYOUT_AOS;
+	batch->elem = elem;
+	batch->row_bytes = row_bytes;
+	return DOCA_SUCCESS;
+}
+
+void l2_batch_free(struct l2_backend *be, struct l2_batch *batch)
+{
+	l2_backend_mem_free(be, &batch->mem);
+	memset(batch, 0, sizeof(*batch));
+}
+
+void l2_batch_fill_args(const struct l2_batch *batch, uint32_t first, uint32_t count, struct l2_batch_args *args)
+{
+	args->handle = batch->mem.handle;
+	args->a_base = (uint64_t)(uintptr_t)(batch->a + (size_t)first * batch->dim);
+	args->b_base = (uint64_t)(uintptr_t)(batch->b + (size_t)first * batch->dim);
+	args->out_base = (uint64_t)(uintptr_t)(batch->out + first);
+	args->a_stride = batch->dim * sizeof(int32_t);
+	args->b_stride = batch->dim * sizeof(int32_t);
+	args->out_stride = sizeof(uint64_t);
+	args->dim = batch->dim;
+	args->frac_bits = batch->frac_bits;
+	args->batch_size = count;
+}
+
+void l2_batch_fill_blocked_args(const struct l2_batch *batch, struct l2_batch_blocked_args *args)
+{
+	args->handle = batch->mem.handle;
+	args->a_base = (uint64_t)(uintptr_t)batch->a;
+	args->b_base = (uint64_t)(uintptr_t)batch->b;
+	args->out_base = (uint64_t)(uintptr_t)batch->out;
+	args->dim = batch->dim;
+	args->frac_bits = batch->frac_bits;
+	args->batch_size = batch->batch_size;
+}
+
+void l2_batch_fill_qargs(const struct l2_batch *batch, uint32_t first, uint32_t count, struct l2_qbatch_args *args)
+{
+	args->handle = batch->mem.handle;
+	args->a_base = (uint64_t)(uintptr_t)batch->a + (uint64_t)first * batch->row_bytes;
+	args->b_base = (uint64_t)(uintptr_t)batch->b + (uint64_t)first * batch->row_bytes;
+	args->out_base = (uint64_t)(uintptr_t)(batch->out + first);
+	args->a_stride = batch->row_bytes;
+	args->b_stride = batch->row_bytes;
+	args->out_stride = sizeof(uint64_t);
+	args->dim = batch->dim;
+	args->frac_bits = batch->frac_bits;
+	args->batch_size = count;
+	args->elem = l2_elem_qelem(batch->elem);
+}
+
+doca_error_t l2_batch_submit(struct l2_backend *be, struct l2_batch *batch)
+{
+	struct l2_batch_args args;
+	struct l2_batch_blocked_args blocked;
+	struct l2_qbatch_args qargs;
+
+	if (batch->elem != L2_ELEM_Q16_16) {
+		l2_batch_fill_qargs(batch, 0, batch->batch_size, &qargs);
+		return l2_backend_launch(be, L2_KERNEL_QBATCH, &qargs, &batch->seq);
+	}
+	if (batch->layout == L2_LAYOUT_BLOCKED) {
+		l2_batch_fill_blocked_args(batch, &blocked);
+		return l2_backend_launch(be, L2_KERNEL_BATCH_BLOCKED, &blocked, &batch->seq);
+	}
+	l2_batch_fill_args(batch, 0, batch->batch_size, &args);
+	return l2_backend_launch(be, L2_KERNEL_BATCH, &args, &batch->seq);
+}
+
+doca_error_t l2_batch_wait(struct l2_backend *be, struct l2_batch *batch)
+{
+	return l2_backend_wait(be, batch->seq);
+}
@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_backend.h"
+#include "../include/l2_filter.h"
+#include "../include/l2_qvec.h"
+#include "../include/l2_topk.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::CPU);
+
+/* Scalar reference for l2_single_kernel */
+void l2_cpu_single(const struct l2_single_dist_args *args)
+{
+	const int32_t *a = (const int32_t *)(uintptr_t)args->a_offset;
+	const int32_t *b = (const int32_t *)(uintptr_t)args->b_offset;
+	int64_t dist = 0;
+
+	for (uint32_t i = 0; i < args->dim; ++i) {
+		int64_t da = (int64_t)a[i] - (int64_t)b[i];
+		dist += da * da;
+	}
+	*(uint64_t *)(uintptr_t)args->out_offset = (uint64_t)dist; // 2Q(2q)
+}
+
+/* Scalar reference for l2_batch_kernel, one host thread */
+void l2_cpu_batch(const struct l2_batch_args *args)
+{
+	for (uint32_t idx = 0; idx < args->batch_size; ++idx) {
+		const int32_t *a = (const int32_t *)(uintptr_t)(args->a_base + (uint64_t)idx * args->a_stride);
+		const int32_t *b = (const int32_t *)(uintptr_t)(args->b_base + (uint64_t)idx * args->b_stride);
+		uint64_t *out = (uint64_t *)(uintptr_t)(args->out_base + (uint64_t)idx * args->out_stride);
+		int64_t dist = 0;
+
+		for (uint32_t i = 0; i < args->dim; ++i) {
+			int64_t da = (int64_t)a[i] - (int64_t)b[i];
+			dist += da * da;
+		}
+		*out = (uint64_t)dist;
+	}
+}
+
+/*
+ * Scalar reference for l2_qbatch_kernel: dequantizes every element and squares the
+ * difference, so header sum / norm written by the quantizer are checked too
+ */
+void l2_cpu_qbatch(const struct l2_qbatch_args *args)
+{
+	for (uint32_t idx = 0; idx < args->batch_size; ++idx) {
+		const struct l2_qvec_hdr *a =
+			(const struct l2_qvec_hdr *)(uintptr_t)(args->a_base + (uint64_t)idx * args->a_stride);
+		const struct l2_qvec_hdr *b =
+			(const struct l2_qvec_hdr *)(uintptr_t)(args->b_base + (uint64_t)idx * args->b_stride);
+		uint64_t *out = (uint64_t *)(uintptr_t)(args->out_base + (uint64_t)idx * args->out_stride);
+		uint64_t dist = 0;
+
+		for (uint32_t i = 0; i < args->dim; ++i) {
+			int64_t qa = args->elem == L2_QELEM_I8 ? ((const int8_t *)l2_qvec_codes(a))[i] :
+								 ((const int16_t *)l2_qvec_codes(a))[i];
+			int64_t qb = args->elem == L2_QELEM_I8 ? ((const int8_t *)l2_qvec_codes(b))[i] :
+								 ((const int16_t *)l2_qvec_codes(b))[i];
+			uint64_t d = (uint64_t)(qa - a->zero) * (uint64_t)(int64_t)a->scale -
+				     (uint64_t)(qb - b->zero) * (uint64_t)(int64_t)b->scale;
+
+			dist += d * d;
+		}
+		*out = dist;
+	}
+}
+
+/* Scalar reference for l2_batch_blocked_kernel, reads through l2_blocked_index() */
+void l2_cpu_batch_blocked(const struct l2_batch_blocked_args *args)
+{
+	const int32_t *a = (const int32_t *)(uintptr_t)args->a_base;
+	const int32_t *b = (const int32_t *)(uintptr_t)args->b_base;
+	uint64_t *out = (uint64_t *)(uintptr_t)args->out_base;
+
+	for (uint32_t v = 0; v < args->batch_size; ++v) {
+		int64_t dist = 0;
+
+		for (uint32_t i = 0; i < args->dim; ++i) {
+			size_t at = l2_blocked_index(args->dim, v, i);
+			int64_t da = (int64_t)a[at] - (int64_t)b[at];
+
+			dist += da * da;
+		}
+		out[v] = (uint64_t)dist;
+	}
+}
+
+/*
+ * Scalar reference for l2_matrix_kernel. Sums (a - b)^2 directly and ignores the
+ * norm arrays, so it also checks that the expansion is exact.
+ */
+void l2_cpu_matrix(const struct l2_matrix_args *args)
+{
+	for (uint32_t i = 0; i < args->m; ++i) {
+		const int32_t *a = (const int32_t *)(uintptr_t)(args->a_base + (uint64_t)i * args->a_stride);
+		uint64_t *out = (uint64_t *)(uintptr_t)(args->out_base + (uint64_t)i * args->out_stride);
+
+		for (uint32_t j = 0; j < args->n; ++j) {
+			const int32_t *b = (const int32_t *)(uintptr_t)(args->b_base + (uint64_t)j * args->b_stride);
+			int64_t dist = 0;
+
+			for (uint32_t d = 0; d < args->dim; ++d) {
+				int64_t da = (int64_t)a[d] - (int64_t)b[d];
+
+				dist += da * da;
+			}
+			out[j] = (uint64_t)dist;
+		}
+	}
+}
+
+/* 和 l2_sq_abandon_dev 一样每 block 维比一次阈值，dims 累加实际算过的维数 */
+static uint64_t cpu_sq_abandon(const int32_t *a, const int32_t *b, uint32_t dim, uint32_t block, uint64_t thresh,
+			       uint64_t *dims)
+{
+	uint64_t dist = 0;
+	uint32_t i = 0;
+
+	while (i < dim) {
+		uint32_t end = dim - i > block ? i + block : dim;
+
+		for (; i < end; ++i) {
+			int64_t d = (int64_t)a[i] - (int64_t)b[i];
+			dist += (uint64_t)(d * d);
+		}
+		if (dist > thresh)
+			break;
+	}
+	*dims += i;
+	return dist;
+}
+
+static void cpu_abandon_stats(uint64_t stats_base, uint32_t part, uint64_t dims, uint64_t cands)
+{
+	uint64_t *stats = (uint64_t *)(uintptr_t)stats_base + (uint64_t)part * L2_ABANDON_STATS;
+
+	if (stats_base == 0)
+		return;
+	stats[L2_ABANDON_DIMS] = dims;
+	stats[L2_ABANDON_CANDS] = cands;
+}
+
+/*
+ * Scalar reference for l2_search_kernel: one global heap per query written to
+ * part 0, the other num_parts - 1 segments are left empty
+ */
+void l2_cpu_search(const struct l2_search_args *args)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	uint64_t dims = 0, cands = 0;
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = (uint32_t)l2_search_next_row(args, 0, args->db_size); idx < args->db_size;
+		     idx = (uint32_t)l2_search_next_row(args, idx + 1, args->db_size)) {
+			const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + (uint64_t)idx * args->db_stride);
+			int64_t dist = 0;
+
+			if (args->abandon_block != 0) {
+				uint64_t thresh = l2_topk_bound(heap, n, k);
+				uint64_t d = cpu_sq_abandon(qv, v, args->dim, args->abandon_block, thresh, &dims);
+
+				++cands;
+				if (d <= thresh)
+					l2_topk_push(heap, &n, k, d, args->id_base + idx);
+				continue;
+			}
+			for (uint32_t i = 0; i < args->dim; ++i) {
+				int64_t d = (int64_t)qv[i] - (int64_t)v[i];
+				dist += d * d;
+			}
+			l2_topk_push(heap, &n, k, (uint64_t)dist, args->id_base + idx);
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+	/* 全局只有一个堆：计数都记在 part 0 */
+	for (uint32_t p = 0; p < args->num_parts; ++p)
+		cpu_abandon_stats(args->stats_base, p, p == 0 ? dims : 0, p == 0 ? cands : 0);
+}
+
+/* Scalar reference for l2_ivf_kernel, same output convention as l2_cpu_search */
+void l2_cpu_ivf(const struct l2_ivf_args *args)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint32_t *offsets = (const uint32_t *)(uintptr_t)args->offsets_base;
+	const uint32_t *ids = (const uint32_t *)(uintptr_t)args->ids_base;
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		const uint32_t *probes = (const uint32_t *)(uintptr_t)args->probes_base + (uint64_t)q * args->nprobe;
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t p = 0; p < args->nprobe; ++p) {
+			for (uint32_t idx = offsets[probes[p]]; idx < offsets[probes[p] + 1]; ++idx) {
+				const int32_t *v =
+					(const int32_t *)(uintptr_t)(args->db_base + (uint64_t)idx * args->db_stride);
+				int64_t dist = 0;
+
+				for (uint32_t i = 0; i < args->dim; ++i) {
+					int64_t d = (int64_t)qv[i] - (int64_t)v[i];
+					dist += d * d;
+				}
+				l2_topk_push(heap, &n, k, (uint64_t)dist, ids[idx]);
+			}
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+/* Scalar reference for l2_pq_kernel: one global heap per query in part 0 */
+void l2_cpu_pq(const struct l2_pq_args *args)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint8_t *codes = (const uint8_t *)(uintptr_t)args->codes_base;
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const uint16_t *lut = (const uint16_t *)(uintptr_t)(args->lut_base + (uint64_t)q * args->lut_stride);
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = 0; idx < args->n; ++idx) {
+			const uint8_t *code = codes + (uint64_t)idx * args->m;
+			uint32_t dist = 0;
+
+			for (uint32_t j = 0; j < args->m; ++j)
+				dist += lut[j * L2_PQ_KSUB + code[j]];
+			l2_topk_push(heap, &n, k, dist, args->id_base + idx);
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+/* Scalar reference for l2_hamming_kernel: one global heap per query in part 0 */
+void l2_cpu_hamming(const struct l2_hamming_args *args)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint32_t *codes = (const uint32_t *)(uintptr_t)args->codes_base;
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const uint32_t *qc = (const uint32_t *)(uintptr_t)args->q_base + (uint64_t)q * args->words;
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = 0; idx < args->n; ++idx) {
+			const uint32_t *code = codes + (uint64_t)idx * args->words;
+			uint32_t dist = 0;
+
+			for (uint32_t w = 0; w < args->words; ++w)
+				dist += (uint32_t)__builtin_popcount(qc[w] ^ code[w]);
+			l2_topk_push(heap, &n, k, dist, args->id_base + idx);
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+/* Scalar reference for l2_range_kernel: same per-part row ranges, so the segments match the kernel's */
+void l2_cpu_range(const struct l2_range_args *args)
+{
+	for (uint32_t p = 0; p < args->num_parts; ++p) {
+		struct l2_range_hit *out = (struct l2_range_hit *)(uintptr_t)args->out_base + (uint64_t)p * args->cap;
+		uint32_t first = (uint32_t)((uint64_t)args->db_size * p / args->num_parts);
+		uint32_t last = (uint32_t)((uint64_t)args->db_size * (p + 1) / args->num_parts);
+		uint64_t count = 0, dims = 0, cands = 0;
+
+		for (uint32_t q = 0; q < args->nq; ++q) {
+			const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+
+			for (uint32_t idx = first; idx < last; ++idx) {
+				const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + (uint64_t)idx * args->db_stride);
+				int64_t dist = 0;
+
+				if (args->abandon_block != 0) {
+					dist = (int64_t)cpu_sq_abandon(qv, v, args->dim, args->abandon_block, args->radius,
+								       &dims);
+					++cands;
+				} else {
+					for (uint32_t i = 0; i < args->dim; ++i) {
+						int64_t d = (int64_t)qv[i] - (int64_t)v[i];
+						dist += d * d;
+					}
+				}
+				if ((uint64_t)dist > args->radius)
+					continue;
+				if (count < args->cap)
+					out[count] = (struct l2_range_hit){(uint64_t)dist, args->id_base + idx, q};
+				++count;
+			}
+		}
+		((uint64_t *)(uintptr_t)args->counts_base)[p] = count;
+		cpu_abandon_stats(args->stats_base, p, dims, cands);
+	}
+}
+
+static doca_error_t cpu_init(struct l2_backend *be)
+{
+	(void)be;
+	return DOCA_SUCCESS;
+}
+
+static void cpu_fini(struct l2_backend *be)
+{
+	(void)be;
+}
+
+/* 直接在调用线程上同步算完，wait 什么都不用做 */
+static doca_error_t cpu_launch(struct l2_backend *be, enum l2_kernel_id kernel, enum l2_variant variant,
+			       const void *args, struct l2_event *wait_event, uint64_t wait_thresh, uint64_t seq)
+{
+	doca_error_t result;
+
+	(void)be;
+	(void)seq;
+	(void)variant;		/* 参考实现始终走通用路径 */
+
+	result = l2_inline_check_wait(wait_event, wait_thresh);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	switch (kernel) {
+	case L2_KERNEL_SINGLE:
+		l2_cpu_single(args);
+		break;
+	case L2_KERNEL_BATCH:
+		l2_cpu_batch(args);
+		break;
+	case L2_KERNEL_SEARCH:
+		l2_cpu_search(args);
+		break;
+	case L2_KERNEL_BATCH_BLOCKED:
+		l2_cpu_batch_blocked(args);
+		break;
+	case L2_KERNEL_MATRIX:
+		l2_cpu_matrix(args);
+		break;
+	case L2_KERNEL_IVF:
+		l2_cpu_ivf(args);
+		break;
+	case L2_KERNEL_PQ:
+		l2_cpu_pq(args);
+		break;
+	case L2_KERNEL_QBATCH:
+		l2_cpu_qbatch(args);
+		break;
+	case L2_KERNEL_HAMMING:
+		l2_cpu_hamming(args);
+		break;
+	case L2_KERNEL_RANGE:
+		l2_cpu_range(args);
+		break;
+	default:
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	return DOCA_SUCCESS;
+}
+
+static doca_error_t cpu_wait(struct l2_backend *be, uint64_t seq)
+{
+	(void)be;
+	(void)seq;
+	return DOCA_SUCCESS;
+}
+
+const struct l2_backend_ops l2_backend_cpu_ops = {
+	.name = "cpu",
+	.init = cpu_init,
+	.fini = cpu_fini,
+	.launch = cpu_launch,
+	.wait = cpu_wait,
+	.event_create = l2_inline_event_create,
+	.event_destroy = l2_inline_event_destroy,
+	.event_set = l2_inline_event_set,
+};
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_dev.h>
+
+#include "dpa_common.h"
+#include "../include/l2_backend.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::DPA_BACKEND);
+
+/* Kernel function decleration */
+extern doca_dpa_func_t l2_single_kernel;
+extern doca_dpa_func_t l2_batch_kernel;
+extern doca_dpa_func_t l2_search_kernel;
+extern doca_dpa_func_t l2_batch_blocked_kernel;
+extern doca_dpa_func_t l2_matrix_kernel;
+extern doca_dpa_func_t l2_ivf_kernel;
+extern doca_dpa_func_t l2_pq_kernel;
+extern doca_dpa_func_t l2_qbatch_kernel;
+extern doca_dpa_func_t l2_hamming_kernel;
+extern doca_dpa_func_t l2_range_kernel;
+#define DPA_DECLARE_SPEC(D)                             \
+	extern doca_dpa_func_t l2_batch_kernel_d##D;    \
+	extern doca_dpa_func_t l2_search_kernel_d##D;
+L2_SPEC_DIMS(DPA_DECLARE_SPEC)
+
+/* 按 variant 索引的定长 kernel，见 l2_dispatch.h */
+static doca_dpa_func_t *const batch_kernels[L2_VARIANT_MAX] = {
+	[L2_VARIANT_GENERIC] = &l2_batch_kernel,
+#define DPA_BATCH_SPEC(D) [L2_VARIANT_D##D] = &l2_batch_kernel_d##D,
+	L2_SPEC_DIMS(DPA_BATCH_SPEC)
+#undef DPA_BATCH_SPEC
+};
+
+static doca_dpa_func_t *const search_kernels[L2_VARIANT_MAX] = {
+	[L2_VARIANT_GENERIC] = &l2_search_kernel,
+#define DPA_SEARCH_SPEC(D) [L2_VARIANT_D##D] = &l2_search_kernel_d##D,
+	L2_SPEC_DIMS(DPA_SEARCH_SPEC)
+#undef DPA_SEARCH_SPEC
+};
+
+struct dpa_backend {
+	struct doca_sync_event *comp_event;	/* 每完成一次 launch 加 1 */
+	uint64_t comp_base;			/* 创建时 comp_event 的初值 */
+};
+
+static void dpa_fini(struct l2_backend *be)
+{
+	struct dpa_backend *db = be->priv;
+	doca_error_t result;
+
+	if (db == NULL)
+		return;
+	if (db->comp_event != NULL) {
+		result = doca_sync_event_destroy(db->comp_event);
+		if (result != DOCA_SUCCESS)
+			DOCA_LOG_ERR("Failed to destroy DOCA sync event: %s", doca_error_get_descr(result));
+	}
+	free(db);
+	be->priv = NULL;
+}
+
+static doca_error_t dpa_init(struct l2_backend *be)
+{
+	struct dpa_resources *resources = be->cfg.resources;
+	struct dpa_backend *db;
+	doca_error_t result;
+
+	if (resources == NULL || resources->doca_dpa == NULL) {
+		DOCA_LOG_ERR("DPA backend requires allocated DPA resources");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	db = calloc(1, sizeof(*db));
+	if (db == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	be->priv = db;
+
+	/* Creating DOCA sync event for DPA kernel completion */
+	result = create_doca_dpa_completion_sync_event(resources->doca_dpa, resources->doca_device, &db->comp_event);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create DOCA sync event for DPA kernel completion: %s",
+			     doca_error_get_descr(result));
+		goto fail;
+	}
+	result = doca_sync_event_get(db->comp_event, &db->comp_base);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to read completion event: %s", doca_error_get_descr(result));
+		goto fail;
+	}
+	return DOCA_SUCCESS;
+
+fail:
+	dpa_fini(be);
+	return result;
+}
+
+static void dpa_arena_reg(struct l2_backend *be, struct dpa_arena_reg_ops *reg)
+{
+	dpa_arena_doca_reg_ops(be->cfg.resources->doca_device, reg);
+}
+
+static doca_error_t dpa_launch(struct l2_backend *be, enum l2_kernel_id kernel, enum l2_variant variant,
+			      const void *args, struct l2_event *wait_event, uint64_t wait_thresh, uint64_t seq)
+{
+	struct dpa_backend *db = be->priv;
+	struct doca_dpa *dpa = be->cfg.resources->doca_dpa;
+	struct doca_sync_event *wait_ev = (struct doca_sync_event *)wait_event;
+	unsigned int num_threads = be->cfg.num_threads;
+	doca_error_t result;
+
+	(void)seq;
+	/* kernel 参数按值传给 doca_dpa_kernel_launch，必须用具体类型展开 */
+	switch (kernel) {
+	case L2_KERNEL_SINGLE:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_single_kernel,
+							   *(const struct l2_single_dist_args *)args);
+		break;
+	case L2_KERNEL_BATCH:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   batch_kernels[variant],
+							   *(const struct l2_batch_args *)args);
+		break;
+	case L2_KERNEL_SEARCH:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   search_kernels[variant],
+							   *(const struct l2_search_args *)args);
+		break;
+	case L2_KERNEL_BATCH_BLOCKED:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_batch_blocked_kernel,
+							   *(const struct l2_batch_blocked_args *)args);
+		break;
+	case L2_KERNEL_MATRIX:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_matrix_kernel, *(const struct l2_matrix_args *)args);
+		break;
+	case L2_KERNEL_IVF:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_ivf_kernel, *(const struct l2_ivf_args *)args);
+		break;
+	case L2_KERNEL_PQ:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_pq_kernel, *(const struct l2_pq_args *)args);
+		break;
+	case L2_KERNEL_QBATCH:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_qbatch_kernel, *(const struct l2_qbatch_args *)args);
+		break;
+	case L2_KERNEL_HAMMING:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_hamming_kernel, *(const struct l2_hamming_args *)args);
+		break;
+	case L2_KERNEL_RANGE:
+		result = doca_dpa_kernel_launch_update_add(dpa, wait_ev, wait_thresh, db->comp_event, 1, num_threads,
+							   &l2_range_kernel, *(const struct l2_range_args *)args);
+		break;
+	default:
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to launch kernel %d (%s): %s", kernel, l2_variant_name(variant),
+			     doca_error_get_descr(result));
+	return result;
+}
+
+static doca_error_t dpa_wait(struct l2_backend *be, uint64_t seq)
+{
+	struct dpa_backend *db = be->priv;
+	doca_error_t result;
+
+	/* Wait until completion event reach completion val */
+	result = doca_sync_event_wait_gt(db->comp_event, db->comp_base + seq - 1, SYNC_EVENT_MASK_FFS);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to wait for host completion event: %s", doca_error_get_descr(result));
+	return result;
+}
+
+static int dpa_poll(struct l2_backend *be, uint64_t seq)
+{
+	struct dpa_backend *db = be->priv;
+	uint64_t value;
+
+	/* 读失败当作还没完成，调用方之后总会走 dpa_wait 报错 */
+	if (doca_sync_event_get(db->comp_event, &value) != DOCA_SUCCESS)
+		return 0;
+	return value - db->comp_base >= seq;
+}
+
+/* host 发布、DPA 订阅的 wait event，kernel launch 用它来排在 host 的 staging 后面 */
+static doca_error_t dpa_event_create(struct l2_backend *be, struct l2_event **event)
+{
+	struct doca_sync_event *ev;
+	doca_error_t result;
+
+	result = create_doca_dpa_wait_sync_event(be->cfg.resources->doca_dpa, be->cfg.resources->doca_device, &ev);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create DOCA sync event for DPA kernel wait: %s", doca_error_get_descr(result));
+		return result;
+	}
+	*event = (struct l2_event *)ev;
+	return DOCA_SUCCESS;
+}
+
+static void dpa_event_destroy(struct l2_backend *be, struct l2_event *event)
+{
+	doca_error_t result;
+
+	(void)be;
+	result = doca_sync_event_destroy((struct doca_sync_event *)event);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to destroy DOCA sync event: %s", doca_error_get_descr(result));
+}
+
+static doca_error_t dpa_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value)
+{
+	doca_error_t result;
+
+	(void)be;
+	result = doca_sync_event_update_set((struct doca_sync_event *)event, value);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to update DOCA sync event: %s", doca_error_get_descr(result));
+	return result;
+}
+
+const struct l2_backend_ops l2_backend_dpa_ops = {
+	.name = "dpa",
+	.init = dpa_init,
+	.fini = dpa_fini,
+	.arena_reg = dpa_arena_reg,
+	.launch = dpa_launch,
+	.wait = dpa_wait,
+	.poll = dpa_poll,
+	.event_create = dpa_event_create,
+	.event_destroy = dpa_event_destroy,
+	.event_set = dpa_event_set,
+	.deferred_launch = 1,
+};
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_backend.h"
+#include "../include/dpa_emu.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::EMU_BACKEND);
+
+struct emu_backend {
+	struct dpa_emu *emu;
+	struct dpa_emu_event *comp_event;	/* 每完成一次 launch 加 1 */
+};
+
+static const size_t emu_args_size[L2_KERNEL_MAX] = {
+	[L2_KERNEL_SINGLE] = sizeof(struct l2_single_dist_args),
+	[L2_KERNEL_BATCH] = sizeof(struct l2_batch_args),
+	[L2_KERNEL_SEARCH] = sizeof(struct l2_search_args),
+	[L2_KERNEL_BATCH_BLOCKED] = sizeof(struct l2_batch_blocked_args),
+	[L2_KERNEL_MATRIX] = sizeof(struct l2_matrix_args),
+	[L2_KERNEL_IVF] = sizeof(struct l2_ivf_args),
+	[L2_KERNEL_PQ] = sizeof(struct l2_pq_args),
+	[L2_KERNEL_QBATCH] = sizeof(struct l2_qbatch_args),
+	[L2_KERNEL_HAMMING] = sizeof(struct l2_hamming_args),
+	[L2_KERNEL_RANGE] = sizeof(struct l2_range_args),
+};
+
+/* [kernel][variant]，没有特化版本的项为 NULL，回落到通用版本 */
+static const dpa_emu_kernel_fn emu_kernels[L2_KERNEL_MAX][L2_VARIANT_MAX] = {
+	[L2_KERNEL_SINGLE] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_single_kernel},
+	[L2_KERNEL_BATCH] = {
+		[L2_VARIANT_GENERIC] = dpa_emu_l2_batch_kernel,
+#define EMU_BATCH_SPEC(D) [L2_VARIANT_D##D] = dpa_emu_l2_batch_kernel_d##D,
+		L2_SPEC_DIMS(EMU_BATCH_SPEC)
+#undef EMU_BATCH_SPEC
+	},
+	[L2_KERNEL_SEARCH] = {
+		[L2_VARIANT_GENERIC] = dpa_emu_l2_search_kernel,
+#define EMU_SEARCH_SPEC(D) [L2_VARIANT_D##D] = dpa_emu_l2_search_kernel_d##D,
+		L2_SPEC_DIMS(EMU_SEARCH_SPEC)
+#undef EMU_SEARCH_SPEC
+	},
+	[L2_KERNEL_BATCH_BLOCKED] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_batch_blocked_kernel},
+	[L2_KERNEL_MATRIX] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_matrix_kernel},
+	[L2_KERNEL_IVF] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_ivf_kernel},
+	[L2_KERNEL_PQ] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_pq_kernel},
+	[L2_KERNEL_QBATCH] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_qbatch_kernel},
+	[L2_KERNEL_HAMMING] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_hamming_kernel},
+	[L2_KERNEL_RANGE] = {[L2_VARIANT_GENERIC] = dpa_emu_l2_range_kernel},
+};
+
+static void emu_fini(struct l2_backend *be)
+{
+	struct emu_backend *eb = be->priv;
+
+	if (eb == NULL)
+		return;
+	dpa_emu_destroy(eb->emu);
+	dpa_emu_event_destroy(eb->comp_event);
+	free(eb);
+	be->priv = NULL;
+}
+
+static doca_error_t emu_init(struct l2_backend *be)
+{
+	struct emu_backend *eb;
+	doca_error_t result;
+
+	eb = calloc(1, sizeof(*eb));
+	if (eb == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	be->priv = eb;
+
+	result = dpa_emu_event_create(&eb->comp_event);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	result = dpa_emu_create(0, &eb->emu);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	return DOCA_SUCCESS;
+
+fail:
+	emu_fini(be);
+	return result;
+}
+
+static doca_error_t emu_launch(struct l2_backend *be, enum l2_kernel_id kernel, enum l2_variant variant,
+			      const void *args, struct l2_event *wait_event, uint64_t wait_thresh, uint64_t seq)
+{
+	struct emu_backend *eb = be->priv;
+	dpa_emu_kernel_fn fn = emu_kernels[kernel][variant];
+
+	(void)seq;
+	if (fn == NULL)
+		fn = emu_kernels[kernel][L2_VARIANT_GENERIC];
+	if (fn == NULL)
+		return DOCA_ERROR_NOT_SUPPORTED;
+	return dpa_emu_kernel_launch_update_add(eb->emu,
+						(struct dpa_emu_event *)wait_event,
+						wait_thresh,
+						eb->comp_event,
+						1,
+						be->cfg.num_threads,
+						fn,
+						args,
+						emu_args_size[kernel]);
+}
+
+static doca_error_t emu_wait(struct l2_backend *be, uint64_t seq)
+{
+	struct emu_backend *eb = be->priv;
+
+	dpa_emu_event_wait_gt(eb->comp_event, seq - 1);
+	return DOCA_SUCCESS;
+}
+
+static int emu_poll(struct l2_backend *be, uint64_t seq)
+{
+	struct emu_backend *eb = be->priv;
+
+	return dpa_emu_event_get(eb->comp_event) >= seq;
+}
+
+static doca_error_t emu_event_create(struct l2_backend *be, struct l2_event **event)
+{
+	(void)be;
+	return dpa_emu_event_create((struct dpa_emu_event **)event);
+}
+
+static void emu_event_destroy(struct l2_backend *be, struct l2_event *event)
+{
+	(void)be;
+	dpa_emu_event_destroy((struct dpa_emu_event *)event);
+}
+
+static doca_error_t emu_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value)
+{
+	(void)be;
+	dpa_emu_event_update_set((struct dpa_emu_event *)event, value);
+	return DOCA_SUCCESS;
+}
+
+const struct l2_backend_ops l2_backend_emu_ops = {
+	.name = "emu",
+	.init = emu_init,
+	.fini = emu_fini,
+	.launch = emu_launch,
+	.wait = emu_wait,
+	.poll = emu_poll,
+	.event_create = emu_event_create,
+	.event_destroy = emu_event_destroy,
+	.event_set = emu_event_set,
+	.deferred_launch = 1,
+};
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_backend.h"
+#include "../include/l2_filter.h"
+#include "../include/l2_simd.h"
+#include "../include/l2_pool.h"
+#include "../include/l2_topk.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::HOST);
+
+/* chunk 划分时每个 task 至少这么多个 pair，再小调度开销就比计算大了 */
+#define L2_HOST_MIN_CHUNK 256
+/* 每个 worker 大约分到的 task 数，留出 work stealing 的余地 */
+#define L2_HOST_TASKS_PER_WORKER 8
+
+struct host_priv {
+	struct l2_pool *pool;	/* host_threads == 1 时为 NULL，在调用线程上跑 */
+};
+
+/* 一次 launch 在 pool 上的参数 */
+struct host_job {
+	struct l2_backend *be;
+	const void *args;
+	l2_sq_fn sq;
+	l2_sq_abandon_fn sqa;	/* abandon_block != 0 时用 */
+	enum l2_variant variant;
+	uint32_t chunk;		/* chunk 划分：每个 task 的 pair 数（blocked 时为 block 数，matrix 时为行数） */
+	uint32_t ranks;		/* stride 划分：rank 数 */
+};
+
+static doca_error_t host_init(struct l2_backend *be)
+{
+	struct host_priv *priv;
+	struct l2_pool_cfg pool_cfg = {.num_workers = be->cfg.host_threads};
+	doca_error_t result;
+
+	priv = calloc(1, sizeof(*priv));
+	if (priv == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	if (be->cfg.host_threads != 1) {
+		result = l2_pool_create(&pool_cfg, &priv->pool);
+		if (result != DOCA_SUCCESS) {
+			free(priv);
+			return result;
+		}
+	}
+	be->priv = priv;
+	DOCA_LOG_INFO("Host backend using %s kernels on %u thread(s), %s partition", l2_simd_isa_name(l2_simd_isa()),
+		      priv->pool != NULL ? l2_pool_size(priv->pool) : 1,
+		      be->cfg.host_partition == L2_HOST_PART_STRIDE ? "rank-stride" : "chunked");
+	return DOCA_SUCCESS;
+}
+
+static void host_fini(struct l2_backend *be)
+{
+	struct host_priv *priv = be->priv;
+
+	l2_pool_destroy(priv->pool);
+	free(priv);
+	be->priv = NULL;
+}
+
+static void host_mem_touch(struct l2_backend *be, void *addr, size_t len)
+{
+	struct host_priv *priv = be->priv;
+
+	/* stride 划分时每页都被所有 rank 访问，没有“本地”可言 */
+	if (priv->pool == NULL || be->cfg.host_partition == L2_HOST_PART_STRIDE)
+		return;
+	l2_pool_first_touch(priv->pool, addr, len, 0);
+}
+
+static void batch_chunk_task(void *ctx, uint32_t task, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	struct l2_batch_args sub = *(const struct l2_batch_args *)job->args;
+	uint64_t first = (uint64_t)task * job->chunk;
+
+	(void)worker;
+	sub.batch_size = (uint32_t)(sub.batch_size - first < job->chunk ? sub.batch_size - first : job->chunk);
+	sub.a_base += first * sub.a_stride;
+	sub.b_base += first * sub.b_stride;
+	sub.out_base += first * sub.out_stride;
+	l2_simd_batch(&sub, job->variant);
+}
+
+static void qbatch_chunk_task(void *ctx, uint32_t task, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	struct l2_qbatch_args sub = *(const struct l2_qbatch_args *)job->args;
+	uint64_t first = (uint64_t)task * job->chunk;
+
+	(void)worker;
+	sub.batch_size = (uint32_t)(sub.batch_size - first < job->chunk ? sub.batch_size - first : job->chunk);
+	sub.a_base += first * sub.a_stride;
+	sub.b_base += first * sub.b_stride;
+	sub.out_base += first * sub.out_stride;
+	l2_simd_qbatch(&sub);
+}
+
+/* blocked 布局按 block 切：task 拿 job->chunk 个连续 block */
+static void batch_blocked_task(void *ctx, uint32_t task, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	struct l2_batch_blocked_args sub = *(const struct l2_batch_blocked_args *)job->args;
+	uint64_t first = (uint64_t)task * job->chunk * L2_BLOCK_VECS;
+	uint64_t block_bytes = (uint64_t)sub.dim * L2_BLOCK_VECS * sizeof(int32_t);
+
+	(void)worker;
+	sub.batch_size = (uint32_t)(sub.batch_size - first < (uint64_t)job->chunk * L2_BLOCK_VECS ?
+					    sub.batch_size - first :
+					    (uint64_t)job->chunk * L2_BLOCK_VECS);
+	sub.a_base += first / L2_BLOCK_VECS * block_bytes;
+	sub.b_base += first / L2_BLOCK_VECS * block_bytes;
+	sub.out_base += first * sizeof(uint64_t);
+	l2_simd_batch_blocked(&sub);
+}
+
+/* 距离矩阵按 a 的行切：task 拿 job->chunk 行（L2_MATRIX_TILE 的倍数），每个 task 自己扫完所有 b */
+static void matrix_rows_task(void *ctx, uint32_t task, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	struct l2_matrix_args sub = *(const struct l2_matrix_args *)job->args;
+	uint64_t first = (uint64_t)task * job->chunk;
+
+	(void)worker;
+	sub.m = (uint32_t)(sub.m - first < job->chunk ? sub.m - first : job->chunk);
+	sub.a_base += first * sub.a_stride;
+	sub.a_norm_base += first * sizeof(uint64_t);
+	sub.out_base += first * sub.out_stride;
+	l2_simd_matrix(&sub);
+}
+
+/* 和 l2_batch_kernel 一样：rank r 处理 r, r + R, r + 2R, ... */
+static void batch_stride_task(void *ctx, uint32_t rank, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	const struct l2_batch_args *args = job->args;
+
+	(void)worker;
+	for (uint64_t idx = rank; idx < args->batch_size; idx += job->ranks) {
+		const int32_t *a = (const int32_t *)(uintptr_t)(args->a_base + idx * args->a_stride);
+		const int32_t *b = (const int32_t *)(uintptr_t)(args->b_base + idx * args->b_stride);
+
+		*(uint64_t *)(uintptr_t)(args->out_base + idx * args->out_stride) = job->sq(a, b, args->dim);
+	}
+}
+
+/* 和 kernel 一样每个 part 一行提前放弃计数 */
+static void host_abandon_stats(uint64_t stats_base, uint32_t part, uint64_t dims, uint64_t cands)
+{
+	uint64_t *stats = (uint64_t *)(uintptr_t)stats_base + (uint64_t)part * L2_ABANDON_STATS;
+
+	if (stats_base == 0)
+		return;
+	stats[L2_ABANDON_DIMS] = dims;
+	stats[L2_ABANDON_CANDS] = cands;
+}
+
+static inline void search_cand(const struct host_job *job, struct l2_hit *heap, uint32_t *n, uint32_t k,
+			       const int32_t *qv, uint64_t idx, uint64_t *dims, uint64_t *cands)
+{
+	const struct l2_search_args *args = job->args;
+	const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + idx * args->db_stride);
+
+	if (args->abandon_block != 0) {
+		uint64_t thresh = l2_topk_bound(heap, *n, k);
+		uint64_t dist = job->sqa(qv, v, args->dim, args->abandon_block, thresh, dims);
+
+		++*cands;
+		if (dist <= thresh)
+			l2_topk_push(heap, n, k, dist, args->id_base + (uint32_t)idx);
+		return;
+	}
+	l2_topk_push(heap, n, k, job->sq(qv, v, args->dim), args->id_base + (uint32_t)idx);
+}
+
+/* 每个 part 一个 task，和 l2_search_kernel 的 rank 一样只写自己那段堆；过滤时总是连续切 */
+static void search_part_task(void *ctx, uint32_t part, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	const struct l2_search_args *args = job->args;
+	const uint32_t P = args->num_parts;
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	uint64_t begin, end, step, dims = 0, cands = 0;
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+
+	(void)worker;
+	if (job->be->cfg.host_partition == L2_HOST_PART_STRIDE && args->filter_base == 0) {
+		begin = part;
+		end = args->db_size;
+		step = P;
+	} else {
+		begin = (uint64_t)args->db_size * part / P;
+		end = (uint64_t)args->db_size * (part + 1) / P;
+		step = 1;
+	}
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + ((uint64_t)q * P + part) * k;
+		uint32_t n = 0;
+
+		/* 过滤时 step 为 1，一次看一个 bitmap 字，全 0 的字一步跳过 64 行 */
+		for (uint64_t idx = l2_search_next_row(args, begin, end); idx < end;
+		     idx = l2_search_next_row(args, idx + step, end))
+			search_cand(job, heap, &n, k, qv, idx, &dims, &cands);
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+	}
+	host_abandon_stats(args->stats_base, part, dims, cands);
+}
+
+/*
+ * IVF：把一个 query 要扫的表首尾相接，part 拿其中连续的 1 / P。
+ * 和 kernel 的按 rank 跨步不同，但合并后的 top-k 一样（按 (dist, id) 排序）。
+ */
+static void ivf_part_task(void *ctx, uint32_t part, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+	const struct l2_ivf_args *args = job->args;
+	const uint32_t P = args->num_parts;
+	const uint32_t *offsets = (const uint32_t *)(uintptr_t)args->offsets_base;
+	const uint32_t *ids = (const uint32_t *)(uintptr_t)args->ids_base;
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+
+	(void)worker;
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		const uint32_t *probes = (const uint32_t *)(uintptr_t)args->probes_base + (uint64_t)q * args->nprobe;
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + ((uint64_t)q * P + part) * k;
+		uint64_t total = 0, pos = 0, lo, hi;
+		uint32_t n = 0;
+
+		for (uint32_t p = 0; p < args->nprobe; ++p)
+			total += offsets[probes[p] + 1] - offsets[probes[p]];
+		lo = total * part / P;
+		hi = total * (part + 1) / P;
+
+		for (uint32_t p = 0; p < args->nprobe && pos < hi; ++p) {
+			uint32_t begin = offsets[probes[p]], end = offsets[probes[p] + 1];
+			uint64_t from = lo > pos ? lo - pos : 0, to = hi - pos < end - begin ? hi - pos : end - begin;
+
+			for (uint64_t idx = begin + from; idx < begin + to; ++idx) {
+				const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + idx * args->db_stride);
+
+				l2_topk_push(heap, &n, k, job->sq(qv, v, args->dim), ids[idx]);
+			}
+			pos += end - begin;
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+	}
+}
+
+static void pq_part_task(void *ctx, uint32_t part, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+
+	(void)worker;
+	l2_simd_pq_part(job->args, part);
+}
+
+static void hamming_part_task(void *ctx, uint32_t part, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+
+	(void)worker;
+	l2_simd_hamming_part(job->args, part);
+}
+
+/* 半径搜索：和 l2_range_kernel 一样 part 拿连续的 1 / P 行，段的内容逐位相同 */
+static void range_part(const struct l2_range_args *args, l2_sq_fn sq, l2_sq_abandon_fn sqa, uint32_t part)
+{
+	struct l2_range_hit *out = (struct l2_range_hit *)(uintptr_t)args->out_base + (uint64_t)part * args->cap;
+	uint64_t first = (uint64_t)args->db_size * part / args->num_parts;
+	uint64_t last = (uint64_t)args->db_size * (part + 1) / args->num_parts;
+	uint64_t count = 0, dims = 0, cands = 0;
+
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+
+		for (uint64_t idx = first; idx < last; ++idx) {
+			const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + idx * args->db_stride);
+			uint64_t dist;
+
+			if (args->abandon_block != 0) {
+				dist = sqa(qv, v, args->dim, args->abandon_block, args->radius, &dims);
+				++cands;
+			} else {
+				dist = sq(qv, v, args->dim);
+			}
+			if (dist > args->radius)
+				continue;
+			if (count < args->cap)
+				out[count] = (struct l2_range_hit){dist, args->id_base + (uint32_t)idx, q};
+			++count;
+		}
+	}
+	((uint64_t *)(uintptr_t)args->counts_base)[part] = count;
+	host_abandon_stats(args->stats_base, part, dims, cands);
+}
+
+static void range_part_task(void *ctx, uint32_t part, unsigned int worker)
+{
+	const struct host_job *job = ctx;
+
+	(void)worker;
+	range_part(job->args, job->sq, job->sqa, part);
+}
+
+static void pool_batch(struct l2_backend *be, struct l2_pool *pool, const struct l2_batch_args *args,
+		       enum l2_variant variant)
+{
+	struct host_job job = {.be = be, .args = args, .variant = variant};
+	uint32_t per_worker = l2_pool_size(pool) * L2_HOST_TASKS_PER_WORKER;
+
+	if (be->cfg.host_partition == L2_HOST_PART_STRIDE) {
+		job.sq = l2_simd_kernel(l2_simd_isa(), variant);
+		job.ranks = be->cfg.num_threads;
+		l2_pool_run(pool, job.ranks, batch_stride_task, &job);
+		return;
+	}
+	job.chunk = (args->batch_size + per_worker - 1) / per_worker;
+	if (job.chunk < L2_HOST_MIN_CHUNK)
+		job.chunk = L2_HOST_MIN_CHUNK;
+	l2_pool_run(pool, (args->batch_size + job.chunk - 1) / job.chunk, batch_chunk_task, &job);
+}
+
+/* 量化格式只做 chunk 划分，host_partition 不影响它 */
+static void pool_qbatch(struct l2_backend *be, struct l2_pool *pool, const struct l2_qbatch_args *args)
+{
+	struct host_job job = {.be = be, .args = args};
+	uint32_t per_worker = l2_pool_size(pool) * L2_HOST_TASKS_PER_WORKER;
+
+	job.chunk = (args->batch_size + per_worker - 1) / per_worker;
+	if (job.chunk < L2_HOST_MIN_CHUNK)
+		job.chunk = L2_HOST_MIN_CHUNK;
+	l2_pool_run(pool, (args->batch_size + job.chunk - 1) / job.chunk, qbatch_chunk_task, &job);
+}
+
+/* 和 l2_batch_blocked_kernel 一样总是连续划分，host_partition 不影响它 */
+static void pool_batch_blocked(struct l2_backend *be, struct l2_pool *pool, const struct l2_batch_blocked_args *args)
+{
+	struct host_job job = {.be = be, .args = args};
+	uint32_t nblocks = (args->batch_size + L2_BLOCK_VECS - 1) / L2_BLOCK_VECS;
+	uint32_t per_worker = l2_pool_size(pool) * L2_HOST_TASKS_PER_WORKER;
+
+	job.chunk = (nblocks + per_worker - 1) / per_worker;
+	if (job.chunk * L2_BLOCK_VECS < L2_HOST_MIN_CHUNK)
+		job.chunk = L2_HOST_MIN_CHUNK / L2_BLOCK_VECS;
+	l2_pool_run(pool, (nblocks + job.chunk - 1) / job.chunk, batch_blocked_task, &job);
+}
+
+static void pool_matrix(struct l2_backend *be, struct l2_pool *pool, const struct l2_matrix_args *args)
+{
+	struct host_job job = {.be = be, .args = args};
+	uint32_t per_worker = l2_pool_size(pool) * L2_HOST_TASKS_PER_WORKER;
+
+	job.chunk = (args->m + per_worker - 1) / per_worker;
+	job.chunk = (job.chunk + L2_MATRIX_TILE - 1) / L2_MATRIX_TILE * L2_MATRIX_TILE;
+	if (job.chunk == 0)
+		return;
+	l2_pool_run(pool, (args->m + job.chunk - 1) / job.chunk, matrix_rows_task, &job);
+}
+
+static void pool_ivf(struct l2_backend *be, struct l2_pool *pool, const struct l2_ivf_args *args,
+		     enum l2_variant variant)
+{
+	struct host_job job = {
+		.be = be,
+		.args = args,
+		.sq = l2_simd_kernel(l2_simd_isa(), variant),
+		.variant = variant,
+	};
+
+	l2_pool_run(pool, args->num_parts, ivf_part_task, &job);
+}
+
+static void pool_pq(struct l2_backend *be, struct l2_pool *pool, const struct l2_pq_args *args)
+{
+	struct host_job job = {.be = be, .args = args};
+
+	l2_pool_run(pool, args->num_parts, pq_part_task, &job);
+}
+
+static void pool_hamming(struct l2_backend *be, struct l2_pool *pool, const struct l2_hamming_args *args)
+{
+	struct host_job job = {.be = be, .args = args};
+
+	l2_pool_run(pool, args->num_parts, hamming_part_task, &job);
+}
+
+static void pool_range(struct l2_backend *be, struct l2_pool *pool, const struct l2_range_args *args)
+{
+	struct host_job job = {
+		.be = be,
+		.args = args,
+		.sq = l2_simd_sq_fn(l2_simd_isa()),
+		.sqa = l2_simd_abandon_fn(l2_simd_isa()),
+	};
+
+	l2_pool_run(pool, args->num_parts, range_part_task, &job);
+}
+
+static void pool_search(struct l2_backend *be, struct l2_pool *pool, const struct l2_search_args *args,
+			enum l2_variant variant)
+{
+	struct host_job job = {
+		.be = be,
+		.args = args,
+		.sq = l2_simd_kernel(l2_simd_isa(), variant),
+		.sqa = l2_simd_abandon_fn(l2_simd_isa()),
+		.variant = variant,
+	};
+
+	l2_pool_run(pool, args->num_parts, search_part_task, &job);
+}
+
+/* 在调用线程里同步执行：有 pool 时拆给 worker，等它们做完再返回 */
+static doca_error_t host_launch(struct l2_backend *be, enum l2_kernel_id kernel, enum l2_variant variant,
+				const void *args, struct l2_event *wait_event, uint64_t wait_thresh, uint64_t seq)
+{
+	struct host_priv *priv = be->priv;
+	doca_error_t result;
+
+	(void)seq;
+
+	result = l2_inline_check_wait(wait_event, wait_thresh);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	switch (kernel) {
+	case L2_KERNEL_SINGLE: {
+		const struct l2_single_dist_args *s = args;
+
+		*(uint64_t *)(uintptr_t)s->out_offset = l2_sq_q16_16((const int32_t *)(uintptr_t)s->a_offset,
+								     (const int32_t *)(uintptr_t)s->b_offset,
+								     (uint32_t)s->dim);
+		break;
+	}
+	case L2_KERNEL_BATCH:
+		if (priv->pool != NULL)
+			pool_batch(be, priv->pool, args, variant);
+		else
+			l2_simd_batch(args, variant);
+		break;
+	case L2_KERNEL_QBATCH:
+		if (priv->pool != NULL)
+			pool_qbatch(be, priv->pool, args);
+		else
+			l2_simd_qbatch(args);
+		break;
+	case L2_KERNEL_BATCH_BLOCKED:
+		if (priv->pool != NULL)
+			pool_batch_blocked(be, priv->pool, args);
+		else
+			l2_simd_batch_blocked(args);
+		break;
+	case L2_KERNEL_MATRIX:
+		if (priv->pool != NULL)
+			pool_matrix(be, priv->pool, args);
+		else
+			l2_simd_matrix(args);
+		break;
+	case L2_KERNEL_IVF:
+		if (priv->pool != NULL)
+			pool_ivf(be, priv->pool, args, variant);
+		else
+			l2_simd_ivf(args, variant);
+		break;
+	case L2_KERNEL_PQ:
+		if (priv->pool != NULL)
+			pool_pq(be, priv->pool, args);
+		else
+			l2_simd_pq(args);
+		break;
+	case L2_KERNEL_HAMMING:
+		if (priv->pool != NULL)
+			pool_hamming(be, priv->pool, args);
+		else
+			l2_simd_hamming(args);
+		break;
+	case L2_KERNEL_RANGE:
+		if (priv->pool != NULL) {
+			pool_range(be, priv->pool, args);
+		} else {
+			l2_sq_fn sq = l2_simd_sq_fn(l2_simd_isa());
+			l2_sq_abandon_fn sqa = l2_simd_abandon_fn(l2_simd_isa());
+
+			for (uint32_t p = 0; p < ((const struct l2_range_args *)args)->num_parts; ++p)
+				range_part(args, sq, sqa, p);
+		}
+		break;
+	case L2_KERNEL_SEARCH:
+		if (priv->pool != NULL)
+			pool_search(be, priv->pool, args, variant);
+		else
+			l2_simd_search(args, variant);
+		break;
+	default:
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	return DOCA_SUCCESS;
+}
+
+static doca_error_t host_wait(struct l2_backend *be, uint64_t seq)
+{
+	(void)be;
+	(void)seq;
+	return DOCA_SUCCESS;
+}
+
+const struct l2_backend_ops l2_backend_host_ops = {
+	.name = "host",
+	.init = host_init,
+	.fini = host_fini,
+	.launch = host_launch,
+	.wait = host_wait,
+	.event_create = l2_inline_event_create,
+	.event_destroy = l2_inline_event_destroy,
+	.event_set = l2_inline_event_set,
+	.mem_touch = host_mem_touch,
+};
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_bench.h"
+#include "../include/l2_simd.h"
+#include "../include/l2_trace.h"
+#include "../include/utils.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::BENCH);
+
+/* 数据取值范围 ±100.0，和 sample 一致 */
+#define BENCH_VALUE_RANGE (100 << 16)
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void l2_bench_cfg_init(struct l2_bench_cfg *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->dims[0] = 32;
+	cfg->dims[1] = 128;
+	cfg->dims[2] = 768;
+	cfg->num_dims = 3;
+	cfg->batches[0] = 64 * 1024;
+	cfg->num_batches = 1;
+	cfg->threads[0] = 64;
+	cfg->num_threads = 1;
+	cfg->elems[0] = L2_ELEM_Q16_16;
+	cfg->num_elems = 1;
+	cfg->layouts[0] = L2_LAYOUT_AOS;
+	cfg->num_layouts = 1;
+	cfg->backends[0] = L2_BACKEND_CPU;
+	cfg->backends[1] = L2_BACKEND_HOST;
+	cfg->backends[2] = L2_BACKEND_EMU;
+	cfg->num_backends = 3;
+	cfg->warmup = 2;
+	cfg->repeats = 10;
+}
+
+doca_error_t l2_bench_parse_u32_list(const char *str, uint32_t *out, uint32_t *count)
+{
+	const char *p = str;
+	char *end;
+	uint32_t n = 0;
+
+	while (*p != '\0') {
+		unsigned long v = strtoul(p, &end, 0);
+
+		if (end == p || v == 0 || v > UINT32_MAX || n == L2_BENCH_MAX_LIST)
+			return DOCA_ERROR_INVALID_VALUE;
+		out[n++] = (uint32_t)v;
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return DOCA_ERROR_INVALID_VALUE;
+		p = end;
+	}
+	if (n == 0)
+		return DOCA_ERROR_INVALID_VALUE;
+	*count = n;
+	return DOCA_SUCCESS;
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* nearest-rank 百分位，samples 已排序 */
+static uint64_t percentile(const uint64_t *samples, uint32_t n, double p)
+{
+	uint32_t idx = (uint32_t)(p * n + 0.999999);
+
+	if (idx == 0)
+		idx = 1;
+	if (idx > n)
+		idx = n;
+	return samples[idx - 1];
+}
+
+/* xorshift，填数据比 rand() + 量化快得多，大 batch 时初始化不会喧宾夺主 */
+static void fill_random(int32_t *v, size_t len, uint64_t *state)
+{
+	uint64_t x = *state;
+
+	for (size_t i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		v[i] = (int32_t)(x % (2 * BENCH_VALUE_RANGE + 1)) - BENCH_VALUE_RANGE;
+	}
+	*state = x;
+}
+
+/* int16 / int8 batch：随机 double 按行量化，取值范围和 Q16.16 一样 */
+static doca_error_t fill_random_rows(const struct l2_batch *batch, int32_t *rows, uint64_t *state)
+{
+	double *x = malloc(batch->dim * sizeof(*x));
+	uint64_t s = *state;
+
+	if (x == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	for (uint32_t v = 0; v < batch->batch_size; v++) {
+		void *row = (uint8_t *)rows + (size_t)v * batch->row_bytes;
+
+		for (uint32_t i = 0; i < batch->dim; i++) {
+			s ^= s << 13;
+			s ^= s >> 7;
+			s ^= s << 17;
+			x[i] = (double)((int64_t)(s % (2 * BENCH_VALUE_RANGE + 1)) - BENCH_VALUE_RANGE) / 65536.0;
+		}
+		if (batch->elem == L2_ELEM_I8)
+			quantize_vectors_int8(x, batch->dim, 1, row, batch->row_bytes, batch->frac_bits);
+		else
+			quantize_vectors_int16(x, batch->dim, 1, row, batch->row_bytes, batch->frac_bits);
+	}
+	*state = s;
+	free(x);
+	return DOCA_SUCCESS;
+}
+
+/* blocked 的 batch 先转回 AoS，再和 l2_cpu_batch 比，布局转换也一起被校验 */
+static uint64_t verify_batch(const struct l2_batch *batch)
+{
+	struct l2_batch_args args;
+	size_t vec_len = (size_t)batch->batch_size * batch->dim;
+	int32_t *a = NULL, *b = NULL;
+	uint64_t *ref, mismatches = 0;
+
+	ref = malloc((size_t)batch->batch_size * sizeof(*ref));
+	if (ref == NULL)
+		return batch->batch_size;
+	if (batch->elem != L2_ELEM_Q16_16) {
+		struct l2_qbatch_args qargs;
+
+		l2_batch_fill_qargs(batch, 0, batch->batch_size, &qargs);
+		qargs.out_base = (uint64_t)(uintptr_t)ref;
+		l2_cpu_qbatch(&qargs);
+		goto compare;
+	}
+	l2_batch_fill_args(batch, 0, batch->batch_size, &args);
+	if (batch->layout == L2_LAYOUT_BLOCKED) {
+		a = malloc(vec_len * sizeof(*a));
+		b = malloc(vec_len * sizeof(*b));
+		if (a == NULL || b == NULL) {
+			mismatches = batch->batch_size;
+			goto out;
+		}
+		l2_layout_blocked_to_aos(batch->a, batch->dim, batch->batch_size, a);
+		l2_layout_blocked_to_aos(batch->b, batch->dim, batch->batch_size, b);
+		args.a_base = (uint64_t)(uintptr_t)a;
+		args.b_base = (uint64_t)(uintptr_t)b;
+	}
+	args.out_base = (uint64_t)(uintptr_t)ref;
+	l2_cpu_batch(&args);
+compare:
+	for (uint32_t i = 0; i < batch->batch_size; i++)
+		mismatches += ref[i] != batch->out[i];
+out:
+	free(a);
+	free(b);
+	free(ref);
+	return mismatches;
+}
+
+/*
+ * Time one sweep point
+ *
+ * @be [in]: backend
+ * @cfg [in]: sweep description (warmup / repeats)
+ * @batch [in]: filled batch
+ * @samples [in]: scratch for 2 * cfg->repeats timings
+ * @res [in/out]: result, shape fields already set
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t bench_point(struct l2_backend *be, const struct l2_bench_cfg *cfg, struct l2_batch *batch,
+				uint64_t *samples, struct l2_bench_result *res)
+{
+	uint64_t *total = samples, *launch = samples + cfg->repeats;
+	uint64_t sum = 0, bytes;
+	doca_error_t result;
+
+	/* 第一次运行同时做正确性检查，不计时 */
+	for (uint32_t i = 0; i < cfg->warmup + 1; i++) {
+		result = l2_batch_submit(be, batch);
+		if (result == DOCA_SUCCESS)
+			result = l2_batch_wait(be, batch);
+		if (result != DOCA_SUCCESS)
+			return result;
+		if (i == 0) {
+			L2_TRACE_BEGIN(tv);
+			res->mismatches = verify_batch(batch);
+			L2_TRACE_END(tv, "bench.verify", batch->batch_size);
+		}
+	}
+
+	for (uint32_t i = 0; i < cfg->repeats; i++) {
+		uint64_t t0 = now_ns(), t1, t2;
+
+		result = l2_batch_submit(be, batch);
+		t1 = now_ns();
+		if (result == DOCA_SUCCESS)
+			result = l2_batch_wait(be, batch);
+		t2 = now_ns();
+		if (result != DOCA_SUCCESS)
+			return result;
+		L2_TRACE_END(t0, "bench.repeat", batch->batch_size);
+		launch[i] = t1 - t0;
+		total[i] = t2 - t0;
+		sum += total[i];
+	}
+
+	qsort(total, cfg->repeats, sizeof(*total), u64_cmp);
+	qsort(launch, cfg->repeats, sizeof(*launch), u64_cmp);
+	bytes = (uint64_t)batch->batch_size * (2ULL * l2_elem_row_bytes(res->elem, batch->dim) + sizeof(uint64_t));
+
+	res->repeats = cfg->repeats;
+	res->launch_p50_us = percentile(launch, cfg->repeats, 0.5) / 1e3;
+	res->min_us = total[0] / 1e3;
+	res->p50_us = percentile(total, cfg->repeats, 0.5) / 1e3;
+	res->p99_us = percentile(total, cfg->repeats, 0.99) / 1e3;
+	res->mean_us = (double)sum / cfg->repeats / 1e3;
+	res->vec_per_s = batch->batch_size / (res->p50_us / 1e6);
+	res->gb_per_s = bytes / (res->p50_us * 1e3);
+	return DOCA_SUCCESS;
+}
+
+static void print_result(const struct l2_bench_result *r)
+{
+	printf("%-5s %-7s %-7s %-8s %5u %9u %4u | %10.1f %10.1f %10.1f %10.1f | %8.2f Mvec/s %7.2f GB/s%s\n",
+	       l2_backend_type_name(r->backend), l2_elem_name(r->elem), l2_layout_name(r->layout),
+	       l2_variant_name(r->variant), r->dim,
+	       r->batch, r->threads, r->launch_p50_us, r->min_us, r->p50_us, r->p99_us, r->vec_per_s / 1e6,
+	       r->gb_per_s, r->mismatches != 0 ? "  MISMATCH" : "");
+}
+
+static doca_error_t write_csv(const char *path, const struct l2_bench_result *res, uint32_t n)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		DOCA_LOG_ERR("Failed to open %s for writing", path);
+		return DOCA_ERROR_IO_FAILED;
+	}
+	fprintf(f, "backend,elem,layout,variant,dim,batch,threads,repeats,launch_p50_us,min_us,p50_us,p99_us,mean_us,"
+		   "vec_per_s,gb_per_s,mismatches\n");
+	for (uint32_t i = 0; i < n; i++) {
+		const struct l2_bench_result *r = &res[i];
+
+		fprintf(f, "%s,%s,%s,%s,%u,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.4f,%lu\n",
+			l2_backend_type_name(r->backend), l2_elem_name(r->elem), l2_layout_name(r->layout),
+			l2_variant_name(r->variant), r->dim,
+			r->batch, r->threads, r->repeats, r->launch_p50_us, r->min_us, r->p50_us, r->p99_us,
+			r->mean_us, r->vec_per_s, r->gb_per_s, r->mismatches);
+	}
+	fclose(f);
+	return DOCA_SUCCESS;
+}
+
+static doca_error_t write_json(const char *path, const struct l2_bench_cfg *cfg, const struct l2_bench_result *res,
+			       uint32_t n)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		DOCA_LOG_ERR("Failed to open %s for writing", path);
+		return DOCA_ERROR_IO_FAILED;
+	}
+	fprintf(f, "{\n  \"host_simd\": \"%s\",\n  \"warmup\": %u,\n  \"repeats\": %u,\n  \"results\": [\n",
+		l2_simd_isa_name(l2_simd_isa()), cfg->warmup, cfg->repeats);
+	for (uint32_t i = 0; i < n; i++) {
+		const struct l2_bench_result *r = &res[i];
+
+		fprintf(f,
+			"    {\"backend\": \"%s\", \"elem\": \"%s\", \"layout\": \"%s\", \"variant\": \"%s\", "
+			"\"dim\": %u, \"batch\": %u, "
+			"\"threads\": %u, \"launch_p50_us\": %.3f, \"min_us\": %.3f, \"p50_us\": %.3f, "
+			"\"p99_us\": %.3f, \"mean_us\": %.3f, \"vec_per_s\": %.1f, \"gb_per_s\": %.4f, "
+			"\"mismatches\": %lu}%s\n",
+			l2_backend_type_name(r->backend), l2_elem_name(r->elem), l2_layout_name(r->layout),
+			l2_variant_name(r->variant), r->dim, r->batch, r->threads, r->launch_p50_us, r->min_us, r->p50_us, r->p99_us, r->mean_us,
+			r->vec_per_s, r->gb_per_s, r->mismatches, i + 1 < n ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	return DOCA_SUCCESS;
+}
+
+/* 一个 backend 配置下跑完 elem x layout x dim x batch */
+static doca_error_t bench_backend(const struct l2_bench_cfg *cfg, const struct l2_backend_cfg *be_cfg,
+				  uint64_t *samples, struct l2_bench_result *res, uint32_t *n)
+{
+	struct l2_backend *be;
+	uint64_t seed = 0x9e3779b97f4a7c15ULL;
+	doca_error_t result, status = DOCA_SUCCESS;
+
+	result = l2_backend_create(be_cfg, &be);
+	if (result != DOCA_SUCCESS) {
+		DOCA_LOG_ERR("Failed to create %s backend: %s", l2_backend_type_name(be_cfg->type),
+			     doca_error_get_descr(result));
+		return result;
+	}
+
+	for (uint32_t e = 0; e < cfg->num_elems; e++) {
+		for (uint32_t l = 0; l < cfg->num_layouts; l++) {
+			for (uint32_t d = 0; d < cfg->num_dims; d++) {
+				for (uint32_t b = 0; b < cfg->num_batches; b++) {
+					struct l2_bench_result *r = &res[*n];
+					enum l2_layout layout = cfg->layouts[l];
+					enum l2_elem elem = cfg->elems[e];
+					struct l2_batch batch;
+					struct l2_batch_args args;
+					struct l2_batch_blocked_args blocked;
+					struct l2_qbatch_args qargs;
+					size_t vec_len;
+
+					/* 量化格式只有 AOS 的 kernel */
+					if (elem != L2_ELEM_Q16_16 && layout != L2_LAYOUT_AOS)
+						continue;
+					if (elem != L2_ELEM_Q16_16) {
+						result = l2_batch_alloc_elem(be, cfg->dims[d], cfg->batches[b], elem, &batch);
+						if (result != DOCA_SUCCESS)
+							goto out;
+						result = fill_random_rows(&batch, batch.a, &seed);
+						if (result == DOCA_SUCCESS)
+							result = fill_random_rows(&batch, batch.b, &seed);
+						if (result != DOCA_SUCCESS) {
+							l2_batch_free(be, &batch);
+							goto out;
+						}
+					} else {
+						result = l2_batch_alloc_layout(be, cfg->dims[d], cfg->batches[b], layout,
+									       &batch);
+						if (result != DOCA_SUCCESS)
+							goto out;
+						/* blocked 的 padding lane 也填上，kernel 会算但不写回 */
+						vec_len = l2_layout_vec_bytes(layout, batch.dim, batch.batch_size) /
+							  sizeof(int32_t);
+						fill_random(batch.a, vec_len, &seed);
+						fill_random(batch.b, vec_len, &seed);
+					}
+
+					memset(r, 0, sizeof(*r));
+					r->backend = be_cfg->type;
+					r->elem = elem;
+					r->layout = layout;
+					/* cpu 参考实现不区分 variant，blocked / 量化 kernel 只有通用版本 */
+					if (elem != L2_ELEM_Q16_16) {
+						l2_batch_fill_qargs(&batch, 0, batch.batch_size, &qargs);
+						r->variant = l2_backend_variant(be, L2_KERNEL_QBATCH, &qargs);
+					} else if (layout == L2_LAYOUT_BLOCKED) {
+						l2_batch_fill_blocked_args(&batch, &blocked);
+						r->variant = l2_backend_variant(be, L2_KERNEL_BATCH_BLOCKED, &blocked);
+					} else {
+						l2_batch_fill_args(&batch, 0, batch.batch_size, &args);
+						r->variant = be_cfg->type == L2_BACKEND_CPU ?
+								     L2_VARIANT_GENERIC :
+								     l2_backend_variant(be, L2_KERNEL_BATCH, &args);
+					}
+					r->dim = batch.dim;
+					r->batch = batch.batch_size;
+					r->threads = be_cfg->num_threads;
+
+					result = bench_point(be, cfg, &batch, samples, r);
+					l2_batch_free(be, &batch);
+					if (result != DOCA_SUCCESS)
+						goto out;
+					print_result(r);
+					if (r->mismatches != 0)
+						status = DOCA_ERROR_UNEXPECTED;
+					(*n)++;
+				}
+			}
+		}
+	}
+	result = status;
+out:
+	l2_backend_destroy(be);
+	return result;
+}
+
+doca_error_t l2_bench_run(const struct l2_bench_cfg *cfg, struct dpa_resources *resources)
+{
+	uint32_t max_points, n = 0;
+	size_t max_bytes = 0;
+	struct l2_bench_result *res;
+	uint64_t *samples;
+	doca_error_t result = DOCA_SUCCESS, status = DOCA_SUCCESS;
+
+	if (cfg->repeats == 0)
+		return DOCA_ERROR_INVALID_VALUE;
+	for (uint32_t e = 0; e < cfg->num_elems; e++) {
+		if (cfg->elems[e] >= L2_ELEM_MAX)
+			return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	/* arena 按最大的一个点来开 */
+	for (uint32_t d = 0; d < cfg->num_dims; d++) {
+		for (uint32_t b = 0; b < cfg->num_batches; b++) {
+			/* blocked 会把 batch 补齐到 L2_BLOCK_VECS 的倍数 */
+			size_t bytes = 2 * l2_layout_vec_bytes(L2_LAYOUT_BLOCKED, cfg->dims[d], cfg->batches[b]) +
+				       (size_t)cfg->batches[b] * sizeof(uint64_t);
+
+			if (bytes > max_bytes)
+				max_bytes = bytes;
+			/* 很小的 dim 时量化行的 header 比数据还大 */
+			for (uint32_t e = 0; e < cfg->num_elems; e++) {
+				bytes = 2 * ((size_t)cfg->batches[b] * l2_elem_row_bytes(cfg->elems[e], cfg->dims[d]) + 64) +
+					(size_t)cfg->batches[b] * sizeof(uint64_t);
+				if (bytes > max_bytes)
+					max_bytes = bytes;
+			}
+		}
+	}
+
+	max_points = cfg->num_backends * cfg->num_threads * (cfg->compare_generic ? 2 : 1) * cfg->num_elems *
+		     cfg->num_layouts * cfg->num_dims * cfg->num_batches;
+	res = calloc(max_points, sizeof(*res));
+	samples = calloc(2 * (size_t)cfg->repeats, sizeof(*samples));
+	if (res == NULL || samples == NULL) {
+		free(res);
+		free(samples);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+
+	printf("%-5s %-7s %-7s %-8s %5s %9s %4s | %10s %10s %10s %10s | (us, %u warmup, %u repeats)\n", "be",
+	       "elem", "layout", "variant", "dim", "batch", "thr", "launch_p50", "min", "p50", "p99", cfg->warmup, cfg->repeats);
+
+	for (uint32_t bi = 0; bi < cfg->num_backends; bi++) {
+		enum l2_backend_type type = cfg->backends[bi];
+		/* cpu 在调用线程上单线程执行，线程数不影响结果；host 的线程数是 worker pool 的大小 */
+		uint32_t nthr = type == L2_BACKEND_CPU ? 1 : cfg->num_threads;
+
+		if (type == L2_BACKEND_DPA && resources == NULL) {
+			DOCA_LOG_ERR("DPA backend requested without DPA resources");
+			status = DOCA_ERROR_INVALID_VALUE;
+			continue;
+		}
+		for (uint32_t ti = 0; ti < nthr; ti++) {
+			for (int generic = 0; generic <= cfg->compare_generic; generic++) {
+				struct l2_backend_cfg be_cfg = {
+					.type = type,
+					.resources = resources,
+					.num_threads = cfg->threads[ti],
+					.arena_size = max_bytes + (2UL << 20),
+					.arena_page = DPA_ARENA_PAGE_2M,
+					.generic_kernels = generic,
+					.host_threads = cfg->threads[ti],
+					.host_partition = cfg->host_stride ? L2_HOST_PART_STRIDE : L2_HOST_PART_CHUNK,
+				};
+
+				result = bench_backend(cfg, &be_cfg, samples, res, &n);
+				if (result != DOCA_SUCCESS)
+					status = result;
+			}
+		}
+	}
+
+	if (cfg->csv_path[0] != '\0') {
+		result = write_csv(cfg->csv_path, res, n);
+		if (result != DOCA_SUCCESS)
+			status = result;
+	}
+	if (cfg->json_path[0] != '\0') {
+		result = write_json(cfg->json_path, cfg, res, n);
+		if (result != DOCA_SUCCESS)
+			status = result;
+	}
+
+	free(samples);
+	free(res);
+	return status;
+}
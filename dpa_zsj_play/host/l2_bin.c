@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_bin.h"
+#include "../include/l2_search.h"
+#include "../include/l2_topk.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::BIN);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+doca_error_t l2_bin_train(const int32_t *vecs, uint32_t n, uint32_t dim, struct l2_bin *bin)
+{
+	int64_t *sum;
+
+	memset(bin, 0, sizeof(*bin));
+	if (n == 0 || dim == 0) {
+		DOCA_LOG_ERR("Cannot fit binary codes on %u vectors of dim %u", n, dim);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	sum = calloc(dim, sizeof(*sum));
+	bin->center = malloc((size_t)dim * sizeof(*bin->center));
+	if (sum == NULL || bin->center == NULL) {
+		free(sum);
+		free(bin->center);
+		bin->center = NULL;
+		return DOCA_ERROR_NO_MEMORY;
+	}
+
+	/* 均值做阈值：全非负的数据（SIFT 这类）按符号位切会全是 1 */
+	for (uint32_t i = 0; i < n; i++) {
+		const int32_t *v = vecs + (size_t)i * dim;
+
+		for (uint32_t d = 0; d < dim; d++)
+			sum[d] += v[d];
+	}
+	for (uint32_t d = 0; d < dim; d++)
+		bin->center[d] = (int32_t)(sum[d] / n);
+	free(sum);
+	bin->dim = dim;
+	bin->words = L2_BIN_WORDS(dim);
+	return DOCA_SUCCESS;
+}
+
+void l2_bin_free(struct l2_bin *bin)
+{
+	free(bin->center);
+	memset(bin, 0, sizeof(*bin));
+}
+
+void l2_bin_encode_one(const struct l2_bin *bin, const int32_t *vec, uint32_t *code)
+{
+	/* dim 不是 32 的倍数时最后一个字的高位留 0，两边都是 0，不影响距离 */
+	memset(code, 0, bin->words * sizeof(*code));
+	for (uint32_t d = 0; d < bin->dim; d++)
+		code[d / 32] |= (uint32_t)(vec[d] >= bin->center[d]) << (d % 32);
+}
+
+doca_error_t l2_bin_encode(struct l2_backend *be, const struct l2_bin *bin, const int32_t *vecs, uint32_t n,
+			   struct l2_bin_codes *codes)
+{
+	doca_error_t result;
+
+	memset(codes, 0, sizeof(*codes));
+	result = l2_backend_mem_alloc(be, (size_t)n * bin->words * sizeof(uint32_t), &codes->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+	codes->codes = codes->mem.addr;
+	codes->n = n;
+	codes->words = bin->words;
+
+	L2_TRACE_BEGIN(t0);
+	for (uint32_t i = 0; i < n; i++)
+		l2_bin_encode_one(bin, vecs + (size_t)i * bin->dim, codes->codes + (size_t)i * bin->words);
+	L2_TRACE_END(t0, "bin.encode", n);
+	return DOCA_SUCCESS;
+}
+
+void l2_bin_codes_free(struct l2_backend *be, struct l2_bin_codes *codes)
+{
+	l2_backend_mem_free(be, &codes->mem);
+	memset(codes, 0, sizeof(*codes));
+}
+
+doca_error_t l2_bin_search_alloc(struct l2_backend *be, const struct l2_bin *bin, uint32_t max_nq, uint32_t k,
+				 uint32_t rerank, struct l2_bin_search *search)
+{
+	uint32_t num_parts = be->cfg.num_threads;
+	uint32_t k_part = rerank < L2_SEARCH_MAX_K ? rerank : L2_SEARCH_MAX_K;
+	size_t qcodes_bytes = ALIGN64((size_t)max_nq * bin->words * sizeof(uint32_t));
+	size_t parts_bytes = ALIGN64((size_t)max_nq * num_parts * k_part * sizeof(struct l2_hit));
+	size_t queries_bytes = ALIGN64((size_t)max_nq * bin->dim * sizeof(int32_t));
+	size_t rows_bytes = ALIGN64((size_t)max_nq * rerank * bin->dim * sizeof(int32_t));
+	size_t ids_bytes = ALIGN64((size_t)max_nq * rerank * sizeof(uint32_t));
+	size_t offsets_bytes = ALIGN64((size_t)(max_nq + 1) * sizeof(uint32_t));
+	size_t probes_bytes = ALIGN64((size_t)max_nq * sizeof(uint32_t));
+	size_t rparts_bytes = (size_t)max_nq * num_parts * k * sizeof(struct l2_hit);
+	uint8_t *p;
+	doca_error_t result;
+
+	memset(search, 0, sizeof(*search));
+	if (k == 0 || k > L2_SEARCH_MAX_K || max_nq == 0 || rerank < k ||
+	    rerank > (uint64_t)num_parts * L2_SEARCH_MAX_K) {
+		DOCA_LOG_ERR("Invalid binary search shape: k = %u (max %u), rerank = %u (%u..%u), max_nq = %u", k,
+			     L2_SEARCH_MAX_K, rerank, k, num_parts * L2_SEARCH_MAX_K, max_nq);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	search->cand = malloc((size_t)rerank * sizeof(*search->cand));
+	if (search->cand == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	result = l2_backend_mem_alloc(be,
+				      qcodes_bytes + parts_bytes + queries_bytes + rows_bytes + ids_bytes +
+					      offsets_bytes + probes_bytes + rparts_bytes,
+				      &search->mem);
+	if (result != DOCA_SUCCESS) {
+		free(search->cand);
+		search->cand = NULL;
+		return result;
+	}
+
+	p = search->mem.addr;
+	search->qcodes = (uint32_t *)p;
+	p += qcodes_bytes;
+	search->parts = (struct l2_hit *)p;
+	p += parts_bytes;
+	search->queries = (int32_t *)p;
+	p += queries_bytes;
+	search->rows = (int32_t *)p;
+	p += rows_bytes;
+	search->ids = (uint32_t *)p;
+	p += ids_bytes;
+	search->offsets = (uint32_t *)p;
+	p += offsets_bytes;
+	search->probes = (uint32_t *)p;
+	p += probes_bytes;
+	search->rparts = (struct l2_hit *)p;
+	search->dim = bin->dim;
+	search->max_nq = max_nq;
+	search->k = k;
+	search->rerank = rerank;
+	search->k_part = k_part;
+	search->num_parts = num_parts;
+	return DOCA_SUCCESS;
+}
+
+void l2_bin_search_free(struct l2_backend *be, struct l2_bin_search *search)
+{
+	l2_backend_mem_free(be, &search->mem);
+	free(search->cand);
+	memset(search, 0, sizeof(*search));
+}
+
+/* query q 的 num_parts 段 Hamming 候选合成前 rerank 个，拷进重排区，返回候选数 */
+static uint32_t bin_gather(const struct l2_bin_search *search, const int32_t *vecs, uint32_t q, uint32_t off)
+{
+	const struct l2_hit *parts = search->parts + (uint64_t)q * search->num_parts * search->k_part;
+	uint32_t n = 0;
+
+	for (uint64_t i = 0; i < (uint64_t)search->num_parts * search->k_part; i++) {
+		if (parts[i].id == L2_HIT_EMPTY_ID)
+			continue;
+		l2_topk_push(search->cand, &n, search->rerank, parts[i].dist, parts[i].id);
+	}
+	/* 重排不看顺序，堆里的候选直接拷 */
+	for (uint32_t j = 0; j < n; j++) {
+		search->ids[off + j] = search->cand[j].id;
+		memcpy(search->rows + (size_t)(off + j) * search->dim, vecs + (size_t)search->cand[j].id * search->dim,
+		       search->dim * sizeof(int32_t));
+	}
+	return n;
+}
+
+doca_error_t l2_bin_search(struct l2_backend *be, const struct l2_bin *bin, const struct l2_bin_codes *codes,
+			   const int32_t *vecs, struct l2_bin_search *search, const int32_t *queries, uint32_t nq,
+			   struct l2_hit *results, struct l2_bin_search_stats *stats)
+{
+	struct l2_hamming_args hargs;
+	struct l2_ivf_args iargs;
+	uint64_t t0 = now_ns(), t1, t2;
+	uint32_t off = 0;
+	doca_error_t result;
+
+	if (nq == 0 || nq > search->max_nq || codes->words != bin->words || search->dim != bin->dim) {
+		DOCA_LOG_ERR("Invalid binary search: %u queries (max %u), %u-word codes for dim %u", nq,
+			     search->max_nq, codes->words, bin->dim);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	for (uint32_t q = 0; q < nq; q++)
+		l2_bin_encode_one(bin, queries + (size_t)q * bin->dim, search->qcodes + (size_t)q * bin->words);
+
+	/* 第一段：Hamming 扫描，codes 和 search 都在同一个 arena 里，handle 相同 */
+	hargs.handle = search->mem.handle;
+	hargs.q_base = (uint64_t)(uintptr_t)search->qcodes;
+	hargs.codes_base = (uint64_t)(uintptr_t)codes->codes;
+	hargs.out_base = (uint64_t)(uintptr_t)search->parts;
+	hargs.words = bin->words;
+	hargs.nq = nq;
+	hargs.n = codes->n;
+	hargs.k = search->k_part;
+	hargs.num_parts = search->num_parts;
+	hargs.id_base = 0;
+	result = l2_backend_launch(be, L2_KERNEL_HAMMING, &hargs, &search->seq);
+	if (result == DOCA_SUCCESS)
+		result = l2_backend_wait(be, search->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	t1 = now_ns();
+
+	/* 候选向量按 query 首尾相接，每个 query 是一个只有自己的 "倒排表" */
+	L2_TRACE_BEGIN(tg);
+	for (uint32_t q = 0; q < nq; q++) {
+		search->offsets[q] = off;
+		search->probes[q] = q;
+		off += bin_gather(search, vecs, q, off);
+	}
+	search->offsets[nq] = off;
+	memcpy(search->queries, queries, (size_t)nq * bin->dim * sizeof(int32_t));
+	L2_TRACE_END(tg, "bin.gather", (uint64_t)off * bin->dim * sizeof(int32_t));
+	t2 = now_ns();
+
+	/* 第二段：l2_ivf_kernel 算候选的精确距离 */
+	iargs.handle = search->mem.handle;
+	iargs.q_base = (uint64_t)(uintptr_t)search->queries;
+	iargs.db_base = (uint64_t)(uintptr_t)search->rows;
+	iargs.ids_base = (uint64_t)(uintptr_t)search->ids;
+	iargs.offsets_base = (uint64_t)(uintptr_t)search->offsets;
+	iargs.probes_base = (uint64_t)(uintptr_t)search->probes;
+	iargs.out_base = (uint64_t)(uintptr_t)search->rparts;
+	iargs.q_stride = bin->dim * sizeof(int32_t);
+	iargs.db_stride = bin->dim * sizeof(int32_t);
+	iargs.dim = bin->dim;
+	iargs.frac_bits = 16;
+	iargs.nq = nq;
+	iargs.nprobe = 1;
+	iargs.k = search->k;
+	iargs.num_parts = search->num_parts;
+	result = l2_backend_launch(be, L2_KERNEL_IVF, &iargs, &search->seq);
+	if (result == DOCA_SUCCESS)
+		result = l2_backend_wait(be, search->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	for (uint32_t q = 0; q < nq; q++)
+		l2_topk_merge(search->rparts + (uint64_t)q * search->num_parts * search->k, search->num_parts,
+			      search->k, results + (uint64_t)q * search->k);
+
+	if (stats != NULL) {
+		stats->scan_ns += t1 - t0;
+		stats->gather_ns += t2 - t1;
+		stats->rerank_ns += now_ns() - t2;
+		stats->candidates += off;
+	}
+	return DOCA_SUCCESS;
+}
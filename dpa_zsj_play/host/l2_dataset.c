@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_dataset.h"
+#include "../include/l2_search.h"
+#include "../include/l2_topk.h"
+#include "../include/l2_trace.h"
+#include "../include/utils.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::DATASET);
+
+/* 维度上限，防止把坏文件的前 4 个字节当成巨大的 dim */
+#define L2_VECS_MAX_DIM (1u << 20)
+/* 每个线程至少量化这么多个元素，太少不值得开线程 */
+#define L2_VECS_MIN_PER_THREAD (64 * 1024)
+/* search 一次最多带多少个 query，限制 parts 区的大小 */
+#define L2_VECS_MAX_QUERY_BATCH 256
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t elem_size(enum l2_vecs_type type)
+{
+	return type == L2_VECS_BVECS ? sizeof(uint8_t) : sizeof(int32_t);
+}
+
+const char *l2_vecs_type_name(enum l2_vecs_type type)
+{
+	switch (type) {
+	case L2_VECS_FVECS:
+		return "fvecs";
+	case L2_VECS_BVECS:
+		return "bvecs";
+	case L2_VECS_IVECS:
+		return "ivecs";
+	}
+	return "unknown";
+}
+
+static int type_from_path(const char *path, enum l2_vecs_type *type)
+{
+	const char *ext = strrchr(path, '.');
+
+	if (ext == NULL)
+		return -1;
+	if (strcmp(ext, ".fvecs") == 0)
+		*type = L2_VECS_FVECS;
+	else if (strcmp(ext, ".bvecs") == 0)
+		*type = L2_VECS_BVECS;
+	else if (strcmp(ext, ".ivecs") == 0)
+		*type = L2_VECS_IVECS;
+	else
+		return -1;
+	return 0;
+}
+
+static inline int32_t row_dim(const struct l2_vecs *vs, uint64_t i)
+{
+	int32_t d;
+
+	/* header 不一定 4 字节对齐（bvecs） */
+	memcpy(&d, vs->rows + i * vs->row_bytes, sizeof(d));
+	return d;
+}
+
+doca_error_t l2_vecs_open(const char *path, struct l2_vecs *vs)
+{
+	struct stat st;
+	int32_t dim;
+	void *map;
+	int fd;
+
+	memset(vs, 0, sizeof(*vs));
+	if (type_from_path(path, &vs->type) != 0) {
+		DOCA_LOG_ERR("%s: expected a .fvecs, .bvecs or .ivecs file", path);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		DOCA_LOG_ERR("Failed to open %s: %s", path, strerror(errno));
+		return DOCA_ERROR_IO_FAILED;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(int32_t)) {
+		DOCA_LOG_ERR("%s: empty or unreadable file", path);
+		close(fd);
+		return DOCA_ERROR_IO_FAILED;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* mapping 持有文件引用，fd 可以直接关掉 */
+	close(fd);
+	if (map == MAP_FAILED) {
+		DOCA_LOG_ERR("Failed to mmap %s: %s", path, strerror(errno));
+		return DOCA_ERROR_IO_FAILED;
+	}
+
+	memcpy(&dim, map, sizeof(dim));
+	vs->map = map;
+	vs->map_bytes = (size_t)st.st_size;
+	vs->rows = map;
+	if (dim <= 0 || (uint32_t)dim > L2_VECS_MAX_DIM) {
+		DOCA_LOG_ERR("%s: bad dimension %d in the first record", path, dim);
+		goto bad_file;
+	}
+	vs->dim = (uint32_t)dim;
+	vs->row_bytes = sizeof(int32_t) + (size_t)dim * elem_size(vs->type);
+	if (vs->map_bytes % vs->row_bytes != 0) {
+		DOCA_LOG_ERR("%s: size %zu is not a multiple of the %zu-byte %s record", path, vs->map_bytes,
+			     vs->row_bytes, l2_vecs_type_name(vs->type));
+		goto bad_file;
+	}
+	vs->count = vs->map_bytes / vs->row_bytes;
+	/* 中间行的 header 在量化时顺带检查，这里只看最后一行，不把整个文件读一遍 */
+	if (row_dim(vs, vs->count - 1) != dim) {
+		DOCA_LOG_ERR("%s: last record has dimension %d, expected %d", path, row_dim(vs, vs->count - 1), dim);
+		goto bad_file;
+	}
+
+	DOCA_LOG_INFO("Mapped %s: %lu x %u %s", path, vs->count, vs->dim, l2_vecs_type_name(vs->type));
+	return DOCA_SUCCESS;
+
+bad_file:
+	l2_vecs_close(vs);
+	return DOCA_ERROR_INVALID_VALUE;
+}
+
+void l2_vecs_close(struct l2_vecs *vs)
+{
+	if (vs->map != NULL)
+		munmap(vs->map, vs->map_bytes);
+	memset(vs, 0, sizeof(*vs));
+}
+
+doca_error_t l2_vecs_slice(const struct l2_vecs *vs, uint64_t first, uint64_t count, struct l2_vecs *view)
+{
+	if (first > vs->count || count > vs->count - first)
+		return DOCA_ERROR_INVALID_VALUE;
+	*view = *vs;
+	view->rows = vs->rows + first * vs->row_bytes;
+	view->count = count;
+	view->map = NULL;
+	view->map_bytes = 0;
+	return DOCA_SUCCESS;
+}
+
+/* 一段连续行的量化任务 */
+struct vecs_job {
+	const struct l2_vecs *vs;
+	uint64_t first;
+	uint64_t count;
+	int32_t *dst;
+	doca_error_t result;
+};
+
+static inline int32_t sat_q16_16(int64_t v)
+{
+	if (v > INT32_MAX >> 16)
+		return INT32_MAX;
+	if (v < INT32_MIN >> 16)
+		return INT32_MIN;
+	return (int32_t)(v * 65536);
+}
+
+static void *vecs_worker(void *arg)
+{
+	struct vecs_job *job = arg;
+	const struct l2_vecs *vs = job->vs;
+	const uint32_t dim = vs->dim;
+
+	job->result = DOCA_SUCCESS;
+	for (uint64_t r = 0; r < job->count; r++) {
+		uint64_t i = job->first + r;
+		int32_t *out = job->dst + r * dim;
+		const void *row = l2_vecs_row(vs, i);
+
+		if (row_dim(vs, i) != (int32_t)dim) {
+			DOCA_LOG_ERR("Record %lu has dimension %d, expected %u", i, row_dim(vs, i), dim);
+			job->result = DOCA_ERROR_BAD_STATE;
+			break;
+		}
+		switch (vs->type) {
+		case L2_VECS_FVECS:
+			/* 外层已经按行分了线程，这里单线程 */
+			q16_16_quantize_float(row, out, dim, 1);
+			break;
+		case L2_VECS_BVECS:
+			for (uint32_t j = 0; j < dim; j++)
+				out[j] = (int32_t)((const uint8_t *)row)[j] << 16;
+			break;
+		case L2_VECS_IVECS:
+			for (uint32_t j = 0; j < dim; j++) {
+				int32_t v;
+
+				memcpy(&v, (const uint8_t *)row + (size_t)j * sizeof(v), sizeof(v));
+				out[j] = sat_q16_16(v);
+			}
+			break;
+		}
+	}
+	return NULL;
+}
+
+doca_error_t l2_vecs_quantize(const struct l2_vecs *vs, uint64_t first, uint32_t count, int32_t *dst,
+			      unsigned int num_threads)
+{
+	doca_error_t result = DOCA_SUCCESS;
+	uint64_t per;
+
+	if (first > vs->count || count > vs->count - first)
+		return DOCA_ERROR_INVALID_VALUE;
+	if (num_threads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		num_threads = ncpu > 0 ? (unsigned int)ncpu : 1;
+	}
+	if ((uint64_t)num_threads * L2_VECS_MIN_PER_THREAD > (uint64_t)count * vs->dim)
+		num_threads = (unsigned int)((uint64_t)count * vs->dim / L2_VECS_MIN_PER_THREAD);
+	if (num_threads <= 1) {
+		struct vecs_job job = {vs, first, count, dst, DOCA_SUCCESS};
+
+		vecs_worker(&job);
+		return job.result;
+	}
+
+	pthread_t tids[num_threads];
+	struct vecs_job jobs[num_threads];
+	unsigned int started = 0, used = 0;
+
+	per = (count + num_threads - 1) / num_threads;
+	for (unsigned int t = 0; t < num_threads; t++) {
+		uint64_t begin = (uint64_t)t * per;
+		uint64_t end = begin + per < count ? begin + per : count;
+
+		if (begin >= end)
+			break;
+		jobs[t] = (struct vecs_job){vs, first + begin, end - begin, dst + begin * vs->dim, DOCA_SUCCESS};
+		used = t + 1;
+		/* 最后一块在当前线程上做 */
+		if (end == count) {
+			vecs_worker(&jobs[t]);
+			break;
+		}
+		if (pthread_create(&tids[started], NULL, vecs_worker, &jobs[t]) != 0)
+			vecs_worker(&jobs[t]);
+		else
+			started++;
+	}
+	for (unsigned int t = 0; t < started; t++)
+		pthread_join(tids[t], NULL);
+	for (unsigned int t = 0; t < used; t++) {
+		if (jobs[t].result != DOCA_SUCCESS && result == DOCA_SUCCESS)
+			result = jobs[t].result;
+	}
+	return result;
+}
+
+void l2_vecs_stream_init(struct l2_vecs_stream *st, const struct l2_vecs *vs, uint32_t chunk,
+			 unsigned int num_threads)
+{
+	st->vs = vs;
+	st->next = 0;
+	st->chunk = chunk != 0 ? chunk : 1;
+	st->num_threads = num_threads;
+}
+
+/* 对 [begin, end) 里完整包含的页做 madvise，view 的边界不一定页对齐 */
+static void advise_rows(const uint8_t *begin, const uint8_t *end, int advice)
+{
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t b = ((uintptr_t)begin + page - 1) & ~(page - 1);
+	uintptr_t e = (uintptr_t)end & ~(page - 1);
+
+	if (e > b)
+		(void)madvise((void *)b, e - b, advice);
+}
+
+doca_error_t l2_vecs_stream_next(struct l2_vecs_stream *st, int32_t *dst, uint64_t *first, uint32_t *count)
+{
+	const struct l2_vecs *vs = st->vs;
+	uint64_t left = vs->count - st->next;
+	uint32_t n = left < st->chunk ? (uint32_t)left : st->chunk;
+	const uint8_t *begin = vs->rows + st->next * vs->row_bytes;
+	const uint8_t *end = begin + (size_t)n * vs->row_bytes;
+	doca_error_t result;
+
+	*first = st->next;
+	*count = n;
+	if (n == 0)
+		return DOCA_SUCCESS;
+
+	/* 先让内核预读下一块，再量化这一块 */
+	if (n < left) {
+		uint64_t next_n = left - n < st->chunk ? left - n : st->chunk;
+
+		advise_rows(end, end + next_n * vs->row_bytes, MADV_WILLNEED);
+	}
+	result = l2_vecs_quantize(vs, st->next, n, dst, st->num_threads);
+	if (result != DOCA_SUCCESS)
+		return result;
+	/* 只读的文件映射，丢掉后再访问会重新从 page cache / 磁盘读，不会丢数据 */
+	advise_rows(begin, end, MADV_DONTNEED);
+	st->next += n;
+	return DOCA_SUCCESS;
+}
+
+/* 一个 query batch 在当前 chunk 上的结果合并进 results */
+static void merge_chunk(const struct l2_hit *chunk_hits, uint32_t nq, uint32_t k, struct l2_hit *results,
+			struct l2_hit *tmp)
+{
+	for (uint32_t q = 0; q < nq; q++) {
+		memcpy(tmp, results + (size_t)q * k, k * sizeof(*tmp));
+		memcpy(tmp + k, chunk_hits + (size_t)q * k, k * sizeof(*tmp));
+		l2_topk_merge(tmp, 2, k, results + (size_t)q * k);
+	}
+}
+
+doca_error_t l2_vecs_search(struct l2_backend *be, const struct l2_vecs *base, const struct l2_vecs *queries,
+			    uint32_t k, uint32_t chunk_vectors, struct l2_hit *results,
+			    struct l2_vecs_search_stats *stats)
+{
+	const uint32_t nq = (uint32_t)queries->count;
+	const uint32_t qbatch = nq < L2_VECS_MAX_QUERY_BATCH ? nq : L2_VECS_MAX_QUERY_BATCH;
+	struct l2_vecs_search_stats st = {0};
+	struct l2_vecs_stream stream;
+	struct l2_db db[2];
+	struct l2_search search;
+	struct l2_hit *chunk_hits = NULL, *tmp = NULL;
+	uint64_t first, t_start = now_ns(), t0;
+	uint32_t count, loaded_q = UINT32_MAX;	/* search.queries 里现在是哪个 query batch */
+	doca_error_t result;
+	int cur = 0;
+
+	if (base->dim != queries->dim || nq == 0 || queries->count > UINT32_MAX || chunk_vectors == 0) {
+		DOCA_LOG_ERR("Invalid search: base dim %u, query dim %u, %lu queries, chunk %u", base->dim,
+			     queries->dim, queries->count, chunk_vectors);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (base->count > (uint64_t)UINT32_MAX) {
+		DOCA_LOG_ERR("Base set of %lu vectors does not fit 32-bit ids", base->count);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	memset(db, 0, sizeof(db));
+	result = l2_db_alloc(be, base->dim, chunk_vectors, &db[0]);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(be, base->dim, chunk_vectors, &db[1]);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+	result = l2_search_alloc(be, base->dim, qbatch, k, &search);
+	if (result != DOCA_SUCCESS)
+		goto free_db;
+
+	chunk_hits = calloc((size_t)qbatch * k, sizeof(*chunk_hits));
+	tmp = calloc(2 * (size_t)k, sizeof(*tmp));
+	if (chunk_hits == NULL || tmp == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_search;
+	}
+	for (uint32_t q = 0; q < nq; q++)
+		l2_topk_pad(results + (size_t)q * k, 0, k);
+
+	/* 第一块单独装，之后每块都在下一块的 search 跑的时候装 */
+	l2_vecs_stream_init(&stream, base, chunk_vectors, 0);
+	t0 = now_ns();
+	result = l2_vecs_stream_next(&stream, db[cur].vecs, &first, &count);
+	st.quantize_ns += now_ns() - t0;
+	L2_TRACE_END(t0, "dataset.stage", count);
+	L2_TRACE_COUNTER("bytes_staged", (uint64_t)count * base->dim * sizeof(int32_t));
+	db[cur].size = count;
+	db[cur].id_base = (uint32_t)first;
+
+	while (result == DOCA_SUCCESS && db[cur].size > 0) {
+		struct l2_db *next = &db[cur ^ 1];
+
+		for (uint32_t q0 = 0; q0 < nq; q0 += qbatch) {
+			uint32_t n = nq - q0 < qbatch ? nq - q0 : qbatch;
+
+			if (loaded_q != q0) {
+				result = l2_vecs_quantize(queries, q0, n, search.queries, 0);
+				if (result != DOCA_SUCCESS)
+					break;
+				loaded_q = q0;
+			}
+			result = l2_search_submit(be, &db[cur], &search, n);
+			if (result != DOCA_SUCCESS)
+				break;
+			st.launches++;
+
+			/* 设备在算第一个 query batch 时，host 把下一块量化进另一个 buffer */
+			if (q0 == 0) {
+				t0 = now_ns();
+				result = l2_vecs_stream_next(&stream, next->vecs, &first, &count);
+				st.quantize_ns += now_ns() - t0;
+				L2_TRACE_END(t0, "dataset.stage", count);
+				L2_TRACE_COUNTER("bytes_staged", (uint64_t)count * base->dim * sizeof(int32_t));
+				next->size = count;
+				next->id_base = (uint32_t)first;
+			}
+
+			t0 = now_ns();
+			if (result == DOCA_SUCCESS)
+				result = l2_search_wait(be, &search, chunk_hits);
+			else
+				(void)l2_backend_wait(be, search.seq);
+			st.wait_ns += now_ns() - t0;
+			if (result != DOCA_SUCCESS)
+				break;
+			L2_TRACE_BEGIN(tm);
+			merge_chunk(chunk_hits, n, k, results + (size_t)q0 * k, tmp);
+			L2_TRACE_END(tm, "dataset.merge", n);
+		}
+		st.chunks++;
+		cur ^= 1;
+	}
+
+	st.total_ns = now_ns() - t_start;
+	if (stats != NULL)
+		*stats = st;
+
+free_search:
+	free(tmp);
+	free(chunk_hits);
+	l2_search_free(be, &search);
+free_db:
+	if (db[1].mem.addr != NULL)
+		l2_db_free(be, &db[1]);
+	l2_db_free(be, &db[0]);
+	return result;
+}
+
+double l2_recall_at_k(const struct l2_hit *results, uint32_t nq, uint32_t k, const struct l2_vecs *gt)
+{
+	uint64_t found = 0;
+
+	if (k == 0 || gt->type != L2_VECS_IVECS || gt->count < nq || gt->dim < k)
+		return -1.0;
+
+	for (uint32_t q = 0; q < nq; q++) {
+		const int32_t *truth = l2_vecs_row(gt, q);
+		const struct l2_hit *hits = results + (size_t)q * k;
+
+		for (uint32_t i = 0; i < k; i++) {
+			for (uint32_t j = 0; j < k; j++) {
+				if (hits[j].id != L2_HIT_EMPTY_ID && hits[j].id == (uint32_t)truth[i]) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	return (double)found / ((double)nq * k);
+}
+
+double l2_recall_vs_exact(const struct l2_hit *results, const struct l2_hit *exact, uint32_t nq, uint32_t k)
+{
+	uint64_t found = 0, total = 0;
+
+	for (uint32_t q = 0; q < nq; q++) {
+		const struct l2_hit *truth = exact + (size_t)q * k;
+		const struct l2_hit *hits = results + (size_t)q * k;
+
+		for (uint32_t i = 0; i < k; i++) {
+			if (truth[i].id == L2_HIT_EMPTY_ID)
+				continue;
+			total++;
+			for (uint32_t j = 0; j < k; j++) {
+				if (hits[j].id == truth[i].id) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	return total == 0 ? 1.0 : (double)found / total;
+}
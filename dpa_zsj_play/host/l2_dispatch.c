@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "../include/l2_dispatch.h"
+
+static const struct {
+	uint32_t dim;
+	enum l2_metric metric;
+	enum l2_elem elem;
+	enum l2_variant variant;
+} variant_table[] = {
+#define L2_VARIANT_ROW(D) {D, L2_METRIC_L2SQ, L2_ELEM_Q16_16, L2_VARIANT_D##D},
+	L2_SPEC_DIMS(L2_VARIANT_ROW)
+#undef L2_VARIANT_ROW
+};
+
+static const uint32_t variant_dims[L2_VARIANT_MAX] = {
+	[L2_VARIANT_GENERIC] = 0,
+#define L2_VARIANT_DIM(D) [L2_VARIANT_D##D] = D,
+	L2_SPEC_DIMS(L2_VARIANT_DIM)
+#undef L2_VARIANT_DIM
+};
+
+static const char *const variant_names[L2_VARIANT_MAX] = {
+	[L2_VARIANT_GENERIC] = "generic",
+#define L2_VARIANT_NAME(D) [L2_VARIANT_D##D] = "d" #D,
+	L2_SPEC_DIMS(L2_VARIANT_NAME)
+#undef L2_VARIANT_NAME
+};
+
+static const struct {
+	const char *name;
+	uint32_t size;
+	uint32_t qelem;
+} elem_info[L2_ELEM_MAX] = {
+	[L2_ELEM_Q16_16] = {"q16_16", sizeof(int32_t), 0},
+	[L2_ELEM_I16] = {"int16", sizeof(int16_t), L2_QELEM_I16},
+	[L2_ELEM_I8] = {"int8", sizeof(int8_t), L2_QELEM_I8},
+};
+
+enum l2_elem l2_elem_from_name(const char *name)
+{
+	for (int i = 0; i < L2_ELEM_MAX; i++) {
+		if (strcmp(name, elem_info[i].name) == 0)
+			return (enum l2_elem)i;
+	}
+	return L2_ELEM_MAX;
+}
+
+const char *l2_elem_name(enum l2_elem elem)
+{
+	return elem < L2_ELEM_MAX ? elem_info[elem].name : "unknown";
+}
+
+uint32_t l2_elem_size(enum l2_elem elem)
+{
+	return elem < L2_ELEM_MAX ? elem_info[elem].size : 0;
+}
+
+uint32_t l2_elem_row_bytes(enum l2_elem elem, uint32_t dim)
+{
+	if (elem >= L2_ELEM_MAX)
+		return 0;
+	if (elem_info[elem].qelem == 0)
+		return dim * elem_info[elem].size;
+	return (sizeof(struct l2_qvec_hdr) + dim * elem_info[elem].size + L2_QVEC_ROW_ALIGN - 1) &
+	       ~(uint32_t)(L2_QVEC_ROW_ALIGN - 1);
+}
+
+uint32_t l2_elem_qelem(enum l2_elem elem)
+{
+	return elem < L2_ELEM_MAX ? elem_info[elem].qelem : 0;
+}
+
+enum l2_variant l2_variant_select(uint32_t dim, enum l2_metric metric, enum l2_elem elem)
+{
+	/* 表很小，线性查找即可；每次 launch 只查一次 */
+	for (size_t i = 0; i < sizeof(variant_table) / sizeof(variant_table[0]); i++) {
+		if (variant_table[i].dim == dim && variant_table[i].metric == metric && variant_table[i].elem == elem)
+			return variant_table[i].variant;
+	}
+	return L2_VARIANT_GENERIC;
+}
+
+uint32_t l2_variant_dim(enum l2_variant variant)
+{
+	return variant < L2_VARIANT_MAX ? variant_dims[variant] : 0;
+}
+
+const char *l2_variant_name(enum l2_variant variant)
+{
+	return variant < L2_VARIANT_MAX ? variant_names[variant] : "unknown";
+}
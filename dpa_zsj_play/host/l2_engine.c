@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_engine.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::ENGINE);
+
+#define L2_ENGINE_DEFAULT_INFLIGHT 16
+
+/*
+ * 提交队列里的一项，按 ticket 递增排列。retire 之后槽位要等窗口再转一圈才会被覆盖；
+ * 出错之后不再接受提交，所以失败 ticket 的槽位一直留着，被覆盖的 ticket 一定是成功的。
+ */
+struct engine_entry {
+	uint64_t ticket;
+	l2_engine_cb cb;
+	void *ctx;
+	doca_error_t status;	/* 完成时写入 */
+};
+
+struct l2_engine {
+	struct l2_backend *be;
+	uint32_t max_inflight;
+
+	pthread_mutex_t lock;
+	pthread_cond_t space_cond;	/* submitters: 窗口有空位 */
+	pthread_cond_t work_cond;	/* completion thread: 队列非空 / 退出 */
+	pthread_cond_t done_cond;	/* waiters: completed 前进了 */
+	pthread_mutex_t launch_lock;	/* launch + 入队要原子，保证队列按 ticket 有序 */
+
+	struct engine_entry *ring;	/* max_inflight 项的环形提交队列 */
+	uint32_t head;
+	uint32_t count;
+	uint32_t reserved;		/* 已占用的窗口（含正在 launch 的） */
+	uint64_t completed;		/* 最大的已完成 ticket */
+	doca_error_t error;		/* completion thread 遇到的第一个错误，之后拒绝新的提交 */
+	bool stop;
+
+	struct l2_engine_stats stats;
+	pthread_t completion_thread;
+};
+
+/*
+ * Completion thread: waits for the oldest outstanding ticket, runs its callback and retires it
+ *
+ * @arg [in]: struct l2_engine
+ * @return: NULL
+ */
+static void *engine_completion(void *arg)
+{
+	struct l2_engine *eng = arg;
+	struct engine_entry e;
+	doca_error_t result;
+
+	L2_TRACE_THREAD("engine completion");
+	pthread_mutex_lock(&eng->lock);
+	for (;;) {
+		while (eng->count == 0 && !eng->stop)
+			pthread_cond_wait(&eng->work_cond, &eng->lock);
+		if (eng->count == 0)
+			break;
+		e = eng->ring[eng->head];
+		pthread_mutex_unlock(&eng->lock);
+
+		/* ticket 一定已经 launch 过，直接走 ops->wait，不去读 be->launched */
+		L2_TRACE_BEGIN(t0);
+		result = eng->be->ops->wait(eng->be, e.ticket);
+		L2_TRACE_END(t0, "engine.wait", 0);
+#ifdef ZSJ_TRACE
+		if (result == DOCA_SUCCESS)
+			l2_backend_trace_completed(eng->be, e.ticket);
+#endif
+		if (e.cb != NULL) {
+			L2_TRACE_BEGIN(tc);
+			e.cb(e.ctx, e.ticket, result);
+			L2_TRACE_END(tc, "engine.callback", 0);
+		}
+
+		pthread_mutex_lock(&eng->lock);
+		if (result != DOCA_SUCCESS && eng->error == DOCA_SUCCESS)
+			eng->error = result;
+		eng->ring[eng->head].status = result;
+		eng->head = (eng->head + 1) % eng->max_inflight;
+		eng->count--;
+		eng->reserved--;
+		eng->completed = e.ticket;
+		eng->stats.completed++;
+		pthread_cond_broadcast(&eng->done_cond);
+		pthread_cond_signal(&eng->space_cond);
+	}
+	pthread_mutex_unlock(&eng->lock);
+	return NULL;
+}
+
+doca_error_t l2_engine_create(struct l2_backend *be, const struct l2_engine_cfg *cfg, struct l2_engine **engine)
+{
+	struct l2_engine *eng;
+	int ret;
+
+	eng = calloc(1, sizeof(*eng));
+	if (eng == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	eng->be = be;
+	eng->max_inflight = (cfg != NULL && cfg->max_inflight != 0) ? cfg->max_inflight : L2_ENGINE_DEFAULT_INFLIGHT;
+	eng->completed = be->launched;
+	eng->ring = calloc(eng->max_inflight, sizeof(*eng->ring));
+	if (eng->ring == NULL) {
+		free(eng);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	pthread_mutex_init(&eng->lock, NULL);
+	pthread_mutex_init(&eng->launch_lock, NULL);
+	pthread_cond_init(&eng->space_cond, NULL);
+	pthread_cond_init(&eng->work_cond, NULL);
+	pthread_cond_init(&eng->done_cond, NULL);
+
+	ret = pthread_create(&eng->completion_thread, NULL, engine_completion, eng);
+	if (ret != 0) {
+		DOCA_LOG_ERR("Failed to start completion thread: %d", ret);
+		pthread_cond_destroy(&eng->done_cond);
+		pthread_cond_destroy(&eng->work_cond);
+		pthread_cond_destroy(&eng->space_cond);
+		pthread_mutex_destroy(&eng->launch_lock);
+		pthread_mutex_destroy(&eng->lock);
+		free(eng->ring);
+		free(eng);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	*engine = eng;
+	return DOCA_SUCCESS;
+}
+
+void l2_engine_destroy(struct l2_engine *engine)
+{
+	if (engine == NULL)
+		return;
+	pthread_mutex_lock(&engine->lock);
+	engine->stop = true;
+	pthread_cond_signal(&engine->work_cond);
+	pthread_mutex_unlock(&engine->lock);
+	/* completion thread 把队列清空后才退出 */
+	pthread_join(engine->completion_thread, NULL);
+
+	pthread_cond_destroy(&engine->done_cond);
+	pthread_cond_destroy(&engine->work_cond);
+	pthread_cond_destroy(&engine->space_cond);
+	pthread_mutex_destroy(&engine->launch_lock);
+	pthread_mutex_destroy(&engine->lock);
+	free(engine->ring);
+	free(engine);
+}
+
+static doca_error_t engine_submit(struct l2_engine *eng, enum l2_kernel_id kernel, const void *args,
+				  l2_engine_cb cb, void *ctx, uint64_t *ticket, bool block)
+{
+	struct engine_entry *e;
+	uint64_t seq;
+	doca_error_t result;
+
+	/* 先占窗口，满了就阻塞（或者返回 AGAIN） */
+	pthread_mutex_lock(&eng->lock);
+	if (eng->stop) {
+		pthread_mutex_unlock(&eng->lock);
+		return DOCA_ERROR_BAD_STATE;
+	}
+	if (eng->error != DOCA_SUCCESS) {
+		result = eng->error;
+		pthread_mutex_unlock(&eng->lock);
+		return result;
+	}
+	if (eng->reserved == eng->max_inflight) {
+		if (!block) {
+			pthread_mutex_unlock(&eng->lock);
+			return DOCA_ERROR_AGAIN;
+		}
+		eng->stats.backpressure_waits++;
+		L2_TRACE_BEGIN(t0);
+		while (eng->reserved == eng->max_inflight)
+			pthread_cond_wait(&eng->space_cond, &eng->lock);
+		L2_TRACE_END(t0, "engine.backpressure", 0);
+	}
+	eng->reserved++;
+	if (eng->reserved > eng->stats.max_inflight_seen)
+		eng->stats.max_inflight_seen = eng->reserved;
+	pthread_mutex_unlock(&eng->lock);
+
+	pthread_mutex_lock(&eng->launch_lock);
+	result = l2_backend_launch(eng->be, kernel, args, &seq);
+	pthread_mutex_lock(&eng->lock);
+	if (result != DOCA_SUCCESS) {
+		eng->reserved--;
+		pthread_cond_signal(&eng->space_cond);
+	} else {
+		e = &eng->ring[(eng->head + eng->count) % eng->max_inflight];
+		e->ticket = seq;
+		e->cb = cb;
+		e->ctx = ctx;
+		e->status = DOCA_SUCCESS;
+		eng->count++;
+		eng->stats.submitted++;
+		pthread_cond_signal(&eng->work_cond);
+	}
+	pthread_mutex_unlock(&eng->lock);
+	pthread_mutex_unlock(&eng->launch_lock);
+
+	if (result != DOCA_SUCCESS)
+		return result;
+	if (ticket != NULL)
+		*ticket = seq;
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_engine_submit(struct l2_engine *engine, enum l2_kernel_id kernel, const void *args,
+			      l2_engine_cb cb, void *ctx, uint64_t *ticket)
+{
+	return engine_submit(engine, kernel, args, cb, ctx, ticket, true);
+}
+
+doca_error_t l2_engine_try_submit(struct l2_engine *engine, enum l2_kernel_id kernel, const void *args,
+				  l2_engine_cb cb, void *ctx, uint64_t *ticket)
+{
+	return engine_submit(engine, kernel, args, cb, ctx, ticket, false);
+}
+
+doca_error_t l2_engine_submit_batch(struct l2_engine *engine, struct l2_batch *batch, l2_engine_cb cb, void *ctx)
+{
+	struct l2_batch_args args;
+	struct l2_batch_blocked_args blocked;
+	struct l2_qbatch_args qargs;
+
+	if (batch->elem != L2_ELEM_Q16_16) {
+		l2_batch_fill_qargs(batch, 0, batch->batch_size, &qargs);
+		return l2_engine_submit(engine, L2_KERNEL_QBATCH, &qargs, cb, ctx, &batch->seq);
+	}
+	if (batch->layout == L2_LAYOUT_BLOCKED) {
+		l2_batch_fill_blocked_args(batch, &blocked);
+		return l2_engine_submit(engine, L2_KERNEL_BATCH_BLOCKED, &blocked, cb, ctx, &batch->seq);
+	}
+	l2_batch_fill_args(batch, 0, batch->batch_size, &args);
+	return l2_engine_submit(engine, L2_KERNEL_BATCH, &args, cb, ctx, &batch->seq);
+}
+
+int l2_engine_poll(struct l2_engine *engine, uint64_t ticket)
+{
+	int done;
+
+	pthread_mutex_lock(&engine->lock);
+	done = engine->completed >= ticket;
+	pthread_mutex_unlock(&engine->lock);
+	return done;
+}
+
+doca_error_t l2_engine_wait(struct l2_engine *engine, uint64_t ticket)
+{
+	doca_error_t result;
+
+	pthread_mutex_lock(&engine->lock);
+	while (engine->completed < ticket && engine->count > 0)
+		pthread_cond_wait(&engine->done_cond, &engine->lock);
+	if (engine->completed < ticket) {
+		result = DOCA_ERROR_INVALID_VALUE;
+	} else {
+		/* 槽位还在就用它的状态；已经被后来的提交覆盖说明它成功了（见 engine_entry） */
+		result = DOCA_SUCCESS;
+		for (uint32_t i = 0; i < engine->max_inflight; i++) {
+			if (engine->ring[i].ticket == ticket) {
+				result = engine->ring[i].status;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&engine->lock);
+	return result;
+}
+
+doca_error_t l2_engine_drain(struct l2_engine *engine)
+{
+	doca_error_t result;
+
+	pthread_mutex_lock(&engine->lock);
+	while (engine->reserved > 0)
+		pthread_cond_wait(&engine->done_cond, &engine->lock);
+	result = engine->error;
+	pthread_mutex_unlock(&engine->lock);
+	return result;
+}
+
+void l2_engine_get_stats(struct l2_engine *engine, struct l2_engine_stats *stats)
+{
+	pthread_mutex_lock(&engine->lock);
+	*stats = engine->stats;
+	pthread_mutex_unlock(&engine->lock);
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_filter.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::FILTER);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+doca_error_t l2_filter_alloc(struct l2_backend *be, const struct l2_db *db, uint32_t max_nq, double gather_below,
+			     struct l2_filter *filter)
+{
+	uint32_t words = L2_FILTER_WORDS(db->size);
+	uint32_t max_gather = gather_below > 0 ? (uint32_t)(db->size * (gather_below < 1.0 ? gather_below : 1.0)) : 0;
+	size_t bitmap_bytes = ALIGN64((size_t)words * sizeof(uint64_t));
+	size_t rows_bytes = ALIGN64((size_t)max_gather * db->dim * sizeof(int32_t));
+	size_t ids_bytes = ALIGN64((size_t)max_gather * sizeof(uint32_t));
+	size_t offsets_bytes = ALIGN64(2 * sizeof(uint32_t));
+	size_t probes_bytes = (size_t)max_nq * sizeof(uint32_t);
+	uint8_t *p;
+	doca_error_t result;
+
+	memset(filter, 0, sizeof(*filter));
+	if (max_nq == 0 || db->size == 0) {
+		DOCA_LOG_ERR("Invalid filter shape: max_nq = %u, db_size = %u", max_nq, db->size);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	result = l2_backend_mem_alloc(be, bitmap_bytes + rows_bytes + ids_bytes + offsets_bytes + probes_bytes,
+				      &filter->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	p = filter->mem.addr;
+	filter->bitmap = (uint64_t *)p;
+	p += bitmap_bytes;
+	filter->rows = (int32_t *)p;
+	p += rows_bytes;
+	filter->ids = (uint32_t *)p;
+	p += ids_bytes;
+	filter->offsets = (uint32_t *)p;
+	p += offsets_bytes;
+	filter->probes = (uint32_t *)p;
+	/* 所有 query 都只探这一张表 */
+	memset(filter->probes, 0, probes_bytes);
+	filter->db_size = db->size;
+	filter->dim = db->dim;
+	filter->max_gather = max_gather;
+	filter->max_nq = max_nq;
+	filter->gather_below = gather_below;
+
+	/* 默认全部允许，最后一个字里超出 db_size 的位清零 */
+	memset(filter->bitmap, 0xff, (size_t)words * sizeof(uint64_t));
+	if (db->size % 64 != 0)
+		filter->bitmap[words - 1] = (1ULL << (db->size % 64)) - 1;
+	return DOCA_SUCCESS;
+}
+
+void l2_filter_free(struct l2_backend *be, struct l2_filter *filter)
+{
+	l2_backend_mem_free(be, &filter->mem);
+	memset(filter, 0, sizeof(*filter));
+}
+
+void l2_filter_from_attr(struct l2_filter *filter, const uint32_t *attrs, uint32_t lo, uint32_t hi)
+{
+	uint32_t words = L2_FILTER_WORDS(filter->db_size);
+
+	/* 一次攒满一个字再写，不做逐位读改写 */
+	for (uint32_t w = 0; w < words; w++) {
+		uint32_t base = w * 64, n = filter->db_size - base < 64 ? filter->db_size - base : 64;
+		uint64_t word = 0;
+
+		for (uint32_t b = 0; b < n; b++)
+			word |= (uint64_t)(attrs[base + b] >= lo && attrs[base + b] <= hi) << b;
+		filter->bitmap[w] = word;
+	}
+}
+
+uint64_t l2_filter_count(const struct l2_filter *filter)
+{
+	uint64_t count = 0;
+
+	for (uint32_t w = 0; w < L2_FILTER_WORDS(filter->db_size); w++)
+		count += (uint64_t)__builtin_popcountll(filter->bitmap[w]);
+	return count;
+}
+
+/* 允许的行按顺序拷进 rows，ids 记全局 id */
+static uint32_t filter_gather(struct l2_filter *filter, const struct l2_db *db)
+{
+	size_t row_bytes = (size_t)db->dim * sizeof(int32_t);
+	uint32_t n = 0;
+
+	for (uint64_t i = l2_filter_next(filter->bitmap, 0, db->size); i < db->size;
+	     i = l2_filter_next(filter->bitmap, i + 1, db->size)) {
+		memcpy(filter->rows + (size_t)n * db->dim, db->vecs + i * db->dim, row_bytes);
+		filter->ids[n++] = db->id_base + (uint32_t)i;
+	}
+	return n;
+}
+
+doca_error_t l2_filter_search(struct l2_backend *be, const struct l2_db *db, struct l2_search *search,
+			      struct l2_filter *filter, uint32_t nq, struct l2_hit *results,
+			      struct l2_filter_stats *stats)
+{
+	struct l2_filter_stats st = {0};
+	struct l2_ivf_args iargs;
+	uint64_t t0 = now_ns(), t1;
+	doca_error_t result;
+
+	if (nq == 0 || nq > search->max_nq || nq > filter->max_nq || db->dim != search->dim ||
+	    db->size != filter->db_size) {
+		DOCA_LOG_ERR("Invalid filtered search: %u queries (max %u / %u), db of %u x %u for filter of %u", nq,
+			     search->max_nq, filter->max_nq, db->size, db->dim, filter->db_size);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	st.allowed = l2_filter_count(filter);
+	st.selectivity = (double)st.allowed / db->size;
+	st.gathered = st.selectivity < filter->gather_below && st.allowed <= filter->max_gather;
+
+	if (!st.gathered) {
+		/* 过滤扫描：bitmap 直接交给 l2_search_kernel */
+		t1 = now_ns();
+		search->filter = filter->bitmap;
+		result = l2_search_submit(be, db, search, nq);
+		search->filter = NULL;
+	} else {
+		/* gather-then-scan：允许的行拼成一张稠密的表，l2_ivf_kernel 对所有 query 扫这一张 */
+		L2_TRACE_BEGIN(tg);
+		filter->offsets[0] = 0;
+		filter->offsets[1] = filter_gather(filter, db);
+		L2_TRACE_END(tg, "filter.gather", (uint64_t)filter->offsets[1] * db->dim * sizeof(int32_t));
+		t1 = now_ns();
+
+		iargs.handle = filter->mem.handle;
+		iargs.q_base = (uint64_t)(uintptr_t)search->queries;
+		iargs.db_base = (uint64_t)(uintptr_t)filter->rows;
+		iargs.ids_base = (uint64_t)(uintptr_t)filter->ids;
+		iargs.offsets_base = (uint64_t)(uintptr_t)filter->offsets;
+		iargs.probes_base = (uint64_t)(uintptr_t)filter->probes;
+		iargs.out_base = (uint64_t)(uintptr_t)search->parts;
+		iargs.q_stride = search->dim * sizeof(int32_t);
+		iargs.db_stride = db->dim * sizeof(int32_t);
+		iargs.dim = db->dim;
+		iargs.frac_bits = 16;
+		iargs.nq = nq;
+		iargs.nprobe = 1;
+		iargs.k = search->k;
+		iargs.num_parts = search->num_parts;
+		search->nq = nq;
+		result = l2_backend_launch(be, L2_KERNEL_IVF, &iargs, &search->seq);
+	}
+	/* 两条路的输出形状一样，都用 l2_search_wait 合并 */
+	if (result == DOCA_SUCCESS)
+		result = l2_search_wait(be, search, results);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	st.gather_ns = t1 - t0;
+	st.scan_ns = now_ns() - t1;
+	if (stats != NULL)
+		*stats = st;
+	return DOCA_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <string.h>
+
+#include "../include/l2_hist.h"
+
+static inline uint32_t bucket_of(uint64_t v)
+{
+	uint32_t shift;
+
+	if (v < L2_HIST_SUB)
+		return (uint32_t)v;
+	/* v 的最高位在 shift + SUB_BITS，次高的 SUB_BITS 位选子桶 */
+	shift = 63 - (uint32_t)__builtin_clzll(v) - L2_HIST_SUB_BITS;
+	return (shift + 1) * L2_HIST_SUB + (uint32_t)((v >> shift) & (L2_HIST_SUB - 1));
+}
+
+static inline void bucket_range(uint32_t idx, uint64_t *lower, uint64_t *upper)
+{
+	uint32_t shift;
+
+	if (idx < L2_HIST_SUB) {
+		*lower = *upper = idx;
+		return;
+	}
+	shift = idx / L2_HIST_SUB - 1;
+	*lower = (uint64_t)(L2_HIST_SUB + idx % L2_HIST_SUB) << shift;
+	*upper = *lower + ((1ULL << shift) - 1);
+}
+
+void l2_hist_reset(struct l2_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+void l2_hist_record(struct l2_hist *hist, uint64_t value)
+{
+	hist->counts[bucket_of(value)]++;
+	if (hist->n == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->n++;
+	hist->sum += value;
+}
+
+void l2_hist_merge(struct l2_hist *dst, const struct l2_hist *src)
+{
+	if (src->n == 0)
+		return;
+	for (uint32_t i = 0; i < L2_HIST_BUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+	if (dst->n == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->n += src->n;
+	dst->sum += src->sum;
+}
+
+uint64_t l2_hist_percentile(const struct l2_hist *hist, double p)
+{
+	uint64_t rank, seen = 0, lower, upper;
+
+	if (hist->n == 0)
+		return 0;
+	if (p < 0)
+		p = 0;
+	rank = (uint64_t)(p * (hist->n - 1)) + 1;
+	for (uint32_t i = 0; i < L2_HIST_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			bucket_range(i, &lower, &upper);
+			return upper < hist->max ? upper : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+double l2_hist_mean(const struct l2_hist *hist)
+{
+	return hist->n == 0 ? 0.0 : (double)hist->sum / hist->n;
+}
+
+void l2_hist_write_csv(FILE *f, const char *name, const struct l2_hist *hist)
+{
+	uint64_t lower, upper;
+
+	for (uint32_t i = 0; i < L2_HIST_BUCKETS; i++) {
+		if (hist->counts[i] == 0)
+			continue;
+		bucket_range(i, &lower, &upper);
+		fprintf(f, "%s,%lu,%lu,%lu\n", name, lower, upper, hist->counts[i]);
+	}
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_hybrid.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::HYBRID);
+
+#define HYBRID_DEFAULT_MIN_CHUNK 4096
+#define HYBRID_DEFAULT_DEPTH 2
+
+struct hybrid_chunk {
+	uint64_t seq;
+	uint32_t count;
+};
+
+struct l2_hybrid {
+	struct l2_hybrid_cfg cfg;
+	double dev_vps;		/* 吞吐的滑动平均，0 = 还没测过 */
+	double host_vps;
+
+	/* watcher 线程按 seq 顺序等 device 块，完成时间在完成时记，不依赖 host 两块之间的轮询 */
+	pthread_t watcher;
+	bool watcher_started;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* watcher: 有新的 launch / 退出 */
+	pthread_cond_t done_cond;	/* run: done 前进了 */
+	uint64_t launched;		/* 最新 launch 的 seq */
+	uint64_t launch_ns[L2_HYBRID_MAX_DEPTH];	/* 按 seq % L2_HYBRID_MAX_DEPTH */
+	uint64_t done;			/* 最新完成的 seq */
+	uint64_t done_ns;
+	uint64_t dev_busy_ns;		/* 本次 run 里 device 上至少有一块在跑的时间 */
+	doca_error_t error;		/* 本次 run 里第一个失败的 device 块 */
+	bool stop;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Watcher thread: waits for every device launch in order and timestamps its completion
+ *
+ * @arg [in]: struct l2_hybrid
+ * @return: NULL
+ */
+static void *hybrid_watcher(void *arg)
+{
+	struct l2_hybrid *hy = arg;
+	struct l2_backend *dev = hy->cfg.dev;
+	doca_error_t result;
+	uint64_t seq, t1, start;
+
+	L2_TRACE_THREAD("hybrid watcher");
+	pthread_mutex_lock(&hy->lock);
+	for (;;) {
+		while (hy->done == hy->launched && !hy->stop)
+			pthread_cond_wait(&hy->work_cond, &hy->lock);
+		if (hy->done == hy->launched)
+			break;
+		seq = hy->done + 1;
+		pthread_mutex_unlock(&hy->lock);
+
+		/* 只走 ops->wait，be 上的其它状态（launched、trace）都归 run 线程 */
+		result = dev->ops->wait(dev, seq);
+		t1 = now_ns();
+
+		pthread_mutex_lock(&hy->lock);
+		if (result != DOCA_SUCCESS && hy->error == DOCA_SUCCESS)
+			hy->error = result;
+		/* 块在前一块完成（或者自己 launch）之后才开始算，device 断粮的时间不计 */
+		start = hy->launch_ns[seq % L2_HYBRID_MAX_DEPTH];
+		if (hy->done_ns > start)
+			start = hy->done_ns;
+		hy->dev_busy_ns += t1 - start;
+		hy->done = seq;
+		hy->done_ns = t1;
+		pthread_cond_broadcast(&hy->done_cond);
+	}
+	pthread_mutex_unlock(&hy->lock);
+	return NULL;
+}
+
+doca_error_t l2_hybrid_create(const struct l2_hybrid_cfg *cfg, struct l2_hybrid **hybrid)
+{
+	struct l2_hybrid *hy;
+
+	if (cfg->dev == NULL || cfg->host == NULL || !l2_backend_can_defer(cfg->dev) ||
+	    l2_backend_can_defer(cfg->host)) {
+		DOCA_LOG_ERR("Hybrid scheduling needs an asynchronous device backend and an inline host backend");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (cfg->dev_depth > L2_HYBRID_MAX_DEPTH || cfg->dev_share < 0 || cfg->dev_share >= 1 || cfg->ewma < 0 ||
+	    cfg->ewma > 1) {
+		DOCA_LOG_ERR("Invalid hybrid configuration");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	hy = calloc(1, sizeof(*hy));
+	if (hy == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	hy->cfg = *cfg;
+	if (hy->cfg.min_chunk == 0)
+		hy->cfg.min_chunk = HYBRID_DEFAULT_MIN_CHUNK;
+	if (hy->cfg.dev_depth == 0)
+		hy->cfg.dev_depth = HYBRID_DEFAULT_DEPTH;
+	if (hy->cfg.dev_share == 0)
+		hy->cfg.dev_share = 0.5;
+	if (hy->cfg.ewma == 0)
+		hy->cfg.ewma = 0.5;
+	hy->launched = hy->done = hy->cfg.dev->launched;
+	pthread_mutex_init(&hy->lock, NULL);
+	pthread_cond_init(&hy->work_cond, NULL);
+	pthread_cond_init(&hy->done_cond, NULL);
+	if (pthread_create(&hy->watcher, NULL, hybrid_watcher, hy) != 0) {
+		DOCA_LOG_ERR("Failed to start hybrid watcher thread");
+		l2_hybrid_destroy(hy);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	hy->watcher_started = true;
+	*hybrid = hy;
+	return DOCA_SUCCESS;
+}
+
+void l2_hybrid_destroy(struct l2_hybrid *hybrid)
+{
+	if (hybrid == NULL)
+		return;
+	if (hybrid->watcher_started) {
+		pthread_mutex_lock(&hybrid->lock);
+		hybrid->stop = true;
+		pthread_cond_signal(&hybrid->work_cond);
+		pthread_mutex_unlock(&hybrid->lock);
+		/* watcher 等完已经 launch 的块才退出 */
+		pthread_join(hybrid->watcher, NULL);
+	}
+	pthread_cond_destroy(&hybrid->done_cond);
+	pthread_cond_destroy(&hybrid->work_cond);
+	pthread_mutex_destroy(&hybrid->lock);
+	free(hybrid);
+}
+
+double l2_hybrid_dev_share(const struct l2_hybrid *hybrid)
+{
+	if (hybrid->dev_vps > 0 && hybrid->host_vps > 0)
+		return hybrid->dev_vps / (hybrid->dev_vps + hybrid->host_vps);
+	return hybrid->cfg.dev_share;
+}
+
+/* 剩余量里 share 这部分再分成 slices 块，至少 min_chunk，最多全部剩余 */
+static uint32_t chunk_size(const struct l2_hybrid *hy, uint32_t remaining, double share, uint32_t slices)
+{
+	double c = ceil(remaining * share / slices);
+
+	if (c < hy->cfg.min_chunk)
+		c = hy->cfg.min_chunk;
+	return c < remaining ? (uint32_t)c : remaining;
+}
+
+/* pairs [first, first + count) 交给 be；batch 的内存属于 device arena，host backend 直接读 */
+static doca_error_t launch_range(struct l2_backend *be, struct l2_batch *batch, uint32_t first, uint32_t count,
+				 uint64_t *seq)
+{
+	struct l2_batch_args args;
+	struct l2_qbatch_args qargs;
+
+	if (batch->elem != L2_ELEM_Q16_16) {
+		l2_batch_fill_qargs(batch, first, count, &qargs);
+		return l2_backend_launch(be, L2_KERNEL_QBATCH, &qargs, seq);
+	}
+	l2_batch_fill_args(batch, first, count, &args);
+	return l2_backend_launch(be, L2_KERNEL_BATCH, &args, seq);
+}
+
+/* 把刚 launch 的 seq 交给 watcher */
+static void watch_launch(struct l2_hybrid *hy, uint64_t seq, uint64_t t)
+{
+	pthread_mutex_lock(&hy->lock);
+	hy->launch_ns[seq % L2_HYBRID_MAX_DEPTH] = t;
+	hy->launched = seq;
+	pthread_cond_signal(&hy->work_cond);
+	pthread_mutex_unlock(&hy->lock);
+}
+
+/* 最新完成的 device seq；block 时一直等到 done 至少到 seq。inflight trace 在 run 线程这里补上 */
+static uint64_t watch_done(struct l2_hybrid *hy, uint64_t seq, bool block, doca_error_t *error)
+{
+	uint64_t done;
+
+	pthread_mutex_lock(&hy->lock);
+	while (block && hy->done < seq)
+		pthread_cond_wait(&hy->done_cond, &hy->lock);
+	done = hy->done;
+	*error = hy->error;
+	pthread_mutex_unlock(&hy->lock);
+#ifdef ZSJ_TRACE
+	if (*error == DOCA_SUCCESS && done > 0)
+		l2_backend_trace_completed(hy->cfg.dev, done);
+#endif
+	return done;
+}
+
+static void ewma_update(double *est, double sample, double weight)
+{
+	*est = *est == 0 ? sample : (1 - weight) * *est + weight * sample;
+}
+
+doca_error_t l2_hybrid_run(struct l2_hybrid *hybrid, struct l2_batch *batch, struct l2_hybrid_stats *stats)
+{
+	const uint32_t depth = hybrid->cfg.dev_depth;
+	struct l2_backend *dev = hybrid->cfg.dev, *host = hybrid->cfg.host;
+	struct hybrid_chunk ring[L2_HYBRID_MAX_DEPTH];
+	struct l2_hybrid_stats st = {0};
+	uint32_t head = 0, tail = batch->batch_size, r_head = 0, n_in = 0;
+	uint64_t t_start = now_ns(), dev_busy_ns, host_busy_ns = 0, done, t0;
+	doca_error_t result = DOCA_SUCCESS;
+	double share = l2_hybrid_dev_share(hybrid);
+
+	if (batch->layout != L2_LAYOUT_AOS) {
+		DOCA_LOG_ERR("Hybrid scheduling supports the AoS layout only");
+		return DOCA_ERROR_NOT_SUPPORTED;
+	}
+	st.dev_share = share;
+
+	/* 上一次 run 结束时 watcher 已经空闲，从 device 当前的 seq 重新开始计 */
+	pthread_mutex_lock(&hybrid->lock);
+	hybrid->launched = hybrid->done = dev->launched;
+	hybrid->done_ns = 0;
+	hybrid->dev_busy_ns = 0;
+	hybrid->error = DOCA_SUCCESS;
+	pthread_mutex_unlock(&hybrid->lock);
+
+	for (;;) {
+		/* 收掉已经完成的 device 块 */
+		done = watch_done(hybrid, 0, false, &result);
+		while (n_in > 0 && ring[r_head].seq <= done) {
+			r_head = (r_head + 1) % depth;
+			n_in--;
+		}
+		if (result != DOCA_SUCCESS)
+			goto drain;
+
+		/* device 队列补满：从前面拿 */
+		while (n_in < depth && head < tail) {
+			uint32_t c = chunk_size(hybrid, tail - head, share, depth);
+			struct hybrid_chunk *ch = &ring[(r_head + n_in) % depth];
+
+			result = launch_range(dev, batch, head, c, &ch->seq);
+			if (result != DOCA_SUCCESS)
+				goto drain;
+			watch_launch(hybrid, ch->seq, now_ns());
+			ch->count = c;
+			n_in++;
+			head += c;
+			st.dev_chunks++;
+			st.dev_vectors += c;
+		}
+
+		/* host 从后面拿一块，在调用线程上跑完 */
+		if (head < tail) {
+			uint32_t c = chunk_size(hybrid, tail - head, 1 - share, L2_HYBRID_HOST_SLICES);
+
+			t0 = now_ns();
+			result = launch_range(host, batch, tail - c, c, NULL);
+			host_busy_ns += now_ns() - t0;
+			L2_TRACE_END(t0, "hybrid.host_chunk", c);
+			if (result != DOCA_SUCCESS)
+				goto drain;
+			tail -= c;
+			st.host_chunks++;
+			st.host_vectors += c;
+			continue;
+		}
+
+		/*
+		 * 全部分完，等 device 的尾巴。还没 launch 的部分 host 已经从后面拿光了；
+		 * 在飞的块已经进了 device 队列，撤不回来，host 再算一遍只会和 device 抢着写 out，
+		 * 所以这里阻塞等 watcher。尾巴的长度靠块越分越小来控制。
+		 */
+		if (n_in == 0)
+			break;
+		t0 = now_ns();
+		done = watch_done(hybrid, ring[r_head].seq, true, &result);
+		st.host_idle_ns += now_ns() - t0;
+		L2_TRACE_END(t0, "hybrid.host_idle", ring[r_head].count);
+		if (result != DOCA_SUCCESS)
+			goto drain;
+	}
+
+	st.total_ns = now_ns() - t_start;
+	pthread_mutex_lock(&hybrid->lock);
+	dev_busy_ns = hybrid->dev_busy_ns;
+	pthread_mutex_unlock(&hybrid->lock);
+	if (st.dev_vectors > 0 && dev_busy_ns > 0) {
+		st.dev_vps = st.dev_vectors / (dev_busy_ns / 1e9);
+		ewma_update(&hybrid->dev_vps, st.dev_vps, hybrid->cfg.ewma);
+	}
+	if (st.host_vectors > 0 && host_busy_ns > 0) {
+		st.host_vps = st.host_vectors / (host_busy_ns / 1e9);
+		ewma_update(&hybrid->host_vps, st.host_vps, hybrid->cfg.ewma);
+	}
+	if (stats != NULL)
+		*stats = st;
+	return DOCA_SUCCESS;
+
+drain:
+	/* 已经挂上的 device 块还会写 batch，返回前必须等完 */
+	if (n_in > 0) {
+		doca_error_t ignored;
+
+		(void)watch_done(hybrid, ring[(r_head + n_in - 1) % depth].seq, true, &ignored);
+	}
+	return result;
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_ivf.h"
+#include "../include/l2_kmeans.h"
+#include "../include/l2_search.h"
+#include "../include/l2_topk.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::IVF);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+#define IVF_FILE_MAGIC "ZSJIVF1"
+
+struct ivf_file_hdr {
+	char magic[8];
+	uint32_t dim;
+	uint32_t nlist;
+	uint32_t ntotal;
+	uint32_t pad;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+doca_error_t l2_ivf_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			  const struct l2_ivf_train_cfg *cfg, int32_t *centroids)
+{
+	struct l2_kmeans_cfg km = {
+		.k = cfg->nlist,
+		.iters = cfg->iters,
+		.max_train = cfg->max_train,
+		.seed = cfg->seed,
+	};
+
+	return l2_kmeans_train(be, vecs, n, dim, &km, centroids);
+}
+
+/* 给 index 分配 [vecs][ids][offsets] 和 host 上的 centroids */
+static doca_error_t ivf_alloc(struct l2_backend *be, uint32_t dim, uint32_t nlist, uint32_t ntotal,
+			      struct l2_ivf *ivf)
+{
+	size_t vec_bytes = ALIGN64((size_t)ntotal * dim * sizeof(int32_t));
+	size_t id_bytes = ALIGN64((size_t)ntotal * sizeof(uint32_t));
+	size_t off_bytes = (size_t)(nlist + 1) * sizeof(uint32_t);
+	doca_error_t result;
+
+	memset(ivf, 0, sizeof(*ivf));
+	ivf->centroids = malloc((size_t)nlist * dim * sizeof(int32_t));
+	if (ivf->centroids == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	result = l2_backend_mem_alloc(be, vec_bytes + id_bytes + off_bytes, &ivf->mem);
+	if (result != DOCA_SUCCESS) {
+		free(ivf->centroids);
+		ivf->centroids = NULL;
+		return result;
+	}
+	ivf->vecs = ivf->mem.addr;
+	ivf->ids = (uint32_t *)((uint8_t *)ivf->mem.addr + vec_bytes);
+	ivf->offsets = (uint32_t *)((uint8_t *)ivf->mem.addr + vec_bytes + id_bytes);
+	l2_backend_mem_touch(be, ivf->vecs, (size_t)ntotal * dim * sizeof(int32_t));
+	ivf->dim = dim;
+	ivf->nlist = nlist;
+	ivf->ntotal = ntotal;
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_ivf_build(struct l2_backend *be, uint32_t dim, uint32_t nlist, const int32_t *centroids,
+			  const int32_t *vecs, uint32_t n, struct l2_ivf *ivf)
+{
+	uint32_t *assign, *fill;
+	doca_error_t result;
+
+	assign = malloc((size_t)n * sizeof(*assign));
+	fill = calloc(nlist, sizeof(*fill));
+	if (assign == NULL || fill == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto out;
+	}
+	result = l2_kmeans_assign(be, vecs, n, dim, centroids, nlist, assign, NULL);
+	if (result != DOCA_SUCCESS)
+		goto out;
+	result = ivf_alloc(be, dim, nlist, n, ivf);
+	if (result != DOCA_SUCCESS)
+		goto out;
+	memcpy(ivf->centroids, centroids, (size_t)nlist * dim * sizeof(int32_t));
+
+	/* counting sort：先数每个表的大小，再按行号顺序放进去，表内保持原顺序 */
+	for (uint32_t i = 0; i < n; i++)
+		fill[assign[i]]++;
+	ivf->offsets[0] = 0;
+	for (uint32_t c = 0; c < nlist; c++) {
+		ivf->offsets[c + 1] = ivf->offsets[c] + fill[c];
+		fill[c] = ivf->offsets[c];
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t row = fill[assign[i]]++;
+
+		ivf->ids[row] = i;
+		memcpy(ivf->vecs + (size_t)row * dim, vecs + (size_t)i * dim, dim * sizeof(int32_t));
+	}
+out:
+	free(fill);
+	free(assign);
+	return result;
+}
+
+void l2_ivf_free(struct l2_backend *be, struct l2_ivf *ivf)
+{
+	l2_backend_mem_free(be, &ivf->mem);
+	free(ivf->centroids);
+	memset(ivf, 0, sizeof(*ivf));
+}
+
+doca_error_t l2_ivf_save(const struct l2_ivf *ivf, const char *path)
+{
+	struct ivf_file_hdr hdr = {.dim = ivf->dim, .nlist = ivf->nlist, .ntotal = ivf->ntotal};
+	FILE *f = fopen(path, "wb");
+	int ok;
+
+	if (f == NULL) {
+		DOCA_LOG_ERR("Failed to open %s for writing", path);
+		return DOCA_ERROR_IO_FAILED;
+	}
+	memcpy(hdr.magic, IVF_FILE_MAGIC, sizeof(hdr.magic));
+	ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+	     fwrite(ivf->centroids, sizeof(int32_t), (size_t)ivf->nlist * ivf->dim, f) ==
+		     (size_t)ivf->nlist * ivf->dim &&
+	     fwrite(ivf->offsets, sizeof(uint32_t), ivf->nlist + 1, f) == ivf->nlist + 1 &&
+	     fwrite(ivf->ids, sizeof(uint32_t), ivf->ntotal, f) == ivf->ntotal &&
+	     fwrite(ivf->vecs, sizeof(int32_t), (size_t)ivf->ntotal * ivf->dim, f) == (size_t)ivf->ntotal * ivf->dim;
+	if (fclose(f) != 0)
+		ok = 0;
+	if (!ok) {
+		DOCA_LOG_ERR("Failed to write index to %s", path);
+		return DOCA_ERROR_IO_FAILED;
+	}
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_ivf_load(struct l2_backend *be, const char *path, struct l2_ivf *ivf)
+{
+	struct ivf_file_hdr hdr;
+	FILE *f = fopen(path, "rb");
+	doca_error_t result;
+	int ok;
+
+	if (f == NULL) {
+		DOCA_LOG_ERR("Failed to open index %s", path);
+		return DOCA_ERROR_NOT_FOUND;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, IVF_FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.dim == 0 || hdr.nlist == 0) {
+		DOCA_LOG_ERR("%s is not an IVF index", path);
+		fclose(f);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	result = ivf_alloc(be, hdr.dim, hdr.nlist, hdr.ntotal, ivf);
+	if (result != DOCA_SUCCESS) {
+		fclose(f);
+		return result;
+	}
+	ok = fread(ivf->centroids, sizeof(int32_t), (size_t)hdr.nlist * hdr.dim, f) == (size_t)hdr.nlist * hdr.dim &&
+	     fread(ivf->offsets, sizeof(uint32_t), hdr.nlist + 1, f) == hdr.nlist + 1 &&
+	     fread(ivf->ids, sizeof(uint32_t), hdr.ntotal, f) == hdr.ntotal &&
+	     fread(ivf->vecs, sizeof(int32_t), (size_t)hdr.ntotal * hdr.dim, f) == (size_t)hdr.ntotal * hdr.dim;
+	fclose(f);
+
+	/* offsets 会被 kernel 直接拿来寻址，必须单调且收尾于 ntotal */
+	for (uint32_t c = 0; ok && c < hdr.nlist; c++)
+		ok = ivf->offsets[c] <= ivf->offsets[c + 1];
+	if (!ok || ivf->offsets[0] != 0 || ivf->offsets[hdr.nlist] != hdr.ntotal) {
+		DOCA_LOG_ERR("Index %s is truncated or corrupt", path);
+		l2_ivf_free(be, ivf);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_ivf_search_alloc(struct l2_backend *be, const struct l2_ivf *ivf, uint32_t max_nq, uint32_t k,
+				 struct l2_ivf_search *search)
+{
+	uint32_t num_parts = be->cfg.num_threads;
+	size_t probe_bytes = ALIGN64((size_t)max_nq * ivf->nlist * sizeof(uint32_t));
+	size_t parts_bytes = (size_t)max_nq * num_parts * k * sizeof(struct l2_hit);
+	doca_error_t result;
+
+	memset(search, 0, sizeof(*search));
+	if (k == 0 || k > L2_SEARCH_MAX_K || max_nq == 0) {
+		DOCA_LOG_ERR("Invalid search shape: k = %u (max %u), max_nq = %u", k, L2_SEARCH_MAX_K, max_nq);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	search->probe_heap = malloc((size_t)ivf->nlist * sizeof(*search->probe_heap));
+	if (search->probe_heap == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	result = l2_matrix_alloc(be, ivf->dim, max_nq, ivf->nlist, &search->coarse);
+	if (result != DOCA_SUCCESS)
+		goto free_heap;
+	memcpy(search->coarse.b, ivf->centroids, (size_t)ivf->nlist * ivf->dim * sizeof(int32_t));
+	l2_matrix_update_norms(&search->coarse, 0, L2_MATRIX_B);
+
+	result = l2_backend_mem_alloc(be, probe_bytes + parts_bytes, &search->mem);
+	if (result != DOCA_SUCCESS)
+		goto free_coarse;
+	search->queries = search->coarse.a;
+	search->probes = search->mem.addr;
+	search->parts = (struct l2_hit *)((uint8_t *)search->mem.addr + probe_bytes);
+	search->max_nq = max_nq;
+	search->k = k;
+	search->num_parts = num_parts;
+	return DOCA_SUCCESS;
+
+free_coarse:
+	l2_matrix_free(be, &search->coarse);
+free_heap:
+	free(search->probe_heap);
+	search->probe_heap = NULL;
+	return result;
+}
+
+void l2_ivf_search_free(struct l2_backend *be, struct l2_ivf_search *search)
+{
+	l2_backend_mem_free(be, &search->mem);
+	l2_matrix_free(be, &search->coarse);
+	free(search->probe_heap);
+	memset(search, 0, sizeof(*search));
+}
+
+doca_error_t l2_ivf_search(struct l2_backend *be, const struct l2_ivf *ivf, struct l2_ivf_search *search,
+			   uint32_t nq, uint32_t nprobe, struct l2_hit *results, struct l2_ivf_search_stats *stats)
+{
+	struct l2_ivf_args args;
+	uint64_t t0 = now_ns(), t1, scanned = 0;
+	doca_error_t result;
+
+	if (nq == 0 || nq > search->max_nq || nprobe == 0 || nprobe > ivf->nlist) {
+		DOCA_LOG_ERR("Invalid IVF search: %u queries (max %u), nprobe %u of %u lists", nq, search->max_nq,
+			     nprobe, ivf->nlist);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	/* 粗筛：query x centroid 矩阵，每个 query 留 nprobe 个最近的表 */
+	l2_matrix_update_norms(&search->coarse, nq, L2_MATRIX_A);
+	result = l2_matrix_submit(be, &search->coarse, nq);
+	if (result == DOCA_SUCCESS)
+		result = l2_matrix_wait(be, &search->coarse);
+	if (result != DOCA_SUCCESS)
+		return result;
+	for (uint32_t q = 0; q < nq; q++) {
+		const uint64_t *row = l2_matrix_row(&search->coarse, q);
+		uint32_t *probes = search->probes + (uint64_t)q * nprobe;
+		uint32_t n = 0;
+
+		for (uint32_t c = 0; c < ivf->nlist; c++)
+			l2_topk_push(search->probe_heap, &n, nprobe, row[c], c);
+		for (uint32_t p = 0; p < nprobe; p++) {
+			probes[p] = search->probe_heap[p].id;
+			scanned += ivf->offsets[probes[p] + 1] - ivf->offsets[probes[p]];
+		}
+	}
+	t1 = now_ns();
+
+	/* 细查：ivf 和 search 都在同一个 arena 里，handle 相同 */
+	args.handle = search->mem.handle;
+	args.q_base = (uint64_t)(uintptr_t)search->queries;
+	args.db_base = (uint64_t)(uintptr_t)ivf->vecs;
+	args.ids_base = (uint64_t)(uintptr_t)ivf->ids;
+	args.offsets_base = (uint64_t)(uintptr_t)ivf->offsets;
+	args.probes_base = (uint64_t)(uintptr_t)search->probes;
+	args.out_base = (uint64_t)(uintptr_t)search->parts;
+	args.q_stride = (uint64_t)ivf->dim * sizeof(int32_t);
+	args.db_stride = (uint64_t)ivf->dim * sizeof(int32_t);
+	args.dim = ivf->dim;
+	args.frac_bits = 16;
+	args.nq = nq;
+	args.nprobe = nprobe;
+	args.k = search->k;
+	args.num_parts = search->num_parts;
+	result = l2_backend_launch(be, L2_KERNEL_IVF, &args, &search->seq);
+	if (result == DOCA_SUCCESS)
+		result = l2_backend_wait(be, search->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	for (uint32_t q = 0; q < nq; q++)
+		l2_topk_merge(search->parts + (uint64_t)q * search->num_parts * search->k, search->num_parts,
+			      search->k, results + (uint64_t)q * search->k);
+
+	if (stats != NULL) {
+		stats->coarse_ns += t1 - t0;
+		stats->scan_ns += now_ns() - t1;
+		stats->scanned += scanned;
+	}
+	return DOCA_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_kmeans.h"
+#include "../include/l2_matrix.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::KMEANS);
+
+/* assignment 矩阵的结果区上限，chunk 行数按它和 k 定 */
+#define KMEANS_ASSIGN_OUT_BYTES (8UL << 20)
+
+static inline uint64_t xorshift(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+doca_error_t l2_kmeans_assign(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			      const int32_t *centroids, uint32_t k, uint32_t *assign, double *obj)
+{
+	uint32_t chunk = (uint32_t)(KMEANS_ASSIGN_OUT_BYTES / ((uint64_t)k * sizeof(uint64_t)));
+	struct l2_matrix mat;
+	double sum = 0;
+	doca_error_t result;
+
+	if (chunk < L2_MATRIX_TILE)
+		chunk = L2_MATRIX_TILE;
+	if (chunk > n)
+		chunk = n;
+	result = l2_matrix_alloc(be, dim, chunk, k, &mat);
+	if (result != DOCA_SUCCESS)
+		return result;
+	memcpy(mat.b, centroids, (size_t)k * dim * sizeof(int32_t));
+	l2_matrix_update_norms(&mat, 0, L2_MATRIX_B);
+
+	for (uint32_t first = 0; first < n; first += chunk) {
+		uint32_t m = n - first < chunk ? n - first : chunk;
+
+		memcpy(mat.a, vecs + (size_t)first * dim, (size_t)m * dim * sizeof(int32_t));
+		l2_matrix_update_norms(&mat, m, L2_MATRIX_A);
+		result = l2_matrix_submit(be, &mat, m);
+		if (result == DOCA_SUCCESS)
+			result = l2_matrix_wait(be, &mat);
+		if (result != DOCA_SUCCESS)
+			goto out;
+
+		for (uint32_t i = 0; i < m; i++) {
+			const uint64_t *row = l2_matrix_row(&mat, i);
+			uint32_t best = 0;
+
+			for (uint32_t c = 1; c < k; c++) {
+				if (row[c] < row[best])
+					best = c;
+			}
+			assign[first + i] = best;
+			sum += (double)row[best];
+		}
+	}
+	if (obj != NULL)
+		*obj = sum;
+out:
+	l2_matrix_free(be, &mat);
+	return result;
+}
+
+doca_error_t l2_kmeans_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			     const struct l2_kmeans_cfg *cfg, int32_t *centroids)
+{
+	uint32_t k = cfg->k, iters = cfg->iters != 0 ? cfg->iters : 10;
+	uint64_t max_train = cfg->max_train != 0 ? cfg->max_train : 256ULL * k;
+	uint64_t rng = cfg->seed != 0 ? cfg->seed : 0x9e3779b97f4a7c15ULL;
+	uint32_t nt = n < max_train ? n : (uint32_t)(max_train > k ? max_train : k);
+	uint32_t *perm = NULL, *assign = NULL, *counts = NULL;
+	int32_t *train = NULL;
+	int64_t *sums = NULL;
+	double obj = 0;
+	doca_error_t result;
+
+	if (k == 0 || n < k || dim == 0) {
+		DOCA_LOG_ERR("Cannot train %u centroids from %u vectors of dim %u", k, n, dim);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	perm = malloc((size_t)n * sizeof(*perm));
+	train = malloc((size_t)nt * dim * sizeof(*train));
+	assign = malloc((size_t)nt * sizeof(*assign));
+	counts = malloc((size_t)k * sizeof(*counts));
+	sums = malloc((size_t)k * dim * sizeof(*sums));
+	if (perm == NULL || train == NULL || assign == NULL || counts == NULL || sums == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto out;
+	}
+
+	/* 部分 Fisher-Yates：前 nt 个是无放回的随机样本，前 k 个同时作为初始中心 */
+	for (uint32_t i = 0; i < n; i++)
+		perm[i] = i;
+	for (uint32_t i = 0; i < nt; i++) {
+		uint32_t j = i + (uint32_t)(xorshift(&rng) % (n - i));
+		uint32_t t = perm[i];
+
+		perm[i] = perm[j];
+		perm[j] = t;
+		memcpy(train + (size_t)i * dim, vecs + (size_t)perm[i] * dim, dim * sizeof(int32_t));
+	}
+	memcpy(centroids, train, (size_t)k * dim * sizeof(int32_t));
+
+	for (uint32_t it = 0; it < iters; it++) {
+		result = l2_kmeans_assign(be, train, nt, dim, centroids, k, assign, &obj);
+		if (result != DOCA_SUCCESS)
+			goto out;
+
+		memset(counts, 0, (size_t)k * sizeof(*counts));
+		memset(sums, 0, (size_t)k * dim * sizeof(*sums));
+		for (uint32_t i = 0; i < nt; i++) {
+			const int32_t *v = train + (size_t)i * dim;
+			int64_t *s = sums + (size_t)assign[i] * dim;
+
+			counts[assign[i]]++;
+			for (uint32_t d = 0; d < dim; d++)
+				s[d] += v[d];
+		}
+		for (uint32_t c = 0; c < k; c++) {
+			if (counts[c] == 0)
+				continue;
+			for (uint32_t d = 0; d < dim; d++)
+				centroids[(size_t)c * dim + d] =
+					(int32_t)llround((double)sums[(size_t)c * dim + d] / counts[c]);
+		}
+
+		/* 空簇：从最大的簇里随机挑一个点做新中心，下一轮会把那个簇分开 */
+		for (uint32_t c = 0; c < k; c++) {
+			uint32_t big = 0, pick;
+
+			if (counts[c] != 0)
+				continue;
+			for (uint32_t b = 1; b < k; b++) {
+				if (counts[b] > counts[big])
+					big = b;
+			}
+			pick = (uint32_t)(xorshift(&rng) % counts[big]);
+			for (uint32_t i = 0; i < nt; i++) {
+				if (assign[i] == big && pick-- == 0) {
+					memcpy(centroids + (size_t)c * dim, train + (size_t)i * dim, dim * sizeof(int32_t));
+					break;
+				}
+			}
+			counts[big]--;
+			counts[c] = 1;
+		}
+		DOCA_LOG_DBG("k-means iteration %u: mean squared distance %.6f", it,
+			     obj / nt / (double)(1ULL << 32));
+	}
+	DOCA_LOG_INFO("Trained %u centroids on %u of %u vectors, %u iterations, mean distance %.6f", k, nt, n, iters,
+		      sqrt(obj / nt) / (double)(1u << 16));
+	result = DOCA_SUCCESS;
+out:
+	free(sums);
+	free(counts);
+	free(assign);
+	free(train);
+	free(perm);
+	return result;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <string.h>
+
+#include "../include/l2_layout.h"
+
+static const char *const layout_names[L2_LAYOUT_MAX] = {
+	[L2_LAYOUT_AOS] = "aos",
+	[L2_LAYOUT_BLOCKED] = "blocked",
+};
+
+const char *l2_layout_name(enum l2_layout layout)
+{
+	return layout < L2_LAYOUT_MAX ? layout_names[layout] : "unknown";
+}
+
+enum l2_layout l2_layout_from_name(const char *name)
+{
+	for (int l = 0; l < L2_LAYOUT_MAX; ++l)
+		if (strcmp(name, layout_names[l]) == 0)
+			return (enum l2_layout)l;
+	return L2_LAYOUT_MAX;
+}
+
+void l2_layout_aos_to_blocked(const int32_t *src, uint32_t dim, uint32_t n, int32_t *dst)
+{
+	uint32_t nblocks = (n + L2_BLOCK_VECS - 1) / L2_BLOCK_VECS;
+
+	/* 按 block 写 dst，保证输出是顺序写；src 每次只跨 16 行 */
+	for (uint32_t blk = 0; blk < nblocks; ++blk) {
+		int32_t *out = dst + (size_t)blk * dim * L2_BLOCK_VECS;
+		uint32_t lanes = n - blk * L2_BLOCK_VECS;
+
+		if (lanes > L2_BLOCK_VECS)
+			lanes = L2_BLOCK_VECS;
+		for (uint32_t i = 0; i < dim; ++i) {
+			for (uint32_t l = 0; l < lanes; ++l)
+				out[i * L2_BLOCK_VECS + l] = src[(size_t)(blk * L2_BLOCK_VECS + l) * dim + i];
+			for (uint32_t l = lanes; l < L2_BLOCK_VECS; ++l)
+				out[i * L2_BLOCK_VECS + l] = 0;
+		}
+	}
+}
+
+void l2_layout_blocked_to_aos(const int32_t *src, uint32_t dim, uint32_t n, int32_t *dst)
+{
+	for (uint32_t v = 0; v < n; ++v)
+		for (uint32_t i = 0; i < dim; ++i)
+			dst[(size_t)v * dim + i] = src[l2_blocked_index(dim, v, i)];
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_matrix.h"
+#include "../include/l2_simd.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::MATRIX);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+doca_error_t l2_matrix_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_m, uint32_t n,
+			     struct l2_matrix *mat)
+{
+	size_t a_bytes = ALIGN64((size_t)max_m * dim * sizeof(int32_t));
+	size_t b_bytes = ALIGN64((size_t)n * dim * sizeof(int32_t));
+	size_t an_bytes = ALIGN64((size_t)max_m * sizeof(uint64_t));
+	size_t bn_bytes = ALIGN64((size_t)n * sizeof(uint64_t));
+	size_t out_stride = ALIGN64((size_t)n * sizeof(uint64_t));
+	uint8_t *base;
+	doca_error_t result;
+
+	memset(mat, 0, sizeof(*mat));
+	if (dim == 0 || max_m == 0 || n == 0) {
+		DOCA_LOG_ERR("Invalid matrix shape: %u x %u, dim %u", max_m, n, dim);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	/* 布局: [a][b][a_norm][b_norm][out]，out 每行按 64 字节对齐 */
+	result = l2_backend_mem_alloc(be, a_bytes + b_bytes + an_bytes + bn_bytes + (size_t)max_m * out_stride,
+				      &mat->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+	base = mat->mem.addr;
+	mat->a = (int32_t *)base;
+	mat->b = (int32_t *)(base + a_bytes);
+	mat->a_norm = (uint64_t *)(base + a_bytes + b_bytes);
+	mat->b_norm = (uint64_t *)(base + a_bytes + b_bytes + an_bytes);
+	mat->out = (uint64_t *)(base + a_bytes + b_bytes + an_bytes + bn_bytes);
+	l2_backend_mem_touch(be, mat->out, (size_t)max_m * out_stride);
+	mat->out_stride = out_stride;
+	mat->dim = dim;
+	mat->max_m = max_m;
+	mat->n = n;
+	return DOCA_SUCCESS;
+}
+
+void l2_matrix_free(struct l2_backend *be, struct l2_matrix *mat)
+{
+	l2_backend_mem_free(be, &mat->mem);
+	memset(mat, 0, sizeof(*mat));
+}
+
+void l2_matrix_update_norms(struct l2_matrix *mat, uint32_t m, unsigned int sides)
+{
+	uint64_t stride = (uint64_t)mat->dim * sizeof(int32_t);
+
+	if (sides & L2_MATRIX_A)
+		l2_simd_norms(mat->a, stride, m < mat->max_m ? m : mat->max_m, mat->dim, mat->a_norm);
+	if (sides & L2_MATRIX_B)
+		l2_simd_norms(mat->b, stride, mat->n, mat->dim, mat->b_norm);
+}
+
+void l2_matrix_fill_args(const struct l2_matrix *mat, uint32_t m, struct l2_matrix_args *args)
+{
+	args->handle = mat->mem.handle;
+	args->a_base = (uint64_t)(uintptr_t)mat->a;
+	args->b_base = (uint64_t)(uintptr_t)mat->b;
+	args->a_norm_base = (uint64_t)(uintptr_t)mat->a_norm;
+	args->b_norm_base = (uint64_t)(uintptr_t)mat->b_norm;
+	args->out_base = (uint64_t)(uintptr_t)mat->out;
+	args->a_stride = (uint64_t)mat->dim * sizeof(int32_t);
+	args->b_stride = (uint64_t)mat->dim * sizeof(int32_t);
+	args->out_stride = mat->out_stride;
+	args->dim = mat->dim;
+	args->frac_bits = 16;
+	args->m = m;
+	args->n = mat->n;
+}
+
+doca_error_t l2_matrix_submit(struct l2_backend *be, struct l2_matrix *mat, uint32_t m)
+{
+	struct l2_matrix_args args;
+
+	if (m == 0 || m > mat->max_m) {
+		DOCA_LOG_ERR("Matrix submit of %u rows, capacity %u", m, mat->max_m);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	l2_matrix_fill_args(mat, m, &args);
+	mat->m = m;
+	return l2_backend_launch(be, L2_KERNEL_MATRIX, &args, &mat->seq);
+}
+
+doca_error_t l2_matrix_wait(struct l2_backend *be, struct l2_matrix *mat)
+{
+	return l2_backend_wait(be, mat->seq);
+}
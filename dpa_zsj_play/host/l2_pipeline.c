@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_pipeline.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::PIPELINE);
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+doca_error_t l2_pipeline_create(struct l2_backend *be, const struct l2_pipeline_cfg *cfg, struct l2_pipeline *pl)
+{
+	size_t vec_bytes = ((size_t)cfg->slot_vectors * cfg->dim * sizeof(int32_t) + 63) & ~(size_t)63;
+	size_t out_bytes = ((size_t)cfg->slot_vectors * sizeof(uint64_t) + 63) & ~(size_t)63;
+	size_t slot_bytes = 2 * vec_bytes + out_bytes;
+	doca_error_t result;
+
+	memset(pl, 0, sizeof(*pl));
+	if (cfg->num_slots == 0 || cfg->slot_vectors == 0 || cfg->dim == 0 || cfg->stage == NULL) {
+		DOCA_LOG_ERR("Invalid pipeline shape: %u slots of %u vectors, dim %u", cfg->num_slots,
+			     cfg->slot_vectors, cfg->dim);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	pl->be = be;
+	pl->cfg = *cfg;
+
+	pl->slots = calloc(cfg->num_slots, sizeof(*pl->slots));
+	pl->slot_seq = calloc(cfg->num_slots, sizeof(*pl->slot_seq));
+	pl->slot_first = calloc(cfg->num_slots, sizeof(*pl->slot_first));
+	pl->slot_count = calloc(cfg->num_slots, sizeof(*pl->slot_count));
+	if (pl->slots == NULL || pl->slot_seq == NULL || pl->slot_first == NULL || pl->slot_count == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto fail;
+	}
+
+	result = l2_backend_mem_alloc(be, slot_bytes * cfg->num_slots, &pl->mem);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+
+	/* 布局: slot i = [a][b][out]，每段 64 字节对齐 */
+	for (uint32_t i = 0; i < cfg->num_slots; i++) {
+		struct l2_batch *slot = &pl->slots[i];
+		uint8_t *base = (uint8_t *)pl->mem.addr + i * slot_bytes;
+
+		slot->mem = pl->mem;
+		slot->a = (int32_t *)base;
+		slot->b = (int32_t *)(base + vec_bytes);
+		slot->out = (uint64_t *)(base + 2 * vec_bytes);
+		slot->dim = cfg->dim;
+		slot->frac_bits = 16;
+		slot->batch_size = cfg->slot_vectors;
+	}
+
+	result = l2_event_create(be, &pl->staged);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	return DOCA_SUCCESS;
+
+fail:
+	l2_pipeline_destroy(pl);
+	return result;
+}
+
+void l2_pipeline_destroy(struct l2_pipeline *pl)
+{
+	if (pl->be != NULL) {
+		if (pl->be->launched > 0)
+			(void)l2_backend_wait(pl->be, pl->be->launched);
+		l2_event_destroy(pl->be, pl->staged);
+		if (pl->mem.addr != NULL)
+			l2_backend_mem_free(pl->be, &pl->mem);
+	}
+	free(pl->slot_count);
+	free(pl->slot_first);
+	free(pl->slot_seq);
+	free(pl->slots);
+	memset(pl, 0, sizeof(*pl));
+}
+
+/* 等 slot 上的那一批算完，交给 drain */
+static doca_error_t retire_slot(struct l2_pipeline *pl, uint32_t s, int drain)
+{
+	uint64_t t0 = now_ns();
+	doca_error_t result;
+
+	result = l2_backend_wait(pl->be, pl->slot_seq[s]);
+	pl->stats.slot_wait_ns += now_ns() - t0;
+	if (result != DOCA_SUCCESS)
+		return result;
+	if (drain && pl->cfg.drain != NULL) {
+		L2_TRACE_BEGIN(td);
+		pl->cfg.drain(pl->cfg.ctx, pl->slot_first[s], pl->slot_count[s], pl->slots[s].out);
+		L2_TRACE_END(td, "pipeline.drain", pl->slot_count[s]);
+	}
+	pl->slot_seq[s] = 0;
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_pipeline_run(struct l2_pipeline *pl, uint64_t num_pairs)
+{
+	const uint32_t K = pl->cfg.num_slots;
+	uint64_t nb = (num_pairs + pl->cfg.slot_vectors - 1) / pl->cfg.slot_vectors;
+	uint64_t base = pl->published;
+	int defer = l2_backend_can_defer(pl->be);
+	uint64_t t_start = now_ns();
+	doca_error_t result = DOCA_SUCCESS, status = DOCA_SUCCESS;
+	uint64_t n, ok = 0;	/* ok: 完整 stage + launch 成功的批数，这些批的结果照常 drain */
+
+	for (n = 0; n < nb; n++) {
+		uint32_t s = n % K;
+		struct l2_batch *slot = &pl->slots[s];
+		uint64_t first = n * pl->cfg.slot_vectors;
+		uint32_t count = (uint32_t)(num_pairs - first < pl->cfg.slot_vectors ? num_pairs - first :
+										   pl->cfg.slot_vectors);
+		struct l2_batch_args args;
+		uint64_t t0;
+
+		/* slot 还被 K 批之前的 launch 占着 */
+		if (pl->slot_seq[s] != 0) {
+			result = retire_slot(pl, s, 1);
+			if (result != DOCA_SUCCESS) {
+				status = result;
+				break;
+			}
+		}
+
+		l2_batch_fill_args(slot, 0, count, &args);
+		pl->slot_first[s] = first;
+		pl->slot_count[s] = count;
+
+		/* 能延迟的 backend 先把 launch 挂上，等 staged > base + n 再开始 */
+		if (defer) {
+			result = l2_backend_launch_after(pl->be, L2_KERNEL_BATCH, &args, pl->staged, base + n,
+							 &pl->slot_seq[s]);
+			if (result != DOCA_SUCCESS) {
+				status = result;
+				break;
+			}
+		}
+
+		t0 = now_ns();
+		result = pl->cfg.stage(pl->cfg.ctx, first, count, slot->a, slot->b);
+		pl->stats.stage_ns += now_ns() - t0;
+		L2_TRACE_END(t0, "pipeline.stage", count);
+		L2_TRACE_COUNTER("bytes_staged", 2 * (uint64_t)count * pl->cfg.dim * sizeof(int32_t));
+		if (result != DOCA_SUCCESS)
+			status = result;
+
+		/* 即使 stage 失败也要发布，否则已经挂上的 launch 永远等不到 */
+		result = l2_event_set(pl->be, pl->staged, base + n + 1);
+		if (result != DOCA_SUCCESS && status == DOCA_SUCCESS)
+			status = result;
+		if (status != DOCA_SUCCESS) {
+			n++;
+			break;
+		}
+
+		if (!defer) {
+			result = l2_backend_launch_after(pl->be, L2_KERNEL_BATCH, &args, pl->staged, base + n,
+							 &pl->slot_seq[s]);
+			if (result != DOCA_SUCCESS) {
+				status = result;
+				n++;
+				break;
+			}
+		}
+		pl->stats.launches++;
+		ok++;
+	}
+
+	/* 收尾：按提交顺序把还在飞的 slot 等完 */
+	for (uint64_t m = n > K ? n - K : 0; m < n; m++) {
+		uint32_t s = m % K;
+
+		if (pl->slot_seq[s] == 0)
+			continue;
+		result = retire_slot(pl, s, m < ok);
+		if (result != DOCA_SUCCESS && status == DOCA_SUCCESS)
+			status = result;
+	}
+
+	pl->published = base + n;
+	pl->stats.total_ns += now_ns() - t_start;
+	return status;
+}
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_pool.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::POOL);
+
+/* 找 CPU 所在 NUMA node 时最多试这么多个 node */
+#define L2_POOL_MAX_NODES 64
+/* first touch 时一次 move_pages 处理的页数 */
+#define L2_POOL_MOVE_BATCH 256
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)	/* <numaif.h>，不为它引入 libnuma */
+#endif
+
+/* 一个 worker 的 task 范围：低 32 位 head，高 32 位 tail，owner 和 thief 都 CAS 同一个字 */
+struct pool_queue {
+	_Atomic uint64_t range;
+} __attribute__((aligned(64)));
+
+struct pool_worker {
+	struct l2_pool *pool;
+	unsigned int id;
+	int cpu;		/* -1: 不绑核 */
+	int node;		/* cpu 所在的 NUMA node，不绑核时 -1 */
+	pthread_t tid;
+	uint64_t steals;	/* 只有本 worker 写 */
+};
+
+struct l2_pool {
+	unsigned int num_workers;
+	struct pool_worker *workers;
+	struct pool_queue *queues;
+	unsigned int num_nodes;
+
+	pthread_mutex_t run_lock;	/* 同一时间只有一个 run */
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	uint64_t generation;	/* 每次 run 加一，worker 靠它发现新任务 */
+	unsigned int busy;	/* 本次 run 还没结束的 worker 数 */
+	bool stop;
+
+	/* 当前 run */
+	l2_pool_task_fn fn;
+	void *ctx;
+	bool steal;
+
+	uint64_t runs;
+	uint64_t tasks;
+};
+
+static inline uint64_t pack_range(uint32_t head, uint32_t tail)
+{
+	return (uint64_t)tail << 32 | head;
+}
+
+/* 从自己范围的前端拿一个 */
+static bool pop_front(struct pool_queue *q, uint32_t *task)
+{
+	uint64_t r = atomic_load_explicit(&q->range, memory_order_relaxed);
+
+	for (;;) {
+		uint32_t head = (uint32_t)r, tail = (uint32_t)(r >> 32);
+
+		if (head >= tail)
+			return false;
+		if (atomic_compare_exchange_weak_explicit(&q->range, &r, pack_range(head + 1, tail),
+							  memory_order_acq_rel, memory_order_relaxed)) {
+			*task = head;
+			return true;
+		}
+	}
+}
+
+/* 从别人范围的后端偷一个，离 owner 正在做的位置最远 */
+static bool pop_back(struct pool_queue *q, uint32_t *task)
+{
+	uint64_t r = atomic_load_explicit(&q->range, memory_order_relaxed);
+
+	for (;;) {
+		uint32_t head = (uint32_t)r, tail = (uint32_t)(r >> 32);
+
+		if (head >= tail)
+			return false;
+		if (atomic_compare_exchange_weak_explicit(&q->range, &r, pack_range(head, tail - 1),
+							  memory_order_acq_rel, memory_order_relaxed)) {
+			*task = tail - 1;
+			return true;
+		}
+	}
+}
+
+/* 返回本 worker 这次 run 跑了几个 task */
+static uint32_t worker_run(struct pool_worker *w)
+{
+	struct l2_pool *pool = w->pool;
+	const unsigned int W = pool->num_workers;
+	uint32_t task, done = 0;
+
+	while (pop_front(&pool->queues[w->id], &task)) {
+		pool->fn(pool->ctx, task, w->id);
+		done++;
+	}
+	if (!pool->steal)
+		return done;
+	/* 近的 worker 优先：按 NUMA 排过序，相邻 worker 大概率同一个 node */
+	for (unsigned int d = 1; d < W; d++) {
+		struct pool_queue *victim = &pool->queues[(w->id + d) % W];
+
+		while (pop_back(victim, &task)) {
+			w->steals++;
+			pool->fn(pool->ctx, task, w->id);
+			done++;
+		}
+	}
+	return done;
+}
+
+static void *worker_main(void *arg)
+{
+	struct pool_worker *w = arg;
+	struct l2_pool *pool = w->pool;
+	uint64_t seen = 0;
+	uint32_t done;
+
+	L2_TRACE_THREAD("pool worker");
+	if (w->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+			DOCA_LOG_WARN("Failed to pin pool worker %u to CPU %d", w->id, w->cpu);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->generation == seen && !pool->stop)
+			pthread_cond_wait(&pool->start_cond, &pool->lock);
+		if (pool->stop)
+			break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		L2_TRACE_BEGIN(t0);
+		done = worker_run(w);
+		L2_TRACE_END(t0, "pool.worker", done);
+		(void)done;
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static int cpu_node(int cpu)
+{
+	char path[96];
+
+	for (int node = 0; node < L2_POOL_MAX_NODES; node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+		if (access(path, F_OK) == 0)
+			return node;
+	}
+	return 0;
+}
+
+/*
+ * Pick a CPU for every worker: allowed CPUs sorted by (node, cpu), then spread evenly so that a pool smaller
+ * than the machine still covers every node while consecutive workers share one
+ *
+ * @return: number of NUMA nodes used, 0 if the workers are left unpinned
+ */
+static unsigned int assign_cpus(struct l2_pool *pool, int no_pin)
+{
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE], nodes[CPU_SETSIZE];
+	unsigned int ncpu = 0, used_nodes = 0;
+	uint64_t node_mask = 0;
+
+	for (unsigned int i = 0; i < pool->num_workers; i++) {
+		pool->workers[i].cpu = -1;
+		pool->workers[i].node = -1;
+	}
+	if (no_pin || sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return 0;
+
+	for (int c = 0; c < CPU_SETSIZE; c++) {
+		if (!CPU_ISSET(c, &allowed))
+			continue;
+		/* 插入排序，CPU 数不多 */
+		int node = cpu_node(c);
+		unsigned int j = ncpu++;
+
+		while (j > 0 && nodes[j - 1] > node) {
+			cpus[j] = cpus[j - 1];
+			nodes[j] = nodes[j - 1];
+			j--;
+		}
+		cpus[j] = c;
+		nodes[j] = node;
+	}
+	/* 超订时绑核只会让线程互相抢，交给调度器 */
+	if (ncpu == 0 || pool->num_workers > ncpu)
+		return 0;
+
+	for (unsigned int i = 0; i < pool->num_workers; i++) {
+		unsigned int slot = (unsigned int)((uint64_t)i * ncpu / pool->num_workers);
+
+		pool->workers[i].cpu = cpus[slot];
+		pool->workers[i].node = nodes[slot];
+		if (!(node_mask & (1ULL << (nodes[slot] % 64)))) {
+			node_mask |= 1ULL << (nodes[slot] % 64);
+			used_nodes++;
+		}
+	}
+	return used_nodes;
+}
+
+doca_error_t l2_pool_create(const struct l2_pool_cfg *cfg, struct l2_pool **pool)
+{
+	struct l2_pool *p;
+	unsigned int n = cfg != NULL ? cfg->num_workers : 0;
+	unsigned int started;
+	int ret;
+
+	if (n == 0) {
+		cpu_set_t allowed;
+
+		n = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? (unsigned int)CPU_COUNT(&allowed) : 1;
+	}
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	p->num_workers = n;
+	p->workers = calloc(n, sizeof(*p->workers));
+	p->queues = aligned_alloc(64, n * sizeof(*p->queues));
+	if (p->workers == NULL || p->queues == NULL) {
+		free(p->queues);
+		free(p->workers);
+		free(p);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	for (unsigned int i = 0; i < n; i++)
+		atomic_init(&p->queues[i].range, 0);
+	pthread_mutex_init(&p->run_lock, NULL);
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->start_cond, NULL);
+	pthread_cond_init(&p->done_cond, NULL);
+	p->num_nodes = assign_cpus(p, cfg != NULL && cfg->no_pin);
+
+	for (started = 0; started < n; started++) {
+		struct pool_worker *w = &p->workers[started];
+
+		w->pool = p;
+		w->id = started;
+		ret = pthread_create(&w->tid, NULL, worker_main, w);
+		if (ret != 0) {
+			DOCA_LOG_ERR("Failed to start pool worker %u: %d", started, ret);
+			p->num_workers = started;
+			l2_pool_destroy(p);
+			return DOCA_ERROR_OPERATING_SYSTEM;
+		}
+	}
+
+	if (p->num_nodes > 0)
+		DOCA_LOG_INFO("Host pool: %u workers pinned over %u NUMA node(s)", n, p->num_nodes);
+	else
+		DOCA_LOG_INFO("Host pool: %u unpinned workers", n);
+	*pool = p;
+	return DOCA_SUCCESS;
+}
+
+void l2_pool_destroy(struct l2_pool *pool)
+{
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (unsigned int i = 0; i < pool->num_workers; i++)
+		pthread_join(pool->workers[i].tid, NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->run_lock);
+	free(pool->queues);
+	free(pool->workers);
+	free(pool);
+}
+
+unsigned int l2_pool_size(const struct l2_pool *pool)
+{
+	return pool->num_workers;
+}
+
+static void pool_run(struct l2_pool *pool, uint32_t num_tasks, l2_pool_task_fn fn, void *ctx, bool steal)
+{
+	const unsigned int W = pool->num_workers;
+
+	if (num_tasks == 0)
+		return;
+
+	pthread_mutex_lock(&pool->run_lock);
+	pthread_mutex_lock(&pool->lock);
+	for (unsigned int i = 0; i < W; i++) {
+		uint32_t head = (uint32_t)((uint64_t)i * num_tasks / W);
+		uint32_t tail = (uint32_t)((uint64_t)(i + 1) * num_tasks / W);
+
+		atomic_store_explicit(&pool->queues[i].range, pack_range(head, tail), memory_order_relaxed);
+	}
+	pool->fn = fn;
+	pool->ctx = ctx;
+	pool->steal = steal;
+	pool->busy = W;
+	pool->generation++;
+	pool->runs++;
+	pool->tasks += num_tasks;
+	pthread_cond_broadcast(&pool->start_cond);
+	while (pool->busy > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&pool->run_lock);
+}
+
+void l2_pool_run(struct l2_pool *pool, uint32_t num_tasks, l2_pool_task_fn fn, void *ctx)
+{
+	pool_run(pool, num_tasks, fn, ctx, true);
+}
+
+void l2_pool_run_static(struct l2_pool *pool, uint32_t num_tasks, l2_pool_task_fn fn, void *ctx)
+{
+	pool_run(pool, num_tasks, fn, ctx, false);
+}
+
+struct touch_ctx {
+	const struct l2_pool *pool;
+	uint8_t *addr;
+	size_t len;
+	uint32_t num_tasks;
+	size_t page;
+	bool move;		/* 多个 node：已经 fault 过的页（arena 回收的块）要迁过来 */
+};
+
+/*
+ * Migrate the already-faulted pages among [first, last) (page aligned) to node; pages that are not
+ * present yet are left to the touch loop, and failures (pinned or hugetlb pages the kernel cannot
+ * move) only cost locality
+ */
+static void move_to_node(uintptr_t first, uintptr_t last, size_t page, int node)
+{
+	void *pages[L2_POOL_MOVE_BATCH];
+	int nodes[L2_POOL_MOVE_BATCH], status[L2_POOL_MOVE_BATCH];
+
+	for (unsigned int i = 0; i < L2_POOL_MOVE_BATCH; i++)
+		nodes[i] = node;
+	while (first < last) {
+		unsigned long n = 0;
+
+		for (; n < L2_POOL_MOVE_BATCH && first < last; n++, first += page)
+			pages[n] = (void *)first;
+		(void)syscall(SYS_move_pages, 0, n, pages, nodes, status, MPOL_MF_MOVE);
+	}
+}
+
+static void touch_task(void *arg, uint32_t task, unsigned int worker)
+{
+	struct touch_ctx *t = arg;
+	size_t begin = (size_t)((unsigned __int128)t->len * task / t->num_tasks);
+	size_t end = (size_t)((unsigned __int128)t->len * (task + 1) / t->num_tasks);
+
+	int node = t->pool->workers[worker].node;
+	/* 页按页首地址归属，addr 之前开始的第一页归 task 0 */
+	uintptr_t p = ((uintptr_t)t->addr + begin + t->page - 1) & ~(uintptr_t)(t->page - 1);
+	uintptr_t first = task == 0 ? (uintptr_t)t->addr & ~(uintptr_t)(t->page - 1) : p;
+
+	/* first touch 只管没 fault 过的页，回收来的页还在上一个用户的 node 上 */
+	if (t->move && node >= 0)
+		move_to_node(first, (uintptr_t)t->addr + end, t->page, node);
+	if (task == 0 && p != (uintptr_t)t->addr)
+		*(volatile uint8_t *)t->addr = *(volatile uint8_t *)t->addr;
+	for (; p < (uintptr_t)t->addr + end; p += t->page) {
+		/* 读再写回原值：只读会映射到共享零页，写才真正分配 */
+		*(volatile uint8_t *)p = *(volatile uint8_t *)p;
+	}
+}
+
+void l2_pool_first_touch(struct l2_pool *pool, void *addr, size_t len, uint32_t num_tasks)
+{
+	struct touch_ctx t = {
+		.pool = pool,
+		.move = pool->num_nodes > 1,
+		.addr = addr,
+		.len = len,
+		.num_tasks = num_tasks != 0 ? num_tasks : pool->num_workers,
+		.page = (size_t)sysconf(_SC_PAGESIZE),
+	};
+
+	if (len == 0)
+		return;
+	l2_pool_run_static(pool, t.num_tasks, touch_task, &t);
+}
+
+void l2_pool_get_stats(struct l2_pool *pool, struct l2_pool_stats *stats)
+{
+	pthread_mutex_lock(&pool->lock);
+	stats->runs = pool->runs;
+	stats->tasks = pool->tasks;
+	stats->steals = 0;
+	for (unsigned int i = 0; i < pool->num_workers; i++)
+		stats->steals += pool->workers[i].steals;
+	pthread_mutex_unlock(&pool->lock);
+}
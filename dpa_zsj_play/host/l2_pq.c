@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_kmeans.h"
+#include "../include/l2_pq.h"
+#include "../include/l2_search.h"
+#include "../include/l2_simd.h"
+#include "../include/l2_topk.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::PQ);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+#define PQ_LUT_MAX 65535.0
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* 取出子空间 j 的列：out[i] = vecs[i][j * dsub, (j + 1) * dsub) */
+static void pq_extract(const int32_t *vecs, uint32_t n, uint32_t dim, uint32_t dsub, uint32_t j, int32_t *out)
+{
+	for (uint32_t i = 0; i < n; i++)
+		memcpy(out + (size_t)i * dsub, vecs + (size_t)i * dim + (size_t)j * dsub, dsub * sizeof(int32_t));
+}
+
+doca_error_t l2_pq_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			 const struct l2_pq_train_cfg *cfg, struct l2_pq *pq)
+{
+	struct l2_kmeans_cfg km = {
+		.k = L2_PQ_KSUB,
+		.iters = cfg->iters,
+		.max_train = cfg->max_train,
+		.seed = cfg->seed,
+	};
+	uint32_t m = cfg->m, dsub;
+	int32_t *sub;
+	doca_error_t result = DOCA_SUCCESS;
+
+	memset(pq, 0, sizeof(*pq));
+	if (m == 0 || dim % m != 0 || n < L2_PQ_KSUB) {
+		DOCA_LOG_ERR("Invalid PQ shape: dim %u, m %u, %u training vectors (min %u)", dim, m, n, L2_PQ_KSUB);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	dsub = dim / m;
+	sub = malloc((size_t)n * dsub * sizeof(int32_t));
+	pq->codebooks = malloc((size_t)m * L2_PQ_KSUB * dsub * sizeof(int32_t));
+	if (sub == NULL || pq->codebooks == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto out;
+	}
+	pq->dim = dim;
+	pq->m = m;
+	pq->dsub = dsub;
+
+	for (uint32_t j = 0; j < m; j++) {
+		pq_extract(vecs, n, dim, dsub, j, sub);
+		km.seed = cfg->seed + j;	/* 每个子空间换一个种子 */
+		result = l2_kmeans_train(be, sub, n, dsub, &km, pq->codebooks + (size_t)j * L2_PQ_KSUB * dsub);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("PQ subspace %u: %s", j, doca_error_get_descr(result));
+			goto out;
+		}
+	}
+out:
+	free(sub);
+	if (result != DOCA_SUCCESS)
+		l2_pq_free(pq);
+	return result;
+}
+
+void l2_pq_free(struct l2_pq *pq)
+{
+	free(pq->codebooks);
+	memset(pq, 0, sizeof(*pq));
+}
+
+doca_error_t l2_pq_encode(struct l2_backend *be, const struct l2_pq *pq, const int32_t *vecs, uint32_t n,
+			  struct l2_pq_codes *codes)
+{
+	uint32_t *assign;
+	int32_t *sub;
+	doca_error_t result;
+
+	memset(codes, 0, sizeof(*codes));
+	assign = malloc((size_t)n * sizeof(*assign));
+	sub = malloc((size_t)n * pq->dsub * sizeof(int32_t));
+	if (assign == NULL || sub == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto out;
+	}
+	result = l2_backend_mem_alloc(be, (size_t)n * pq->m, &codes->mem);
+	if (result != DOCA_SUCCESS)
+		goto out;
+	codes->codes = codes->mem.addr;
+	codes->n = n;
+	codes->m = pq->m;
+
+	/* 每个子空间是一次 n x 256 的最近码字查找，和 IVF 建表一样在 backend 上算 */
+	for (uint32_t j = 0; j < pq->m; j++) {
+		pq_extract(vecs, n, pq->dim, pq->dsub, j, sub);
+		result = l2_kmeans_assign(be, sub, n, pq->dsub, pq->codebooks + (size_t)j * L2_PQ_KSUB * pq->dsub,
+					  L2_PQ_KSUB, assign, NULL);
+		if (result != DOCA_SUCCESS) {
+			l2_pq_codes_free(be, codes);
+			goto out;
+		}
+		for (uint32_t i = 0; i < n; i++)
+			codes->codes[(size_t)i * pq->m + j] = (uint8_t)assign[i];
+	}
+out:
+	free(sub);
+	free(assign);
+	return result;
+}
+
+void l2_pq_codes_free(struct l2_backend *be, struct l2_pq_codes *codes)
+{
+	l2_backend_mem_free(be, &codes->mem);
+	memset(codes, 0, sizeof(*codes));
+}
+
+doca_error_t l2_pq_search_alloc(struct l2_backend *be, const struct l2_pq *pq, uint32_t max_nq, uint32_t k,
+				struct l2_pq_search *search)
+{
+	uint32_t num_parts = be->cfg.num_threads;
+	uint64_t lut_stride = ALIGN64((size_t)pq->m * L2_PQ_KSUB * sizeof(uint16_t) + L2_PQ_LUT_PAD);
+	size_t parts_bytes = (size_t)max_nq * num_parts * k * sizeof(struct l2_hit);
+	doca_error_t result;
+
+	memset(search, 0, sizeof(*search));
+	if (k == 0 || k > L2_SEARCH_MAX_K || max_nq == 0) {
+		DOCA_LOG_ERR("Invalid search shape: k = %u (max %u), max_nq = %u", k, L2_SEARCH_MAX_K, max_nq);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	search->partial = malloc((size_t)pq->m * L2_PQ_KSUB * sizeof(*search->partial));
+	search->bias = malloc((size_t)max_nq * sizeof(*search->bias));
+	search->scale = malloc((size_t)max_nq * sizeof(*search->scale));
+	if (search->partial == NULL || search->bias == NULL || search->scale == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto free_host;
+	}
+	result = l2_backend_mem_alloc(be, max_nq * lut_stride + parts_bytes, &search->mem);
+	if (result != DOCA_SUCCESS)
+		goto free_host;
+	/* padding 里的字节只会被 gather 读到后丢掉，清零免得读未初始化内存 */
+	memset(search->mem.addr, 0, max_nq * lut_stride);
+	search->luts = search->mem.addr;
+	search->parts = (struct l2_hit *)((uint8_t *)search->mem.addr + max_nq * lut_stride);
+	search->lut_stride = lut_stride;
+	search->max_nq = max_nq;
+	search->k = k;
+	search->num_parts = num_parts;
+	return DOCA_SUCCESS;
+
+free_host:
+	free(search->partial);
+	free(search->bias);
+	free(search->scale);
+	memset(search, 0, sizeof(*search));
+	return result;
+}
+
+void l2_pq_search_free(struct l2_backend *be, struct l2_pq_search *search)
+{
+	l2_backend_mem_free(be, &search->mem);
+	free(search->partial);
+	free(search->bias);
+	free(search->scale);
+	memset(search, 0, sizeof(*search));
+}
+
+/*
+ * 建一个 query 的表：先算精确的部分距离，每个子空间减去自己的最小值，
+ * 再用所有子空间共同的 scale 量化到 uint16，这样表项之和乘 scale 就是距离。
+ */
+static void pq_build_lut(const struct l2_pq *pq, struct l2_pq_search *search, const int32_t *query, uint32_t q)
+{
+	uint16_t *lut = (uint16_t *)((uint8_t *)search->luts + (uint64_t)q * search->lut_stride);
+	uint64_t *partial = search->partial;
+	uint64_t bias = 0, range = 0;
+	double inv;
+
+	for (uint32_t j = 0; j < pq->m; j++) {
+		const int32_t *qs = query + (size_t)j * pq->dsub;
+		const int32_t *cb = pq->codebooks + (size_t)j * L2_PQ_KSUB * pq->dsub;
+		uint64_t *d = partial + (size_t)j * L2_PQ_KSUB;
+		uint64_t lo = UINT64_MAX, hi = 0;
+
+		for (uint32_t c = 0; c < L2_PQ_KSUB; c++) {
+			d[c] = l2_sq_q16_16(qs, cb + (size_t)c * pq->dsub, pq->dsub);
+			lo = d[c] < lo ? d[c] : lo;
+			hi = d[c] > hi ? d[c] : hi;
+		}
+		for (uint32_t c = 0; c < L2_PQ_KSUB; c++)
+			d[c] -= lo;
+		bias += lo;
+		range = hi - lo > range ? hi - lo : range;
+	}
+
+	search->bias[q] = bias;
+	search->scale[q] = range != 0 ? (double)range / PQ_LUT_MAX : 1.0;
+	inv = 1.0 / search->scale[q];
+	for (uint32_t e = 0; e < pq->m * L2_PQ_KSUB; e++) {
+		double v = (double)partial[e] * inv + 0.5;
+
+		lut[e] = v >= PQ_LUT_MAX ? (uint16_t)PQ_LUT_MAX : (uint16_t)v;
+	}
+}
+
+doca_error_t l2_pq_search(struct l2_backend *be, const struct l2_pq *pq, const struct l2_pq_codes *codes,
+			  struct l2_pq_search *search, const int32_t *queries, uint32_t nq, struct l2_hit *results,
+			  struct l2_pq_search_stats *stats)
+{
+	struct l2_pq_args args;
+	uint64_t t0 = now_ns(), t1;
+	doca_error_t result;
+
+	if (nq == 0 || nq > search->max_nq || codes->m != pq->m) {
+		DOCA_LOG_ERR("Invalid PQ search: %u queries (max %u), %u-byte codes for m = %u", nq, search->max_nq,
+			     codes->m, pq->m);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	for (uint32_t q = 0; q < nq; q++)
+		pq_build_lut(pq, search, queries + (size_t)q * pq->dim, q);
+	t1 = now_ns();
+
+	/* codes 和 search 都在同一个 arena 里，handle 相同 */
+	args.handle = search->mem.handle;
+	args.lut_base = (uint64_t)(uintptr_t)search->luts;
+	args.codes_base = (uint64_t)(uintptr_t)codes->codes;
+	args.out_base = (uint64_t)(uintptr_t)search->parts;
+	args.lut_stride = search->lut_stride;
+	args.m = pq->m;
+	args.nq = nq;
+	args.n = codes->n;
+	args.k = search->k;
+	args.num_parts = search->num_parts;
+	args.id_base = 0;
+	result = l2_backend_launch(be, L2_KERNEL_PQ, &args, &search->seq);
+	if (result == DOCA_SUCCESS)
+		result = l2_backend_wait(be, search->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* 表内单位 -> 2Q(2q)，同一 query 里是单调变换，排序不变 */
+	for (uint32_t q = 0; q < nq; q++) {
+		struct l2_hit *out = results + (uint64_t)q * search->k;
+
+		l2_topk_merge(search->parts + (uint64_t)q * search->num_parts * search->k, search->num_parts,
+			      search->k, out);
+		for (uint32_t j = 0; j < search->k; j++) {
+			if (out[j].id != L2_HIT_EMPTY_ID)
+				out[j].dist = search->bias[q] + (uint64_t)((double)out[j].dist * search->scale[q] + 0.5);
+		}
+	}
+
+	if (stats != NULL) {
+		stats->lut_ns += t1 - t0;
+		stats->scan_ns += now_ns() - t1;
+	}
+	return DOCA_SUCCESS;
+}
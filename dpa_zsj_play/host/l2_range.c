@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_range.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::RANGE);
+
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+doca_error_t l2_range_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_nq, uint32_t cap,
+			    struct l2_range *range)
+{
+	uint32_t num_parts = be->cfg.num_threads;
+	size_t q_bytes = ALIGN64((size_t)max_nq * dim * sizeof(int32_t));
+	size_t counts_bytes = ALIGN64((size_t)num_parts * sizeof(uint64_t));
+	size_t segs_bytes = ALIGN64((size_t)num_parts * cap * sizeof(struct l2_range_hit));
+	size_t abandon_bytes = (size_t)num_parts * L2_ABANDON_STATS * sizeof(uint64_t);
+	doca_error_t result;
+
+	memset(range, 0, sizeof(*range));
+	if (max_nq == 0 || cap == 0) {
+		DOCA_LOG_ERR("Invalid range search shape: max_nq = %u, cap = %u", max_nq, cap);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	range->cursor = malloc((size_t)num_parts * sizeof(*range->cursor));
+	if (range->cursor == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	result = l2_backend_mem_alloc(be, q_bytes + counts_bytes + segs_bytes + abandon_bytes, &range->mem);
+	if (result != DOCA_SUCCESS) {
+		free(range->cursor);
+		range->cursor = NULL;
+		return result;
+	}
+	range->queries = range->mem.addr;
+	range->counts = (uint64_t *)((uint8_t *)range->mem.addr + q_bytes);
+	range->segs = (struct l2_range_hit *)((uint8_t *)range->mem.addr + q_bytes + counts_bytes);
+	range->abandon = (uint64_t *)((uint8_t *)range->mem.addr + q_bytes + counts_bytes + segs_bytes);
+	memset(range->abandon, 0, abandon_bytes);
+	range->dim = dim;
+	range->max_nq = max_nq;
+	range->cap = cap;
+	range->num_parts = num_parts;
+	return DOCA_SUCCESS;
+}
+
+void l2_range_free(struct l2_backend *be, struct l2_range *range)
+{
+	l2_backend_mem_free(be, &range->mem);
+	free(range->cursor);
+	memset(range, 0, sizeof(*range));
+}
+
+void l2_range_fill_args(const struct l2_db *db, uint32_t first, uint32_t count, const struct l2_range *range,
+			uint32_t nq, uint64_t radius, struct l2_range_args *args)
+{
+	/* db 和 range 都在同一个 arena 里，handle 相同 */
+	args->handle = range->mem.handle;
+	args->q_base = (uint64_t)(uintptr_t)range->queries;
+	args->db_base = (uint64_t)(uintptr_t)(db->vecs + (size_t)first * db->dim);
+	args->out_base = (uint64_t)(uintptr_t)range->segs;
+	args->counts_base = (uint64_t)(uintptr_t)range->counts;
+	args->q_stride = range->dim * sizeof(int32_t);
+	args->db_stride = db->dim * sizeof(int32_t);
+	args->radius = radius;
+	args->stats_base = range->abandon_block != 0 ? (uint64_t)(uintptr_t)range->abandon : 0;
+	args->dim = db->dim;
+	args->frac_bits = 16;
+	args->nq = nq;
+	args->db_size = count;
+	args->cap = range->cap;
+	args->num_parts = range->num_parts;
+	args->id_base = db->id_base + first;
+	args->abandon_block = range->abandon_block;
+}
+
+doca_error_t l2_range_submit(struct l2_backend *be, const struct l2_db *db, struct l2_range *range, uint32_t nq,
+			     uint64_t radius)
+{
+	struct l2_range_args args;
+
+	if (nq == 0 || nq > range->max_nq || db->dim != range->dim)
+		return DOCA_ERROR_INVALID_VALUE;
+
+	l2_range_fill_args(db, 0, db->size, range, nq, radius, &args);
+	range->nq = nq;
+	return l2_backend_launch(be, L2_KERNEL_RANGE, &args, &range->seq);
+}
+
+doca_error_t l2_range_wait(struct l2_backend *be, struct l2_range *range, struct l2_range_hit *hits,
+			   uint64_t *offsets, struct l2_range_stats *stats)
+{
+	struct l2_range_stats st = {0};
+	uint64_t n = 0;
+	doca_error_t result;
+
+	result = l2_backend_wait(be, range->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* 只读 count 和段里真正写了的命中 */
+	L2_TRACE_BEGIN(t0);
+	for (uint32_t p = 0; p < range->num_parts; p++) {
+		range->cursor[p] = 0;
+		if (range->counts[p] > range->cap) {
+			st.dropped += range->counts[p] - range->cap;
+			st.overflowed++;
+		}
+		if (range->abandon_block != 0) {
+			st.abandon.dims += range->abandon[(uint64_t)p * L2_ABANDON_STATS + L2_ABANDON_DIMS];
+			st.abandon.candidates += range->abandon[(uint64_t)p * L2_ABANDON_STATS + L2_ABANDON_CANDS];
+		}
+	}
+	/* 段内按 (q, id) 有序，段 p 的行都在段 p + 1 前面：按 query 依次扫各段就是 (q, id) 序 */
+	for (uint32_t q = 0; q < range->nq; q++) {
+		offsets[q] = n;
+		for (uint32_t p = 0; p < range->num_parts; p++) {
+			const struct l2_range_hit *seg = range->segs + (uint64_t)p * range->cap;
+			uint64_t end = range->counts[p] < range->cap ? range->counts[p] : range->cap;
+
+			while (range->cursor[p] < end && seg[range->cursor[p]].q == q)
+				hits[n++] = seg[range->cursor[p]++];
+		}
+	}
+	offsets[range->nq] = n;
+	st.hits = n;
+	L2_TRACE_END(t0, "range.gather", n * sizeof(struct l2_range_hit));
+
+	if (st.overflowed > 0)
+		DOCA_LOG_WARN("%u of %u range segments overflowed, %lu hits dropped", st.overflowed,
+			      range->num_parts, st.dropped);
+	if (stats != NULL)
+		*stats = st;
+	return DOCA_SUCCESS;
+}
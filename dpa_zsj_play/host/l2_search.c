@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_search.h"
+#include "../include/l2_topk.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::SEARCH);
+
+doca_error_t l2_db_alloc(struct l2_backend *be, uint32_t dim, uint32_t size, struct l2_db *db)
+{
+	doca_error_t result;
+
+	memset(db, 0, sizeof(*db));
+	result = l2_backend_mem_alloc(be, (size_t)size * dim * sizeof(int32_t), &db->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+	db->vecs = db->mem.addr;
+	l2_backend_mem_touch(be, db->vecs, (size_t)size * dim * sizeof(int32_t));
+	db->dim = dim;
+	db->size = size;
+	return DOCA_SUCCESS;
+}
+
+void l2_db_free(struct l2_backend *be, struct l2_db *db)
+{
+	l2_backend_mem_free(be, &db->mem);
+	memset(db, 0, sizeof(*db));
+}
+
+doca_error_t l2_search_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_nq, uint32_t k,
+			     struct l2_search *search)
+{
+	uint32_t num_parts = be->cfg.num_threads;
+	size_t q_bytes = ((size_t)max_nq * dim * sizeof(int32_t) + 63) & ~(size_t)63;
+	size_t parts_bytes = ((size_t)max_nq * num_parts * k * sizeof(struct l2_hit) + 63) & ~(size_t)63;
+	size_t abandon_bytes = (size_t)num_parts * L2_ABANDON_STATS * sizeof(uint64_t);
+	doca_error_t result;
+
+	memset(search, 0, sizeof(*search));
+	if (k == 0 || k > L2_SEARCH_MAX_K || max_nq == 0) {
+		DOCA_LOG_ERR("Invalid search shape: k = %u (max %u), max_nq = %u", k, L2_SEARCH_MAX_K, max_nq);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	/* 布局: [queries][parts][abandon]，query 区很小，放前面 */
+	result = l2_backend_mem_alloc(be, q_bytes + parts_bytes + abandon_bytes, &search->mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+	search->queries = search->mem.addr;
+	search->parts = (struct l2_hit *)((uint8_t *)search->mem.addr + q_bytes);
+	search->abandon = (uint64_t *)((uint8_t *)search->mem.addr + q_bytes + parts_bytes);
+	memset(search->abandon, 0, abandon_bytes);
+	search->dim = dim;
+	search->max_nq = max_nq;
+	search->k = k;
+	search->num_parts = num_parts;
+	return DOCA_SUCCESS;
+}
+
+void l2_search_free(struct l2_backend *be, struct l2_search *search)
+{
+	l2_backend_mem_free(be, &search->mem);
+	memset(search, 0, sizeof(*search));
+}
+
+void l2_search_fill_args(const struct l2_db *db, uint32_t first, uint32_t count, const struct l2_search *search,
+			 uint32_t nq, struct l2_search_args *args)
+{
+	/* db 和 search 都在同一个 arena 里，handle 相同 */
+	args->handle = search->mem.handle;
+	args->q_base = (uint64_t)(uintptr_t)search->queries;
+	args->db_base = (uint64_t)(uintptr_t)(db->vecs + (size_t)first * db->dim);
+	args->out_base = (uint64_t)(uintptr_t)search->parts;
+	args->q_stride = search->dim * sizeof(int32_t);
+	args->db_stride = db->dim * sizeof(int32_t);
+	args->stats_base = search->abandon_block != 0 ? (uint64_t)(uintptr_t)search->abandon : 0;
+	args->filter_base = search->filter != NULL ? (uint64_t)(uintptr_t)(search->filter + first / 64) : 0;
+	args->filter_bit = first % 64;
+	args->dim = db->dim;
+	args->frac_bits = 16;
+	args->nq = nq;
+	args->db_size = count;
+	args->k = search->k;
+	args->num_parts = search->num_parts;
+	args->id_base = db->id_base + first;
+	args->abandon_block = search->abandon_block;
+}
+
+doca_error_t l2_search_submit(struct l2_backend *be, const struct l2_db *db, struct l2_search *search, uint32_t nq)
+{
+	struct l2_search_args args;
+
+	if (nq == 0 || nq > search->max_nq || db->dim != search->dim)
+		return DOCA_ERROR_INVALID_VALUE;
+
+	l2_search_fill_args(db, 0, db->size, search, nq, &args);
+	search->nq = nq;
+	return l2_backend_launch(be, L2_KERNEL_SEARCH, &args, &search->seq);
+}
+
+static int hit_cmp(const void *a, const void *b)
+{
+	const struct l2_hit *x = a, *y = b;
+
+	if (l2_hit_worse(x->dist, x->id, y->dist, y->id))
+		return 1;
+	if (l2_hit_worse(y->dist, y->id, x->dist, x->id))
+		return -1;
+	return 0;
+}
+
+void l2_topk_merge(const struct l2_hit *parts, uint32_t nparts, uint32_t k, struct l2_hit *out)
+{
+	uint32_t n = 0;
+
+	for (uint64_t i = 0; i < (uint64_t)nparts * k; i++) {
+		if (parts[i].id == L2_HIT_EMPTY_ID)
+			continue;
+		l2_topk_push(out, &n, k, parts[i].dist, parts[i].id);
+	}
+	qsort(out, n, sizeof(*out), hit_cmp);
+	l2_topk_pad(out, n, k);
+}
+
+doca_error_t l2_search_wait(struct l2_backend *be, struct l2_search *search, struct l2_hit *results)
+{
+	doca_error_t result;
+
+	result = l2_backend_wait(be, search->seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* 读回每个 part 的 top-k 并合并 */
+	L2_TRACE_BEGIN(t0);
+	for (uint32_t q = 0; q < search->nq; q++)
+		l2_topk_merge(search->parts + (uint64_t)q * search->num_parts * search->k, search->num_parts,
+			      search->k, results + (uint64_t)q * search->k);
+	L2_TRACE_END(t0, "search.readback", (uint64_t)search->nq * search->num_parts * search->k);
+	return DOCA_SUCCESS;
+}
+
+void l2_search_abandon_stats(const struct l2_search *search, struct l2_abandon_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (search->abandon_block == 0)
+		return;
+	for (uint32_t p = 0; p < search->num_parts; p++) {
+		stats->dims += search->abandon[(uint64_t)p * L2_ABANDON_STATS + L2_ABANDON_DIMS];
+		stats->candidates += search->abandon[(uint64_t)p * L2_ABANDON_STATS + L2_ABANDON_CANDS];
+	}
+}
+
+/* 方差和维度号一起排，方差相同按维度号，顺序是确定的 */
+struct dim_var {
+	double var;
+	uint32_t dim;
+};
+
+static int dim_var_cmp(const void *a, const void *b)
+{
+	const struct dim_var *x = a, *y = b;
+
+	if (x->var != y->var)
+		return x->var < y->var ? 1 : -1;
+	return x->dim < y->dim ? -1 : x->dim > y->dim;
+}
+
+doca_error_t l2_dim_order_compute(const int32_t *vecs, uint32_t n, uint32_t dim, uint32_t *perm)
+{
+	struct dim_var *order;
+	double *sum;
+
+	order = calloc(dim, sizeof(*order));
+	sum = calloc(dim, sizeof(*sum));
+	if (order == NULL || sum == NULL) {
+		free(order);
+		free(sum);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	/* Q16.16 按 double 累加，只用来排序，精度够 */
+	for (uint32_t i = 0; i < n; i++) {
+		for (uint32_t j = 0; j < dim; j++) {
+			double x = (double)vecs[(size_t)i * dim + j];
+
+			sum[j] += x;
+			order[j].var += x * x;
+		}
+	}
+	for (uint32_t j = 0; j < dim; j++) {
+		double mean = n != 0 ? sum[j] / n : 0.0;
+
+		order[j].var = n != 0 ? order[j].var / n - mean * mean : 0.0;
+		order[j].dim = j;
+	}
+	qsort(order, dim, sizeof(*order), dim_var_cmp);
+	for (uint32_t j = 0; j < dim; j++)
+		perm[j] = order[j].dim;
+	free(order);
+	free(sum);
+	return DOCA_SUCCESS;
+}
+
+void l2_dim_order_apply(const uint32_t *perm, const int32_t *src, int32_t *dst, uint32_t n, uint32_t dim)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		const int32_t *s = src + (size_t)i * dim;
+		int32_t *d = dst + (size_t)i * dim;
+
+		for (uint32_t j = 0; j < dim; j++)
+			d[j] = s[perm[j]];
+	}
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_engine.h"
+#include "../include/l2_server.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::SERVER);
+
+#define L2_SERVER_DEFAULT_BATCH 32
+#define L2_SERVER_DEFAULT_DEADLINE_US 200
+#define L2_SERVER_DEFAULT_SLOTS 2
+
+/* 一个 query，放在调用方的栈上，done 之前由 server 持有 */
+struct server_req {
+	const int32_t *query;
+	struct l2_hit *out;
+	uint64_t t_arrive;
+	doca_error_t status;
+	bool done;
+	pthread_cond_t done_cond;
+};
+
+/* 一个在飞的 batch：search 的 query / heap 区 + 它带着的请求 */
+struct server_slot {
+	struct l2_server *srv;
+	struct l2_search search;
+	struct server_req **reqs;	/* max_batch 项 */
+	uint32_t n;
+	uint64_t t_dispatch;
+};
+
+struct server_conn {
+	struct l2_server *srv;
+	int fd;
+	bool used;
+	pthread_t thread;
+};
+
+struct l2_server {
+	struct l2_server_cfg cfg;
+	struct l2_engine *eng;
+	struct server_slot slots[L2_SERVER_MAX_SLOTS];
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* dispatcher: 有新 query / 退出，CLOCK_MONOTONIC 计时 */
+	pthread_cond_t space_cond;	/* 调用方: 等待队列有空位 */
+	pthread_cond_t slot_cond;	/* dispatcher: 有空闲 slot */
+	struct server_req **queue;	/* queue_depth 项的环形等待队列 */
+	uint32_t head;
+	uint32_t count;
+	struct server_slot *free_slots[L2_SERVER_MAX_SLOTS];
+	uint32_t n_free;
+	bool stop;
+	struct l2_server_stats stats;
+	pthread_t dispatcher;
+
+	/* socket 前端，listen_fd < 0 表示没开 */
+	int listen_fd;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	pthread_t accept_thread;
+	pthread_mutex_t conn_lock;
+	struct server_conn conns[L2_SERVER_MAX_CONN];
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Engine callback: merge the batch's heaps into the callers' buffers and wake them
+ *
+ * @ctx [in]: struct server_slot
+ * @ticket [in]: unused
+ * @status [in]: launch result
+ */
+static void server_batch_done(void *ctx, uint64_t ticket, doca_error_t status)
+{
+	struct server_slot *slot = ctx;
+	struct l2_server *srv = slot->srv;
+	const struct l2_search *s = &slot->search;
+	uint64_t t_done;
+
+	(void)ticket;
+	if (status == DOCA_SUCCESS) {
+		L2_TRACE_BEGIN(t0);
+		for (uint32_t q = 0; q < slot->n; q++)
+			l2_topk_merge(s->parts + (uint64_t)q * s->num_parts * s->k, s->num_parts, s->k,
+				      slot->reqs[q]->out);
+		L2_TRACE_END(t0, "server.merge", slot->n);
+	}
+	t_done = now_ns();
+
+	pthread_mutex_lock(&srv->lock);
+	for (uint32_t q = 0; q < slot->n; q++) {
+		struct server_req *req = slot->reqs[q];
+
+		l2_hist_record(&srv->stats.queue_ns, slot->t_dispatch - req->t_arrive);
+		l2_hist_record(&srv->stats.service_ns, t_done - slot->t_dispatch);
+		l2_hist_record(&srv->stats.total_ns, t_done - req->t_arrive);
+		req->status = status;
+		req->done = true;
+		pthread_cond_signal(&req->done_cond);
+	}
+	srv->stats.queries += slot->n;
+	if (status != DOCA_SUCCESS)
+		srv->stats.errors += slot->n;
+	slot->n = 0;
+	srv->free_slots[srv->n_free++] = slot;
+	pthread_cond_signal(&srv->slot_cond);
+	pthread_mutex_unlock(&srv->lock);
+}
+
+/* 没发出去的 batch：直接给请求回错误，slot 还回去；调用时持有 srv->lock */
+static void server_fail_slot(struct l2_server *srv, struct server_slot *slot, doca_error_t status)
+{
+	for (uint32_t q = 0; q < slot->n; q++) {
+		slot->reqs[q]->status = status;
+		slot->reqs[q]->done = true;
+		pthread_cond_signal(&slot->reqs[q]->done_cond);
+	}
+	srv->stats.queries += slot->n;
+	srv->stats.errors += slot->n;
+	slot->n = 0;
+	srv->free_slots[srv->n_free++] = slot;
+	pthread_cond_signal(&srv->slot_cond);
+}
+
+/*
+ * Dispatcher thread: coalesce queued queries until the batch is full or the oldest one is due, then launch
+ *
+ * @arg [in]: struct l2_server
+ * @return: NULL
+ */
+static void *server_dispatch(void *arg)
+{
+	struct l2_server *srv = arg;
+	const uint64_t deadline_ns = (uint64_t)srv->cfg.deadline_us * 1000;
+	const uint32_t max_batch = srv->cfg.max_batch, dim = srv->cfg.db->dim;
+	struct l2_search_args args;
+	struct server_slot *slot;
+	struct timespec ts;
+	uint64_t due;
+	bool full;
+	doca_error_t result;
+
+	L2_TRACE_THREAD("server dispatcher");
+	pthread_mutex_lock(&srv->lock);
+	for (;;) {
+		while (srv->count == 0 && !srv->stop)
+			pthread_cond_wait(&srv->work_cond, &srv->lock);
+		if (srv->count == 0)
+			break;
+
+		/* 凑 batch：满了或者最老的 query 到期就发车，退出时不再等 */
+		L2_TRACE_BEGIN(tc);
+		due = srv->queue[srv->head]->t_arrive + deadline_ns;
+		while (srv->count < max_batch && !srv->stop && now_ns() < due) {
+			ts.tv_sec = due / 1000000000ULL;
+			ts.tv_nsec = due % 1000000000ULL;
+			pthread_cond_timedwait(&srv->work_cond, &srv->lock, &ts);
+		}
+		/* 所有 slot 都在飞时，等的这段时间里 batch 继续变大 */
+		while (srv->n_free == 0)
+			pthread_cond_wait(&srv->slot_cond, &srv->lock);
+		L2_TRACE_END(tc, "server.coalesce", srv->count);
+
+		slot = srv->free_slots[--srv->n_free];
+		slot->n = srv->count < max_batch ? srv->count : max_batch;
+		full = slot->n == max_batch;
+		for (uint32_t q = 0; q < slot->n; q++) {
+			slot->reqs[q] = srv->queue[srv->head];
+			srv->head = (srv->head + 1) % srv->cfg.queue_depth;
+		}
+		srv->count -= slot->n;
+		srv->stats.batches++;
+		if (full)
+			srv->stats.full_batches++;
+		else
+			srv->stats.deadline_batches++;
+		l2_hist_record(&srv->stats.batch_size, slot->n);
+		pthread_cond_broadcast(&srv->space_cond);
+		pthread_mutex_unlock(&srv->lock);
+
+		/* query 拷进 slot 之后调用方的 query 缓冲就不再被读 */
+		for (uint32_t q = 0; q < slot->n; q++)
+			memcpy(slot->search.queries + (size_t)q * dim, slot->reqs[q]->query, dim * sizeof(int32_t));
+		slot->search.nq = slot->n;
+		slot->t_dispatch = now_ns();
+		l2_search_fill_args(srv->cfg.db, 0, srv->cfg.db->size, &slot->search, slot->n, &args);
+		result = l2_engine_submit(srv->eng, L2_KERNEL_SEARCH, &args, server_batch_done, slot,
+					  &slot->search.seq);
+
+		pthread_mutex_lock(&srv->lock);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to submit a batch of %u queries: %s", slot->n,
+				     doca_error_get_descr(result));
+			server_fail_slot(srv, slot, result);
+		}
+	}
+	pthread_mutex_unlock(&srv->lock);
+	return NULL;
+}
+
+static void server_free(struct l2_server *srv)
+{
+	for (uint32_t i = 0; i < srv->cfg.slots; i++) {
+		if (srv->slots[i].search.mem.addr != NULL)
+			l2_search_free(srv->cfg.be, &srv->slots[i].search);
+		free(srv->slots[i].reqs);
+	}
+	free(srv->queue);
+	free(srv);
+}
+
+doca_error_t l2_server_create(const struct l2_server_cfg *cfg, struct l2_server **server)
+{
+	struct l2_engine_cfg eng_cfg = {0};
+	struct l2_server *srv;
+	pthread_condattr_t attr;
+	doca_error_t result;
+	int ret;
+
+	if (cfg->be == NULL || cfg->db == NULL || cfg->slots > L2_SERVER_MAX_SLOTS) {
+		DOCA_LOG_ERR("Invalid server configuration");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+
+	srv = calloc(1, sizeof(*srv));
+	if (srv == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	srv->cfg = *cfg;
+	if (srv->cfg.max_batch == 0)
+		srv->cfg.max_batch = L2_SERVER_DEFAULT_BATCH;
+	if (srv->cfg.deadline_us == 0)
+		srv->cfg.deadline_us = L2_SERVER_DEFAULT_DEADLINE_US;
+	if (srv->cfg.slots == 0)
+		srv->cfg.slots = L2_SERVER_DEFAULT_SLOTS;
+	if (srv->cfg.queue_depth == 0)
+		srv->cfg.queue_depth = 4 * srv->cfg.max_batch;
+	srv->listen_fd = -1;
+
+	srv->queue = calloc(srv->cfg.queue_depth, sizeof(*srv->queue));
+	if (srv->queue == NULL) {
+		free(srv);
+		return DOCA_ERROR_NO_MEMORY;
+	}
+	for (uint32_t i = 0; i < srv->cfg.slots; i++) {
+		struct server_slot *slot = &srv->slots[i];
+
+		slot->srv = srv;
+		slot->reqs = calloc(srv->cfg.max_batch, sizeof(*slot->reqs));
+		if (slot->reqs == NULL) {
+			server_free(srv);
+			return DOCA_ERROR_NO_MEMORY;
+		}
+		result = l2_search_alloc(cfg->be, cfg->db->dim, srv->cfg.max_batch, cfg->k, &slot->search);
+		if (result != DOCA_SUCCESS) {
+			server_free(srv);
+			return result;
+		}
+		srv->free_slots[srv->n_free++] = slot;
+	}
+
+	eng_cfg.max_inflight = srv->cfg.slots;
+	result = l2_engine_create(cfg->be, &eng_cfg, &srv->eng);
+	if (result != DOCA_SUCCESS) {
+		server_free(srv);
+		return result;
+	}
+
+	pthread_mutex_init(&srv->lock, NULL);
+	pthread_mutex_init(&srv->conn_lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&srv->work_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&srv->space_cond, NULL);
+	pthread_cond_init(&srv->slot_cond, NULL);
+
+	ret = pthread_create(&srv->dispatcher, NULL, server_dispatch, srv);
+	if (ret != 0) {
+		DOCA_LOG_ERR("Failed to start dispatcher thread: %d", ret);
+		pthread_cond_destroy(&srv->slot_cond);
+		pthread_cond_destroy(&srv->space_cond);
+		pthread_cond_destroy(&srv->work_cond);
+		pthread_mutex_destroy(&srv->conn_lock);
+		pthread_mutex_destroy(&srv->lock);
+		l2_engine_destroy(srv->eng);
+		server_free(srv);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	DOCA_LOG_INFO("Query server: %u vectors, k = %u, max batch %u, deadline %u us, %u slots",
+		      cfg->db->size, cfg->k, srv->cfg.max_batch, srv->cfg.deadline_us, srv->cfg.slots);
+	*server = srv;
+	return DOCA_SUCCESS;
+}
+
+void l2_server_destroy(struct l2_server *server)
+{
+	if (server == NULL)
+		return;
+
+	/* 先停 socket：连接线程里可能还有 query 在等结果，dispatcher 要活着 */
+	if (server->listen_fd >= 0) {
+		shutdown(server->listen_fd, SHUT_RDWR);
+		pthread_join(server->accept_thread, NULL);
+		close(server->listen_fd);
+		unlink(server->path);
+		for (uint32_t i = 0; i < L2_SERVER_MAX_CONN; i++) {
+			pthread_mutex_lock(&server->conn_lock);
+			bool used = server->conns[i].used;
+
+			if (used)
+				shutdown(server->conns[i].fd, SHUT_RDWR);
+			pthread_mutex_unlock(&server->conn_lock);
+			if (used) {
+				pthread_join(server->conns[i].thread, NULL);
+				close(server->conns[i].fd);
+				server->conns[i].used = false;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&server->lock);
+	server->stop = true;
+	pthread_cond_broadcast(&server->work_cond);
+	pthread_cond_broadcast(&server->space_cond);
+	pthread_mutex_unlock(&server->lock);
+	/* dispatcher 把队列里的 query 都发出去才退出，engine 销毁时等它们完成 */
+	pthread_join(server->dispatcher, NULL);
+	l2_engine_destroy(server->eng);
+
+	pthread_cond_destroy(&server->slot_cond);
+	pthread_cond_destroy(&server->space_cond);
+	pthread_cond_destroy(&server->work_cond);
+	pthread_mutex_destroy(&server->conn_lock);
+	pthread_mutex_destroy(&server->lock);
+	server_free(server);
+}
+
+doca_error_t l2_server_query(struct l2_server *server, const int32_t *query, struct l2_hit *out)
+{
+	struct server_req req = {.query = query, .out = out};
+	doca_error_t result;
+
+	pthread_cond_init(&req.done_cond, NULL);
+	pthread_mutex_lock(&server->lock);
+	while (server->count == server->cfg.queue_depth && !server->stop)
+		pthread_cond_wait(&server->space_cond, &server->lock);
+	if (server->stop) {
+		pthread_mutex_unlock(&server->lock);
+		pthread_cond_destroy(&req.done_cond);
+		return DOCA_ERROR_BAD_STATE;
+	}
+	req.t_arrive = now_ns();
+	server->queue[(server->head + server->count) % server->cfg.queue_depth] = &req;
+	server->count++;
+	/* 空队列来了第一个要开始计时，凑满了要立刻发车，其余情况 dispatcher 不用醒 */
+	if (server->count == 1 || server->count == server->cfg.max_batch)
+		pthread_cond_signal(&server->work_cond);
+	while (!req.done)
+		pthread_cond_wait(&req.done_cond, &server->lock);
+	result = req.status;
+	pthread_mutex_unlock(&server->lock);
+	pthread_cond_destroy(&req.done_cond);
+	return result;
+}
+
+/* 读满 / 写满 len 字节；对端关闭返回 DOCA_ERROR_NOT_CONNECTED */
+static doca_error_t read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n == 0)
+			return DOCA_ERROR_NOT_CONNECTED;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return DOCA_ERROR_IO_FAILED;
+		}
+		p += n;
+		len -= n;
+	}
+	return DOCA_SUCCESS;
+}
+
+static doca_error_t write_full(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EPIPE ? DOCA_ERROR_NOT_CONNECTED : DOCA_ERROR_IO_FAILED;
+		}
+		p += n;
+		len -= n;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Connection thread: hello, then query -> reply until the client closes
+ *
+ * @arg [in]: struct server_conn
+ * @return: NULL
+ */
+static void *server_conn_run(void *arg)
+{
+	struct server_conn *conn = arg;
+	struct l2_server *srv = conn->srv;
+	struct l2_server_hello hello = {.dim = srv->cfg.db->dim, .k = srv->cfg.k};
+	int32_t *query = malloc(hello.dim * sizeof(*query));
+	struct l2_hit *hits = malloc(hello.k * sizeof(*hits));
+	doca_error_t result = DOCA_ERROR_NO_MEMORY;
+
+	L2_TRACE_THREAD("server connection");
+	if (query == NULL || hits == NULL)
+		goto out;
+	result = write_full(conn->fd, &hello, sizeof(hello));
+	while (result == DOCA_SUCCESS) {
+		result = read_full(conn->fd, query, hello.dim * sizeof(*query));
+		if (result != DOCA_SUCCESS)
+			break;
+		result = l2_server_query(srv, query, hits);
+		if (result != DOCA_SUCCESS)
+			break;
+		result = write_full(conn->fd, hits, hello.k * sizeof(*hits));
+	}
+out:
+	if (result != DOCA_SUCCESS && result != DOCA_ERROR_NOT_CONNECTED)
+		DOCA_LOG_WARN("Closing connection: %s", doca_error_get_descr(result));
+	free(hits);
+	free(query);
+	/* fd 和 used 由 destroy / accept 线程回收，这里只关读写 */
+	shutdown(conn->fd, SHUT_RDWR);
+	return NULL;
+}
+
+/* 槽位里已经结束的连接线程收回来；调用时持有 conn_lock */
+static void server_reap_conns(struct l2_server *srv)
+{
+	for (uint32_t i = 0; i < L2_SERVER_MAX_CONN; i++) {
+		struct server_conn *c = &srv->conns[i];
+
+		if (c->used && pthread_tryjoin_np(c->thread, NULL) == 0) {
+			close(c->fd);
+			c->used = false;
+		}
+	}
+}
+
+/*
+ * Accept thread: one server_conn per client until the listening socket is shut down
+ *
+ * @arg [in]: struct l2_server
+ * @return: NULL
+ */
+static void *server_accept(void *arg)
+{
+	struct l2_server *srv = arg;
+	struct server_conn *conn;
+	int fd, ret;
+
+	L2_TRACE_THREAD("server accept");
+	for (;;) {
+		fd = accept(srv->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		pthread_mutex_lock(&srv->conn_lock);
+		server_reap_conns(srv);
+		conn = NULL;
+		for (uint32_t i = 0; i < L2_SERVER_MAX_CONN && conn == NULL; i++) {
+			if (!srv->conns[i].used)
+				conn = &srv->conns[i];
+		}
+		if (conn == NULL) {
+			pthread_mutex_unlock(&srv->conn_lock);
+			DOCA_LOG_WARN("Refusing connection, already %d clients", L2_SERVER_MAX_CONN);
+			close(fd);
+			continue;
+		}
+		conn->srv = srv;
+		conn->fd = fd;
+		ret = pthread_create(&conn->thread, NULL, server_conn_run, conn);
+		if (ret != 0) {
+			DOCA_LOG_WARN("Failed to start connection thread: %d", ret);
+			close(fd);
+		} else {
+			conn->used = true;
+		}
+		pthread_mutex_unlock(&srv->conn_lock);
+	}
+	return NULL;
+}
+
+doca_error_t l2_server_listen(struct l2_server *server, const char *path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	int fd, ret;
+
+	if (server->listen_fd >= 0) {
+		DOCA_LOG_ERR("Server is already listening on %s", server->path);
+		return DOCA_ERROR_BAD_STATE;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		DOCA_LOG_ERR("Socket path %s is too long, at most %zu characters", path, sizeof(addr.sun_path) - 1);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		DOCA_LOG_ERR("Failed to create socket: %s", strerror(errno));
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, L2_SERVER_MAX_CONN) != 0) {
+		DOCA_LOG_ERR("Failed to listen on %s: %s", path, strerror(errno));
+		close(fd);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+
+	server->listen_fd = fd;
+	strcpy(server->path, path);
+	ret = pthread_create(&server->accept_thread, NULL, server_accept, server);
+	if (ret != 0) {
+		DOCA_LOG_ERR("Failed to start accept thread: %d", ret);
+		server->listen_fd = -1;
+		close(fd);
+		unlink(path);
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	}
+	DOCA_LOG_INFO("Query server listening on %s", path);
+	return DOCA_SUCCESS;
+}
+
+void l2_server_get_stats(struct l2_server *server, struct l2_server_stats *stats)
+{
+	pthread_mutex_lock(&server->lock);
+	*stats = server->stats;
+	pthread_mutex_unlock(&server->lock);
+}
+
+void l2_server_print_stats(const struct l2_server_stats *stats)
+{
+	const struct {
+		const char *name;
+		const struct l2_hist *hist;
+	} lat[] = {
+		{"queue", &stats->queue_ns},
+		{"service", &stats->service_ns},
+		{"total", &stats->total_ns},
+	};
+
+	printf("  %lu queries in %lu batches (%lu full, %lu on deadline), %lu errors\n", stats->queries,
+	       stats->batches, stats->full_batches, stats->deadline_batches, stats->errors);
+	printf("  batch size: mean %.1f, p50 %lu, p99 %lu, max %lu\n", l2_hist_mean(&stats->batch_size),
+	       l2_hist_percentile(&stats->batch_size, 0.5), l2_hist_percentile(&stats->batch_size, 0.99),
+	       stats->batch_size.max);
+	printf("  %-8s %10s %10s %10s %10s %10s\n", "latency", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+	for (size_t i = 0; i < sizeof(lat) / sizeof(lat[0]); i++)
+		printf("  %-8s %10.1f %10.1f %10.1f %10.1f %10.1f\n", lat[i].name, l2_hist_mean(lat[i].hist) / 1e3,
+		       l2_hist_percentile(lat[i].hist, 0.5) / 1e3, l2_hist_percentile(lat[i].hist, 0.9) / 1e3,
+		       l2_hist_percentile(lat[i].hist, 0.99) / 1e3, lat[i].hist->max / 1e3);
+}
+
+doca_error_t l2_server_connect(const char *path, int *fd, struct l2_server_hello *hello)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	doca_error_t result;
+	int s;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return DOCA_ERROR_INVALID_VALUE;
+	strcpy(addr.sun_path, path);
+
+	s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0)
+		return DOCA_ERROR_OPERATING_SYSTEM;
+	if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		DOCA_LOG_ERR("Failed to connect to %s: %s", path, strerror(errno));
+		close(s);
+		return DOCA_ERROR_NOT_CONNECTED;
+	}
+	result = read_full(s, hello, sizeof(*hello));
+	if (result != DOCA_SUCCESS) {
+		close(s);
+		return result;
+	}
+	*fd = s;
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_server_remote_query(int fd, const struct l2_server_hello *hello, const int32_t *query,
+				    struct l2_hit *out)
+{
+	doca_error_t result;
+
+	result = write_full(fd, query, hello->dim * sizeof(*query));
+	if (result != DOCA_SUCCESS)
+		return result;
+	return read_full(fd, out, hello->k * sizeof(*out));
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "dpa_common.h"
+
+#include "../include/l2_pipeline.h"
+#include "../include/l2_session.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::SESSION);
+
+#define SESSION_DEFAULT_THREADS 64
+#define SESSION_DEFAULT_SLOT_VECTORS (64 * 1024)
+#define SESSION_DEFAULT_SLOTS 2
+#define SESSION_ARENA_MARGIN (16UL << 20)
+
+struct l2_session {
+	struct l2_session_cfg cfg;
+	struct dpa_resources resources;	/* 自己打开的设备 */
+	int own_device;
+	struct l2_backend *be;
+	struct l2_pipeline pl;		/* staging 槽和 staged event 跨 job 复用 */
+	pthread_mutex_t lock;		/* 一次只跑一个 job */
+	/* 当前 job，stage / drain 回调用 */
+	const int32_t *a;
+	const int32_t *b;
+	uint64_t *out;
+	struct l2_session_stats stats;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static doca_error_t session_stage(void *ctx, uint64_t first, uint32_t count, int32_t *a, int32_t *b)
+{
+	struct l2_session *s = ctx;
+	size_t bytes = (size_t)count * s->cfg.dim * sizeof(int32_t);
+
+	/* 预热时没有 job，填零 */
+	if (s->a == NULL) {
+		memset(a, 0, bytes);
+		memset(b, 0, bytes);
+		return DOCA_SUCCESS;
+	}
+	memcpy(a, s->a + first * s->cfg.dim, bytes);
+	memcpy(b, s->b + first * s->cfg.dim, bytes);
+	return DOCA_SUCCESS;
+}
+
+static void session_drain(void *ctx, uint64_t first, uint32_t count, const uint64_t *out)
+{
+	struct l2_session *s = ctx;
+
+	if (s->out != NULL)
+		memcpy(s->out + first, out, (size_t)count * sizeof(*out));
+}
+
+doca_error_t l2_session_open(const struct l2_session_cfg *cfg, struct l2_session **session)
+{
+	struct l2_backend_cfg be_cfg;
+	struct l2_pipeline_cfg pl_cfg;
+	struct l2_session *s;
+	uint64_t t_start = now_ns(), t0;
+	size_t staging_bytes;
+	doca_error_t result;
+
+	if (cfg->dim == 0) {
+		DOCA_LOG_ERR("Session needs a vector dimension");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (cfg->type == L2_BACKEND_DPA && cfg->resources == NULL && cfg->dpa == NULL) {
+		DOCA_LOG_ERR("DPA session needs either open resources or a device to open");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	s->cfg = *cfg;
+	if (s->cfg.num_threads == 0)
+		s->cfg.num_threads = SESSION_DEFAULT_THREADS;
+	if (s->cfg.slot_vectors == 0)
+		s->cfg.slot_vectors = SESSION_DEFAULT_SLOT_VECTORS;
+	if (s->cfg.num_slots == 0)
+		s->cfg.num_slots = SESSION_DEFAULT_SLOTS;
+	pthread_mutex_init(&s->lock, NULL);
+
+	/* 设备 */
+	L2_TRACE_BEGIN(td);
+	t0 = now_ns();
+	if (s->cfg.type == L2_BACKEND_DPA && s->cfg.resources == NULL) {
+		result = allocate_dpa_resources(s->cfg.dpa, &s->resources);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to Allocate DPA Resources: %s", doca_error_get_descr(result));
+			goto fail;
+		}
+		s->own_device = 1;
+		s->cfg.resources = &s->resources;
+	}
+	s->stats.open.device_ns = now_ns() - t0;
+	L2_TRACE_END(td, "session.device", s->own_device);
+
+	/* backend：completion event、arena 注册 */
+	staging_bytes = (size_t)s->cfg.num_slots *
+			(2 * (((size_t)s->cfg.slot_vectors * s->cfg.dim * sizeof(int32_t) + 63) & ~(size_t)63) +
+			 (((size_t)s->cfg.slot_vectors * sizeof(uint64_t) + 63) & ~(size_t)63));
+	be_cfg = (struct l2_backend_cfg){
+		.type = s->cfg.type,
+		.resources = s->cfg.resources,
+		.num_threads = s->cfg.num_threads,
+		.arena_size = s->cfg.arena_size != 0 ? s->cfg.arena_size : staging_bytes + SESSION_ARENA_MARGIN,
+		.arena_page = s->cfg.arena_page,
+	};
+	L2_TRACE_BEGIN(tb);
+	t0 = now_ns();
+	result = l2_backend_create(&be_cfg, &s->be);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	s->stats.open.backend_ns = now_ns() - t0;
+	L2_TRACE_END(tb, "session.backend", be_cfg.arena_size);
+
+	/* staging 槽 + staged event，之后每个 job 都复用 */
+	pl_cfg = (struct l2_pipeline_cfg){
+		.dim = s->cfg.dim,
+		.slot_vectors = s->cfg.slot_vectors,
+		.num_slots = s->cfg.num_slots,
+		.stage = session_stage,
+		.drain = session_drain,
+		.ctx = s,
+	};
+	t0 = now_ns();
+	result = l2_pipeline_create(s->be, &pl_cfg, &s->pl);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	s->stats.open.staging_ns = now_ns() - t0;
+
+	/* 预热：每个槽都 launch 一次，kernel 装载和 first-touch 都发生在这里 */
+	if (!s->cfg.no_warmup) {
+		L2_TRACE_BEGIN(tw);
+		t0 = now_ns();
+		result = l2_pipeline_run(&s->pl, (uint64_t)s->cfg.slot_vectors * s->cfg.num_slots);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Session warmup failed: %s", doca_error_get_descr(result));
+			goto fail;
+		}
+		s->stats.open.warmup_ns = now_ns() - t0;
+		L2_TRACE_END(tw, "session.warmup", s->pl.stats.launches);
+	}
+	s->stats.open.total_ns = now_ns() - t_start;
+	*session = s;
+	return DOCA_SUCCESS;
+
+fail:
+	l2_session_close(s);
+	return result;
+}
+
+void l2_session_close(struct l2_session *session)
+{
+	doca_error_t result;
+
+	if (session == NULL)
+		return;
+	if (session->be != NULL) {
+		l2_pipeline_destroy(&session->pl);
+		l2_backend_destroy(session->be);
+	}
+	if (session->own_device) {
+		result = destroy_dpa_resources(&session->resources);
+		if (result != DOCA_SUCCESS)
+			DOCA_LOG_ERR("Failed to destroy DOCA DPA resources: %s", doca_error_get_descr(result));
+	}
+	pthread_mutex_destroy(&session->lock);
+	free(session);
+}
+
+doca_error_t l2_session_run(struct l2_session *session, const int32_t *a, const int32_t *b, uint64_t num_pairs,
+			    uint64_t *out, uint64_t *job_ns)
+{
+	uint64_t launches, t0, dt;
+	doca_error_t result;
+
+	if (num_pairs == 0)
+		return DOCA_SUCCESS;
+	pthread_mutex_lock(&session->lock);
+	launches = session->pl.stats.launches;
+	session->a = a;
+	session->b = b;
+	session->out = out;
+	L2_TRACE_BEGIN(tj);
+	t0 = now_ns();
+	result = l2_pipeline_run(&session->pl, num_pairs);
+	dt = now_ns() - t0;
+	L2_TRACE_END(tj, "session.job", num_pairs);
+	session->a = NULL;
+	session->b = NULL;
+	session->out = NULL;
+
+	if (session->stats.jobs == 0)
+		session->stats.first_job_ns = dt;
+	session->stats.jobs++;
+	session->stats.job_ns += dt;
+	if (result == DOCA_SUCCESS)
+		session->stats.pairs += num_pairs;
+	session->stats.launches += session->pl.stats.launches - launches;
+	pthread_mutex_unlock(&session->lock);
+
+	if (job_ns != NULL)
+		*job_ns = dt;
+	return result;
+}
+
+struct l2_backend *l2_session_backend(struct l2_session *session)
+{
+	return session->be;
+}
+
+void l2_session_get_stats(struct l2_session *session, struct l2_session_stats *stats)
+{
+	pthread_mutex_lock(&session->lock);
+	*stats = session->stats;
+	pthread_mutex_unlock(&session->lock);
+}
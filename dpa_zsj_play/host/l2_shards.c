@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "dpa_common.h"
+
+#include "../include/l2_pool.h"
+#include "../include/l2_shards.h"
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::SHARDS);
+
+#define SHARDS_DEFAULT_THREADS 64
+#define SHARDS_ARENA_MARGIN (16UL << 20)
+#define ALIGN64(x) (((x) + 63) & ~(size_t)63)
+
+enum shard_op {
+	SHARD_OP_SEARCH,
+	SHARD_OP_DISTANCES,
+};
+
+struct shard {
+	struct dpa_resources resources;	/* dpa 时自己打开的设备 */
+	int own_device;
+	struct l2_backend *be;
+	struct l2_db db;		/* 全局行 [first, first + rows)，id_base = first */
+	struct l2_search search;
+	struct dpa_region dist_mem;	/* [query][dist]，l2_shards_distances 用 */
+	int32_t *dist_query;
+	uint64_t *dist;
+	uint32_t first;
+	uint32_t rows;
+	char device[DOCA_DEVINFO_IBDEV_NAME_SIZE];
+	doca_error_t result;		/* 最近一次 fan-out 的结果 */
+	uint64_t batches;
+	uint64_t busy_ns;
+	uint64_t last_ns;
+};
+
+struct l2_shards {
+	struct l2_shards_cfg cfg;
+	struct l2_pool *pool;		/* 每个 shard 一个 worker，只负责发 launch 和等完成 */
+	struct shard shard[L2_SHARD_MAX];
+	struct l2_hit *parts;		/* host 内存，num_shards * max_nq * k，每个 shard 合并好的 top-k */
+	struct l2_hit *merged;		/* host 内存，num_shards * k，一个 query 的各 shard 结果 */
+	/* 当前 fan-out，worker 读 */
+	enum shard_op op;
+	const int32_t *queries;
+	uint32_t nq;
+	struct l2_shards_stats stats;
+};
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static doca_error_t shard_search(struct l2_shards *g, struct shard *sh)
+{
+	doca_error_t result;
+
+	memcpy(sh->search.queries, g->queries, (size_t)g->nq * g->cfg.dim * sizeof(int32_t));
+	result = l2_search_submit(sh->be, &sh->db, &sh->search, g->nq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	return l2_search_wait(sh->be, &sh->search, g->parts + (uint64_t)(sh - g->shard) * g->nq * g->cfg.k);
+}
+
+/* query 广播给这个 shard 的每一行：b_stride = 0 */
+static doca_error_t shard_distances(struct l2_shards *g, struct shard *sh)
+{
+	struct l2_batch_args args = {
+		.handle = sh->dist_mem.handle,
+		.a_base = (uint64_t)(uintptr_t)sh->db.vecs,
+		.b_base = (uint64_t)(uintptr_t)sh->dist_query,
+		.out_base = (uint64_t)(uintptr_t)sh->dist,
+		.a_stride = g->cfg.dim * sizeof(int32_t),
+		.b_stride = 0,
+		.out_stride = sizeof(uint64_t),
+		.dim = g->cfg.dim,
+		.frac_bits = 16,
+		.batch_size = sh->rows,
+	};
+	uint64_t seq;
+	doca_error_t result;
+
+	memcpy(sh->dist_query, g->queries, (size_t)g->cfg.dim * sizeof(int32_t));
+	result = l2_backend_launch(sh->be, L2_KERNEL_BATCH, &args, &seq);
+	if (result != DOCA_SUCCESS)
+		return result;
+	return l2_backend_wait(sh->be, seq);
+}
+
+static void shard_task(void *ctx, uint32_t task, unsigned int worker)
+{
+	struct l2_shards *g = ctx;
+	struct shard *sh = &g->shard[task];
+	uint64_t t0 = now_ns();
+
+	(void)worker;
+	L2_TRACE_BEGIN(ts);
+	if (sh->rows == 0)
+		sh->result = DOCA_SUCCESS;
+	else if (g->op == SHARD_OP_SEARCH)
+		sh->result = shard_search(g, sh);
+	else
+		sh->result = shard_distances(g, sh);
+	L2_TRACE_END(ts, g->op == SHARD_OP_SEARCH ? "shard.search" : "shard.distances", task);
+	sh->last_ns = now_ns() - t0;
+	sh->busy_ns += sh->last_ns;
+	sh->batches++;
+}
+
+/* 所有 shard 并发跑当前 op，返回第一个失败 shard 的错误 */
+static doca_error_t shards_fanout(struct l2_shards *g)
+{
+	uint64_t t0 = now_ns(), sum = 0, max = 0;
+
+	L2_TRACE_BEGIN(tf);
+	l2_pool_run_static(g->pool, g->cfg.num_shards, shard_task, g);
+	L2_TRACE_END(tf, "shards.fanout", g->cfg.num_shards);
+	g->stats.fanout_ns += now_ns() - t0;
+	g->stats.batches++;
+
+	for (uint32_t s = 0; s < g->cfg.num_shards; s++) {
+		sum += g->shard[s].last_ns;
+		if (g->shard[s].last_ns > max)
+			max = g->shard[s].last_ns;
+	}
+	g->stats.imbalance = sum != 0 ? (double)max * g->cfg.num_shards / sum : 1.0;
+
+	for (uint32_t s = 0; s < g->cfg.num_shards; s++) {
+		if (g->shard[s].result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Shard %u (%s) failed: %s", s, g->shard[s].device,
+				     doca_error_get_descr(g->shard[s].result));
+			return g->shard[s].result;
+		}
+	}
+	return DOCA_SUCCESS;
+}
+
+static doca_error_t shard_open(struct l2_shards *g, uint32_t s)
+{
+	const struct l2_shards_cfg *cfg = &g->cfg;
+	struct shard *sh = &g->shard[s];
+	struct dpa_config dpa_cfg;
+	struct l2_backend_cfg be_cfg;
+	size_t db_bytes, search_bytes, dist_bytes;
+	doca_error_t result;
+
+	sh->first = (uint32_t)((uint64_t)cfg->db_size * s / cfg->num_shards);
+	sh->rows = (uint32_t)((uint64_t)cfg->db_size * (s + 1) / cfg->num_shards) - sh->first;
+	if (cfg->devices[s] != NULL)
+		snprintf(sh->device, sizeof(sh->device), "%s", cfg->devices[s]);
+	else
+		snprintf(sh->device, sizeof(sh->device), "%s%u", l2_backend_type_name(cfg->type), s);
+
+	if (cfg->type == L2_BACKEND_DPA) {
+		if (cfg->dpa != NULL)
+			dpa_cfg = *cfg->dpa;
+		else
+			memset(&dpa_cfg, 0, sizeof(dpa_cfg));
+		snprintf(dpa_cfg.device_name, sizeof(dpa_cfg.device_name), "%s", sh->device);
+		result = allocate_dpa_resources(&dpa_cfg, &sh->resources);
+		if (result != DOCA_SUCCESS) {
+			DOCA_LOG_ERR("Failed to open device %s for shard %u: %s", sh->device, s,
+				     doca_error_get_descr(result));
+			return result;
+		}
+		sh->own_device = 1;
+	}
+
+	/* arena: [db 切片][query + 堆][query + 距离]，每个 shard 只注册自己那份 */
+	db_bytes = ALIGN64((size_t)sh->rows * cfg->dim * sizeof(int32_t));
+	search_bytes = ALIGN64((size_t)cfg->max_nq * cfg->dim * sizeof(int32_t)) +
+		       ALIGN64((size_t)cfg->max_nq * cfg->num_threads * cfg->k * sizeof(struct l2_hit));
+	dist_bytes = ALIGN64((size_t)cfg->dim * sizeof(int32_t)) + ALIGN64((size_t)sh->rows * sizeof(uint64_t));
+	be_cfg = (struct l2_backend_cfg){
+		.type = cfg->type,
+		.resources = sh->own_device ? &sh->resources : NULL,
+		.num_threads = cfg->num_threads,
+		.arena_size = db_bytes + search_bytes + dist_bytes + SHARDS_ARENA_MARGIN,
+		.arena_page = cfg->arena_page,
+		.host_threads = cfg->host_threads,
+	};
+	result = l2_backend_create(&be_cfg, &sh->be);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_db_alloc(sh->be, cfg->dim, sh->rows, &sh->db);
+	if (result != DOCA_SUCCESS)
+		return result;
+	sh->db.id_base = sh->first;
+	result = l2_search_alloc(sh->be, cfg->dim, cfg->max_nq, cfg->k, &sh->search);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = l2_backend_mem_alloc(sh->be, dist_bytes, &sh->dist_mem);
+	if (result != DOCA_SUCCESS)
+		return result;
+	sh->dist_query = sh->dist_mem.addr;
+	sh->dist = (uint64_t *)((uint8_t *)sh->dist_mem.addr + ALIGN64((size_t)cfg->dim * sizeof(int32_t)));
+	return DOCA_SUCCESS;
+}
+
+static void shard_close(struct shard *sh)
+{
+	doca_error_t result;
+
+	if (sh->be != NULL) {
+		if (sh->dist_mem.addr != NULL)
+			l2_backend_mem_free(sh->be, &sh->dist_mem);
+		if (sh->search.mem.addr != NULL)
+			l2_search_free(sh->be, &sh->search);
+		if (sh->db.mem.addr != NULL)
+			l2_db_free(sh->be, &sh->db);
+		l2_backend_destroy(sh->be);
+		sh->be = NULL;
+	}
+	if (sh->own_device) {
+		result = destroy_dpa_resources(&sh->resources);
+		if (result != DOCA_SUCCESS)
+			DOCA_LOG_ERR("Failed to destroy DOCA DPA resources: %s", doca_error_get_descr(result));
+		sh->own_device = 0;
+	}
+}
+
+doca_error_t l2_shards_open(const struct l2_shards_cfg *cfg, struct l2_shards **shards)
+{
+	struct l2_pool_cfg pool_cfg;
+	struct l2_shards *g;
+	doca_error_t result;
+
+	if (cfg->num_shards == 0 || cfg->num_shards > L2_SHARD_MAX) {
+		DOCA_LOG_ERR("Invalid number of shards %u (max %u)", cfg->num_shards, L2_SHARD_MAX);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (cfg->dim == 0 || cfg->db_size < cfg->num_shards || cfg->max_nq == 0) {
+		DOCA_LOG_ERR("Invalid shard shape: dim %u, db_size %u, max_nq %u", cfg->dim, cfg->db_size, cfg->max_nq);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	if (cfg->type == L2_BACKEND_DPA) {
+		for (uint32_t s = 0; s < cfg->num_shards; s++) {
+			if (cfg->devices[s] == NULL) {
+				DOCA_LOG_ERR("DPA shard %u has no device", s);
+				return DOCA_ERROR_INVALID_VALUE;
+			}
+		}
+	}
+	g = calloc(1, sizeof(*g));
+	if (g == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	g->cfg = *cfg;
+	if (g->cfg.num_threads == 0)
+		g->cfg.num_threads = SHARDS_DEFAULT_THREADS;
+	/* host backend 的 worker 在 shard 之间分 CPU，不然 N 个 pool 抢同一批核 */
+	if (g->cfg.type == L2_BACKEND_HOST && g->cfg.host_threads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		g->cfg.host_threads = ncpu > (long)g->cfg.num_shards ? (unsigned int)(ncpu / g->cfg.num_shards) : 1;
+	}
+
+	g->parts = malloc((size_t)g->cfg.max_nq * g->cfg.num_shards * g->cfg.k * sizeof(*g->parts));
+	g->merged = malloc((size_t)g->cfg.num_shards * g->cfg.k * sizeof(*g->merged));
+	if (g->parts == NULL || g->merged == NULL) {
+		result = DOCA_ERROR_NO_MEMORY;
+		goto fail;
+	}
+	for (uint32_t s = 0; s < g->cfg.num_shards; s++) {
+		L2_TRACE_BEGIN(to);
+		result = shard_open(g, s);
+		if (result != DOCA_SUCCESS)
+			goto fail;
+		L2_TRACE_END(to, "shards.open", s);
+	}
+
+	/* worker 大部分时间在等设备，不绑核 */
+	pool_cfg = (struct l2_pool_cfg){.num_workers = g->cfg.num_shards, .no_pin = 1};
+	result = l2_pool_create(&pool_cfg, &g->pool);
+	if (result != DOCA_SUCCESS)
+		goto fail;
+	*shards = g;
+	return DOCA_SUCCESS;
+
+fail:
+	l2_shards_close(g);
+	return result;
+}
+
+void l2_shards_close(struct l2_shards *shards)
+{
+	if (shards == NULL)
+		return;
+	if (shards->pool != NULL)
+		l2_pool_destroy(shards->pool);
+	for (uint32_t s = 0; s < shards->cfg.num_shards; s++)
+		shard_close(&shards->shard[s]);
+	free(shards->merged);
+	free(shards->parts);
+	free(shards);
+}
+
+doca_error_t l2_shards_load(struct l2_shards *shards, const int32_t *vecs)
+{
+	for (uint32_t s = 0; s < shards->cfg.num_shards; s++) {
+		struct shard *sh = &shards->shard[s];
+
+		memcpy(sh->db.vecs, vecs + (size_t)sh->first * shards->cfg.dim,
+		       (size_t)sh->rows * shards->cfg.dim * sizeof(int32_t));
+	}
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_shards_search(struct l2_shards *shards, const int32_t *queries, uint32_t nq,
+			      struct l2_hit *results)
+{
+	const uint32_t N = shards->cfg.num_shards, k = shards->cfg.k;
+	struct l2_hit *merged = shards->merged;
+	uint64_t t0;
+	doca_error_t result;
+
+	if (nq == 0 || nq > shards->cfg.max_nq)
+		return DOCA_ERROR_INVALID_VALUE;
+	shards->op = SHARD_OP_SEARCH;
+	shards->queries = queries;
+	shards->nq = nq;
+	result = shards_fanout(shards);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	/* shard s 的结果在 parts[s * nq * k]，每个 query 把 N 份 top-k 摆到一起再合并 */
+	L2_TRACE_BEGIN(tm);
+	t0 = now_ns();
+	for (uint32_t q = 0; q < nq; q++) {
+		for (uint32_t s = 0; s < N; s++)
+			memcpy(merged + (size_t)s * k, shards->parts + ((uint64_t)s * nq + q) * k, k * sizeof(*merged));
+		l2_topk_merge(merged, N, k, results + (uint64_t)q * k);
+	}
+	shards->stats.merge_ns += now_ns() - t0;
+	L2_TRACE_END(tm, "shards.merge", nq);
+	return DOCA_SUCCESS;
+}
+
+doca_error_t l2_shards_distances(struct l2_shards *shards, const int32_t *query, uint64_t *out)
+{
+	uint64_t t0;
+	doca_error_t result;
+
+	shards->op = SHARD_OP_DISTANCES;
+	shards->queries = query;
+	shards->nq = 1;
+	result = shards_fanout(shards);
+	if (result != DOCA_SUCCESS)
+		return result;
+
+	L2_TRACE_BEGIN(tm);
+	t0 = now_ns();
+	for (uint32_t s = 0; s < shards->cfg.num_shards; s++)
+		memcpy(out + shards->shard[s].first, shards->shard[s].dist,
+		       (size_t)shards->shard[s].rows * sizeof(*out));
+	shards->stats.merge_ns += now_ns() - t0;
+	L2_TRACE_END(tm, "shards.gather", shards->cfg.db_size);
+	return DOCA_SUCCESS;
+}
+
+uint32_t l2_shards_count(const struct l2_shards *shards)
+{
+	return shards->cfg.num_shards;
+}
+
+void l2_shards_get_stats(const struct l2_shards *shards, struct l2_shard_stats *shard_stats,
+			 struct l2_shards_stats *stats)
+{
+	if (shard_stats != NULL) {
+		for (uint32_t s = 0; s < shards->cfg.num_shards; s++) {
+			const struct shard *sh = &shards->shard[s];
+
+			shard_stats[s] = (struct l2_shard_stats){
+				.device = sh->device,
+				.first = sh->first,
+				.rows = sh->rows,
+				.batches = sh->batches,
+				.busy_ns = sh->busy_ns,
+				.last_ns = sh->last_ns,
+			};
+		}
+	}
+	if (stats != NULL)
+		*stats = shards->stats;
+}
@@ -0,0 +1,1054 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include <doca_log.h>
+
+#include "../include/l2_filter.h"
+#include "../include/l2_qvec.h"
+#include "../include/l2_simd.h"
+#include "../include/l2_topk.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::SIMD);
+
+/*
+ * 精确性：a, b 是 int32，差值需要 33 位，平方在 int64 里按 2^64 回绕（和标量版一致）。
+ * 64 位 lane 里 d = dh * 2^32 + dl（dl 为低 32 位无符号），
+ *   d^2 mod 2^64 = dl * dl + ((dh * dl) mod 2^31) << 33
+ * 两项都能用 mul_epu32（32x32 -> 64 无符号乘）算出，不会溢出。
+ */
+
+/*
+ * 各 ISA 的实现都写成 always_inline 的 *_body，再分别包成通用版本和
+ * L2_SPEC_DIMS 里每个维度的定长版本（dim 是常量，循环和尾部处理在编译期定下来）。
+ */
+static inline __attribute__((always_inline)) uint64_t l2_sq_scalar_body(const int32_t *a, const int32_t *b,
+									 uint32_t dim)
+{
+	uint64_t dist = 0;
+
+	for (uint32_t i = 0; i < dim; ++i) {
+		uint64_t d = (uint64_t)((int64_t)a[i] - (int64_t)b[i]);
+		dist += d * d;
+	}
+	return dist;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i sq_epi64_avx2(__m256i d)
+{
+	__m256i lo = _mm256_mul_epu32(d, d);
+	__m256i cross = _mm256_mul_epu32(_mm256_srli_epi64(d, 32), d);
+
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 33));
+}
+
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) uint64_t l2_sq_avx2_body(const int32_t *a, const int32_t *b,
+								       uint32_t dim)
+{
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; i + 8 <= dim; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i d0 = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(va)),
+					      _mm256_cvtepi32_epi64(_mm256_castsi256_si128(vb)));
+		__m256i d1 = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(va, 1)),
+					      _mm256_cvtepi32_epi64(_mm256_extracti128_si256(vb, 1)));
+
+		acc0 = _mm256_add_epi64(acc0, sq_epi64_avx2(d0));
+		acc1 = _mm256_add_epi64(acc1, sq_epi64_avx2(d1));
+	}
+	if (i + 4 <= dim) {
+		__m256i d = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(a + i))),
+					     _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(b + i))));
+
+		acc0 = _mm256_add_epi64(acc0, sq_epi64_avx2(d));
+		i += 4;
+	}
+
+	acc0 = _mm256_add_epi64(acc0, acc1);
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	uint64_t dist = (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+
+	return dist + l2_sq_scalar_body(a + i, b + i, dim - i);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i sq_epi64_avx512(__m512i d)
+{
+	__m512i lo = _mm512_mul_epu32(d, d);
+	__m512i cross = _mm512_mul_epu32(_mm512_srli_epi64(d, 32), d);
+
+	return _mm512_add_epi64(lo, _mm512_slli_epi64(cross, 33));
+}
+
+__attribute__((target("avx512f")))
+static inline __attribute__((always_inline)) uint64_t l2_sq_avx512_body(const int32_t *a, const int32_t *b,
+									 uint32_t dim)
+{
+	__m512i acc0 = _mm512_setzero_si512();
+	__m512i acc1 = _mm512_setzero_si512();
+	uint32_t i = 0;
+
+	for (; i + 16 <= dim; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void *)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void *)(b + i));
+		__m512i d0 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(va)),
+					      _mm512_cvtepi32_epi64(_mm512_castsi512_si256(vb)));
+		__m512i d1 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(va, 1)),
+					      _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(vb, 1)));
+
+		acc0 = _mm512_add_epi64(acc0, sq_epi64_avx512(d0));
+		acc1 = _mm512_add_epi64(acc1, sq_epi64_avx512(d1));
+	}
+	if (i < dim) {
+		/* 剩余 1..15 维用掩码加载，被屏蔽的 lane 两边都是 0 */
+		uint32_t rest = dim - i;
+		__mmask16 m = (__mmask16)((1u << rest) - 1);
+		__m512i va = _mm512_maskz_loadu_epi32(m, a + i);
+		__m512i vb = _mm512_maskz_loadu_epi32(m, b + i);
+		__m512i d0 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(va)),
+					      _mm512_cvtepi32_epi64(_mm512_castsi512_si256(vb)));
+		__m512i d1 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(va, 1)),
+					      _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(vb, 1)));
+
+		acc0 = _mm512_add_epi64(acc0, sq_epi64_avx512(d0));
+		acc1 = _mm512_add_epi64(acc1, sq_epi64_avx512(d1));
+	}
+
+	return (uint64_t)_mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+static uint64_t l2_sq_scalar(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	return l2_sq_scalar_body(a, b, dim);
+}
+
+__attribute__((target("avx2")))
+static uint64_t l2_sq_avx2(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	return l2_sq_avx2_body(a, b, dim);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t l2_sq_avx512(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	return l2_sq_avx512_body(a, b, dim);
+}
+
+/*
+ * 提前放弃：每 block 维用 *_body 算一段部分和，超过 thresh 就停。block 取向量宽度的倍数
+ * （AVX2 8 维、AVX-512 16 维）时每段都没有标量尾巴。
+ */
+#define SIMD_ABANDON(ISA)                                                                          \
+	static uint64_t l2_sq_abandon_##ISA(const int32_t *a, const int32_t *b, uint32_t dim, uint32_t block, \
+					    uint64_t thresh, uint64_t *dims)                           \
+	{                                                                                          \
+		uint64_t dist = 0;                                                                 \
+		uint32_t i = 0;                                                                    \
+                                                                                                   \
+		while (i < dim) {                                                                  \
+			uint32_t len = dim - i > block ? block : dim - i;                          \
+                                                                                                   \
+			dist += l2_sq_##ISA##_body(a + i, b + i, len);                             \
+			i += len;                                                                  \
+			if (dist > thresh)                                                         \
+				break;                                                             \
+		}                                                                                  \
+		*dims += i;                                                                        \
+		return dist;                                                                       \
+	}
+SIMD_ABANDON(scalar)
+__attribute__((target("avx2")))
+SIMD_ABANDON(avx2)
+__attribute__((target("avx512f")))
+SIMD_ABANDON(avx512)
+#undef SIMD_ABANDON
+
+static const l2_sq_abandon_fn abandon_fns[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = l2_sq_abandon_scalar,
+	[L2_SIMD_AVX2] = l2_sq_abandon_avx2,
+	[L2_SIMD_AVX512] = l2_sq_abandon_avx512,
+};
+
+/* 定长版本忽略 dim 参数，只在 dim == D 时由 dispatch 选中 */
+#define SIMD_SPECIALIZE(D)                                                                     \
+	static uint64_t l2_sq_scalar_d##D(const int32_t *a, const int32_t *b, uint32_t dim)    \
+	{                                                                                      \
+		(void)dim;                                                                     \
+		return l2_sq_scalar_body(a, b, D);                                             \
+	}                                                                                      \
+	__attribute__((target("avx2")))                                                        \
+	static uint64_t l2_sq_avx2_d##D(const int32_t *a, const int32_t *b, uint32_t dim)      \
+	{                                                                                      \
+		(void)dim;                                                                     \
+		return l2_sq_avx2_body(a, b, D);                                               \
+	}                                                                                      \
+	__attribute__((target("avx512f")))                                                     \
+	static uint64_t l2_sq_avx512_d##D(const int32_t *a, const int32_t *b, uint32_t dim)    \
+	{                                                                                      \
+		(void)dim;                                                                     \
+		return l2_sq_avx512_body(a, b, D);                                             \
+	}
+L2_SPEC_DIMS(SIMD_SPECIALIZE)
+#undef SIMD_SPECIALIZE
+
+/* [isa][variant] */
+static const l2_sq_fn simd_fns[L2_SIMD_MAX][L2_VARIANT_MAX] = {
+	[L2_SIMD_SCALAR] = {
+		[L2_VARIANT_GENERIC] = l2_sq_scalar,
+#define SIMD_SCALAR_SPEC(D) [L2_VARIANT_D##D] = l2_sq_scalar_d##D,
+		L2_SPEC_DIMS(SIMD_SCALAR_SPEC)
+#undef SIMD_SCALAR_SPEC
+	},
+	[L2_SIMD_AVX2] = {
+		[L2_VARIANT_GENERIC] = l2_sq_avx2,
+#define SIMD_AVX2_SPEC(D) [L2_VARIANT_D##D] = l2_sq_avx2_d##D,
+		L2_SPEC_DIMS(SIMD_AVX2_SPEC)
+#undef SIMD_AVX2_SPEC
+	},
+	[L2_SIMD_AVX512] = {
+		[L2_VARIANT_GENERIC] = l2_sq_avx512,
+#define SIMD_AVX512_SPEC(D) [L2_VARIANT_D##D] = l2_sq_avx512_d##D,
+		L2_SPEC_DIMS(SIMD_AVX512_SPEC)
+#undef SIMD_AVX512_SPEC
+	},
+};
+
+/*
+ * Blocked 布局：一个 block 是 dim 行 x 16 lane，第 l 个 lane 的累加器只对应第 l 个向量，
+ * 每行是一次连续的 16 x int32 读取，不需要横向归约。
+ */
+typedef void (*l2_block_fn)(const int32_t *a, const int32_t *b, uint32_t dim, uint64_t *acc);
+
+static void l2_block_scalar(const int32_t *a, const int32_t *b, uint32_t dim, uint64_t *acc)
+{
+	int64_t sum[L2_BLOCK_VECS] = {0};
+
+	for (uint32_t i = 0; i < dim; ++i)
+		for (uint32_t l = 0; l < L2_BLOCK_VECS; ++l) {
+			int64_t d = (int64_t)a[i * L2_BLOCK_VECS + l] - (int64_t)b[i * L2_BLOCK_VECS + l];
+
+			sum[l] += d * d;
+		}
+	for (uint32_t l = 0; l < L2_BLOCK_VECS; ++l)
+		acc[l] = (uint64_t)sum[l];
+}
+
+__attribute__((target("avx2")))
+static void l2_block_avx2(const int32_t *a, const int32_t *b, uint32_t dim, uint64_t *acc)
+{
+	__m256i s[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(),
+			_mm256_setzero_si256()};
+
+	for (uint32_t i = 0; i < dim; ++i) {
+		const int32_t *ra = a + (size_t)i * L2_BLOCK_VECS;
+		const int32_t *rb = b + (size_t)i * L2_BLOCK_VECS;
+
+		for (int j = 0; j < 4; ++j) {
+			__m256i d = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(ra + 4 * j))),
+						     _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(rb + 4 * j))));
+
+			s[j] = _mm256_add_epi64(s[j], sq_epi64_avx2(d));
+		}
+	}
+	for (int j = 0; j < 4; ++j)
+		_mm256_storeu_si256((__m256i *)(acc + 4 * j), s[j]);
+}
+
+__attribute__((target("avx512f")))
+static void l2_block_avx512(const int32_t *a, const int32_t *b, uint32_t dim, uint64_t *acc)
+{
+	__m512i s0 = _mm512_setzero_si512();
+	__m512i s1 = _mm512_setzero_si512();
+
+	for (uint32_t i = 0; i < dim; ++i) {
+		__m512i va = _mm512_loadu_si512((const void *)(a + (size_t)i * L2_BLOCK_VECS));
+		__m512i vb = _mm512_loadu_si512((const void *)(b + (size_t)i * L2_BLOCK_VECS));
+		__m512i d0 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(va)),
+					      _mm512_cvtepi32_epi64(_mm512_castsi512_si256(vb)));
+		__m512i d1 = _mm512_sub_epi64(_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(va, 1)),
+					      _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(vb, 1)));
+
+		s0 = _mm512_add_epi64(s0, sq_epi64_avx512(d0));
+		s1 = _mm512_add_epi64(s1, sq_epi64_avx512(d1));
+	}
+	_mm512_storeu_si512((void *)acc, s0);
+	_mm512_storeu_si512((void *)(acc + 8), s1);
+}
+
+static const l2_block_fn block_fns[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = l2_block_scalar,
+	[L2_SIMD_AVX2] = l2_block_avx2,
+	[L2_SIMD_AVX512] = l2_block_avx512,
+};
+
+/*
+ * 距离矩阵：||a||^2 + ||b||^2 - 2 a.b，点积用 4x4 寄存器块（4 行 a x 4 行 b，16 个 int64
+ * 累加器），每次从 a / b 读进来的一段数据被复用 4 次。int32 x int32 的积在 int64 里精确，
+ * 累加和展开式都按 2^64 回绕，和直接算 (a - b)^2 逐位相同。
+ */
+typedef uint64_t (*l2_dot_fn)(const int32_t *a, const int32_t *b, uint32_t dim);
+typedef void (*l2_dot4x4_fn)(const int32_t *const *a, const int32_t *const *b, uint32_t dim, uint64_t *dot);
+
+static uint64_t l2_dot_scalar(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	int64_t dot = 0;
+
+	for (uint32_t i = 0; i < dim; ++i)
+		dot += (int64_t)a[i] * (int64_t)b[i];
+	return (uint64_t)dot;
+}
+
+static void l2_dot4x4_scalar(const int32_t *const *a, const int32_t *const *b, uint32_t dim, uint64_t *dot)
+{
+	int64_t acc[L2_MATRIX_TILE * L2_MATRIX_TILE] = {0};
+
+	for (uint32_t i = 0; i < dim; ++i)
+		for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r)
+			for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+				acc[r * L2_MATRIX_TILE + c] += (int64_t)a[r][i] * (int64_t)b[c][i];
+	for (uint32_t t = 0; t < L2_MATRIX_TILE * L2_MATRIX_TILE; ++t)
+		dot[t] = (uint64_t)acc[t];
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load4_epi64_avx2(const int32_t *p)
+{
+	return _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)p));
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t hsum_epi64_avx2(__m256i v)
+{
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+	return (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+}
+
+__attribute__((target("avx2")))
+static uint64_t l2_dot_avx2(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	__m256i acc = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; i + 4 <= dim; i += 4)
+		acc = _mm256_add_epi64(acc, _mm256_mul_epi32(load4_epi64_avx2(a + i), load4_epi64_avx2(b + i)));
+	return hsum_epi64_avx2(acc) + l2_dot_scalar(a + i, b + i, dim - i);
+}
+
+__attribute__((target("avx2")))
+static void l2_dot4x4_avx2(const int32_t *const *a, const int32_t *const *b, uint32_t dim, uint64_t *dot)
+{
+	__m256i acc[L2_MATRIX_TILE][L2_MATRIX_TILE];
+	uint32_t i = 0;
+
+	for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r)
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			acc[r][c] = _mm256_setzero_si256();
+
+	/* mul_epi32 取每个 64 位 lane 的低 32 位做有符号乘，cvtepi32_epi64 之后正好是原值 */
+	for (; i + 4 <= dim; i += 4) {
+		__m256i vb[L2_MATRIX_TILE];
+
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			vb[c] = load4_epi64_avx2(b[c] + i);
+		for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r) {
+			__m256i va = load4_epi64_avx2(a[r] + i);
+
+			for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+				acc[r][c] = _mm256_add_epi64(acc[r][c], _mm256_mul_epi32(va, vb[c]));
+		}
+	}
+	for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r)
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			dot[r * L2_MATRIX_TILE + c] =
+				hsum_epi64_avx2(acc[r][c]) + l2_dot_scalar(a[r] + i, b[c] + i, dim - i);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i load8_epi64_avx512(const int32_t *p, uint32_t rest)
+{
+	/* rest < 8 时用掩码加载，被屏蔽的 lane 为 0 */
+	if (rest >= 8)
+		return _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *)p));
+	return _mm512_cvtepi32_epi64(_mm512_castsi512_si256(_mm512_maskz_loadu_epi32((__mmask16)((1u << rest) - 1), p)));
+}
+
+__attribute__((target("avx512f")))
+static uint64_t l2_dot_avx512(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	__m512i acc = _mm512_setzero_si512();
+
+	for (uint32_t i = 0; i < dim; i += 8)
+		acc = _mm512_add_epi64(acc, _mm512_mul_epi32(load8_epi64_avx512(a + i, dim - i),
+							     load8_epi64_avx512(b + i, dim - i)));
+	return (uint64_t)_mm512_reduce_add_epi64(acc);
+}
+
+__attribute__((target("avx512f")))
+static void l2_dot4x4_avx512(const int32_t *const *a, const int32_t *const *b, uint32_t dim, uint64_t *dot)
+{
+	__m512i acc[L2_MATRIX_TILE][L2_MATRIX_TILE];
+
+	for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r)
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			acc[r][c] = _mm512_setzero_si512();
+
+	/* 4 个 b + 1 个 a + 16 个累加器，32 个 zmm 放得下 */
+	for (uint32_t i = 0; i < dim; i += 8) {
+		__m512i vb[L2_MATRIX_TILE];
+
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			vb[c] = load8_epi64_avx512(b[c] + i, dim - i);
+		for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r) {
+			__m512i va = load8_epi64_avx512(a[r] + i, dim - i);
+
+			for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+				acc[r][c] = _mm512_add_epi64(acc[r][c], _mm512_mul_epi32(va, vb[c]));
+		}
+	}
+	for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r)
+		for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c)
+			dot[r * L2_MATRIX_TILE + c] = (uint64_t)_mm512_reduce_add_epi64(acc[r][c]);
+}
+
+static const l2_dot_fn dot_fns[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = l2_dot_scalar,
+	[L2_SIMD_AVX2] = l2_dot_avx2,
+	[L2_SIMD_AVX512] = l2_dot_avx512,
+};
+
+static const l2_dot4x4_fn dot4x4_fns[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = l2_dot4x4_scalar,
+	[L2_SIMD_AVX2] = l2_dot4x4_avx2,
+	[L2_SIMD_AVX512] = l2_dot4x4_avx512,
+};
+
+/*
+ * ADC 距离：m 次查 uint16 表求和。8 bit code 对应 256 项的表，pshufb 只能查 16 项，
+ * 这里用 32 位 gather 一次取 8/16 个子空间的表项，再屏蔽掉高 16 位。
+ * gather 会多读表项后面 2 字节，所以 LUT 尾部留了 L2_PQ_LUT_PAD。
+ */
+typedef uint32_t (*l2_adc_fn)(const uint16_t *lut, const uint8_t *code, uint32_t m);
+
+static uint32_t l2_adc_scalar(const uint16_t *lut, const uint8_t *code, uint32_t m)
+{
+	uint32_t dist = 0;
+
+	for (uint32_t j = 0; j < m; ++j)
+		dist += lut[j * L2_PQ_KSUB + code[j]];
+	return dist;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i adc8_avx2(const uint16_t *lut, const uint8_t *code)
+{
+	const __m256i lane = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+	__m256i idx = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)code)), lane);
+
+	return _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, idx, 2), _mm256_set1_epi32(0xffff));
+}
+
+__attribute__((target("avx2")))
+static uint32_t l2_adc_avx2(const uint16_t *lut, const uint8_t *code, uint32_t m)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m128i sum;
+	uint32_t j = 0;
+
+	for (; j + 8 <= m; j += 8)
+		acc = _mm256_add_epi32(acc, adc8_avx2(lut + j * L2_PQ_KSUB, code + j));
+	sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t)_mm_cvtsi128_si32(sum) + l2_adc_scalar(lut + j * L2_PQ_KSUB, code + j, m - j);
+}
+
+__attribute__((target("avx512f")))
+static uint32_t l2_adc_avx512(const uint16_t *lut, const uint8_t *code, uint32_t m)
+{
+	const __m512i lane = _mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32(L2_PQ_KSUB));
+	__m512i acc = _mm512_setzero_si512();
+	uint32_t j = 0;
+
+	for (; j + 16 <= m; j += 16) {
+		__m512i idx = _mm512_add_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(code + j))), lane);
+		__m512i v = _mm512_i32gather_epi32(idx, (const void *)(lut + j * L2_PQ_KSUB), 2);
+
+		acc = _mm512_add_epi32(acc, _mm512_and_si512(v, _mm512_set1_epi32(0xffff)));
+	}
+	/* m = 8, 24, ... 剩下的 8 个子空间走 256 位 */
+	return (uint32_t)_mm512_reduce_add_epi32(acc) + l2_adc_avx2(lut + j * L2_PQ_KSUB, code + j, m - j);
+}
+
+static const l2_adc_fn adc_fns[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = l2_adc_scalar,
+	[L2_SIMD_AVX2] = l2_adc_avx2,
+	[L2_SIMD_AVX512] = l2_adc_avx512,
+};
+
+/*
+ * int8 / int16 code 的 raw 点积，距离由 l2_qvec_dist() 用 header 拼出来。
+ * 两种宽度都先扩成 int16 再 madd_epi16：int8 的 lane 和每 16 个元素最多长 2^15，
+ * int32 累加器每 L2_Q8_DOT_CHUNK 个元素并进 int64 一次；int16 的两个积之和 < 2^31
+ * （code 限制在 +-32767），每步都扩到 int64。zmm 上的 madd_epi16 要 AVX512BW，
+ * 这里只要求 AVX512F，所以 avx512 也用 256 位版本。
+ */
+typedef int64_t (*l2_qdot_fn)(const void *a, const void *b, uint32_t dim);
+
+static int64_t l2_qdot8_scalar(const void *a, const void *b, uint32_t dim)
+{
+	const int8_t *qa = a, *qb = b;
+	int64_t dot = 0;
+
+	for (uint32_t i = 0; i < dim; i++)
+		dot += (int32_t)qa[i] * qb[i];
+	return dot;
+}
+
+static int64_t l2_qdot16_scalar(const void *a, const void *b, uint32_t dim)
+{
+	const int16_t *qa = a, *qb = b;
+	int64_t dot = 0;
+
+	for (uint32_t i = 0; i < dim; i++)
+		dot += (int32_t)qa[i] * qb[i];
+	return dot;
+}
+
+__attribute__((target("avx2")))
+static inline int64_t hsum_epi32_avx2(__m256i v)
+{
+	__m256i w = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)),
+				     _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+
+	return (int64_t)hsum_epi64_avx2(w);
+}
+
+__attribute__((target("avx2")))
+static int64_t l2_qdot8_avx2(const void *a, const void *b, uint32_t dim)
+{
+	const int8_t *qa = a, *qb = b;
+	int64_t dot = 0;
+	uint32_t i = 0;
+
+	while (i + 16 <= dim) {
+		uint32_t end = dim - i < L2_Q8_DOT_CHUNK ? dim : i + L2_Q8_DOT_CHUNK;
+		__m256i acc = _mm256_setzero_si256();
+
+		for (; i + 16 <= end; i += 16) {
+			__m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(qa + i)));
+			__m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(qb + i)));
+
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+		}
+		dot += hsum_epi32_avx2(acc);
+	}
+	return dot + l2_qdot8_scalar(qa + i, qb + i, dim - i);
+}
+
+__attribute__((target("avx2")))
+static int64_t l2_qdot16_avx2(const void *a, const void *b, uint32_t dim)
+{
+	const int16_t *qa = a, *qb = b;
+	__m256i acc = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; i + 16 <= dim; i += 16) {
+		__m256i p = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(qa + i)),
+					      _mm256_loadu_si256((const __m256i *)(qb + i)));
+
+		acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+		acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+	}
+	return (int64_t)hsum_epi64_avx2(acc) + l2_qdot16_scalar(qa + i, qb + i, dim - i);
+}
+
+/* [isa][L2_QELEM_I8 / L2_QELEM_I16] */
+static const l2_qdot_fn qdot_fns[L2_SIMD_MAX][L2_QELEM_I16 + 1] = {
+	[L2_SIMD_SCALAR] = {[L2_QELEM_I8] = l2_qdot8_scalar, [L2_QELEM_I16] = l2_qdot16_scalar},
+	[L2_SIMD_AVX2] = {[L2_QELEM_I8] = l2_qdot8_avx2, [L2_QELEM_I16] = l2_qdot16_avx2},
+	[L2_SIMD_AVX512] = {[L2_QELEM_I8] = l2_qdot8_avx2, [L2_QELEM_I16] = l2_qdot16_avx2},
+};
+
+/*
+ * Hamming 距离：一次算一块 code 对同一个 query 的距离。code 是 words 个 uint32 一行，
+ * 向量化沿着 code 方向：每个 lane 一个 code，逐字 xor + popcount 后累加。words = 1
+ * （dim <= 32）时一块 code 是连续的，直接整块 load；否则按 words 的步长 gather。
+ * AVX-512 VPOPCNTDQ 有 32 位 lane 的 popcount；没有时用 pshufb 查 4 位的 popcount 表，
+ * 字节计数再用 maddubs / madd 横向加到 32 位 lane。
+ */
+typedef void (*l2_ham_fn)(const uint32_t *q, const uint32_t *codes, uint32_t words, uint32_t count, uint32_t *dist);
+
+static void l2_ham_scalar(const uint32_t *q, const uint32_t *codes, uint32_t words, uint32_t count, uint32_t *dist)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t *code = codes + (uint64_t)i * words;
+		uint32_t d = 0;
+
+		for (uint32_t w = 0; w < words; w++)
+			d += (uint32_t)__builtin_popcount(q[w] ^ code[w]);
+		dist[i] = d;
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i popcnt_epi32_avx2(__m256i x)
+{
+	const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+				      _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+
+	return _mm256_madd_epi16(_mm256_maddubs_epi16(cnt, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+}
+
+__attribute__((target("avx2")))
+static void l2_ham_avx2(const uint32_t *q, const uint32_t *codes, uint32_t words, uint32_t count, uint32_t *dist)
+{
+	const __m256i lane = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(words));
+	uint32_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		const uint32_t *block = codes + (uint64_t)i * words;
+		__m256i acc = _mm256_setzero_si256();
+
+		for (uint32_t w = 0; w < words; w++) {
+			__m256i c = words == 1 ? _mm256_loadu_si256((const __m256i *)block) :
+						 _mm256_i32gather_epi32((const int *)(block + w), lane, 4);
+
+			acc = _mm256_add_epi32(acc, popcnt_epi32_avx2(_mm256_xor_si256(c, _mm256_set1_epi32(q[w]))));
+		}
+		_mm256_storeu_si256((__m256i *)(dist + i), acc);
+	}
+	l2_ham_scalar(q, codes + (uint64_t)i * words, words, count - i, dist + i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void l2_ham_vpopcnt(const uint32_t *q, const uint32_t *codes, uint32_t words, uint32_t count, uint32_t *dist)
+{
+	const __m512i lane = _mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(words));
+	uint32_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		const uint32_t *block = codes + (uint64_t)i * words;
+		__m512i acc = _mm512_setzero_si512();
+
+		for (uint32_t w = 0; w < words; w++) {
+			__m512i c = words == 1 ? _mm512_loadu_si512(block) :
+						 _mm512_i32gather_epi32(lane, (const void *)(block + w), 4);
+
+			acc = _mm512_add_epi32(acc, _mm512_popcnt_epi32(_mm512_xor_si512(c, _mm512_set1_epi32(q[w]))));
+		}
+		_mm512_storeu_si512(dist + i, acc);
+	}
+	l2_ham_avx2(q, codes + (uint64_t)i * words, words, count - i, dist + i);
+}
+
+static const char *const simd_names[L2_SIMD_MAX] = {
+	[L2_SIMD_SCALAR] = "scalar",
+	[L2_SIMD_AVX2] = "avx2",
+	[L2_SIMD_AVX512] = "avx512",
+};
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+static enum l2_simd_isa simd_isa = L2_SIMD_SCALAR;
+static l2_sq_fn simd_sq = l2_sq_scalar;
+static l2_ham_fn simd_ham = l2_ham_scalar;
+
+static int isa_supported(enum l2_simd_isa isa)
+{
+	switch (isa) {
+	case L2_SIMD_AVX512:
+		return __builtin_cpu_supports("avx512f");
+	case L2_SIMD_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case L2_SIMD_SCALAR:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void simd_select(void)
+{
+	const char *force = getenv("ZSJ_SIMD");
+
+	__builtin_cpu_init();
+	if (isa_supported(L2_SIMD_AVX512))
+		simd_isa = L2_SIMD_AVX512;
+	else if (isa_supported(L2_SIMD_AVX2))
+		simd_isa = L2_SIMD_AVX2;
+
+	if (force != NULL) {
+		for (int i = 0; i < L2_SIMD_MAX; i++) {
+			if (strcmp(force, simd_names[i]) != 0)
+				continue;
+			if (isa_supported((enum l2_simd_isa)i))
+				simd_isa = (enum l2_simd_isa)i;
+			else
+				DOCA_LOG_WARN("ZSJ_SIMD=%s not supported by this CPU, using %s", force,
+					      simd_names[simd_isa]);
+		}
+	}
+	simd_sq = simd_fns[simd_isa][L2_VARIANT_GENERIC];
+	DOCA_LOG_INFO("Host L2 kernel: %s", simd_names[simd_isa]);
+
+	/* VPOPCNTDQ 不是 AVX-512F 的一部分，单独检测 */
+	if (simd_isa == L2_SIMD_AVX512 && __builtin_cpu_supports("avx512vpopcntdq"))
+		simd_ham = l2_ham_vpopcnt;
+	else if (simd_isa != L2_SIMD_SCALAR)
+		simd_ham = l2_ham_avx2;
+}
+
+enum l2_simd_isa l2_simd_isa(void)
+{
+	pthread_once(&simd_once, simd_select);
+	return simd_isa;
+}
+
+const char *l2_simd_isa_name(enum l2_simd_isa isa)
+{
+	return isa < L2_SIMD_MAX ? simd_names[isa] : "unknown";
+}
+
+l2_sq_fn l2_simd_sq_fn(enum l2_simd_isa isa)
+{
+	return l2_simd_kernel(isa, L2_VARIANT_GENERIC);
+}
+
+l2_sq_fn l2_simd_kernel(enum l2_simd_isa isa, enum l2_variant variant)
+{
+	pthread_once(&simd_once, simd_select);
+	if (isa >= L2_SIMD_MAX || variant >= L2_VARIANT_MAX || !isa_supported(isa))
+		return NULL;
+	return simd_fns[isa][variant];
+}
+
+l2_sq_abandon_fn l2_simd_abandon_fn(enum l2_simd_isa isa)
+{
+	pthread_once(&simd_once, simd_select);
+	if (isa >= L2_SIMD_MAX || !isa_supported(isa))
+		return NULL;
+	return abandon_fns[isa];
+}
+
+uint64_t l2_sq_q16_16(const int32_t *a, const int32_t *b, uint32_t dim)
+{
+	pthread_once(&simd_once, simd_select);
+	return simd_sq(a, b, dim);
+}
+
+void l2_simd_batch(const struct l2_batch_args *args, enum l2_variant variant)
+{
+	l2_sq_fn sq;
+
+	pthread_once(&simd_once, simd_select);
+	sq = variant < L2_VARIANT_MAX ? simd_fns[simd_isa][variant] : simd_sq;
+	for (uint32_t idx = 0; idx < args->batch_size; ++idx) {
+		const int32_t *a = (const int32_t *)(uintptr_t)(args->a_base + (uint64_t)idx * args->a_stride);
+		const int32_t *b = (const int32_t *)(uintptr_t)(args->b_base + (uint64_t)idx * args->b_stride);
+
+		*(uint64_t *)(uintptr_t)(args->out_base + (uint64_t)idx * args->out_stride) = sq(a, b, args->dim);
+	}
+}
+
+void l2_simd_search(const struct l2_search_args *args, enum l2_variant variant)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	uint64_t dims = 0, cands = 0;
+	l2_sq_fn sq;
+
+	pthread_once(&simd_once, simd_select);
+	sq = variant < L2_VARIANT_MAX ? simd_fns[simd_isa][variant] : simd_sq;
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = (uint32_t)l2_search_next_row(args, 0, args->db_size); idx < args->db_size;
+		     idx = (uint32_t)l2_search_next_row(args, idx + 1, args->db_size)) {
+			const int32_t *v = (const int32_t *)(uintptr_t)(args->db_base + (uint64_t)idx * args->db_stride);
+
+			if (args->abandon_block != 0) {
+				uint64_t thresh = l2_topk_bound(heap, n, k);
+				uint64_t dist = abandon_fns[simd_isa](qv, v, args->dim, args->abandon_block, thresh,
+								      &dims);
+
+				++cands;
+				if (dist <= thresh)
+					l2_topk_push(heap, &n, k, dist, args->id_base + idx);
+				continue;
+			}
+			l2_topk_push(heap, &n, k, sq(qv, v, args->dim), args->id_base + idx);
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+	if (args->stats_base != 0) {
+		uint64_t *stats = (uint64_t *)(uintptr_t)args->stats_base;
+
+		memset(stats, 0, (size_t)args->num_parts * L2_ABANDON_STATS * sizeof(*stats));
+		stats[L2_ABANDON_DIMS] = dims;
+		stats[L2_ABANDON_CANDS] = cands;
+	}
+}
+
+void l2_simd_batch_blocked(const struct l2_batch_blocked_args *args)
+{
+	const size_t block_elems = (size_t)args->dim * L2_BLOCK_VECS;
+	uint32_t nblocks = (args->batch_size + L2_BLOCK_VECS - 1) / L2_BLOCK_VECS;
+	const int32_t *a = (const int32_t *)(uintptr_t)args->a_base;
+	const int32_t *b = (const int32_t *)(uintptr_t)args->b_base;
+	uint64_t *out = (uint64_t *)(uintptr_t)args->out_base;
+	uint64_t acc[L2_BLOCK_VECS];
+	l2_block_fn fn;
+
+	pthread_once(&simd_once, simd_select);
+	fn = block_fns[simd_isa];
+	for (uint32_t blk = 0; blk < nblocks; ++blk) {
+		uint32_t n = args->batch_size - blk * L2_BLOCK_VECS;
+
+		fn(a + blk * block_elems, b + blk * block_elems, args->dim, acc);
+		memcpy(out + (size_t)blk * L2_BLOCK_VECS, acc, (n < L2_BLOCK_VECS ? n : L2_BLOCK_VECS) * sizeof(*out));
+	}
+}
+
+void l2_simd_norms(const int32_t *vecs, uint64_t stride, uint32_t count, uint32_t dim, uint64_t *norms)
+{
+	l2_dot_fn dot;
+
+	pthread_once(&simd_once, simd_select);
+	dot = dot_fns[simd_isa];
+	for (uint32_t i = 0; i < count; ++i) {
+		const int32_t *v = (const int32_t *)((const uint8_t *)vecs + (uint64_t)i * stride);
+
+		norms[i] = dot(v, v, dim);
+	}
+}
+
+void l2_simd_matrix(const struct l2_matrix_args *args)
+{
+	const uint64_t *a_norm = (const uint64_t *)(uintptr_t)args->a_norm_base;
+	const uint64_t *b_norm = (const uint64_t *)(uintptr_t)args->b_norm_base;
+	uint32_t tile_n;
+	l2_dot4x4_fn dot4x4;
+
+	if (args->m == 0 || args->n == 0)
+		return;
+	pthread_once(&simd_once, simd_select);
+	dot4x4 = dot4x4_fns[simd_isa];
+
+	/* b 按 L2_MATRIX_B_TILE_BYTES 分段，一段 b 在缓存里时把所有 a 行扫一遍 */
+	tile_n = (uint32_t)(L2_MATRIX_B_TILE_BYTES / ((uint64_t)args->dim * sizeof(int32_t)));
+	tile_n = tile_n / L2_MATRIX_TILE * L2_MATRIX_TILE;
+	if (tile_n < L2_MATRIX_TILE)
+		tile_n = L2_MATRIX_TILE;
+
+	for (uint32_t j_base = 0; j_base < args->n; j_base += tile_n) {
+		uint32_t j_end = args->n - j_base < tile_n ? args->n : j_base + tile_n;
+
+		for (uint32_t i0 = 0; i0 < args->m; i0 += L2_MATRIX_TILE) {
+			const int32_t *a[L2_MATRIX_TILE];
+
+			/* 越界的行夹到最后一行，多算的结果不写回 */
+			for (uint32_t r = 0; r < L2_MATRIX_TILE; ++r) {
+				uint32_t i = i0 + r < args->m ? i0 + r : args->m - 1;
+
+				a[r] = (const int32_t *)(uintptr_t)(args->a_base + (uint64_t)i * args->a_stride);
+			}
+			for (uint32_t j0 = j_base; j0 < j_end; j0 += L2_MATRIX_TILE) {
+				const int32_t *b[L2_MATRIX_TILE];
+				uint64_t dot[L2_MATRIX_TILE * L2_MATRIX_TILE];
+
+				for (uint32_t c = 0; c < L2_MATRIX_TILE; ++c) {
+					uint32_t j = j0 + c < args->n ? j0 + c : args->n - 1;
+
+					b[c] = (const int32_t *)(uintptr_t)(args->b_base + (uint64_t)j * args->b_stride);
+				}
+				dot4x4(a, b, args->dim, dot);
+				for (uint32_t r = 0; r < L2_MATRIX_TILE && i0 + r < args->m; ++r) {
+					uint64_t *out = (uint64_t *)(uintptr_t)(args->out_base +
+										(uint64_t)(i0 + r) * args->out_stride);
+
+					for (uint32_t c = 0; c < L2_MATRIX_TILE && j0 + c < args->n; ++c)
+						out[j0 + c] = a_norm[i0 + r] + b_norm[j0 + c] -
+							      2 * dot[r * L2_MATRIX_TILE + c];
+				}
+			}
+		}
+	}
+}
+
+void l2_simd_ivf(const struct l2_ivf_args *args, enum l2_variant variant)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint32_t *offsets = (const uint32_t *)(uintptr_t)args->offsets_base;
+	const uint32_t *ids = (const uint32_t *)(uintptr_t)args->ids_base;
+	l2_sq_fn sq;
+
+	pthread_once(&simd_once, simd_select);
+	sq = variant < L2_VARIANT_MAX ? simd_fns[simd_isa][variant] : simd_sq;
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const int32_t *qv = (const int32_t *)(uintptr_t)(args->q_base + (uint64_t)q * args->q_stride);
+		const uint32_t *probes = (const uint32_t *)(uintptr_t)args->probes_base + (uint64_t)q * args->nprobe;
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+		uint32_t n = 0;
+
+		for (uint32_t p = 0; p < args->nprobe; ++p) {
+			for (uint32_t idx = offsets[probes[p]]; idx < offsets[probes[p] + 1]; ++idx) {
+				const int32_t *v =
+					(const int32_t *)(uintptr_t)(args->db_base + (uint64_t)idx * args->db_stride);
+
+				l2_topk_push(heap, &n, k, sq(qv, v, args->dim), ids[idx]);
+			}
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+/* code [first, last) 的 top-k 写到 part 这一格 */
+static void simd_pq_range(const struct l2_pq_args *args, uint32_t first, uint32_t last, uint32_t part)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint8_t *codes = (const uint8_t *)(uintptr_t)args->codes_base;
+	l2_adc_fn adc;
+
+	pthread_once(&simd_once, simd_select);
+	adc = adc_fns[simd_isa];
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const uint16_t *lut = (const uint16_t *)(uintptr_t)(args->lut_base + (uint64_t)q * args->lut_stride);
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + ((uint64_t)q * args->num_parts + part) * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = first; idx < last; ++idx)
+			l2_topk_push(heap, &n, k, adc(lut, codes + (uint64_t)idx * args->m, args->m), args->id_base + idx);
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+	}
+}
+
+void l2_simd_pq(const struct l2_pq_args *args)
+{
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+
+	simd_pq_range(args, 0, args->n, 0);
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+void l2_simd_pq_part(const struct l2_pq_args *args, uint32_t part)
+{
+	uint32_t first = (uint32_t)((uint64_t)args->n * part / args->num_parts);
+	uint32_t last = (uint32_t)((uint64_t)args->n * (part + 1) / args->num_parts);
+
+	simd_pq_range(args, first, last, part);
+}
+
+/* 每次算这么多个 code 的距离再逐个进堆 */
+#define SIMD_HAM_BLOCK 256
+
+/* code [first, last) 的 top-k 写到 part 这一格 */
+static void simd_hamming_range(const struct l2_hamming_args *args, uint32_t first, uint32_t last, uint32_t part)
+{
+	struct l2_hit heap[L2_SEARCH_MAX_K];
+	uint32_t dist[SIMD_HAM_BLOCK];
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+	const uint32_t *codes = (const uint32_t *)(uintptr_t)args->codes_base;
+
+	pthread_once(&simd_once, simd_select);
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		const uint32_t *qc = (const uint32_t *)(uintptr_t)args->q_base + (uint64_t)q * args->words;
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + ((uint64_t)q * args->num_parts + part) * k;
+		uint32_t n = 0;
+
+		for (uint32_t idx = first; idx < last; idx += SIMD_HAM_BLOCK) {
+			uint32_t count = last - idx < SIMD_HAM_BLOCK ? last - idx : SIMD_HAM_BLOCK;
+			uint64_t bound;
+
+			simd_ham(qc, codes + (uint64_t)idx * args->words, args->words, count, dist);
+			bound = l2_topk_bound(heap, n, k);
+			for (uint32_t i = 0; i < count; i++) {
+				if (dist[i] > bound)
+					continue;
+				l2_topk_push(heap, &n, k, dist[i], args->id_base + idx + i);
+				bound = l2_topk_bound(heap, n, k);
+			}
+		}
+		l2_topk_pad(heap, n, k);
+		memcpy(out, heap, k * sizeof(*out));
+	}
+}
+
+void l2_simd_hamming(const struct l2_hamming_args *args)
+{
+	uint32_t k = args->k < L2_SEARCH_MAX_K ? args->k : L2_SEARCH_MAX_K;
+
+	simd_hamming_range(args, 0, args->n, 0);
+	for (uint32_t q = 0; q < args->nq; ++q) {
+		struct l2_hit *out = (struct l2_hit *)(uintptr_t)args->out_base + (uint64_t)q * args->num_parts * k;
+
+		for (uint32_t p = 1; p < args->num_parts; ++p)
+			l2_topk_pad(out + (uint64_t)p * k, 0, k);
+	}
+}
+
+void l2_simd_hamming_part(const struct l2_hamming_args *args, uint32_t part)
+{
+	uint32_t first = (uint32_t)((uint64_t)args->n * part / args->num_parts);
+	uint32_t last = (uint32_t)((uint64_t)args->n * (part + 1) / args->num_parts);
+
+	simd_hamming_range(args, first, last, part);
+}
+
+void l2_simd_qbatch(const struct l2_qbatch_args *args)
+{
+	l2_qdot_fn dot;
+
+	pthread_once(&simd_once, simd_select);
+	dot = qdot_fns[simd_isa][args->elem == L2_QELEM_I8 ? L2_QELEM_I8 : L2_QELEM_I16];
+	for (uint32_t idx = 0; idx < args->batch_size; idx++) {
+		const struct l2_qvec_hdr *a =
+			(const struct l2_qvec_hdr *)(uintptr_t)(args->a_base + (uint64_t)idx * args->a_stride);
+		const struct l2_qvec_hdr *b =
+			(const struct l2_qvec_hdr *)(uintptr_t)(args->b_base + (uint64_t)idx * args->b_stride);
+		uint64_t *out = (uint64_t *)(uintptr_t)(args->out_base + (uint64_t)idx * args->out_stride);
+
+		*out = l2_qvec_dist(a, b, dot(l2_qvec_codes(a), l2_qvec_codes(b), args->dim), args->dim);
+	}
+}
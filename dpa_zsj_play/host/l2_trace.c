@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/l2_trace.h"
+
+DOCA_LOG_REGISTER(ZSJ_PLAY::TRACE);
+
+#ifdef ZSJ_TRACE
+
+/* 每个 chunk 的事件数，chunk 满了再挂一个新的 */
+#define TRACE_CHUNK_EVENTS 4096
+
+enum trace_type {
+	TRACE_SPAN,
+	TRACE_ASYNC,
+	TRACE_COUNTER,
+};
+
+struct trace_event {
+	const char *name;
+	uint64_t ts;		/* CLOCK_MONOTONIC ns，dump 时减去第一个事件的时刻 */
+	uint64_t dur;		/* span 的时长，counter 为 0 */
+	uint64_t value;		/* span 的计数 / async 的 id / counter 的增量 */
+	uint32_t tid;		/* 只在 dump 时填 */
+	uint32_t type;
+};
+
+struct trace_chunk {
+	struct trace_chunk *_Atomic next;
+	_Atomic uint32_t count;	/* owner release 写，dump acquire 读 */
+	struct trace_event ev[TRACE_CHUNK_EVENTS];
+};
+
+/* 一个线程的 buffer，只有 owner 线程写，线程退出后保留到进程结束 */
+struct trace_thread {
+	struct trace_thread *next;
+	struct trace_chunk *_Atomic head;
+	struct trace_chunk *tail;
+	const char *_Atomic name;
+	uint32_t tid;
+};
+
+/* 一个名字的汇总 */
+struct trace_stat {
+	const char *name;
+	uint32_t type;
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t value;
+};
+
+static struct trace_thread *_Atomic trace_threads;
+static _Atomic uint32_t trace_next_tid;
+static __thread struct trace_thread *trace_self;
+
+uint64_t l2_trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Buffer of the calling thread, created and linked into trace_threads on first use
+ *
+ * @return: the buffer, NULL if out of memory (the event is dropped)
+ */
+static struct trace_thread *trace_thread_get(void)
+{
+	struct trace_thread *t = trace_self;
+
+	if (t != NULL)
+		return t;
+	t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		return NULL;
+	t->tail = calloc(1, sizeof(*t->tail));
+	if (t->tail == NULL) {
+		free(t);
+		return NULL;
+	}
+	atomic_store_explicit(&t->head, t->tail, memory_order_relaxed);
+	t->tid = atomic_fetch_add_explicit(&trace_next_tid, 1, memory_order_relaxed) + 1;
+	t->next = atomic_load_explicit(&trace_threads, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&trace_threads, &t->next, t, memory_order_release,
+						      memory_order_relaxed))
+		;
+	trace_self = t;
+	return t;
+}
+
+static void trace_record(const char *name, uint32_t type, uint64_t ts, uint64_t dur, uint64_t value)
+{
+	struct trace_thread *t = trace_thread_get();
+	struct trace_chunk *c;
+	uint32_t n;
+
+	if (t == NULL)
+		return;
+	c = t->tail;
+	n = atomic_load_explicit(&c->count, memory_order_relaxed);
+	if (n == TRACE_CHUNK_EVENTS) {
+		struct trace_chunk *nc = calloc(1, sizeof(*nc));
+
+		if (nc == NULL)
+			return;
+		atomic_store_explicit(&c->next, nc, memory_order_release);
+		t->tail = c = nc;
+		n = 0;
+	}
+	c->ev[n] = (struct trace_event){.name = name, .ts = ts, .dur = dur, .value = value, .type = type};
+	atomic_store_explicit(&c->count, n + 1, memory_order_release);
+}
+
+void l2_trace_span(const char *name, uint64_t t0, uint64_t t1, uint64_t value)
+{
+	trace_record(name, TRACE_SPAN, t0, t1 > t0 ? t1 - t0 : 0, value);
+}
+
+void l2_trace_async(const char *name, uint64_t t0, uint64_t t1, uint64_t id)
+{
+	trace_record(name, TRACE_ASYNC, t0, t1 > t0 ? t1 - t0 : 0, id);
+}
+
+void l2_trace_counter(const char *name, uint64_t value)
+{
+	trace_record(name, TRACE_COUNTER, l2_trace_now(), 0, value);
+}
+
+void l2_trace_thread_name(const char *name)
+{
+	struct trace_thread *t = trace_thread_get();
+
+	if (t != NULL)
+		atomic_store_explicit(&t->name, name, memory_order_release);
+}
+
+static int event_cmp(const void *pa, const void *pb)
+{
+	const struct trace_event *a = pa, *b = pb;
+
+	if (a->ts != b->ts)
+		return a->ts < b->ts ? -1 : 1;
+	return a->tid < b->tid ? -1 : a->tid > b->tid;
+}
+
+static int stat_cmp(const void *pa, const void *pb)
+{
+	const struct trace_stat *a = pa, *b = pb;
+
+	if (a->type != b->type)
+		return a->type < b->type ? -1 : 1;
+	if (a->total_ns != b->total_ns)
+		return a->total_ns > b->total_ns ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+/*
+ * Copy every published event into one array sorted by timestamp
+ *
+ * @events [out]: malloc'ed array, freed by the caller
+ * @count [out]: number of events
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t trace_collect(struct trace_event **events, size_t *count)
+{
+	struct trace_thread *head = atomic_load_explicit(&trace_threads, memory_order_acquire);
+	struct trace_event *ev;
+	size_t n = 0, i = 0;
+
+	for (struct trace_thread *t = head; t != NULL; t = t->next)
+		for (struct trace_chunk *c = atomic_load_explicit(&t->head, memory_order_acquire); c != NULL;
+		     c = atomic_load_explicit(&c->next, memory_order_acquire))
+			n += atomic_load_explicit(&c->count, memory_order_acquire);
+	ev = malloc((n > 0 ? n : 1) * sizeof(*ev));
+	if (ev == NULL)
+		return DOCA_ERROR_NO_MEMORY;
+	/* 两遍之间 owner 可能又追加了事件，第二遍最多拷 n 个 */
+	for (struct trace_thread *t = head; t != NULL && i < n; t = t->next) {
+		for (struct trace_chunk *c = atomic_load_explicit(&t->head, memory_order_acquire); c != NULL && i < n;
+		     c = atomic_load_explicit(&c->next, memory_order_acquire)) {
+			uint32_t cnt = atomic_load_explicit(&c->count, memory_order_acquire);
+
+			for (uint32_t j = 0; j < cnt && i < n; j++) {
+				ev[i] = c->ev[j];
+				ev[i++].tid = t->tid;
+			}
+		}
+	}
+	qsort(ev, i, sizeof(*ev), event_cmp);
+	*events = ev;
+	*count = i;
+	return DOCA_SUCCESS;
+}
+
+/* 按名字找汇总项，没有就追加；名字按内容比较，不同编译单元的同名字面量算一个 */
+static struct trace_stat *stat_find(struct trace_stat *stats, size_t *num_stats, const struct trace_event *e)
+{
+	for (size_t i = 0; i < *num_stats; i++)
+		if (stats[i].type == e->type && (stats[i].name == e->name || strcmp(stats[i].name, e->name) == 0))
+			return &stats[i];
+	stats[*num_stats] = (struct trace_stat){.name = e->name, .type = e->type};
+	return &stats[(*num_stats)++];
+}
+
+/* JSON 字符串里只会出现字面量名字，转义引号和反斜杠就够了 */
+static void json_str(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void print_summary(struct trace_stat *stats, size_t num_stats)
+{
+	qsort(stats, num_stats, sizeof(*stats), stat_cmp);
+	printf("%-24s %10s %12s %12s %12s %16s\n", "span", "calls", "total ms", "mean us", "max us", "count");
+	for (size_t i = 0; i < num_stats && stats[i].type != TRACE_COUNTER; i++) {
+		const struct trace_stat *s = &stats[i];
+
+		/* async 的 value 是 id，加起来没有意义 */
+		printf("%-24s %10lu %12.3f %12.3f %12.3f", s->name, s->calls, s->total_ns / 1e6,
+		       s->total_ns / 1e3 / s->calls, s->max_ns / 1e3);
+		if (s->type == TRACE_SPAN)
+			printf(" %16lu", s->value);
+		printf("\n");
+	}
+	for (size_t i = 0; i < num_stats; i++) {
+		if (stats[i].type != TRACE_COUNTER)
+			continue;
+		printf("%-24s %10lu %55lu\n", stats[i].name, stats[i].calls, stats[i].value);
+	}
+}
+
+int l2_trace_enabled(void)
+{
+	return 1;
+}
+
+doca_error_t l2_trace_dump(const char *path)
+{
+	struct trace_event *events;
+	struct trace_stat *stats = NULL;
+	size_t count, num_stats = 0;
+	const char *sep = "";
+	doca_error_t result;
+	uint64_t t0;
+	FILE *f;
+
+	result = trace_collect(&events, &count);
+	if (result != DOCA_SUCCESS)
+		return result;
+	t0 = count > 0 ? events[0].ts : 0;
+	stats = calloc(count > 0 ? count : 1, sizeof(*stats));
+	f = fopen(path, "w");
+	if (stats == NULL || f == NULL) {
+		DOCA_LOG_ERR("Failed to write trace to %s", path);
+		result = stats == NULL ? DOCA_ERROR_NO_MEMORY : DOCA_ERROR_IO_FAILED;
+		goto out;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (struct trace_thread *t = atomic_load_explicit(&trace_threads, memory_order_acquire); t != NULL;
+	     t = t->next) {
+		const char *name = atomic_load_explicit(&t->name, memory_order_acquire);
+
+		if (name == NULL)
+			continue;
+		fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", sep,
+			t->tid);
+		json_str(f, name);
+		fprintf(f, "}}");
+		sep = ",";
+	}
+	for (size_t i = 0; i < count; i++) {
+		const struct trace_event *e = &events[i];
+		struct trace_stat *s = stat_find(stats, &num_stats, e);
+
+		s->calls++;
+		s->value += e->value;
+		s->total_ns += e->dur;
+		s->max_ns = e->dur > s->max_ns ? e->dur : s->max_ns;
+		fprintf(f, "%s\n{\"name\":", sep);
+		json_str(f, e->name);
+		if (e->type == TRACE_SPAN)
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"count\":%lu}}",
+				e->tid, (e->ts - t0) / 1e3, e->dur / 1e3, e->value);
+		else if (e->type == TRACE_ASYNC)
+			fprintf(f,
+				",\"ph\":\"b\",\"cat\":\"async\",\"id\":%lu,\"pid\":1,\"tid\":%u,\"ts\":%.3f},"
+				"\n{\"name\":\"%s\",\"ph\":\"e\",\"cat\":\"async\",\"id\":%lu,\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+				e->value, e->tid, (e->ts - t0) / 1e3, e->name, e->value, e->tid,
+				(e->ts - t0 + e->dur) / 1e3);
+		else
+			/* counter 轨道显示累计值 */
+			fprintf(f, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"total\":%lu}}", e->tid,
+				(e->ts - t0) / 1e3, s->value);
+		sep = ",";
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f) != 0) {
+		f = NULL;
+		DOCA_LOG_ERR("Failed to write trace to %s", path);
+		result = DOCA_ERROR_IO_FAILED;
+		goto out;
+	}
+	f = NULL;
+	DOCA_LOG_INFO("Wrote %zu trace events to %s", count, path);
+	print_summary(stats, num_stats);
+
+out:
+	if (f != NULL)
+		fclose(f);
+	free(stats);
+	free(events);
+	return result;
+}
+
+#else
+
+int l2_trace_enabled(void)
+{
+	return 0;
+}
+
+doca_error_t l2_trace_dump(const char *path)
+{
+	(void)path;
+	DOCA_LOG_ERR("Tracing is not built in, rebuild with -Dtrace=true");
+	return DOCA_ERROR_NOT_SUPPORTED;
+}
+
+#endif
@@ -1,3 +1,9 @@
+#include <unistd.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "../include/args.h"
+#include "../include/l2_trace.h"
 #include "../include/utils.h"
 
 /* 单个 float 转 Q16.16 */
@@ -96,3 +102,309 @@ double l2_distance(const double *a, const double *b, size_t dim) {
     }
     return sqrt(acc);
 }
+
+/* ---------------- 批量量化（SIMD + 多线程） ---------------- */
+
+#define Q16_16_SCALE 65536.0
+/* 每个线程至少分到这么多元素才值得开线程 */
+#define QUANT_MIN_PER_THREAD (1u << 16)
+
+/* 标量版：先饱和再 llround，保证超出 int64 的输入也不会回绕 */
+static inline int32_t q16_16_round_sat(double x)
+{
+    if (!(x >= (double)INT32_MIN))   // 同时处理 NaN
+        return INT32_MIN;
+    if (x >= (double)INT32_MAX)
+        return INT32_MAX;
+    long long val = llround(x);
+    if (val > INT32_MAX) val = INT32_MAX;
+    return (int32_t)val;
+}
+
+/*
+ * 4 个已经乘过 scale 的 double -> int32，舍入和 llround 一致：
+ * t = trunc(x)，|x - t| >= 0.5 时再往远离 0 的方向加 1（x - t 是精确的）
+ */
+__attribute__((target("avx2")))
+static inline __m128i q16_16_round_sat_avx2(__m256d x)
+{
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d t = _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d f = _mm256_andnot_pd(sign, _mm256_sub_pd(x, t));
+    __m256d up = _mm256_cmp_pd(f, _mm256_set1_pd(0.5), _CMP_GE_OQ);
+    __m256d one = _mm256_or_pd(_mm256_and_pd(x, sign), _mm256_set1_pd(1.0));
+
+    t = _mm256_add_pd(t, _mm256_and_pd(up, one));
+    /* max/min 的第一个操作数是 NaN 时返回第二个，所以 NaN -> INT32_MIN */
+    t = _mm256_max_pd(t, _mm256_set1_pd((double)INT32_MIN));
+    t = _mm256_min_pd(t, _mm256_set1_pd((double)INT32_MAX));
+    return _mm256_cvttpd_epi32(t);
+}
+
+__attribute__((target("avx2")))
+static void quantize_double_avx2(const void *src_v, int32_t *dst, size_t len)
+{
+    const double *src = src_v;
+    const __m256d scale = _mm256_set1_pd(Q16_16_SCALE);
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        __m128i lo = q16_16_round_sat_avx2(_mm256_mul_pd(_mm256_loadu_pd(src + i), scale));
+        __m128i hi = q16_16_round_sat_avx2(_mm256_mul_pd(_mm256_loadu_pd(src + i + 4), scale));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_set_m128i(hi, lo));
+    }
+    for (; i < len; i++)
+        dst[i] = q16_16_round_sat(src[i] * Q16_16_SCALE);
+}
+
+__attribute__((target("avx2")))
+static void quantize_float_avx2(const void *src_v, int32_t *dst, size_t len)
+{
+    const float *src = src_v;
+    const __m256d scale = _mm256_set1_pd(Q16_16_SCALE);
+    size_t i = 0;
+
+    /* float -> double 是精确的，和 float_to_q16_16 一样在 double 上舍入 */
+    for (; i + 8 <= len; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + i);
+        __m128i lo = q16_16_round_sat_avx2(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), scale));
+        __m128i hi = q16_16_round_sat_avx2(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), scale));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_set_m128i(hi, lo));
+    }
+    for (; i < len; i++)
+        dst[i] = q16_16_round_sat((double)src[i] * Q16_16_SCALE);
+}
+
+__attribute__((target("avx512f")))
+static inline __m256i q16_16_round_sat_avx512(__m512d x)
+{
+    __m512d t = _mm512_roundscale_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m512d f = _mm512_abs_pd(_mm512_sub_pd(x, t));
+    __mmask8 up = _mm512_cmp_pd_mask(f, _mm512_set1_pd(0.5), _CMP_GE_OQ);
+    __mmask8 neg = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_LT_OQ);
+
+    t = _mm512_mask_add_pd(t, up & ~neg, t, _mm512_set1_pd(1.0));
+    t = _mm512_mask_sub_pd(t, up & neg, t, _mm512_set1_pd(1.0));
+    t = _mm512_max_pd(t, _mm512_set1_pd((double)INT32_MIN));
+    t = _mm512_min_pd(t, _mm512_set1_pd((double)INT32_MAX));
+    return _mm512_cvttpd_epi32(t);
+}
+
+__attribute__((target("avx512f")))
+static void quantize_double_avx512(const void *src_v, int32_t *dst, size_t len)
+{
+    const double *src = src_v;
+    const __m512d scale = _mm512_set1_pd(Q16_16_SCALE);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m256i lo = q16_16_round_sat_avx512(_mm512_mul_pd(_mm512_loadu_pd(src + i), scale));
+        __m256i hi = q16_16_round_sat_avx512(_mm512_mul_pd(_mm512_loadu_pd(src + i + 8), scale));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1));
+    }
+    for (; i < len; i++)
+        dst[i] = q16_16_round_sat(src[i] * Q16_16_SCALE);
+}
+
+__attribute__((target("avx512f")))
+static void quantize_float_avx512(const void *src_v, int32_t *dst, size_t len)
+{
+    const float *src = src_v;
+    const __m512d scale = _mm512_set1_pd(Q16_16_SCALE);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m512 v = _mm512_loadu_ps(src + i);
+        __m256i lo = q16_16_round_sat_avx512(
+            _mm512_mul_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(v)), scale));
+        __m256i hi = q16_16_round_sat_avx512(
+            _mm512_mul_pd(_mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))), scale));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1));
+    }
+    for (; i < len; i++)
+        dst[i] = q16_16_round_sat((double)src[i] * Q16_16_SCALE);
+}
+
+static void quantize_double_scalar(const void *src_v, int32_t *dst, size_t len)
+{
+    const double *src = src_v;
+    for (size_t i = 0; i < len; i++)
+        dst[i] = q16_16_round_sat(src[i] * Q16_16_SCALE);
+}
+
+static void quantize_float_scalar(const void *src_v, int32_t *dst, size_t len)
+{
+    const float *src = src_v;
+    for (size_t i = 0; i < len; i++)
+        dst[i] = q16_16_round_sat((double)src[i] * Q16_16_SCALE);
+}
+
+typedef void (*quantize_fn)(const void *src, int32_t *dst, size_t len);
+
+struct quantize_job {
+    quantize_fn fn;
+    const uint8_t *src;
+    size_t elem_size;
+    int32_t *dst;
+    size_t begin;
+    size_t end;
+};
+
+static void *quantize_worker(void *arg)
+{
+    struct quantize_job *job = arg;
+
+    job->fn(job->src + job->begin * job->elem_size, job->dst + job->begin, job->end - job->begin);
+    return NULL;
+}
+
+/* 按线程切成连续的块，块边界对齐到 64 个元素（dst 的 cache line 不跨线程） */
+static void quantize_parallel(quantize_fn fn, const void *src, size_t elem_size,
+                              int32_t *dst, size_t len, unsigned int num_threads)
+{
+    L2_TRACE_SCOPE("quantize.q16_16");
+    L2_TRACE_COUNTER("quantized_elems", len);
+    if (num_threads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = ncpu > 0 ? (unsigned int)ncpu : 1;
+    }
+    if ((size_t)num_threads * QUANT_MIN_PER_THREAD > len)
+        num_threads = (unsigned int)(len / QUANT_MIN_PER_THREAD);
+    if (num_threads <= 1) {
+        fn(src, dst, len);
+        return;
+    }
+
+    pthread_t tids[num_threads];
+    struct quantize_job jobs[num_threads];
+    size_t per = ((len + num_threads - 1) / num_threads + 63) & ~(size_t)63;
+    unsigned int started = 0;
+
+    for (unsigned int t = 0; t < num_threads; t++) {
+        size_t begin = (size_t)t * per;
+        size_t end = begin + per < len ? begin + per : len;
+
+        jobs[t] = (struct quantize_job){fn, src, elem_size, dst, begin, end};
+        if (begin >= end)
+            continue;
+        /* 最后一块在当前线程上做 */
+        if (t + 1 == num_threads || end == len) {
+            quantize_worker(&jobs[t]);
+            break;
+        }
+        if (pthread_create(&tids[started], NULL, quantize_worker, &jobs[t]) != 0)
+            quantize_worker(&jobs[t]);
+        else
+            started++;
+    }
+    for (unsigned int t = 0; t < started; t++)
+        pthread_join(tids[t], NULL);
+}
+
+static quantize_fn pick_quantize_double(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return quantize_double_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return quantize_double_avx2;
+    return quantize_double_scalar;
+}
+
+static quantize_fn pick_quantize_float(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return quantize_float_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return quantize_float_avx2;
+    return quantize_float_scalar;
+}
+
+void q16_16_quantize_double(const double *src, int32_t *dst, size_t len, unsigned int num_threads)
+{
+    quantize_parallel(pick_quantize_double(), src, sizeof(double), dst, len, num_threads);
+}
+
+void q16_16_quantize_float(const float *src, int32_t *dst, size_t len, unsigned int num_threads)
+{
+    quantize_parallel(pick_quantize_float(), src, sizeof(float), dst, len, num_threads);
+}
+
+/* ---------------- int16 / int8 按向量量化 ---------------- */
+
+static inline int32_t qvec_code(const void *codes, int code_bytes, size_t i)
+{
+    return code_bytes == 1 ? ((const int8_t *)codes)[i] : ((const int16_t *)codes)[i];
+}
+
+static void quantize_vectors(const double *src, size_t dim, size_t count, void *dst, size_t row_stride,
+                             unsigned int frac_bits, int code_bytes, int32_t qmin, int32_t qmax)
+{
+    const double one = ldexp(1.0, (int)frac_bits);
+    L2_TRACE_SCOPE(code_bytes == 1 ? "quantize.int8" : "quantize.int16");
+
+    L2_TRACE_COUNTER("quantized_elems", dim * count);
+    for (size_t v = 0; v < count; v++) {
+        const double *x = src + v * dim;
+        struct l2_qvec_hdr *hdr = (struct l2_qvec_hdr *)((uint8_t *)dst + v * row_stride);
+        void *codes = (uint8_t *)hdr + sizeof(*hdr);
+        double lo = x[0], hi = x[0];
+
+        for (size_t i = 1; i < dim; i++) {
+            lo = x[i] < lo ? x[i] : lo;
+            hi = x[i] > hi ? x[i] : hi;
+        }
+
+        /* scale 先取定点再用它量化，反量化时用的就是这个值 */
+        double scale_q = ceil((hi - lo) / (double)(qmax - qmin) * one);
+        if (scale_q < 1)
+            scale_q = 1;
+        if (scale_q > INT32_MAX)
+            scale_q = INT32_MAX;
+        double step = scale_q / one;
+        long long zero = (long long)qmin - llround(lo / step);
+
+        if (zero > INT32_MAX) zero = INT32_MAX;
+        if (zero < INT32_MIN) zero = INT32_MIN;
+        hdr->scale = (int32_t)scale_q;
+        hdr->zero = (int32_t)zero;
+        hdr->sum = 0;
+        hdr->norm = 0;
+
+        for (size_t i = 0; i < dim; i++) {
+            long long q = llround(x[i] / step) + zero;
+
+            if (q > qmax) q = qmax;
+            if (q < qmin) q = qmin;
+            if (code_bytes == 1)
+                ((int8_t *)codes)[i] = (int8_t)q;
+            else
+                ((int16_t *)codes)[i] = (int16_t)q;
+            hdr->sum += q;
+            hdr->norm += (q - zero) * (q - zero);
+        }
+    }
+}
+
+void quantize_vectors_int16(const double *src, size_t dim, size_t count, void *dst, size_t row_stride,
+                            unsigned int frac_bits)
+{
+    quantize_vectors(src, dim, count, dst, row_stride, frac_bits, 2, -L2_Q16_MAX, L2_Q16_MAX);
+}
+
+void quantize_vectors_int8(const double *src, size_t dim, size_t count, void *dst, size_t row_stride,
+                           unsigned int frac_bits)
+{
+    quantize_vectors(src, dim, count, dst, row_stride, frac_bits, 1, INT8_MIN, INT8_MAX);
+}
+
+void dequantize_vector(const void *row, int code_bytes, size_t dim, unsigned int frac_bits, double *dst)
+{
+    const struct l2_qvec_hdr *hdr = row;
+    const void *codes = (const uint8_t *)row + sizeof(*hdr);
+    const double step = ldexp((double)hdr->scale, -(int)frac_bits);
+
+    for (size_t i = 0; i < dim; i++)
+        dst[i] = (double)(qvec_code(codes, code_bytes, i) - hdr->zero) * step;
+}
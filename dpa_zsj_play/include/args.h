@@ -2,7 +2,8 @@
 #include <stdint.h>
 
 /* 在设备端(dpacc)编译时，__DOCA_DPA__ 通常会被定义 */
-#ifdef __DOCA_DPA__
+/* DPA_EMU: device 代码在 host 上用 pthread 模拟运行（见 dpa_emu_kernels.c） */
+#if defined(__DOCA_DPA__) && !defined(DPA_EMU)
   #include <doca_dpa_dev.h>               // 只在设备端包含
   #include <doca_mmap.h>                  // 只在设备端包含
   #include <doca_dpa.h>
@@ -10,15 +11,309 @@
   typedef doca_dpa_dev_uintptr_t dpa_uaddr_t;
   #define DPA_PARAM __dpa_global__
 #else
+  #include <doca_dpa.h>                   // doca_dpa_dev_mmap_t，host/emu 两边布局必须一致
+  #ifdef DPA_EMU
+    #include "dpa_emu_dev.h"              // doca_dpa_dev_* 的 host 模拟
+  #endif
   typedef uint64_t                dpa_uaddr_t;  // Host 侧用 64 位无符号代替设备地址类型
   #define DPA_PARAM                        /* Host 侧为空 */
 #endif
 
-// typedef DPA_PARAM struct {
-//     doca_dpa_dev_mmap_t handle;               // 共享内存的handle，DPA凭借这个来访问host mmap出来的内存
-//     uint32_t a_offset;                        // a's offset
-//     uint32_t b_offset;                        // b's offset
-//     uint32_t out_offset;                      // dist(a,b)'s offset
-//     uint32_t dim;                      // e.g. 32
-//     uint32_t frac_bits;                // q (e.g. 16)
-// }l2_single_dist_args ;
+/*
+ * 编译期特化的维度：device 为每个维度生成 l2_batch_kernel_d<D> / l2_search_kernel_d<D>，
+ * host SIMD 生成对应的定长版本，其余维度走通用 kernel。选择逻辑见 l2_dispatch.h。
+ */
+#define L2_SPEC_DIMS(X) X(32) X(64) X(96) X(128) X(256) X(768)
+
+/*
+ * Kernel 参数结构体，host / device / emulator 共用同一份定义。
+ * 所有 *_base / *_offset 都是 host 虚拟地址（doca_dpa_dev_mmap_get_external_ptr 的入参）。
+ */
+typedef DPA_PARAM struct l2_single_dist_args {
+    doca_dpa_dev_mmap_t handle;               // 共享内存的handle，DPA凭借这个来访问host mmap出来的内存
+    uint64_t a_offset;                        // a's offset
+    uint64_t b_offset;                        // b's offset
+    uint64_t out_offset;                      // dist(a,b)'s offset
+    uint64_t dim;                      // e.g. 32
+    uint64_t frac_bits;                // q (e.g. 16)
+} l2_single_dist_args;
+
+typedef DPA_PARAM struct l2_batch_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t a_base;
+    uint64_t b_base;
+    uint64_t out_base;
+
+    uint64_t a_stride;     // 每个向量 a 的步长（字节）
+    uint64_t b_stride;     // 每个向量 b 的步长（字节）
+    uint64_t out_stride;   // 每个输出 dist 的步长（字节）
+
+    uint32_t dim;          // 向量维度（例如 32）
+    uint32_t frac_bits;    // 定点位（例如 16）
+    uint32_t batch_size;   // 这一批里有多少个距离要算
+} l2_batch_args;
+
+/* ---------------- int8 / int16 量化格式 ---------------- */
+
+/*
+ * 每个向量一行：l2_qvec_hdr + dim 个 int8 / int16 code，行长补齐到 16 字节（l2_elem_row_bytes）。
+ * 反量化后的定点值 X_i = (q_i - zero) * scale，scale 是 Q(frac_bits)，所以 X 和 Q16.16 同单位。
+ * sum / norm 由量化时算好，kernel 只需要 raw 点积 sum_i qa_i * qb_i：
+ *   ||Xa - Xb||^2 = sa^2 * norm_a + sb^2 * norm_b - 2 * sa * sb * (dot - zb * sum_a - za * sum_b + dim * za * zb)
+ * 全程整数，按 2^64 回绕，和逐元素反量化再平方逐位相同。
+ */
+typedef struct l2_qvec_hdr {
+    int64_t sum;           // sum_i q_i
+    int64_t norm;          // sum_i (q_i - zero)^2
+    int32_t scale;         // Q(frac_bits)，一个量化步长对应的值，> 0
+    int32_t zero;          // zero-point
+} l2_qvec_hdr;
+
+#define L2_QVEC_ROW_ALIGN 16
+#define L2_Q16_MAX 32767       // int16 code 只用 [-32767, 32767]，两个积之和不会溢出 int32
+#define L2_Q8_DOT_CHUNK 65536  // int8 点积每这么多个元素把 int32 累加器并进 int64（|积| <= 2^14）
+
+enum l2_qelem {
+    L2_QELEM_I8 = 1,
+    L2_QELEM_I16 = 2,      // 值就是每个 code 的字节数
+};
+
+/*
+ * 量化格式的 pairwise batch：out[i] = ||Xa[i] - Xb[i]||^2，单位 2Q(2 * frac_bits)。
+ * 和 l2_batch_kernel 一样按 rank 跨步分 pair。
+ */
+typedef DPA_PARAM struct l2_qbatch_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t a_base;       // 行：l2_qvec_hdr + code
+    uint64_t b_base;
+    uint64_t out_base;
+
+    uint64_t a_stride;     // 字节，>= l2_elem_row_bytes
+    uint64_t b_stride;
+    uint64_t out_stride;
+
+    uint32_t dim;
+    uint32_t frac_bits;    // scale 的小数位
+    uint32_t batch_size;
+    uint32_t elem;         // enum l2_qelem
+} l2_qbatch_args;
+
+/* ---------------- blocked batch ---------------- */
+
+#define L2_BLOCK_VECS 16       // 每个 block 的向量数，block 内按维度转置（SoA）
+
+/*
+ * Blocked 布局的 pairwise batch（见 l2_layout.h）：
+ *   向量 v 的第 i 维在 base + ((v / 16) * dim + i) * 16 + v % 16（以 int32 计）
+ * 每个线程拿一段连续的 block，out 仍是连续的 uint64_t[batch_size]。
+ */
+typedef DPA_PARAM struct l2_batch_blocked_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t a_base;       // blocked，block 大小 dim * 16 * 4 字节
+    uint64_t b_base;
+    uint64_t out_base;     // uint64_t[batch_size]
+
+    uint32_t dim;
+    uint32_t frac_bits;
+    uint32_t batch_size;   // 向量对数，最后一个 block 里多出来的 lane 不写 out
+} l2_batch_blocked_args;
+
+/* ---------------- k-NN search ---------------- */
+
+#define L2_SEARCH_MAX_K 64     // 每个 DPA 线程栈上的 top-k 堆大小上限
+
+/* early-abandon 计数，每个线程一行：stats[rank * L2_ABANDON_STATS + L2_ABANDON_*] */
+#define L2_ABANDON_DIMS 0      // 实际算过的维数之和
+#define L2_ABANDON_CANDS 1     // 扫过的候选数
+#define L2_ABANDON_STATS 2
+
+/* 一个候选 (id, dist)；id == UINT32_MAX 表示空位 */
+typedef struct l2_hit {
+    uint64_t dist;         // 2Q(2q)
+    uint32_t id;
+    uint32_t pad;
+} l2_hit;
+
+/*
+ * nq 个 query 对 db_size 个库向量做 L2 top-k。
+ * 每个线程在本地维护 k 大小的堆，最后把堆写到 out：
+ *   out[(q * num_parts + rank) * k + j]，由 host 合并成最终 top-k。
+ * abandon_block > 0 时每算 abandon_block 维就和堆顶（当前第 k 好）比一次，
+ * 部分和已经更大就放弃这个候选；距离不回绕时结果和算满 dim 逐位相同。
+ * filter_base != 0 时线程改拿连续的 [db_size * rank / T, db_size * (rank + 1) / T) 行，
+ * 按 bitmap 字扫：bit 为 0 的行不读向量，全 0 的字 64 行一步跳过。
+ */
+typedef DPA_PARAM struct l2_search_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t q_base;       // query 区域（单独的一小块，nq 个向量）
+    uint64_t db_base;
+    uint64_t out_base;     // l2_hit[nq][num_parts][k]
+
+    uint64_t q_stride;     // 字节
+    uint64_t db_stride;    // 字节
+    uint64_t stats_base;   // 0 或 uint64_t[num_parts][L2_ABANDON_STATS]，early-abandon 的计数
+    uint64_t filter_base;  // 0 或 allow bitmap（uint64_t 字，低位在前），库内下标 i 对应 bit filter_bit + i
+
+    uint32_t dim;
+    uint32_t frac_bits;
+    uint32_t nq;
+    uint32_t db_size;
+    uint32_t k;            // <= L2_SEARCH_MAX_K
+    uint32_t num_parts;    // out 里每个 query 的段数，= launch 的线程数
+    uint32_t id_base;      // hit.id = id_base + 库内下标（分批 / 分片时用）
+    uint32_t abandon_block; // 0: 每个候选算满 dim
+    uint32_t filter_bit;   // 第 0 行在 filter_base 第一个字里的 bit 位置，< 64
+} l2_search_args;
+
+/* ---------------- all-pairs distance matrix ---------------- */
+
+#define L2_MATRIX_TILE 4       // device 端寄存器块：4 行 a x 4 行 b，16 个累加器
+
+/*
+ * M x N 距离矩阵：out[i][j] = ||a_i||^2 + ||b_j||^2 - 2 a_i . b_j，2Q(2q)。
+ * 范数由 host 预先算好（l2_matrix_norms），kernel 只算点积。所有运算都在
+ * int64 上按 2^64 回绕，展开式和直接累加 (a - b)^2 的结果逐位相同。
+ * 输出按 L2_MATRIX_TILE x L2_MATRIX_TILE 分块，线程拿连续的一段 tile。
+ */
+typedef DPA_PARAM struct l2_matrix_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t a_base;       // M 个向量
+    uint64_t b_base;       // N 个向量
+    uint64_t a_norm_base;  // uint64_t[M]
+    uint64_t b_norm_base;  // uint64_t[N]
+    uint64_t out_base;     // uint64_t，行 i 从 out_base + i * out_stride 开始
+
+    uint64_t a_stride;     // 字节
+    uint64_t b_stride;     // 字节
+    uint64_t out_stride;   // 字节，>= N * 8
+
+    uint32_t dim;
+    uint32_t frac_bits;
+    uint32_t m;
+    uint32_t n;
+} l2_matrix_args;
+
+/* ---------------- IVF list scan ---------------- */
+
+/*
+ * IVF 的细查：库向量按倒排表连续存放，list l 占 [offsets[l], offsets[l + 1]) 这些行。
+ * query q 只扫 probes[q * nprobe + p]（p < nprobe）这几个表。把这些表的行首尾相接后
+ * 第 g 行归 rank g % num_threads，小表也能分到所有线程。输出和 l2_search_args 一样：
+ *   out[(q * num_parts + rank) * k + j]，hit.id = ids[行号]。
+ */
+typedef DPA_PARAM struct l2_ivf_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t q_base;       // nq 个 query
+    uint64_t db_base;      // 按表排好的库向量
+    uint64_t ids_base;     // uint32_t[行数]，行号 -> 原始 id
+    uint64_t offsets_base; // uint32_t[nlist + 1]
+    uint64_t probes_base;  // uint32_t[nq][nprobe]
+    uint64_t out_base;     // l2_hit[nq][num_parts][k]
+
+    uint64_t q_stride;     // 字节
+    uint64_t db_stride;    // 字节
+
+    uint32_t dim;
+    uint32_t frac_bits;
+    uint32_t nq;
+    uint32_t nprobe;
+    uint32_t k;            // <= L2_SEARCH_MAX_K
+    uint32_t num_parts;    // = launch 的线程数
+} l2_ivf_args;
+
+/* ---------------- PQ / ADC scan ---------------- */
+
+#define L2_PQ_KSUB 256         // 每个子空间的码字数，code 是 1 字节
+#define L2_PQ_LUT_PAD 64       // 每个 query 的 LUT 尾部多留的字节，host 上 32 位 gather 会多读 2 字节
+
+/*
+ * ADC 扫描：库向量是 m 字节的 PQ code，query 在 host 上展开成 m x 256 的 uint16 距离表
+ *   lut[q][j][c] ≈ (||q_j - C_j[c]||^2 - min_c) / scale_q
+ * 每个库向量的估计距离就是 m 次查表之和（uint32 不会溢出），按这个值取 top-k，
+ * host 再换算回 2Q(2q)。rank 拿 [n * rank / T, n * (rank + 1) / T) 这段连续的 code。
+ *   out[(q * num_parts + rank) * k + j]，hit.dist 是表内单位的和。
+ */
+typedef DPA_PARAM struct l2_pq_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t lut_base;     // uint16_t，query q 的表从 lut_base + q * lut_stride 开始
+    uint64_t codes_base;   // uint8_t[n][m]
+    uint64_t out_base;     // l2_hit[nq][num_parts][k]
+
+    uint64_t lut_stride;   // 字节，>= m * 256 * 2 + L2_PQ_LUT_PAD
+
+    uint32_t m;
+    uint32_t nq;
+    uint32_t n;
+    uint32_t k;            // <= L2_SEARCH_MAX_K
+    uint32_t num_parts;    // = launch 的线程数
+    uint32_t id_base;      // hit.id = id_base + code 下标
+} l2_pq_args;
+
+/* ---------------- binary code Hamming scan ---------------- */
+
+/*
+ * 1 bit / 维的二值 code：bit i = (x[i] >= center[i])，每 32 维打包成一个 uint32 字，
+ * 32 维的向量只剩 4 字节。距离是 popcount(q ^ x)，按它取 top-k 作为候选，
+ * host 再用精确的 Q16.16 距离重排。rank 拿 [n * rank / T, n * (rank + 1) / T) 这段 code。
+ *   out[(q * num_parts + rank) * k + j]，hit.dist 是 Hamming 距离。
+ */
+typedef DPA_PARAM struct l2_hamming_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t q_base;       // uint32_t[nq][words]
+    uint64_t codes_base;   // uint32_t[n][words]
+    uint64_t out_base;     // l2_hit[nq][num_parts][k]
+
+    uint32_t words;        // 每个 code 的字数 = ceil(dim / 32)
+    uint32_t nq;
+    uint32_t n;
+    uint32_t k;            // <= L2_SEARCH_MAX_K
+    uint32_t num_parts;    // = launch 的线程数
+    uint32_t id_base;      // hit.id = id_base + code 下标
+} l2_hamming_args;
+
+/* ---------------- radius search ---------------- */
+
+/* 一个半径内的命中；按 (q, id) 写进线程自己的段 */
+typedef struct l2_range_hit {
+    uint64_t dist;         // 2Q(2q)
+    uint32_t id;
+    uint32_t q;            // query 下标
+} l2_range_hit;
+
+/*
+ * 半径搜索：nq 个 query 对 db_size 个库向量，dist <= radius 的 (q, id, dist) 追加到
+ * rank 自己的段 out[rank * cap + j]，只有命中才写回。rank 拿
+ * [db_size * rank / T, db_size * (rank + 1) / T) 这段连续的库向量，query 在外层，
+ * 所以段内已经按 (q, id) 有序。counts[rank] 是真实命中数，> cap 表示段溢出，
+ * 多出来的命中丢掉了。abandon_block > 0 时部分和超过 radius 就放弃，和 search 一样。
+ */
+typedef DPA_PARAM struct l2_range_args {
+    doca_dpa_dev_mmap_t handle;
+
+    uint64_t q_base;       // nq 个 query
+    uint64_t db_base;
+    uint64_t out_base;     // l2_range_hit[num_parts][cap]
+    uint64_t counts_base;  // uint64_t[num_parts]
+
+    uint64_t q_stride;     // 字节
+    uint64_t db_stride;    // 字节
+    uint64_t radius;       // 平方半径，2Q(2q)，含边界
+    uint64_t stats_base;   // 0 或 uint64_t[num_parts][L2_ABANDON_STATS]
+
+    uint32_t dim;
+    uint32_t frac_bits;
+    uint32_t nq;
+    uint32_t db_size;
+    uint32_t cap;          // 每个段的命中上限
+    uint32_t num_parts;    // = launch 的线程数
+    uint32_t id_base;      // hit.id = id_base + 库内下标
+    uint32_t abandon_block; // 0: 每个候选算满 dim
+} l2_range_args;
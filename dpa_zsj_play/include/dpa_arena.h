@@ -0,0 +1,89 @@
+#pragma once
+/*
+ * Long-lived DPA-registered memory arena.
+ *
+ * One big host buffer is allocated (optionally on 2 MB / 1 GB hugepages) and
+ * registered once; input, query and output regions are then carved out of it
+ * with a bump pointer plus an offset-sorted, coalescing free list. Registration
+ * goes through struct dpa_arena_reg_ops so the allocator can be driven with a
+ * fake hook off-device; dpa_arena_doca_reg_ops() gives the doca_mmap one.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include <doca_error.h>
+#include <doca_dpa.h>
+
+struct doca_dev;
+struct dpa_arena;
+
+/* 注册 / 注销 hook，reg 为 NULL 表示不注册（host backend，handle 为 0） */
+struct dpa_arena_reg_ops {
+	doca_error_t (*reg)(void *ctx, void *addr, size_t len, doca_dpa_dev_mmap_t *handle, void **reg_obj);
+	void (*unreg)(void *ctx, void *reg_obj);
+	void *ctx;
+};
+
+enum dpa_arena_page {
+	DPA_ARENA_PAGE_4K,	/* 普通页，另外 madvise(MADV_HUGEPAGE) */
+	DPA_ARENA_PAGE_2M,	/* MAP_HUGETLB | MAP_HUGE_2MB，失败时退回 4K */
+	DPA_ARENA_PAGE_1G,	/* MAP_HUGETLB | MAP_HUGE_1GB，失败时退回 2M 再 4K */
+};
+
+struct dpa_arena_cfg {
+	size_t size;			/* 向上取整到页大小 */
+	enum dpa_arena_page page;
+	size_t align;			/* 子分配对齐，0 = 64 字节，必须是 2 的幂 */
+	struct dpa_arena_reg_ops reg;
+};
+
+/* 一块子分配：host 地址 + DPA handle + 在 arena 内的偏移 */
+struct dpa_region {
+	void *addr;
+	size_t len;			/* 对齐后的实际大小 */
+	doca_dpa_dev_mmap_t handle;
+	uint64_t offset;
+};
+
+struct dpa_arena_stats {
+	size_t capacity;
+	size_t used;			/* 已分配出去的字节 */
+	size_t peak;
+	size_t bump;			/* bump 指针位置 */
+	size_t free_bytes;		/* free list 里的字节（bump 以下的空洞） */
+	size_t free_blocks;
+	enum dpa_arena_page page;	/* 实际用上的页大小 */
+};
+
+/*
+ * Allocate and register an arena
+ *
+ * @cfg [in]: arena configuration
+ * @arena [out]: created arena
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t dpa_arena_create(const struct dpa_arena_cfg *cfg, struct dpa_arena **arena);
+
+/* Unregisters and unmaps the arena; outstanding regions become invalid */
+void dpa_arena_destroy(struct dpa_arena *arena);
+
+/*
+ * Sub-allocate a region, first fit from the free list, else from the bump pointer
+ *
+ * @arena [in]: arena
+ * @len [in]: bytes, rounded up to the arena alignment
+ * @region [out]: allocated region
+ * @return: DOCA_SUCCESS on success, DOCA_ERROR_NO_MEMORY when the arena is full
+ */
+doca_error_t dpa_arena_alloc(struct dpa_arena *arena, size_t len, struct dpa_region *region);
+
+/* Return a region; neighbouring free blocks are merged and the bump pointer pulled back */
+void dpa_arena_free(struct dpa_arena *arena, struct dpa_region *region);
+
+/* Drop every allocation at once (bump back to 0, free list cleared) */
+void dpa_arena_reset(struct dpa_arena *arena);
+
+void dpa_arena_get_stats(struct dpa_arena *arena, struct dpa_arena_stats *stats);
+
+/* Registration hooks backed by doca_mmap on dev */
+void dpa_arena_doca_reg_ops(struct doca_dev *dev, struct dpa_arena_reg_ops *ops);
@@ -0,0 +1,110 @@
+#pragma once
+/*
+ * DPA emulator: runs the device kernels from device/dpa_zsj_play_kernels_dev.c
+ * on host pthreads. Kernels see the same doca_dpa_dev_thread_rank() /
+ * doca_dpa_dev_num_threads() values and the same *_args layout as on the DPA,
+ * so the rank striding and offset arithmetic are exercised unchanged.
+ *
+ * Launches are queued and executed in submission order by a dispatcher
+ * thread; the ranks of one launch are spread over a persistent worker pool.
+ * struct dpa_emu_event mirrors the doca_sync_event operations we use.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "args.h"
+
+/* 一个模拟 kernel 入口：args 指向对应的 *_args 结构体 */
+typedef void (*dpa_emu_kernel_fn)(const void *args);
+
+struct dpa_emu_event;
+struct dpa_emu;
+
+/* Emulated kernels, defined in host/dpa_emu_kernels.c */
+void dpa_emu_l2_single_kernel(const void *args);
+void dpa_emu_l2_batch_kernel(const void *args);
+void dpa_emu_l2_search_kernel(const void *args);
+void dpa_emu_l2_batch_blocked_kernel(const void *args);
+void dpa_emu_l2_matrix_kernel(const void *args);
+void dpa_emu_l2_ivf_kernel(const void *args);
+void dpa_emu_l2_pq_kernel(const void *args);
+void dpa_emu_l2_qbatch_kernel(const void *args);
+void dpa_emu_l2_hamming_kernel(const void *args);
+void dpa_emu_l2_range_kernel(const void *args);
+
+/* 定长特化版本 dpa_emu_l2_{batch,search}_kernel_d<D> */
+#define DPA_EMU_DECLARE_SPEC(D)                                 \
+	void dpa_emu_l2_batch_kernel_d##D(const void *args);    \
+	void dpa_emu_l2_search_kernel_d##D(const void *args);
+L2_SPEC_DIMS(DPA_EMU_DECLARE_SPEC)
+
+/*
+ * Create an emulated sync event with initial value 0
+ *
+ * @event [out]: created event
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t dpa_emu_event_create(struct dpa_emu_event **event);
+
+void dpa_emu_event_destroy(struct dpa_emu_event *event);
+
+uint64_t dpa_emu_event_get(struct dpa_emu_event *event);
+
+void dpa_emu_event_update_set(struct dpa_emu_event *event, uint64_t value);
+
+/* 返回加之前的值，同 doca_sync_event_update_add 的 fetched */
+uint64_t dpa_emu_event_update_add(struct dpa_emu_event *event, uint64_t value);
+
+/* 阻塞直到 event 的值 > value */
+void dpa_emu_event_wait_gt(struct dpa_emu_event *event, uint64_t value);
+
+/*
+ * Create an emulated DPA context
+ *
+ * @num_workers [in]: host threads used to run kernel ranks, 0 for one per online CPU
+ * @emu [out]: created context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t dpa_emu_create(unsigned int num_workers, struct dpa_emu **emu);
+
+/* Drains all queued launches, then stops the dispatcher and workers */
+void dpa_emu_destroy(struct dpa_emu *emu);
+
+/*
+ * Queue a kernel launch, same semantics as doca_dpa_kernel_launch_update_set():
+ * the kernel starts once wait_event > wait_thresh (wait_event may be NULL) and
+ * comp_event is set to comp_val when all ranks have returned.
+ *
+ * @emu [in]: emulated DPA context
+ * @wait_event [in]: event to wait on before starting, or NULL
+ * @wait_thresh [in]: threshold for wait_event
+ * @comp_event [in]: event updated on completion, or NULL
+ * @comp_val [in]: value written to comp_event
+ * @num_threads [in]: number of kernel ranks
+ * @kernel [in]: emulated kernel entry
+ * @args [in]: kernel arguments, copied before returning
+ * @args_size [in]: sizeof(*args)
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t dpa_emu_kernel_launch_update_set(struct dpa_emu *emu,
+					      struct dpa_emu_event *wait_event,
+					      uint64_t wait_thresh,
+					      struct dpa_emu_event *comp_event,
+					      uint64_t comp_val,
+					      unsigned int num_threads,
+					      dpa_emu_kernel_fn kernel,
+					      const void *args,
+					      size_t args_size);
+
+/* Same as dpa_emu_kernel_launch_update_set() but adds comp_val to comp_event */
+doca_error_t dpa_emu_kernel_launch_update_add(struct dpa_emu *emu,
+					      struct dpa_emu_event *wait_event,
+					      uint64_t wait_thresh,
+					      struct dpa_emu_event *comp_event,
+					      uint64_t comp_val,
+					      unsigned int num_threads,
+					      dpa_emu_kernel_fn kernel,
+					      const void *args,
+					      size_t args_size);
@@ -0,0 +1,45 @@
+#pragma once
+/*
+ * Host-side stand-ins for the DPA device API, so that the code in
+ * device/dpa_zsj_play_kernels_dev.c can be compiled into the host binary and
+ * run by the DPA emulator (host/dpa_emu.c). Only included when DPA_EMU is
+ * defined (see host/dpa_emu_kernels.c).
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include <doca_dpa.h>
+
+#define __dpa_global__                          /* 模拟时没有 device 地址空间 */
+
+/* 当前模拟线程的 rank / 本次 launch 的线程数，由 dpa_emu.c 在每个 rank 开始前写入 */
+extern __thread unsigned int dpa_emu_tls_rank;
+extern __thread unsigned int dpa_emu_tls_num_threads;
+
+/* kernel 报告本 rank 的迭代数（向量 / block / tile 个数），worker 跑完 rank 后记进 trace */
+extern __thread uint64_t dpa_emu_tls_iters;
+#ifdef ZSJ_TRACE
+#define L2_DEV_TRACE_ITERS(n) (dpa_emu_tls_iters = (n))
+#else
+#define L2_DEV_TRACE_ITERS(n) ((void)(n))
+#endif
+
+static inline unsigned int doca_dpa_dev_thread_rank(void)
+{
+	return dpa_emu_tls_rank;
+}
+
+static inline unsigned int doca_dpa_dev_num_threads(void)
+{
+	return dpa_emu_tls_num_threads;
+}
+
+/* Host 侧 external ptr 就是 host 虚拟地址本身 */
+static inline void *doca_dpa_dev_mmap_get_external_ptr(doca_dpa_dev_mmap_t handle, uint64_t addr)
+{
+	(void)handle;
+	return (void *)(uintptr_t)addr;
+}
+
+#define DOCA_DPA_DEV_LOG_INFO(...) ((void)0)
+#define DOCA_DPA_DEV_LOG_ERR(...) fprintf(stderr, __VA_ARGS__)
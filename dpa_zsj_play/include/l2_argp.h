@@ -0,0 +1,29 @@
+#pragma once
+/*
+ * Table-driven registration of DOCA ARGP parameters, shared by the sample and
+ * the benchmark: each executable lists its flags as an array of
+ * struct l2_argp_param and registers them in one call.
+ */
+#include <stddef.h>
+
+#include <doca_argp.h>
+#include <doca_error.h>
+
+/* One command line flag */
+struct l2_argp_param {
+	const char *short_name;		/* 可以为 NULL */
+	const char *long_name;
+	const char *arguments;		/* --help 里的参数占位，BOOLEAN 为 NULL */
+	const char *description;
+	enum doca_argp_type type;
+	doca_argp_param_cb_t cb;
+};
+
+/*
+ * Create and register every parameter of a table, stopping at the first failure
+ *
+ * @params [in]: parameters in --help order
+ * @count [in]: entries in params
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_argp_register(const struct l2_argp_param *params, size_t count);
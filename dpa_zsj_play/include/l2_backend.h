@@ -0,0 +1,296 @@
+#pragma once
+/*
+ * Pluggable distance backends.
+ *
+ * A backend owns the memory the kernels read and write (a dpa_arena,
+ * registered with doca_mmap once for the DPA) and executes kernels
+ * described by the shared *_args structs in args.h. Addresses inside the
+ * args are host virtual addresses on every backend, so the same args can be
+ * launched on the DPA, the scalar CPU reference or the DPA emulator.
+ *
+ * Launches are asynchronous: l2_backend_launch() returns a sequence number
+ * and l2_backend_wait() blocks until that launch (and all earlier ones) has
+ * completed.
+ *
+ * A launch can also be chained behind a host-published l2_event
+ * (l2_backend_launch_after): the kernel starts only once the event value
+ * exceeds a threshold, so launches can be posted before their input is
+ * staged. Backends that execute inline (cpu / host) require the condition
+ * to already hold when the launch is issued.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ZSJ_TRACE
+#include <pthread.h>
+#endif
+
+#include <doca_error.h>
+
+#include "args.h"
+#include "dpa_arena.h"
+#include "l2_dispatch.h"
+#include "l2_layout.h"
+#include "l2_trace.h"
+
+struct dpa_resources;
+
+enum l2_backend_type {
+	L2_BACKEND_DPA,		/* doca_dpa_kernel_launch on the BlueField DPA */
+	L2_BACKEND_CPU,		/* scalar host reference, runs the launch inline */
+	L2_BACKEND_EMU,		/* device code on host pthreads, see dpa_emu.h */
+	L2_BACKEND_HOST,	/* host SIMD kernels, see l2_simd.h */
+	L2_BACKEND_MAX,
+};
+
+/* Kernels a backend can launch, args type in the comment */
+enum l2_kernel_id {
+	L2_KERNEL_SINGLE,	/* l2_single_dist_args */
+	L2_KERNEL_BATCH,	/* l2_batch_args */
+	L2_KERNEL_SEARCH,	/* l2_search_args */
+	L2_KERNEL_BATCH_BLOCKED,	/* l2_batch_blocked_args */
+	L2_KERNEL_MATRIX,	/* l2_matrix_args */
+	L2_KERNEL_IVF,		/* l2_ivf_args */
+	L2_KERNEL_PQ,		/* l2_pq_args */
+	L2_KERNEL_QBATCH,	/* l2_qbatch_args */
+	L2_KERNEL_HAMMING,	/* l2_hamming_args */
+	L2_KERNEL_RANGE,	/* l2_range_args */
+	L2_KERNEL_MAX,
+};
+
+/* How the host backend splits one launch over its worker pool */
+enum l2_host_partition {
+	L2_HOST_PART_CHUNK,	/* 连续块，worker 之间 work stealing */
+	L2_HOST_PART_STRIDE,	/* 和 DPA kernel 一样按 rank 跨步，rank 数 = num_threads */
+};
+
+struct l2_backend_cfg {
+	enum l2_backend_type type;
+	struct dpa_resources *resources;	/* only used by L2_BACKEND_DPA */
+	unsigned int num_threads;		/* kernel ranks per launch */
+	size_t arena_size;			/* registered arena, 0 = L2_ARENA_DEFAULT_SIZE */
+	enum dpa_arena_page arena_page;
+	int generic_kernels;			/* 1: 不用定长特化 kernel，A/B 对比用 */
+	unsigned int host_threads;		/* host backend 的 worker 数，0 = 所有可用 CPU，1 = 调用线程单线程 */
+	enum l2_host_partition host_partition;
+};
+
+#define L2_ARENA_DEFAULT_SIZE (1UL << 30)
+
+/* 记录 launch 时刻的最近 launch 数，更早的 launch 不出 inflight span */
+#define L2_TRACE_INFLIGHT 64
+
+struct l2_backend;
+
+/* Host-published event a launch can wait on: doca_sync_event on the DPA, dpa_emu_event elsewhere */
+struct l2_event;
+
+struct l2_backend_ops {
+	const char *name;
+	doca_error_t (*init)(struct l2_backend *be);
+	void (*fini)(struct l2_backend *be);
+	/* 提供 arena 的注册 hook，NULL 表示不需要注册（host 内存） */
+	void (*arena_reg)(struct l2_backend *be, struct dpa_arena_reg_ops *reg);
+	/*
+	 * args->handle 由调用方填好；variant 由 l2_backend_launch 选好；seq 为本次 launch 的完成序号。
+	 * wait_event 非 NULL 时 kernel 要等 wait_event > wait_thresh 才开始。
+	 */
+	doca_error_t (*launch)(struct l2_backend *be, enum l2_kernel_id kernel, enum l2_variant variant,
+			       const void *args, struct l2_event *wait_event, uint64_t wait_thresh, uint64_t seq);
+	doca_error_t (*wait)(struct l2_backend *be, uint64_t seq);
+	/* 不阻塞：seq 及之前的 launch 都完成了返回 1；NULL 表示 launch 返回时就已经完成（cpu / host） */
+	int (*poll)(struct l2_backend *be, uint64_t seq);
+	doca_error_t (*event_create)(struct l2_backend *be, struct l2_event **event);
+	void (*event_destroy)(struct l2_backend *be, struct l2_event *event);
+	doca_error_t (*event_set)(struct l2_backend *be, struct l2_event *event, uint64_t value);
+	int deferred_launch;	/* 1: launch 可以在 wait 条件满足之前返回（dpa / emu） */
+	/* 新分配的内存先按计算时的划分 first-touch，NULL 表示不需要 */
+	void (*mem_touch)(struct l2_backend *be, void *addr, size_t len);
+};
+
+
+struct l2_backend {
+	const struct l2_backend_ops *ops;
+	struct l2_backend_cfg cfg;
+	uint64_t launched;	/* 已提交的 launch 数，即最后一个 seq */
+	struct dpa_arena *arena;	/* 所有 kernel 可见内存都从这里切 */
+	void *priv;
+#ifdef ZSJ_TRACE
+	/* launch 线程和 completion / watcher 线程都会碰下面几项，一律在 trace_lock 下读写 */
+	pthread_mutex_t trace_lock;
+	uint64_t trace_launch_ns[L2_TRACE_INFLIGHT];	/* seq % N -> launch 返回的时刻 */
+	uint64_t trace_launched;	/* 已经记下 launch 时刻的最大 seq，代替别的线程读 launched */
+	uint64_t trace_waited;	/* 已经出过 inflight span 的最大 seq */
+#endif
+};
+
+/* One pairwise batch: out[i] = ||a[i] - b[i]||^2 in 2Q(2q) */
+struct l2_batch {
+	struct dpa_region mem;
+	int32_t *a;		/* elem 不是 Q16_16 时是 row_bytes 一行的 l2_qvec 行，按字节寻址 */
+	int32_t *b;
+	uint64_t *out;
+	uint32_t dim;
+	uint32_t frac_bits;	/* 量化格式的 scale 小数位，out 的单位是 2Q(2 * frac_bits) */
+	uint32_t batch_size;
+	enum l2_layout layout;	/* a / b 的布局，决定 submit 用哪个 kernel */
+	enum l2_elem elem;	/* a / b 的元素格式 */
+	uint32_t row_bytes;	/* AOS 时一个向量的字节数 */
+	uint64_t seq;		/* 最近一次 submit 的 seq */
+};
+
+extern const struct l2_backend_ops l2_backend_dpa_ops;
+extern const struct l2_backend_ops l2_backend_cpu_ops;
+extern const struct l2_backend_ops l2_backend_emu_ops;
+extern const struct l2_backend_ops l2_backend_host_ops;
+
+/* "dpa" / "cpu" / "emu" / "host" -> type, L2_BACKEND_MAX if unknown */
+enum l2_backend_type l2_backend_type_from_name(const char *name);
+
+const char *l2_backend_type_name(enum l2_backend_type type);
+
+/*
+ * Create a backend
+ *
+ * @cfg [in]: backend configuration
+ * @be [out]: created backend
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_backend_create(const struct l2_backend_cfg *cfg, struct l2_backend **be);
+
+/* Waits for all outstanding launches and frees the backend */
+void l2_backend_destroy(struct l2_backend *be);
+
+/* Sub-allocate kernel-visible memory from the backend's arena */
+doca_error_t l2_backend_mem_alloc(struct l2_backend *be, size_t len, struct dpa_region *mem);
+
+void l2_backend_mem_free(struct l2_backend *be, struct dpa_region *mem);
+
+/*
+ * Place a freshly allocated buffer that kernels will walk front to back (a, b, out, db vectors)
+ * on the NUMA nodes of the host workers that will process each part; no-op on other backends.
+ * Pages already faulted in (recycled arena blocks) are migrated, see l2_pool_first_touch()
+ */
+void l2_backend_mem_touch(struct l2_backend *be, void *addr, size_t len);
+
+/*
+ * Launch a kernel asynchronously
+ *
+ * @be [in]: backend
+ * @kernel [in]: which kernel, selects the type of args
+ * @args [in]: kernel arguments, copied before returning
+ * @seq [out]: completion sequence number for l2_backend_wait(), may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_backend_launch(struct l2_backend *be, enum l2_kernel_id kernel, const void *args, uint64_t *seq);
+
+/*
+ * Launch a kernel that starts only once wait_event > wait_thresh
+ *
+ * @be [in]: backend
+ * @kernel [in]: which kernel, selects the type of args
+ * @args [in]: kernel arguments, copied before returning
+ * @wait_event [in]: event created with l2_event_create() on the same backend, NULL for none
+ * @wait_thresh [in]: threshold for wait_event
+ * @seq [out]: completion sequence number for l2_backend_wait(), may be NULL
+ * @return: DOCA_SUCCESS on success, DOCA_ERROR_BAD_STATE if an inline backend would have to block
+ */
+doca_error_t l2_backend_launch_after(struct l2_backend *be, enum l2_kernel_id kernel, const void *args,
+				     struct l2_event *wait_event, uint64_t wait_thresh, uint64_t *seq);
+
+/* 1 if launches may be posted before their wait condition holds */
+static inline int l2_backend_can_defer(const struct l2_backend *be)
+{
+	return be->ops->deferred_launch;
+}
+
+/* Create a host-published event with value 0 */
+doca_error_t l2_event_create(struct l2_backend *be, struct l2_event **event);
+
+void l2_event_destroy(struct l2_backend *be, struct l2_event *event);
+
+/* Publish a new value, kernels waiting for event > value - 1 may start */
+doca_error_t l2_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value);
+
+/* Variant l2_backend_launch() would use for these args */
+enum l2_variant l2_backend_variant(const struct l2_backend *be, enum l2_kernel_id kernel, const void *args);
+
+/* Block until launch seq and everything before it have completed */
+doca_error_t l2_backend_wait(struct l2_backend *be, uint64_t seq);
+
+/* Non-blocking l2_backend_wait(): 1 if launch seq and everything before it have completed, 0 otherwise */
+int l2_backend_poll(struct l2_backend *be, uint64_t seq);
+
+#ifdef ZSJ_TRACE
+/*
+ * Record launch -> completion seen by the host for every launch up to seq, called after a successful wait
+ * on seq. On the DPA this is the closest observable to device execution time; launches that completed
+ * before seq get the same end time, an upper bound. Safe to call from a thread other than the launching one.
+ */
+void l2_backend_trace_completed(struct l2_backend *be, uint64_t seq);
+#endif
+
+/*
+ * Allocate a, b and out for a pairwise batch in backend memory.
+ * The caller fills batch->a / batch->b (dim int32 Q16.16 per vector) before submitting.
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_batch_alloc(struct l2_backend *be, uint32_t dim, uint32_t batch_size, struct l2_batch *batch);
+
+/* Same as l2_batch_alloc() with a / b in the given layout (see l2_layout.h) */
+doca_error_t l2_batch_alloc_layout(struct l2_backend *be, uint32_t dim, uint32_t batch_size, enum l2_layout layout,
+				   struct l2_batch *batch);
+
+/*
+ * Same as l2_batch_alloc() with a / b stored as elem (AOS). For L2_ELEM_I16 / L2_ELEM_I8 every
+ * vector is a row of batch->row_bytes bytes, filled with quantize_vectors_int16() / _int8().
+ */
+doca_error_t l2_batch_alloc_elem(struct l2_backend *be, uint32_t dim, uint32_t batch_size, enum l2_elem elem,
+				 struct l2_batch *batch);
+
+void l2_batch_free(struct l2_backend *be, struct l2_batch *batch);
+
+/*
+ * Launch l2_batch_kernel (AOS), l2_batch_blocked_kernel (BLOCKED) or, for the int16 / int8
+ * formats, l2_qbatch_kernel over the whole batch
+ */
+doca_error_t l2_batch_submit(struct l2_backend *be, struct l2_batch *batch);
+
+doca_error_t l2_batch_wait(struct l2_backend *be, struct l2_batch *batch);
+
+/* Valid after l2_batch_wait(): batch_size distances in 2Q(2q) */
+static inline const uint64_t *l2_batch_results(const struct l2_batch *batch)
+{
+	return batch->out;
+}
+
+/* Fill l2_batch_args for batch rows [first, first + count) */
+void l2_batch_fill_args(const struct l2_batch *batch, uint32_t first, uint32_t count, struct l2_batch_args *args);
+
+/* Fill l2_batch_blocked_args for a BLOCKED batch */
+void l2_batch_fill_blocked_args(const struct l2_batch *batch, struct l2_batch_blocked_args *args);
+
+/* Fill l2_qbatch_args for rows [first, first + count) of an int16 / int8 batch */
+void l2_batch_fill_qargs(const struct l2_batch *batch, uint32_t first, uint32_t count, struct l2_qbatch_args *args);
+
+/*
+ * Event ops for backends that run launches inline on the caller (cpu / host),
+ * backed by dpa_emu_event. A launch whose wait condition does not hold yet
+ * cannot be deferred there and is rejected with DOCA_ERROR_BAD_STATE.
+ */
+doca_error_t l2_inline_event_create(struct l2_backend *be, struct l2_event **event);
+void l2_inline_event_destroy(struct l2_backend *be, struct l2_event *event);
+doca_error_t l2_inline_event_set(struct l2_backend *be, struct l2_event *event, uint64_t value);
+doca_error_t l2_inline_check_wait(struct l2_event *wait_event, uint64_t wait_thresh);
+
+/* Scalar reference kernels, also used by L2_BACKEND_CPU */
+void l2_cpu_single(const struct l2_single_dist_args *args);
+void l2_cpu_batch(const struct l2_batch_args *args);
+void l2_cpu_batch_blocked(const struct l2_batch_blocked_args *args);
+void l2_cpu_matrix(const struct l2_matrix_args *args);
+void l2_cpu_ivf(const struct l2_ivf_args *args);
+void l2_cpu_pq(const struct l2_pq_args *args);
+void l2_cpu_qbatch(const struct l2_qbatch_args *args);
+void l2_cpu_hamming(const struct l2_hamming_args *args);
+void l2_cpu_range(const struct l2_range_args *args);
+void l2_cpu_search(const struct l2_search_args *args);
@@ -0,0 +1,78 @@
+#pragma once
+/*
+ * Parametric benchmark for the pairwise batch kernel.
+ *
+ * Sweeps backend x threads x element type x layout x dim x batch size. The
+ * layout axis compares the AoS batch kernel (ranks stride over vectors) with
+ * the blocked kernel (contiguous block ranges, see l2_layout.h). Every point
+ * does `warmup` untimed runs and `repeats` timed runs; launch time (submit
+ * returned) and total time (wait returned) are recorded separately so launch
+ * overhead is not mixed into compute. The first run of every point is
+ * checked against l2_cpu_batch() (l2_cpu_qbatch() for the int16 / int8
+ * formats, which are AoS only). Results go to stdout and optionally to
+ * CSV / JSON for trend tracking.
+ */
+#include <limits.h>
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+#define L2_BENCH_MAX_LIST 16
+
+struct l2_bench_cfg {
+	uint32_t dims[L2_BENCH_MAX_LIST];
+	uint32_t num_dims;
+	uint32_t batches[L2_BENCH_MAX_LIST];
+	uint32_t num_batches;
+	uint32_t threads[L2_BENCH_MAX_LIST];	/* dpa / emu: kernel ranks，host: worker 数，cpu 只用第一个值 */
+	uint32_t num_threads;
+	enum l2_elem elems[L2_BENCH_MAX_LIST];
+	uint32_t num_elems;
+	enum l2_layout layouts[L2_BENCH_MAX_LIST];
+	uint32_t num_layouts;
+	enum l2_backend_type backends[L2_BENCH_MAX_LIST];
+	uint32_t num_backends;
+	int compare_generic;			/* 1: 每个点再用通用 kernel 跑一遍 */
+	int host_stride;			/* 1: host backend 按 rank 跨步划分，而不是连续块 */
+	uint32_t warmup;
+	uint32_t repeats;
+	char csv_path[PATH_MAX];		/* 空字符串表示不输出 */
+	char json_path[PATH_MAX];
+};
+
+/* One sweep point, times in microseconds */
+struct l2_bench_result {
+	enum l2_backend_type backend;
+	enum l2_elem elem;
+	enum l2_layout layout;
+	enum l2_variant variant;
+	uint32_t dim;
+	uint32_t batch;
+	uint32_t threads;
+	uint32_t repeats;
+	double launch_p50_us;
+	double min_us;
+	double p50_us;
+	double p99_us;
+	double mean_us;
+	double vec_per_s;	/* batch / p50 */
+	double gb_per_s;	/* a + b + out bytes / p50 */
+	uint64_t mismatches;	/* 与 l2_cpu_batch 不一致的距离个数 */
+};
+
+/* Defaults: dims 32,128,768, batch 65536, threads 64, q16_16, aos, cpu,host,emu, 2 warmup, 10 repeats */
+void l2_bench_cfg_init(struct l2_bench_cfg *cfg);
+
+/* Parse "a,b,c" into out[], at most L2_BENCH_MAX_LIST entries */
+doca_error_t l2_bench_parse_u32_list(const char *str, uint32_t *out, uint32_t *count);
+
+/*
+ * Run the sweep
+ *
+ * @cfg [in]: sweep description
+ * @resources [in]: DPA resources, only needed when cfg->backends contains L2_BACKEND_DPA
+ * @return: DOCA_SUCCESS when every point ran and matched the reference, DOCA_ERROR otherwise
+ */
+doca_error_t l2_bench_run(const struct l2_bench_cfg *cfg, struct dpa_resources *resources);
@@ -0,0 +1,118 @@
+#pragma once
+/*
+ * Two-stage search over sign-quantized binary codes.
+ *
+ * Every vector is reduced to 1 bit per dimension, bit i = (x[i] >= center[i])
+ * with center the per-dimension mean of the base set, packed 32 dimensions
+ * per uint32 word: a 32-dim Q16.16 row (128 bytes) becomes one 4-byte word,
+ * so the first stage streams 1/32 of the bytes of the full-precision scan.
+ * l2_hamming_kernel ranks all codes by popcount(q ^ x) and keeps the best
+ * `rerank` candidates per query; those rows are gathered from the host copy
+ * of the full vectors and re-ranked exactly with l2_ivf_kernel (one
+ * candidate list per query), so the final distances are exact 2Q(2q) and
+ * only the candidate set is approximate.
+ *
+ * Each DPA thread keeps at most L2_SEARCH_MAX_K candidates of its slice; the
+ * host merges the num_parts lists into the top `rerank`, so rerank can be up
+ * to num_parts * L2_SEARCH_MAX_K but is exact by Hamming order only up to
+ * L2_SEARCH_MAX_K. The cpu reference keeps one global list, so there it
+ * never re-ranks more than L2_SEARCH_MAX_K candidates.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+#define L2_BIN_WORDS(dim) (((dim) + 31) / 32)
+
+struct l2_bin {
+	int32_t *center;	/* host 内存，dim 个 Q16.16，每维的均值 */
+	uint32_t dim;
+	uint32_t words;
+};
+
+struct l2_bin_codes {
+	struct dpa_region mem;
+	uint32_t *codes;	/* n * words */
+	uint32_t n;
+	uint32_t words;
+};
+
+/* Per-caller search state, all regions in the backend arena */
+struct l2_bin_search {
+	struct dpa_region mem;	/* [qcodes][parts][queries][rows][ids][offsets][probes][rparts] */
+	uint32_t *qcodes;	/* max_nq * words */
+	struct l2_hit *parts;	/* max_nq * num_parts * k_part，Hamming 候选 */
+	int32_t *queries;	/* max_nq * dim，重排用的 Q16.16 query */
+	int32_t *rows;		/* max_nq * rerank * dim，从 host 拷来的候选向量 */
+	uint32_t *ids;		/* rows 对应的原始 id */
+	uint32_t *offsets;	/* max_nq + 1，query q 的候选是 rows[offsets[q], offsets[q + 1]) */
+	uint32_t *probes;	/* max_nq，probes[q] = q */
+	struct l2_hit *rparts;	/* max_nq * num_parts * k，重排结果 */
+	struct l2_hit *cand;	/* host 内存，rerank 项，合并候选用 */
+	uint32_t dim;
+	uint32_t max_nq;
+	uint32_t k;
+	uint32_t rerank;
+	uint32_t k_part;	/* 每个 DPA 线程留的候选数 = min(rerank, L2_SEARCH_MAX_K) */
+	uint32_t num_parts;
+	uint64_t seq;
+};
+
+struct l2_bin_search_stats {
+	uint64_t scan_ns;	/* query 编码 + Hamming 扫描 + 候选合并 */
+	uint64_t gather_ns;	/* 候选向量拷进 arena */
+	uint64_t rerank_ns;	/* 精确距离重排 + 合并 */
+	uint64_t candidates;	/* 重排过的候选总数 */
+};
+
+/*
+ * Fit the per-dimension centers the sign bits are taken against
+ *
+ * @vecs [in]: n * dim Q16.16 training vectors
+ * @bin [out]: encoder, release with l2_bin_free()
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_bin_train(const int32_t *vecs, uint32_t n, uint32_t dim, struct l2_bin *bin);
+
+void l2_bin_free(struct l2_bin *bin);
+
+/* Encode one vector into bin->words words */
+void l2_bin_encode_one(const struct l2_bin *bin, const int32_t *vec, uint32_t *code);
+
+/*
+ * Encode vecs into a new code region; code i is the binary code of row i
+ *
+ * @be [in]: backend whose arena holds the codes
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_bin_encode(struct l2_backend *be, const struct l2_bin *bin, const int32_t *vecs, uint32_t n,
+			   struct l2_bin_codes *codes);
+
+void l2_bin_codes_free(struct l2_backend *be, struct l2_bin_codes *codes);
+
+/*
+ * Allocate the search regions
+ *
+ * @k [in]: neighbours per query, at most L2_SEARCH_MAX_K
+ * @rerank [in]: Hamming candidates re-ranked per query, k <= rerank <= num_parts * L2_SEARCH_MAX_K
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_bin_search_alloc(struct l2_backend *be, const struct l2_bin *bin, uint32_t max_nq, uint32_t k,
+				 uint32_t rerank, struct l2_bin_search *search);
+
+void l2_bin_search_free(struct l2_backend *be, struct l2_bin_search *search);
+
+/*
+ * k nearest vectors for each query: Hamming prefilter on the codes, exact re-rank of the candidates
+ *
+ * @vecs [in]: host copy of the full vectors, row i encoded as code i
+ * @queries [in]: nq * dim Q16.16 vectors in host memory
+ * @results [out]: nq * search->k hits sorted by (dist, id), dist exact 2Q(2q)
+ * @stats [in/out]: counters are added to, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_bin_search(struct l2_backend *be, const struct l2_bin *bin, const struct l2_bin_codes *codes,
+			   const int32_t *vecs, struct l2_bin_search *search, const int32_t *queries, uint32_t nq,
+			   struct l2_hit *results, struct l2_bin_search_stats *stats);
@@ -0,0 +1,131 @@
+#pragma once
+/*
+ * Reader for the TEXMEX (SIFT / GIST) .fvecs / .bvecs / .ivecs formats.
+ *
+ * Every record is an int32 dim followed by dim float / uint8 / int32 values.
+ * Files are mmap'ed read-only and rows are handed out as pointers into the
+ * mapping, so slicing never copies. Conversion to Q16.16 happens only when a
+ * chunk is quantized straight into the caller's (usually registered) buffer;
+ * the chunk stream drops the pages it has consumed, so a base set larger than
+ * RAM can be searched chunk by chunk through a fixed amount of registered
+ * memory. Ground truth is an .ivecs file of neighbour ids per query.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "args.h"
+#include "l2_backend.h"
+
+enum l2_vecs_type {
+	L2_VECS_FVECS,	/* float32 */
+	L2_VECS_BVECS,	/* uint8 */
+	L2_VECS_IVECS,	/* int32，通常是 ground truth */
+};
+
+/* An open file, or a zero-copy view of a row range of one */
+struct l2_vecs {
+	const uint8_t *rows;	/* 第 0 行的 header */
+	uint64_t count;
+	uint32_t dim;
+	size_t row_bytes;	/* 4 字节 header + dim 个元素 */
+	enum l2_vecs_type type;
+	void *map;		/* 只有 l2_vecs_open 得到的才持有 mapping，view 为 NULL */
+	size_t map_bytes;
+};
+
+/*
+ * Map a .fvecs / .bvecs / .ivecs file, the type is taken from the extension
+ *
+ * @path [in]: file path
+ * @vs [out]: opened file
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_vecs_open(const char *path, struct l2_vecs *vs);
+
+/* Unmap a file, no-op for views */
+void l2_vecs_close(struct l2_vecs *vs);
+
+/* Rows [first, first + count) of vs as a view sharing its mapping */
+doca_error_t l2_vecs_slice(const struct l2_vecs *vs, uint64_t first, uint64_t count, struct l2_vecs *view);
+
+/* Elements of row i, no bounds check */
+static inline const void *l2_vecs_row(const struct l2_vecs *vs, uint64_t i)
+{
+	return vs->rows + i * vs->row_bytes + sizeof(int32_t);
+}
+
+const char *l2_vecs_type_name(enum l2_vecs_type type);
+
+/*
+ * Quantize rows [first, first + count) to Q16.16 into dst (count * dim int32).
+ * Row headers are checked on the way, a row whose dim differs fails with DOCA_ERROR_BAD_STATE.
+ *
+ * @num_threads [in]: worker threads, 0 = all online CPUs
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_vecs_quantize(const struct l2_vecs *vs, uint64_t first, uint32_t count, int32_t *dst,
+			      unsigned int num_threads);
+
+/* Chunked sequential pass over a file or view */
+struct l2_vecs_stream {
+	const struct l2_vecs *vs;
+	uint64_t next;
+	uint32_t chunk;		/* 每次最多多少行 */
+	unsigned int num_threads;
+};
+
+void l2_vecs_stream_init(struct l2_vecs_stream *st, const struct l2_vecs *vs, uint32_t chunk,
+			 unsigned int num_threads);
+
+/*
+ * Quantize the next chunk into dst (chunk * dim int32) and release the pages it came from
+ *
+ * @first [out]: row index of the chunk within the stream's file / view
+ * @count [out]: rows written, 0 once the stream is exhausted
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_vecs_stream_next(struct l2_vecs_stream *st, int32_t *dst, uint64_t *first, uint32_t *count);
+
+struct l2_vecs_search_stats {
+	uint64_t chunks;
+	uint64_t launches;
+	uint64_t quantize_ns;	/* host 把 base 量化进 registered chunk 的时间 */
+	uint64_t wait_ns;	/* host 等 search kernel 的时间 */
+	uint64_t total_ns;
+};
+
+/*
+ * Exact k-NN of every query against a base set streamed through two registered chunk buffers.
+ * The next chunk is quantized while the first query batch runs on the current one; per-chunk
+ * top-k lists are merged on the host, ids are row indices of base.
+ *
+ * @be [in]: backend, its arena needs room for two chunks plus the search regions
+ * @base [in]: base vectors
+ * @queries [in]: query vectors, same dim as base
+ * @k [in]: neighbours per query, at most L2_SEARCH_MAX_K
+ * @chunk_vectors [in]: base rows per chunk
+ * @results [out]: queries->count * k hits, sorted by (dist, id)
+ * @stats [out]: timing breakdown, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_vecs_search(struct l2_backend *be, const struct l2_vecs *base, const struct l2_vecs *queries,
+			    uint32_t k, uint32_t chunk_vectors, struct l2_hit *results,
+			    struct l2_vecs_search_stats *stats);
+
+/*
+ * recall@k: fraction of the first k ground-truth ids found among the first k results, over nq queries
+ *
+ * @gt [in]: .ivecs ground truth, row q lists the neighbours of query q, at least k per row
+ * @return: recall in [0, 1], or a negative value if gt does not cover nq queries / k neighbours
+ */
+double l2_recall_at_k(const struct l2_hit *results, uint32_t nq, uint32_t k, const struct l2_vecs *gt);
+
+/*
+ * recall@k against a reference result set, e.g. an exact scan of the same queries
+ *
+ * @exact [in]: nq * k reference hits, empty slots are skipped
+ * @return: fraction of the non-empty reference ids found among the first k results, 1.0 if there are none
+ */
+double l2_recall_vs_exact(const struct l2_hit *results, const struct l2_hit *exact, uint32_t nq, uint32_t k);
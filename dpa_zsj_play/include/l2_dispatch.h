@@ -0,0 +1,64 @@
+#pragma once
+/*
+ * Kernel variant selection.
+ *
+ * Every kernel that loops over dim has a generic version plus fixed-dim
+ * versions for the dims in L2_SPEC_DIMS (args.h); with a constant trip
+ * count the compiler fully unrolls the loop and keeps the accumulators in
+ * registers. l2_variant_select() maps (dim, metric, element type) to a
+ * variant index, which the DPA, emu and host backends use to index their
+ * own kernel tables. Rows not in the table fall back to L2_VARIANT_GENERIC.
+ */
+#include <stdint.h>
+
+#include "args.h"
+
+enum l2_metric {
+	L2_METRIC_L2SQ,		/* ||a - b||^2 */
+	L2_METRIC_MAX,
+};
+
+enum l2_elem {
+	L2_ELEM_Q16_16,		/* int32 定点，16 位小数 */
+	L2_ELEM_I16,		/* int16 code + 每向量 scale / zero-point（l2_qvec_hdr） */
+	L2_ELEM_I8,		/* int8 code + 每向量 scale / zero-point */
+	L2_ELEM_MAX,
+};
+
+enum l2_variant {
+	L2_VARIANT_GENERIC,
+#define L2_VARIANT_ENUM(D) L2_VARIANT_D##D,
+	L2_SPEC_DIMS(L2_VARIANT_ENUM)
+#undef L2_VARIANT_ENUM
+	L2_VARIANT_MAX,
+};
+
+/*
+ * Pick the kernel variant for a launch
+ *
+ * @dim [in]: vector dimension
+ * @metric [in]: distance metric
+ * @elem [in]: element format of both operands
+ * @return: specialized variant if one exists for the key, L2_VARIANT_GENERIC otherwise
+ */
+enum l2_variant l2_variant_select(uint32_t dim, enum l2_metric metric, enum l2_elem elem);
+
+/* Fixed dim of a variant, 0 for L2_VARIANT_GENERIC */
+uint32_t l2_variant_dim(enum l2_variant variant);
+
+/* "q16_16" / "int16" / "int8" -> enum l2_elem, L2_ELEM_MAX if unknown */
+enum l2_elem l2_elem_from_name(const char *name);
+
+const char *l2_elem_name(enum l2_elem elem);
+
+/* Bytes per vector element */
+uint32_t l2_elem_size(enum l2_elem elem);
+
+/* Bytes per stored vector: dim elements, plus header and padding for the quantized formats */
+uint32_t l2_elem_row_bytes(enum l2_elem elem, uint32_t dim);
+
+/* enum l2_qelem for l2_qbatch_args, 0 for L2_ELEM_Q16_16 */
+uint32_t l2_elem_qelem(enum l2_elem elem);
+
+/* "generic" / "d32" / ... */
+const char *l2_variant_name(enum l2_variant variant);
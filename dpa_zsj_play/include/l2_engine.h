@@ -0,0 +1,92 @@
+#pragma once
+/*
+ * Asynchronous submission engine on top of an l2_backend.
+ *
+ * Any number of threads may submit kernels; each submit returns a ticket
+ * (the backend completion sequence number). A completion thread waits on
+ * the backend's completion counter (doca_sync_event on the DPA, the
+ * emulator's event otherwise) in ticket order, runs the optional
+ * completion callback and then marks the ticket complete, so after
+ * l2_engine_wait(ticket) returns the callback has finished too.
+ *
+ * At most max_inflight launches are outstanding; l2_engine_submit() blocks
+ * when the window is full and l2_engine_try_submit() returns
+ * DOCA_ERROR_AGAIN instead.
+ *
+ * Each ticket keeps its own completion status. After the first failed
+ * completion the engine refuses new submissions with that error.
+ *
+ * Callbacks run on the completion thread and must not call the blocking
+ * l2_engine_submit() / l2_engine_wait() (use try_submit / poll).
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+/* Runs on the completion thread once the launch behind ticket has finished */
+typedef void (*l2_engine_cb)(void *ctx, uint64_t ticket, doca_error_t status);
+
+struct l2_engine_cfg {
+	uint32_t max_inflight;	/* 同时在飞的 launch 上限，0 = 16 */
+};
+
+struct l2_engine_stats {
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t backpressure_waits;	/* submit 因为窗口满而阻塞的次数 */
+	uint32_t max_inflight_seen;
+};
+
+struct l2_engine;
+
+/*
+ * Create an engine and its completion thread
+ *
+ * @be [in]: backend, must only be launched through this engine while it exists
+ * @cfg [in]: engine configuration, may be NULL for defaults
+ * @engine [out]: created engine
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_engine_create(struct l2_backend *be, const struct l2_engine_cfg *cfg, struct l2_engine **engine);
+
+/* Waits for every submitted ticket, then stops the completion thread */
+void l2_engine_destroy(struct l2_engine *engine);
+
+/*
+ * Submit a kernel, blocking while max_inflight launches are outstanding; fails with the engine's
+ * first completion error once a launch has failed
+ *
+ * @engine [in]: engine
+ * @kernel [in]: which kernel, selects the type of args
+ * @args [in]: kernel arguments, copied before returning
+ * @cb [in]: completion callback, may be NULL
+ * @ctx [in]: passed to cb
+ * @ticket [out]: ticket for poll / wait, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_engine_submit(struct l2_engine *engine, enum l2_kernel_id kernel, const void *args,
+			      l2_engine_cb cb, void *ctx, uint64_t *ticket);
+
+/* Same as l2_engine_submit() but returns DOCA_ERROR_AGAIN instead of blocking */
+doca_error_t l2_engine_try_submit(struct l2_engine *engine, enum l2_kernel_id kernel, const void *args,
+				  l2_engine_cb cb, void *ctx, uint64_t *ticket);
+
+/* Submit the whole batch (kernel picked by batch->elem / layout), batch->seq is set to the ticket */
+doca_error_t l2_engine_submit_batch(struct l2_engine *engine, struct l2_batch *batch, l2_engine_cb cb, void *ctx);
+
+/* 1 if ticket (and every earlier ticket) has completed and its callback returned */
+int l2_engine_poll(struct l2_engine *engine, uint64_t ticket);
+
+/*
+ * Block until ticket has completed
+ *
+ * @return: the status of ticket's own launch, DOCA_ERROR_INVALID_VALUE if it was never submitted
+ */
+doca_error_t l2_engine_wait(struct l2_engine *engine, uint64_t ticket);
+
+/* Block until everything submitted so far has completed, returns the first error of any ticket */
+doca_error_t l2_engine_drain(struct l2_engine *engine);
+
+void l2_engine_get_stats(struct l2_engine *engine, struct l2_engine_stats *stats);
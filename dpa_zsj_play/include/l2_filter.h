@@ -0,0 +1,113 @@
+#pragma once
+/*
+ * Filtered k-NN search: only rows allowed by a metadata predicate compete.
+ *
+ * The filter is a packed allow-bitmap over the database rows, bit i % 64 of
+ * word i / 64 for row i, held in the backend arena next to the database.
+ * l2_filter_from_attr() builds it from a per-row uint32 attribute (tenant,
+ * time bucket, category, ...) and an inclusive [lo, hi] predicate; callers
+ * with other predicates write the bitmap directly.
+ *
+ * Two ways to run a filtered query batch, picked by selectivity (allowed
+ * rows / rows):
+ *   - filtered scan: l2_search_kernel with filter_base set. Threads walk
+ *     their rows one bitmap word at a time, rows with a clear bit are never
+ *     read and an all-zero word skips 64 rows at once. Still touches every
+ *     word, and rows that pass are scattered over the whole database.
+ *   - gather-then-scan: the host copies the allowed rows into a dense arena
+ *     region and l2_ivf_kernel scans it as one list, so threads stream only
+ *     the survivors. Costs one copy of the allowed rows per batch, which is
+ *     cheap when few rows pass.
+ * l2_filter_search() gathers when the selectivity is below gather_below and
+ * the allowed rows fit the gather region. Both paths return the same hits.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+#include "l2_search.h"
+
+#define L2_FILTER_WORDS(n) (((n) + 63) / 64)
+
+/* 选择率低于这个默认值时先 gather 再扫 */
+#define L2_FILTER_GATHER_DEFAULT 0.05
+
+struct l2_filter {
+	struct dpa_region mem;	/* [bitmap][rows][ids][offsets][probes] */
+	uint64_t *bitmap;	/* L2_FILTER_WORDS(db_size)，调用方填或 l2_filter_from_attr */
+	int32_t *rows;		/* max_gather * dim，gather 出来的行 */
+	uint32_t *ids;		/* rows 对应的全局 id */
+	uint32_t *offsets;	/* 2 项：一张表 [0, allowed) */
+	uint32_t *probes;	/* max_nq 项，全 0 */
+	uint32_t db_size;
+	uint32_t dim;
+	uint32_t max_gather;	/* gather 区能放的行数，0 = 不 gather */
+	uint32_t max_nq;
+	double gather_below;	/* 选择率 < 这个值且放得下时 gather */
+};
+
+struct l2_filter_stats {
+	uint64_t allowed;	/* bitmap 里置位的行数 */
+	double selectivity;	/* allowed / db_size */
+	int gathered;		/* 1: 走了 gather-then-scan */
+	uint64_t gather_ns;	/* 数 bitmap + gather 的时间 */
+	uint64_t scan_ns;	/* launch + wait + 合并 */
+};
+
+/* First set bit in [bit, end) one word at a time, end if there is none */
+static inline uint64_t l2_filter_next(const uint64_t *bitmap, uint64_t bit, uint64_t end)
+{
+	while (bit < end) {
+		uint64_t word = bitmap[bit / 64] >> (bit % 64);
+
+		if (word != 0) {
+			bit += (uint64_t)__builtin_ctzll(word);
+			return bit < end ? bit : end;
+		}
+		bit = (bit | 63) + 1;
+	}
+	return end;
+}
+
+/* Next row >= idx and < end the filter of args allows (end if none); idx itself without a filter */
+static inline uint64_t l2_search_next_row(const struct l2_search_args *args, uint64_t idx, uint64_t end)
+{
+	if (args->filter_base == 0)
+		return idx;
+	return l2_filter_next((const uint64_t *)(uintptr_t)args->filter_base, args->filter_bit + idx,
+			      args->filter_bit + end) - args->filter_bit;
+}
+
+/*
+ * Allocate the bitmap and gather regions for a database
+ *
+ * @be [in]: backend holding db
+ * @db [in]: database the bitmap is over
+ * @max_nq [in]: largest query batch
+ * @gather_below [in]: selectivity under which l2_filter_search() gathers, 0 = never gather
+ * @filter [out]: filter context, bitmap initialized to allow every row
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_filter_alloc(struct l2_backend *be, const struct l2_db *db, uint32_t max_nq, double gather_below,
+			     struct l2_filter *filter);
+
+void l2_filter_free(struct l2_backend *be, struct l2_filter *filter);
+
+/* Allow exactly the rows with lo <= attrs[i] <= hi; attrs has db_size entries */
+void l2_filter_from_attr(struct l2_filter *filter, const uint32_t *attrs, uint32_t lo, uint32_t hi);
+
+/* Number of allowed rows */
+uint64_t l2_filter_count(const struct l2_filter *filter);
+
+/*
+ * k nearest allowed rows for the first nq queries in search->queries
+ *
+ * @search [in]: search context allocated for db, its filter field is set and cleared here
+ * @results [out]: nq * k hits sorted by (dist, id), empty slots when fewer than k rows pass
+ * @stats [out]: path taken and timing, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_filter_search(struct l2_backend *be, const struct l2_db *db, struct l2_search *search,
+			      struct l2_filter *filter, uint32_t nq, struct l2_hit *results,
+			      struct l2_filter_stats *stats);
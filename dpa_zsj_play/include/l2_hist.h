@@ -0,0 +1,51 @@
+#pragma once
+/*
+ * Log-linear histogram for latencies (or any non-negative count).
+ *
+ * Values below 2^L2_HIST_SUB_BITS get a bucket each; above that every power
+ * of two is split into 2^L2_HIST_SUB_BITS equal buckets, so a percentile is
+ * off by at most 1 / 2^L2_HIST_SUB_BITS of the value (12.5 %) over the full
+ * uint64_t range with a fixed 4 KB of counters. Recording is a handful of
+ * integer ops and takes no lock; callers serialize access.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#define L2_HIST_SUB_BITS 3
+#define L2_HIST_SUB (1u << L2_HIST_SUB_BITS)
+#define L2_HIST_BUCKETS ((64 - L2_HIST_SUB_BITS + 1) * L2_HIST_SUB)
+
+struct l2_hist {
+	uint64_t counts[L2_HIST_BUCKETS];
+	uint64_t n;
+	uint64_t sum;
+	uint64_t min;	/* n == 0 时无意义 */
+	uint64_t max;
+};
+
+void l2_hist_reset(struct l2_hist *hist);
+
+void l2_hist_record(struct l2_hist *hist, uint64_t value);
+
+/* Add every sample of src to dst */
+void l2_hist_merge(struct l2_hist *dst, const struct l2_hist *src);
+
+/*
+ * Value at quantile p
+ *
+ * @hist [in]: histogram
+ * @p [in]: quantile in [0, 1]
+ * @return: upper bound of the bucket holding the p-quantile sample (capped at max), 0 if empty
+ */
+uint64_t l2_hist_percentile(const struct l2_hist *hist, double p);
+
+double l2_hist_mean(const struct l2_hist *hist);
+
+/*
+ * Write the non-empty buckets as CSV rows "name,lower,upper,count"
+ *
+ * @f [in]: output stream
+ * @name [in]: first column, identifies the histogram when several share a file
+ * @hist [in]: histogram
+ */
+void l2_hist_write_csv(FILE *f, const char *name, const struct l2_hist *hist);
@@ -0,0 +1,87 @@
+#pragma once
+/*
+ * Hybrid scheduling of one pairwise batch over a device backend (dpa, or
+ * emu standing in for it) and the host SIMD backend at the same time.
+ *
+ * The batch is one range of pairs worked from both ends: the device takes
+ * chunks from the front and keeps up to dev_depth of them in flight, the
+ * calling thread runs chunks from the back on the host backend and checks
+ * for device completions in between. Chunk sizes are guided by the current
+ * throughput estimates: each side takes its expected share of what is left
+ * divided over its chunks (device: dev_depth, host: L2_HYBRID_HOST_SLICES),
+ * so chunks shrink towards the end and whichever side frees up first
+ * simply takes the next piece of the remainder - the faster side steals
+ * the tail instead of idling while the other finishes a fixed share.
+ *
+ * Once the remainder is handed out the calling thread blocks until the
+ * device chunks already in flight finish: they sit in the device queue and
+ * cannot be recalled, so the tail is bounded by keeping at most dev_depth
+ * shrinking chunks queued rather than by the host redoing them.
+ *
+ * A watcher thread waits for the device chunks in order and timestamps each
+ * completion when it happens, not when the host next looks. Throughput is
+ * measured per run (device: vectors / time with a chunk running, counted
+ * from each chunk's launch or its predecessor's completion, host: vectors /
+ * time inside host launches) and folded into exponential moving averages
+ * that set the next run's split, so the ratio calibrates itself online.
+ *
+ * The batch must live in the device backend's arena (the host reads the
+ * registered memory directly) and use the AoS layout; both Q16.16 and the
+ * int16 / int8 formats are supported.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+/* host 每次拿剩余量里自己份额的 1 / L2_HYBRID_HOST_SLICES，期间 device 队列不会跑空 */
+#define L2_HYBRID_HOST_SLICES 4
+#define L2_HYBRID_MAX_DEPTH 8
+
+struct l2_hybrid_cfg {
+	struct l2_backend *dev;		/* 能延迟 launch 的 backend（dpa / emu），batch 在它的 arena 里 */
+	struct l2_backend *host;	/* inline backend（host / cpu），在调用线程上跑 */
+	uint32_t min_chunk;		/* 每块最少的向量对数，0 = 4096 */
+	uint32_t dev_depth;		/* device 同时在飞的块数，0 = 2，最多 L2_HYBRID_MAX_DEPTH */
+	double dev_share;		/* 第一次 run 前 device 的份额 (0, 1)，0 = 0.5 */
+	double ewma;			/* 新测量值的权重 (0, 1]，0 = 0.5 */
+};
+
+struct l2_hybrid_stats {
+	uint64_t dev_vectors;
+	uint64_t host_vectors;
+	uint32_t dev_chunks;
+	uint32_t host_chunks;
+	double dev_share;	/* 本次 run 开始时用的份额 */
+	double dev_vps;		/* 本次 run 测到的吞吐（向量对 / 秒），没分到活时为 0 */
+	double host_vps;
+	uint64_t host_idle_ns;	/* 剩余量分完之后 host 等 device 的时间 */
+	uint64_t total_ns;
+};
+
+struct l2_hybrid;
+
+/*
+ * Create a scheduler over two existing backends
+ *
+ * @cfg [in]: configuration, the backends stay owned by the caller
+ * @hybrid [out]: created scheduler
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_hybrid_create(const struct l2_hybrid_cfg *cfg, struct l2_hybrid **hybrid);
+
+void l2_hybrid_destroy(struct l2_hybrid *hybrid);
+
+/*
+ * Compute batch->out for all pairs, split between the device and the host; returns when both are done
+ *
+ * @hybrid [in]: scheduler, its throughput estimates are updated
+ * @batch [in]: batch allocated from cfg->dev, AoS layout
+ * @stats [out]: what this run did, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_hybrid_run(struct l2_hybrid *hybrid, struct l2_batch *batch, struct l2_hybrid_stats *stats);
+
+/* Device share the next run will start from */
+double l2_hybrid_dev_share(const struct l2_hybrid *hybrid);
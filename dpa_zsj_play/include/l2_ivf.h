@@ -0,0 +1,112 @@
+#pragma once
+/*
+ * IVF (inverted file) index over Q16.16 vectors.
+ *
+ * k-means (l2_kmeans) picks nlist centroids, with the assignment step of every
+ * iteration running on the backend. The base set is then bucketed by nearest
+ * centroid and each bucket (list) stored contiguously in one registered
+ * region, together with the original ids and the list offsets. A search computes queries x centroids on the backend,
+ * keeps the nprobe nearest lists per query on the host and launches
+ * l2_ivf_kernel, which scans only those lists. nprobe = nlist is an exact
+ * scan; smaller values trade recall for speed.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+#include "l2_matrix.h"
+
+struct l2_ivf_train_cfg {
+	uint32_t nlist;
+	uint32_t iters;		/* 0 = 10 */
+	uint32_t max_train;	/* 训练集上限，0 = 256 * nlist，多了随机抽样 */
+	uint64_t seed;
+};
+
+struct l2_ivf {
+	struct dpa_region mem;	/* [vecs][ids][offsets] */
+	int32_t *vecs;		/* ntotal * dim，按表排好 */
+	uint32_t *ids;		/* 行号 -> 调用方给的行号 */
+	uint32_t *offsets;	/* nlist + 1，表 l 是 [offsets[l], offsets[l + 1]) */
+	int32_t *centroids;	/* host 内存，nlist * dim */
+	uint32_t dim;
+	uint32_t nlist;
+	uint32_t ntotal;
+};
+
+/* Per-caller search state: coarse matrix, probe table and per-thread heaps */
+struct l2_ivf_search {
+	struct l2_matrix coarse;	/* a = queries，b = centroids */
+	struct dpa_region mem;		/* [probes][parts] */
+	int32_t *queries;		/* = coarse.a，max_nq * dim，调用方填 */
+	uint32_t *probes;		/* max_nq * nlist */
+	struct l2_hit *parts;		/* max_nq * num_parts * k */
+	struct l2_hit *probe_heap;	/* host 内存，nlist 个，选 nprobe 用 */
+	uint32_t max_nq;
+	uint32_t k;
+	uint32_t num_parts;
+	uint64_t seq;
+};
+
+struct l2_ivf_search_stats {
+	uint64_t coarse_ns;	/* query x centroid 矩阵 + 选表 */
+	uint64_t scan_ns;	/* 扫表 + 合并 */
+	uint64_t scanned;	/* 实际算过距离的库向量个数（所有 query 之和） */
+};
+
+/*
+ * Train nlist centroids with k-means
+ *
+ * @be [in]: backend running the assignment step, its arena needs room for a chunk x nlist matrix
+ * @vecs [in]: n * dim training candidates
+ * @cfg [in]: training parameters
+ * @centroids [out]: cfg->nlist * dim
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_ivf_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			  const struct l2_ivf_train_cfg *cfg, int32_t *centroids);
+
+/*
+ * Bucket vecs by nearest centroid into a new index; ids are row indices of vecs
+ *
+ * @be [in]: backend, its arena needs room for n vectors plus the assignment matrix
+ * @centroids [in]: nlist * dim, copied into the index
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_ivf_build(struct l2_backend *be, uint32_t dim, uint32_t nlist, const int32_t *centroids,
+			  const int32_t *vecs, uint32_t n, struct l2_ivf *ivf);
+
+void l2_ivf_free(struct l2_backend *be, struct l2_ivf *ivf);
+
+/* Write a built index (centroids, offsets, ids, vectors) to path */
+doca_error_t l2_ivf_save(const struct l2_ivf *ivf, const char *path);
+
+/* Read an index written by l2_ivf_save() into backend memory */
+doca_error_t l2_ivf_load(struct l2_backend *be, const char *path, struct l2_ivf *ivf);
+
+/*
+ * Allocate search state
+ *
+ * @be [in]: backend, its num_threads fixes the number of heap segments
+ * @ivf [in]: index
+ * @max_nq [in]: largest number of queries per search
+ * @k [in]: neighbours per query, at most L2_SEARCH_MAX_K
+ * @search [out]: search state
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_ivf_search_alloc(struct l2_backend *be, const struct l2_ivf *ivf, uint32_t max_nq, uint32_t k,
+				 struct l2_ivf_search *search);
+
+void l2_ivf_search_free(struct l2_backend *be, struct l2_ivf_search *search);
+
+/*
+ * k-NN of the first nq queries in search->queries, scanning the nprobe nearest lists of each
+ *
+ * @nprobe [in]: lists per query, 1..nlist
+ * @results [out]: nq * k hits, each query sorted by (dist, id)
+ * @stats [in/out]: counters are added to, so one struct can cover many calls; may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_ivf_search(struct l2_backend *be, const struct l2_ivf *ivf, struct l2_ivf_search *search,
+			   uint32_t nq, uint32_t nprobe, struct l2_hit *results, struct l2_ivf_search_stats *stats);
@@ -0,0 +1,44 @@
+#pragma once
+/*
+ * k-means over Q16.16 vectors, shared by the IVF coarse quantizer and the PQ
+ * sub-codebooks.
+ *
+ * The assignment step is a vectors x centroids distance matrix on the
+ * backend (l2_matrix), so it runs wherever the distance kernels run; the
+ * centroid update is a host pass. Empty clusters are re-seeded from a random
+ * member of the largest cluster.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+struct l2_kmeans_cfg {
+	uint32_t k;
+	uint32_t iters;		/* 0 = 10 */
+	uint32_t max_train;	/* 训练集上限，0 = 256 * k，多了随机抽样 */
+	uint64_t seed;		/* 0 = 固定默认值 */
+};
+
+/*
+ * Train cfg->k centroids
+ *
+ * @be [in]: backend running the assignment step, its arena needs room for a chunk x k matrix
+ * @vecs [in]: n * dim training candidates
+ * @cfg [in]: training parameters
+ * @centroids [out]: cfg->k * dim
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_kmeans_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			     const struct l2_kmeans_cfg *cfg, int32_t *centroids);
+
+/*
+ * Nearest centroid of every vector, computed as an n x k distance matrix on the backend
+ *
+ * @assign [out]: n centroid indices, ties go to the lower index
+ * @obj [out]: sum of the squared distances to the assigned centroids, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_kmeans_assign(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			      const int32_t *centroids, uint32_t k, uint32_t *assign, double *obj);
@@ -0,0 +1,47 @@
+#pragma once
+/*
+ * Vector layouts for pairwise batches.
+ *
+ * AOS is one dim-long row per vector, walked by l2_batch_kernel with rank
+ * striding. BLOCKED groups L2_BLOCK_VECS vectors and transposes each group
+ * (SoA): element i of vector v sits at block v / L2_BLOCK_VECS, offset
+ * i * L2_BLOCK_VECS + v % L2_BLOCK_VECS. l2_batch_blocked_kernel hands every
+ * thread a contiguous run of blocks, so each thread reads one sequential
+ * stream per operand and needs one address translation per block instead of
+ * one per vector. The last block is zero-padded.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "args.h"
+
+enum l2_layout {
+	L2_LAYOUT_AOS,
+	L2_LAYOUT_BLOCKED,
+	L2_LAYOUT_MAX,
+};
+
+const char *l2_layout_name(enum l2_layout layout);
+
+/* "aos" / "blocked" -> layout, L2_LAYOUT_MAX if unknown */
+enum l2_layout l2_layout_from_name(const char *name);
+
+/* Bytes taken by n vectors of dim int32 in the given layout */
+static inline size_t l2_layout_vec_bytes(enum l2_layout layout, uint32_t dim, uint32_t n)
+{
+	if (layout == L2_LAYOUT_BLOCKED)
+		n = (n + L2_BLOCK_VECS - 1) / L2_BLOCK_VECS * L2_BLOCK_VECS;
+	return (size_t)n * dim * sizeof(int32_t);
+}
+
+/* Index of element i of vector v in a blocked buffer */
+static inline size_t l2_blocked_index(uint32_t dim, uint32_t v, uint32_t i)
+{
+	return ((size_t)(v / L2_BLOCK_VECS) * dim + i) * L2_BLOCK_VECS + v % L2_BLOCK_VECS;
+}
+
+/* Row-major n x dim -> blocked, padding lanes of the last block are zeroed */
+void l2_layout_aos_to_blocked(const int32_t *src, uint32_t dim, uint32_t n, int32_t *dst);
+
+/* Blocked -> row-major n x dim */
+void l2_layout_blocked_to_aos(const int32_t *src, uint32_t dim, uint32_t n, int32_t *dst);
@@ -0,0 +1,73 @@
+#pragma once
+/*
+ * All-pairs distance matrix: M query vectors x N reference vectors.
+ *
+ * Instead of M * N pairs in l2_batch_kernel (with a and b duplicated to match),
+ * each vector is stored once and the matrix is built from
+ * ||a||^2 + ||b||^2 - 2 a.b. Norms are computed once on the host when a side
+ * changes; l2_matrix_kernel only computes dot products, in 4 x 4 register
+ * tiles, so every row read feeds four distances. Input traffic drops from
+ * O(M * N * dim) to O((M + N) * dim) plus the M x N result. All arithmetic
+ * wraps modulo 2^64, so results are bit-identical to summing (a - b)^2.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+enum l2_matrix_side {
+	L2_MATRIX_A = 1 << 0,
+	L2_MATRIX_B = 1 << 1,
+};
+
+/* a, b, their norms and the result matrix in one region */
+struct l2_matrix {
+	struct dpa_region mem;
+	int32_t *a;		/* max_m * dim，调用方填 */
+	int32_t *b;		/* n * dim，调用方填 */
+	uint64_t *a_norm;
+	uint64_t *b_norm;
+	uint64_t *out;		/* 行 i 从 out + i * out_stride / 8 开始 */
+	uint64_t out_stride;	/* 字节，按 64 字节对齐 */
+	uint32_t dim;
+	uint32_t max_m;
+	uint32_t n;
+	uint32_t m;		/* 最近一次 submit 的行数 */
+	uint64_t seq;
+};
+
+/*
+ * Allocate the matrix region
+ *
+ * @be [in]: backend
+ * @dim [in]: vector dimension
+ * @max_m [in]: largest number of a rows per submit
+ * @n [in]: number of b rows
+ * @mat [out]: matrix context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_matrix_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_m, uint32_t n,
+			     struct l2_matrix *mat);
+
+void l2_matrix_free(struct l2_backend *be, struct l2_matrix *mat);
+
+/*
+ * Recompute the norms of the first m rows of a and / or all rows of b; call after filling them.
+ * b is typically fixed (centroids, a candidate pool), so only the side that changed needs it.
+ */
+void l2_matrix_update_norms(struct l2_matrix *mat, uint32_t m, unsigned int sides);
+
+/* Fill l2_matrix_args for the first m rows of a */
+void l2_matrix_fill_args(const struct l2_matrix *mat, uint32_t m, struct l2_matrix_args *args);
+
+/* Launch l2_matrix_kernel for the first m rows of a, norms must be up to date */
+doca_error_t l2_matrix_submit(struct l2_backend *be, struct l2_matrix *mat, uint32_t m);
+
+doca_error_t l2_matrix_wait(struct l2_backend *be, struct l2_matrix *mat);
+
+/* Row i of the last result */
+static inline const uint64_t *l2_matrix_row(const struct l2_matrix *mat, uint32_t i)
+{
+	return (const uint64_t *)((const uint8_t *)mat->out + (uint64_t)i * mat->out_stride);
+}
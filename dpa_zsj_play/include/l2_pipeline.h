@@ -0,0 +1,79 @@
+#pragma once
+/*
+ * Pipelined streaming of pairwise batches through a ring of staging slots.
+ *
+ * The registered region holds K slots of (a, b, out) for slot_vectors pairs
+ * each. Batch n uses slot n % K and is launched behind the pipeline's
+ * "staged" event with threshold n: on backends that can defer (dpa / emu)
+ * the launch is posted before the host fills the slot, and the kernel starts
+ * as soon as the host publishes staged = n + 1. Before slot s is refilled
+ * the host waits for the completion of the batch that used it K launches
+ * earlier and hands its distances to the drain callback. Host staging of
+ * batch n + 1 .. n + K - 1 therefore overlaps device compute on batch n.
+ *
+ * Inline backends (cpu / host) run the same schedule without overlap, which
+ * keeps the slot / threshold bookkeeping testable off-device.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+/*
+ * Fill one slot: pairs [first, first + count) of the stream, dim int32 Q16.16 per vector.
+ * Returning an error stops the stream.
+ */
+typedef doca_error_t (*l2_pipeline_stage_fn)(void *ctx, uint64_t first, uint32_t count, int32_t *a, int32_t *b);
+
+/* Consume the distances of pairs [first, first + count), out is only valid during the call */
+typedef void (*l2_pipeline_drain_fn)(void *ctx, uint64_t first, uint32_t count, const uint64_t *out);
+
+struct l2_pipeline_cfg {
+	uint32_t dim;
+	uint32_t slot_vectors;		/* 每个 slot（每次 launch）的向量对数 */
+	uint32_t num_slots;		/* K，1 = 串行 stage + launch + wait */
+	l2_pipeline_stage_fn stage;
+	l2_pipeline_drain_fn drain;	/* 可以为 NULL */
+	void *ctx;
+};
+
+struct l2_pipeline_stats {
+	uint64_t launches;
+	uint64_t stage_ns;	/* host 填 slot 的时间 */
+	uint64_t slot_wait_ns;	/* host 等 slot 空出来（即等设备）的时间 */
+	uint64_t total_ns;
+};
+
+struct l2_pipeline {
+	struct l2_backend *be;
+	struct l2_pipeline_cfg cfg;
+	struct dpa_region mem;
+	struct l2_batch *slots;		/* 指向 mem 内部的视图，不能单独 free */
+	uint64_t *slot_seq;		/* slot 上最近一次 launch 的 seq */
+	uint64_t *slot_first;		/* slot 上那一批的起始下标 */
+	uint32_t *slot_count;
+	struct l2_event *staged;	/* 已经填好的 batch 数，单调递增，跨 run 累计 */
+	uint64_t published;
+	struct l2_pipeline_stats stats;
+};
+
+/*
+ * Allocate the slot ring in backend memory and the staged event
+ *
+ * @be [in]: backend
+ * @cfg [in]: pipeline shape and callbacks
+ * @pl [out]: pipeline
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pipeline_create(struct l2_backend *be, const struct l2_pipeline_cfg *cfg, struct l2_pipeline *pl);
+
+void l2_pipeline_destroy(struct l2_pipeline *pl);
+
+/*
+ * Stream num_pairs pairs through the ring; returns after the last batch was drained.
+ * Statistics accumulate in pl->stats.
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pipeline_run(struct l2_pipeline *pl, uint64_t num_pairs);
@@ -0,0 +1,64 @@
+#pragma once
+/*
+ * Host worker pool with pinned threads and work stealing.
+ *
+ * A run is split into num_tasks tasks. Worker w starts on the contiguous
+ * task range [w * T / W, (w + 1) * T / W) and pops from its front; a worker
+ * that runs dry steals from the back of the other ranges, nearest worker
+ * first. Workers are pinned to the allowed CPUs ordered by NUMA node, so
+ * neighbouring workers (and therefore most steals) stay on one node, and a
+ * static run over the same ranges places pages with first-touch on the node
+ * that will later compute on them.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include <doca_error.h>
+
+/* Runs task on some worker; worker is the index of the worker running it */
+typedef void (*l2_pool_task_fn)(void *ctx, uint32_t task, unsigned int worker);
+
+struct l2_pool_cfg {
+	unsigned int num_workers;	/* 0 = 进程允许使用的所有 CPU */
+	int no_pin;			/* 1: 不绑核 */
+};
+
+struct l2_pool_stats {
+	uint64_t runs;
+	uint64_t tasks;
+	uint64_t steals;	/* 从别的 worker 范围里拿到的 task 数 */
+};
+
+struct l2_pool;
+
+/*
+ * Start the workers
+ *
+ * @cfg [in]: pool configuration, may be NULL for defaults
+ * @pool [out]: created pool
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pool_create(const struct l2_pool_cfg *cfg, struct l2_pool **pool);
+
+void l2_pool_destroy(struct l2_pool *pool);
+
+unsigned int l2_pool_size(const struct l2_pool *pool);
+
+/*
+ * Run tasks [0, num_tasks) with work stealing and return when all are done.
+ * Concurrent runs are serialized; must not be called from inside a task.
+ */
+void l2_pool_run(struct l2_pool *pool, uint32_t num_tasks, l2_pool_task_fn fn, void *ctx);
+
+/* Same, but every worker only runs its own initial range (placement-sensitive work) */
+void l2_pool_run_static(struct l2_pool *pool, uint32_t num_tasks, l2_pool_task_fn fn, void *ctx);
+
+/*
+ * Fault in [addr, addr + len) so that the page under byte i lands on the node of the worker that owns
+ * element i when the buffer is processed as num_tasks equal contiguous tasks. Contents are preserved.
+ * Pages that are already faulted in (arena blocks recycled from the free list, memory touched by
+ * registration) are migrated with move_pages() when the workers span more than one node.
+ */
+void l2_pool_first_touch(struct l2_pool *pool, void *addr, size_t len, uint32_t num_tasks);
+
+void l2_pool_get_stats(struct l2_pool *pool, struct l2_pool_stats *stats);
@@ -0,0 +1,100 @@
+#pragma once
+/*
+ * Product quantization (PQ) over Q16.16 vectors.
+ *
+ * A vector is cut into m subvectors of dsub = dim / m elements; each subspace
+ * has its own 256-entry codebook trained with l2_kmeans, and a vector is
+ * stored as m one-byte codeword indices (4 * dim / m times smaller than the
+ * int32 rows). A search builds, per query on the host, the m x 256 table of
+ * partial distances ||q_j - C_j[c]||^2 quantized to uint16 (asymmetric
+ * distance computation, ADC), and l2_pq_kernel sums m table entries per code.
+ * Distances in the results are approximations of ||q - x||^2 in 2Q(2q).
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+struct l2_pq_train_cfg {
+	uint32_t m;		/* 子空间个数，dim 要能被 m 整除 */
+	uint32_t iters;		/* 0 = 10 */
+	uint32_t max_train;	/* 每个子空间的训练集上限，0 = 256 * 256 */
+	uint64_t seed;
+};
+
+struct l2_pq {
+	int32_t *codebooks;	/* host 内存，m * 256 * dsub，子空间 j 的码字 c 在 (j * 256 + c) * dsub */
+	uint32_t dim;
+	uint32_t m;
+	uint32_t dsub;
+};
+
+struct l2_pq_codes {
+	struct dpa_region mem;
+	uint8_t *codes;		/* n * m */
+	uint32_t n;
+	uint32_t m;
+};
+
+/* Per-caller search state: ADC tables and per-thread heaps */
+struct l2_pq_search {
+	struct dpa_region mem;	/* [luts][parts] */
+	uint16_t *luts;		/* max_nq 张表，每张 lut_stride 字节 */
+	struct l2_hit *parts;	/* max_nq * num_parts * k */
+	uint64_t lut_stride;
+	uint64_t *partial;	/* host 内存，m * 256，建表时的精确部分距离 */
+	uint64_t *bias;		/* host 内存，每个 query 的 sum_j min_c，2Q(2q) */
+	double *scale;		/* host 内存，表内单位 -> 2Q(2q) */
+	uint32_t max_nq;
+	uint32_t k;
+	uint32_t num_parts;
+	uint64_t seq;
+};
+
+struct l2_pq_search_stats {
+	uint64_t lut_ns;	/* 建表 */
+	uint64_t scan_ns;	/* 扫 code + 合并 */
+};
+
+/*
+ * Train the m sub-codebooks
+ *
+ * @be [in]: backend running the k-means assignment steps
+ * @vecs [in]: n * dim training vectors, n >= 256
+ * @cfg [in]: training parameters
+ * @pq [out]: quantizer, release with l2_pq_free()
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pq_train(struct l2_backend *be, const int32_t *vecs, uint32_t n, uint32_t dim,
+			 const struct l2_pq_train_cfg *cfg, struct l2_pq *pq);
+
+void l2_pq_free(struct l2_pq *pq);
+
+/*
+ * Encode vecs into a new code region; code i is the PQ code of row i
+ *
+ * @be [in]: backend, its arena needs room for the codes plus an assignment matrix
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pq_encode(struct l2_backend *be, const struct l2_pq *pq, const int32_t *vecs, uint32_t n,
+			  struct l2_pq_codes *codes);
+
+void l2_pq_codes_free(struct l2_backend *be, struct l2_pq_codes *codes);
+
+doca_error_t l2_pq_search_alloc(struct l2_backend *be, const struct l2_pq *pq, uint32_t max_nq, uint32_t k,
+				struct l2_pq_search *search);
+
+void l2_pq_search_free(struct l2_backend *be, struct l2_pq_search *search);
+
+/*
+ * k approximate nearest codes for each query, sorted by (dist, id)
+ *
+ * @queries [in]: nq * dim Q16.16 vectors in host memory
+ * @results [out]: nq * search->k hits, ids are code indices
+ * @stats [in/out]: counters are added to, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_pq_search(struct l2_backend *be, const struct l2_pq *pq, const struct l2_pq_codes *codes,
+			  struct l2_pq_search *search, const int32_t *queries, uint32_t nq, struct l2_hit *results,
+			  struct l2_pq_search_stats *stats);
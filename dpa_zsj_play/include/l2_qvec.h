@@ -0,0 +1,31 @@
+#pragma once
+/*
+ * int8 / int16 vector rows (l2_qvec_hdr + codes, see args.h), shared by the
+ * DPA kernels, the emulator and the host paths (no libc). Only the raw dot
+ * product of the codes depends on the data; everything else comes from the
+ * two headers, so every backend ends up with the same 2Q(2q) value.
+ */
+#include <stdint.h>
+
+#include "args.h"
+
+/* code 紧跟在 header 后面 */
+static inline const void *l2_qvec_codes(const struct l2_qvec_hdr *hdr)
+{
+	return (const uint8_t *)hdr + sizeof(*hdr);
+}
+
+/*
+ * 由 raw 点积 dot = sum_i qa_i * qb_i 和两个 header 算 ||Xa - Xb||^2（2Q(2 * frac_bits)）。
+ * 乘法都在 uint64 上做，溢出按 2^64 回绕，和逐元素算差的平方再累加相同。
+ */
+static inline uint64_t l2_qvec_dist(const struct l2_qvec_hdr *a, const struct l2_qvec_hdr *b, int64_t dot,
+				    uint32_t dim)
+{
+	uint64_t sa = (uint64_t)(int64_t)a->scale, sb = (uint64_t)(int64_t)b->scale;
+	uint64_t za = (uint64_t)(int64_t)a->zero, zb = (uint64_t)(int64_t)b->zero;
+	/* sum_i (qa_i - za) * (qb_i - zb) */
+	uint64_t cross = (uint64_t)dot - zb * (uint64_t)a->sum - za * (uint64_t)b->sum + (uint64_t)dim * za * zb;
+
+	return sa * sa * (uint64_t)a->norm + sb * sb * (uint64_t)b->norm - 2 * sa * sb * cross;
+}
@@ -0,0 +1,92 @@
+#pragma once
+/*
+ * Radius search: every (query, vector) pair with ||q - v||^2 <= radius.
+ *
+ * A pairwise batch writes one uint64_t per pair (8 MB per 1M pairs) even
+ * when only a handful fall under the threshold, as in dedup and
+ * near-duplicate detection. l2_range_kernel instead appends each hit to the
+ * thread's own fixed-size segment of cap (q, id, dist) records and writes
+ * one hit count per thread, so writeback scales with the number of hits.
+ *
+ * l2_range_wait() reads the num_parts counts and then only the hits each
+ * segment actually holds, never the unused tail. Threads own contiguous row
+ * ranges and loop over queries outside rows, so every segment is already
+ * ordered by (q, id) and the gather is a merge without sorting. A count
+ * above cap means that segment overflowed: the surplus hits were counted
+ * but not stored, and the caller should retry with a larger cap or a
+ * smaller batch.
+ *
+ * With abandon_block != 0 a pair is evaluated abandon_block dimensions at a
+ * time and dropped as soon as the partial sum exceeds the radius, the same
+ * early abandoning as l2_search; the hits do not change.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+#include "l2_search.h"
+
+/* Query + segment region for up to max_nq queries */
+struct l2_range {
+	struct dpa_region mem;		/* [queries][counts][segs] */
+	int32_t *queries;		/* max_nq * dim，调用方填 */
+	uint64_t *counts;		/* num_parts，kernel 写 */
+	struct l2_range_hit *segs;	/* num_parts * cap，kernel 写 */
+	uint64_t *abandon;		/* num_parts * L2_ABANDON_STATS，abandon_block != 0 时 kernel 写 */
+	uint32_t abandon_block;		/* 调用方设，0 = 每对都算满 dim 维 */
+	uint64_t *cursor;		/* host 内存，num_parts，合并段用 */
+	uint32_t dim;
+	uint32_t max_nq;
+	uint32_t cap;
+	uint32_t num_parts;
+	uint32_t nq;			/* 最近一次 submit 的 query 数 */
+	uint64_t seq;
+};
+
+struct l2_range_stats {
+	uint64_t hits;		/* 返回的命中数 */
+	uint64_t dropped;	/* 段溢出丢掉的命中数，> 0 时结果不完整 */
+	uint32_t overflowed;	/* 溢出的段数 */
+	struct l2_abandon_stats abandon;	/* abandon_block 为 0 时全 0 */
+};
+
+/*
+ * Allocate query and segment regions
+ *
+ * @be [in]: backend, its num_threads fixes the number of segments
+ * @dim [in]: vector dimension
+ * @max_nq [in]: largest number of queries per submit
+ * @cap [in]: hits each thread can store per launch
+ * @range [out]: range search context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_range_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_nq, uint32_t cap,
+			    struct l2_range *range);
+
+void l2_range_free(struct l2_backend *be, struct l2_range *range);
+
+/* Fill l2_range_args for db rows [first, first + count) */
+void l2_range_fill_args(const struct l2_db *db, uint32_t first, uint32_t count, const struct l2_range *range,
+			uint32_t nq, uint64_t radius, struct l2_range_args *args);
+
+/*
+ * Launch l2_range_kernel for the first nq queries in range->queries
+ *
+ * @radius [in]: squared radius, 2Q(2q) like the distances, inclusive
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_range_submit(struct l2_backend *be, const struct l2_db *db, struct l2_range *range, uint32_t nq,
+			     uint64_t radius);
+
+/*
+ * Wait for the launch and gather the segments
+ *
+ * @hits [out]: at least num_parts * cap entries, hits of query q are
+ *	hits[offsets[q], offsets[q + 1]) sorted by id
+ * @offsets [out]: nq + 1 entries
+ * @stats [out]: hit / overflow counts, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise; an overflow is not an error, see stats->dropped
+ */
+doca_error_t l2_range_wait(struct l2_backend *be, struct l2_range *range, struct l2_range_hit *hits,
+			   uint64_t *offsets, struct l2_range_stats *stats);
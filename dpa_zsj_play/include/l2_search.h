@@ -0,0 +1,107 @@
+#pragma once
+/*
+ * k-NN search: a few queries against a database held in backend memory.
+ *
+ * l2_search_kernel keeps a top-k heap per DPA thread and writes back only
+ * num_threads * k (id, dist) pairs per query; l2_search_wait() merges them on
+ * the host. The same args run on the cpu / host / emu backends, so results
+ * can be checked without hardware. For a single query against N vectors
+ * without top-k, l2_batch_args with b_stride = 0 broadcasts the query.
+ *
+ * With abandon_block != 0 each thread evaluates a candidate abandon_block
+ * dimensions at a time and stops as soon as the partial sum exceeds its
+ * current k-th distance: the squared terms are non-negative, so such a
+ * candidate can never enter the heap. Results are identical to the full
+ * scan as long as distances do not wrap around 2^64. How much is saved
+ * depends on how early the partial sums grow; l2_dim_order_compute() puts
+ * the highest-variance dimensions first, applied to both the database and
+ * the queries it leaves every distance unchanged.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+/* Database vectors, dim int32 Q16.16 each, filled by the caller */
+struct l2_db {
+	struct dpa_region mem;
+	int32_t *vecs;
+	uint32_t dim;
+	uint32_t size;
+	uint32_t id_base;	/* 第 0 行的全局 id，分块装载时用 */
+};
+
+/* Query + per-thread heap region for up to max_nq queries */
+struct l2_search {
+	struct dpa_region mem;
+	int32_t *queries;	/* max_nq * dim，调用方填 */
+	struct l2_hit *parts;	/* max_nq * num_parts * k，kernel 写 */
+	uint64_t *abandon;	/* num_parts * L2_ABANDON_STATS，abandon_block != 0 时 kernel 写 */
+	uint32_t abandon_block;	/* 调用方设，0 = 每个候选都算满 dim 维 */
+	const uint64_t *filter;	/* 调用方设，arena 里 db 行的 allow bitmap，NULL = 不过滤（见 l2_filter.h） */
+	uint32_t dim;
+	uint32_t max_nq;
+	uint32_t k;
+	uint32_t num_parts;
+	uint32_t nq;		/* 最近一次 submit 的 query 数 */
+	uint64_t seq;
+};
+
+/* Work done by the last early-abandon launch, summed over the threads */
+struct l2_abandon_stats {
+	uint64_t dims;		/* 实际算过的维数 */
+	uint64_t candidates;	/* 比较过的候选数，算满是 candidates * dim */
+};
+
+doca_error_t l2_db_alloc(struct l2_backend *be, uint32_t dim, uint32_t size, struct l2_db *db);
+
+void l2_db_free(struct l2_backend *be, struct l2_db *db);
+
+/*
+ * Allocate query and result regions
+ *
+ * @be [in]: backend, its num_threads fixes the number of heap segments
+ * @dim [in]: vector dimension
+ * @max_nq [in]: largest number of queries per submit
+ * @k [in]: neighbours per query, at most L2_SEARCH_MAX_K
+ * @search [out]: search context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_search_alloc(struct l2_backend *be, uint32_t dim, uint32_t max_nq, uint32_t k,
+			     struct l2_search *search);
+
+void l2_search_free(struct l2_backend *be, struct l2_search *search);
+
+/* Fill l2_search_args for db rows [first, first + count) */
+void l2_search_fill_args(const struct l2_db *db, uint32_t first, uint32_t count, const struct l2_search *search,
+			 uint32_t nq, struct l2_search_args *args);
+
+/* Launch l2_search_kernel for the first nq queries in search->queries */
+doca_error_t l2_search_submit(struct l2_backend *be, const struct l2_db *db, struct l2_search *search, uint32_t nq);
+
+/*
+ * Wait for the search and merge the per-thread heaps
+ *
+ * @results [out]: nq * k hits, each query sorted by (dist, id); empty slots have id L2_HIT_EMPTY_ID
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_search_wait(struct l2_backend *be, struct l2_search *search, struct l2_hit *results);
+
+/* Sum the per-thread counters of the last launch, zero when abandon_block was 0 */
+void l2_search_abandon_stats(const struct l2_search *search, struct l2_abandon_stats *stats);
+
+/*
+ * Dimension order for early abandoning: dimensions by decreasing variance over vecs
+ *
+ * @vecs [in]: n * dim Q16.16 sample of the database
+ * @perm [out]: dim entries, position j of a reordered vector holds dimension perm[j]
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_dim_order_compute(const int32_t *vecs, uint32_t n, uint32_t dim, uint32_t *perm);
+
+/* dst[i][j] = src[i][perm[j]] for n vectors; src and dst must not overlap */
+void l2_dim_order_apply(const uint32_t *perm, const int32_t *src, int32_t *dst, uint32_t n, uint32_t dim);
+
+/* Merge nparts unsorted top-k lists of one query into a sorted top-k */
+void l2_topk_merge(const struct l2_hit *parts, uint32_t nparts, uint32_t k, struct l2_hit *out);
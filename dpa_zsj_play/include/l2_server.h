@@ -0,0 +1,118 @@
+#pragma once
+/*
+ * Micro-batching k-NN query server over one database.
+ *
+ * Clients submit single queries from any thread (l2_server_query) or over a
+ * Unix domain socket (l2_server_listen). A dispatcher thread coalesces the
+ * pending queries into one l2_search_kernel launch as soon as max_batch of
+ * them are queued or the oldest has waited deadline_us, whichever comes
+ * first, and submits it through an l2_engine. Each in-flight batch owns a
+ * search slot; while one runs the dispatcher already gathers the next, so
+ * under load batches fill up on their own and at low load a query waits at
+ * most the deadline. The engine's completion thread merges the per-thread
+ * heaps straight into each caller's result buffer and wakes the caller.
+ *
+ * max_batch and deadline_us pick the throughput / latency point: a search
+ * launch costs about the same for 1 or 32 queries until the scan becomes
+ * compute bound, so larger batches amortize the launch and the database
+ * pass, at the price of queueing delay.
+ *
+ * Per-query latency is recorded in three histograms (queue: arrival ->
+ * dispatch, service: dispatch -> results merged, total), plus one for the
+ * batch sizes; l2_server_get_stats() returns a snapshot.
+ *
+ * Socket protocol, native byte order: after accept the server sends
+ * struct l2_server_hello; then each request is dim int32 Q16.16 values and
+ * its reply is k struct l2_hit. Requests on one connection are served in
+ * order; concurrency comes from several connections.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+#include "l2_hist.h"
+#include "l2_search.h"
+
+#define L2_SERVER_MAX_SLOTS 8
+#define L2_SERVER_MAX_CONN 64
+
+struct l2_server_cfg {
+	struct l2_backend *be;		/* server 存在期间只能由它 launch */
+	const struct l2_db *db;		/* be 的 arena 里，调用方拥有 */
+	uint32_t k;			/* 每个 query 的近邻数，<= L2_SEARCH_MAX_K */
+	uint32_t max_batch;		/* 一次 launch 最多的 query 数，0 = 32 */
+	uint32_t deadline_us;		/* 最老的 query 最多等这么久就发车，0 = 200 */
+	uint32_t slots;			/* 同时在飞的 batch 数，0 = 2，最多 L2_SERVER_MAX_SLOTS */
+	uint32_t queue_depth;		/* 等待队列长度，满了 l2_server_query 阻塞，0 = 4 * max_batch */
+};
+
+struct l2_server_stats {
+	uint64_t queries;		/* 已返回结果的 query 数 */
+	uint64_t batches;		/* 已发出的 launch 数 */
+	uint64_t full_batches;		/* 因为凑满 max_batch 发车 */
+	uint64_t deadline_batches;	/* 因为 deadline 到了发车 */
+	uint64_t errors;		/* 返回错误的 query 数 */
+	struct l2_hist batch_size;	/* 每个 launch 的 query 数 */
+	struct l2_hist queue_ns;	/* 到达 -> 发车 */
+	struct l2_hist service_ns;	/* 发车 -> 结果合并完 */
+	struct l2_hist total_ns;
+};
+
+/* First message on every socket connection */
+struct l2_server_hello {
+	uint32_t dim;
+	uint32_t k;
+};
+
+struct l2_server;
+
+/*
+ * Create a server: allocates the search slots, an engine over cfg->be and the dispatcher thread
+ *
+ * @cfg [in]: configuration, be and db stay owned by the caller
+ * @server [out]: created server
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_server_create(const struct l2_server_cfg *cfg, struct l2_server **server);
+
+/* Closes the socket and its connections, answers every query already queued, then frees the server */
+void l2_server_destroy(struct l2_server *server);
+
+/*
+ * Run one query; blocks until its batch has completed. Thread safe.
+ *
+ * @server [in]: server
+ * @query [in]: dim int32 Q16.16 values, read only until the query is dispatched
+ * @out [out]: k hits sorted by (dist, id), empty slots have id L2_HIT_EMPTY_ID
+ * @return: DOCA_SUCCESS on success, DOCA_ERROR_BAD_STATE once the server is shutting down
+ */
+doca_error_t l2_server_query(struct l2_server *server, const int32_t *query, struct l2_hit *out);
+
+/*
+ * Accept queries on a Unix domain socket, one thread per connection
+ *
+ * @server [in]: server, at most one listening socket
+ * @path [in]: socket path, an existing file there is replaced
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_server_listen(struct l2_server *server, const char *path);
+
+void l2_server_get_stats(struct l2_server *server, struct l2_server_stats *stats);
+
+/* Print the batch and latency summary of stats to stdout */
+void l2_server_print_stats(const struct l2_server_stats *stats);
+
+/*
+ * Client side of the socket protocol: connect and read the hello
+ *
+ * @path [in]: socket path passed to l2_server_listen()
+ * @fd [out]: connected socket
+ * @hello [out]: dim and k the server expects / returns
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_server_connect(const char *path, int *fd, struct l2_server_hello *hello);
+
+/* Send one query (hello.dim values) and read its hello.k hits */
+doca_error_t l2_server_remote_query(int fd, const struct l2_server_hello *hello, const int32_t *query,
+				    struct l2_hit *out);
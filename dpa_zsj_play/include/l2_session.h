@@ -0,0 +1,93 @@
+#pragma once
+/*
+ * Long-lived engine session: open once, serve many batch jobs.
+ *
+ * A one-shot run pays the whole startup for every job: open the DPA device
+ * (allocate_dpa_resources), create the completion event, register the
+ * arena, allocate staging buffers, load the kernel, and tear all of it
+ * down on exit. A session does that once. It keeps the backend (completion
+ * event and registered arena) and an l2_pipeline whose staging slots and
+ * "staged" event live as long as the session. The pipeline's published
+ * threshold only grows, so the same events gate every launch of every job.
+ * l2_session_open() then warms the session by streaming zero pairs through
+ * every slot, which loads the batch kernel variant for dim, first-touches
+ * the slots and spins up the emulator / host worker threads.
+ *
+ * The open cost is broken down in l2_session_open_stats. With warmup
+ * disabled the first job carries the lazy part of it, which is what a cold
+ * per-job run looks like.
+ *
+ * With cfg->resources == NULL and type dpa the session opens (and on close
+ * destroys) its own device from cfg->dpa; the other backends need no
+ * device, so the whole lifecycle runs on the emu backend without hardware.
+ * Jobs from several threads are serialized on the session.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+
+struct dpa_config;
+
+struct l2_session_cfg {
+	enum l2_backend_type type;
+	struct dpa_resources *resources;	/* 已经打开的设备，NULL 时 dpa 由 session 自己打开 */
+	struct dpa_config *dpa;			/* resources 为 NULL 时打开的设备 */
+	unsigned int num_threads;		/* kernel ranks per launch, 0 = 64 */
+	size_t arena_size;			/* 0 = staging 区 + 16 MB */
+	enum dpa_arena_page arena_page;
+	uint32_t dim;
+	uint32_t slot_vectors;			/* 每次 launch 的向量对数，0 = 64K */
+	uint32_t num_slots;			/* staging 槽数，0 = 2 */
+	int no_warmup;				/* 1: open 时不预热，第一个 job 付冷启动 */
+};
+
+/* Where l2_session_open() spent its time */
+struct l2_session_open_stats {
+	uint64_t device_ns;	/* allocate_dpa_resources，设备已打开 / 非 dpa 时为 0 */
+	uint64_t backend_ns;	/* completion event、arena 注册、emulator / worker 线程 */
+	uint64_t staging_ns;	/* staging 槽 + staged event */
+	uint64_t warmup_ns;	/* 每个槽跑一遍零向量 */
+	uint64_t total_ns;
+};
+
+struct l2_session_stats {
+	struct l2_session_open_stats open;
+	uint64_t jobs;
+	uint64_t pairs;
+	uint64_t launches;
+	uint64_t first_job_ns;	/* open 之后第一个 job 的耗时 */
+	uint64_t job_ns;	/* 所有 job 的耗时之和 */
+};
+
+struct l2_session;
+
+/*
+ * Open a session: device (if needed), backend, staging slots, warmup
+ *
+ * @cfg [in]: configuration, copied
+ * @session [out]: opened session
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_session_open(const struct l2_session_cfg *cfg, struct l2_session **session);
+
+/* Wait for outstanding launches, free everything and close the device if the session opened it */
+void l2_session_close(struct l2_session *session);
+
+/*
+ * Run one job: out[i] = ||a[i] - b[i]||^2 for num_pairs pairs, streamed through the staging slots
+ *
+ * @a [in]: num_pairs * dim int32 Q16.16 values in host memory
+ * @b [in]: same layout as a
+ * @out [out]: num_pairs distances in 2Q(2q)
+ * @job_ns [out]: wall time of this job, may be NULL
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_session_run(struct l2_session *session, const int32_t *a, const int32_t *b, uint64_t num_pairs,
+			    uint64_t *out, uint64_t *job_ns);
+
+/* Backend of the session, for other APIs (search, range, ...) sharing its arena; not thread safe against jobs */
+struct l2_backend *l2_session_backend(struct l2_session *session);
+
+void l2_session_get_stats(struct l2_session *session, struct l2_session_stats *stats);
@@ -0,0 +1,112 @@
+#pragma once
+/*
+ * Database sharded over several devices.
+ *
+ * One DPA context caps throughput at what its execution units can scan.
+ * l2_shards_open() opens num_shards backends - one DPA device each for the
+ * dpa backend, otherwise independent emu / host / cpu instances standing in
+ * for them - and gives every shard its own registered arena holding a
+ * contiguous slice of the database, rows [first, first + rows). The slices
+ * keep their global row numbers as id_base, so hits need no remapping.
+ *
+ * A query batch is fanned out to all shards at once: one pool worker per
+ * shard copies the queries into the shard's arena, launches and waits, so
+ * the inline host / cpu backends run concurrently too. The host then merges
+ * the num_shards top-k lists of each query (l2_shards_search), or places
+ * each shard's distances at its rows (l2_shards_distances). Every fan-out
+ * records per-shard wall time; l2_shard_stats shows the slowest shard
+ * against the mean, which is the imbalance the whole batch waits on.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#include "l2_backend.h"
+#include "l2_search.h"
+
+#define L2_SHARD_MAX 16
+
+struct dpa_config;
+
+struct l2_shards_cfg {
+	enum l2_backend_type type;
+	uint32_t num_shards;			/* 1 .. L2_SHARD_MAX */
+	const char *devices[L2_SHARD_MAX];	/* dpa: 每个 shard 打开的 IB 设备，其他 backend 只是名字，可以为 NULL */
+	struct dpa_config *dpa;			/* dpa: 设备以外的参数从这里拷 */
+	unsigned int num_threads;		/* 每个 shard 的 kernel rank 数，0 = 64 */
+	unsigned int host_threads;		/* host backend: 每个 shard 的 worker 数，0 = CPU 数 / num_shards */
+	enum dpa_arena_page arena_page;
+	uint32_t dim;
+	uint32_t db_size;			/* 所有 shard 的总行数 */
+	uint32_t max_nq;
+	uint32_t k;
+};
+
+/* One shard, filled by l2_shards_get_stats() */
+struct l2_shard_stats {
+	const char *device;
+	uint32_t first;		/* 这个 shard 的第一行（全局行号） */
+	uint32_t rows;
+	uint64_t batches;	/* 参与过的 fan-out 次数 */
+	uint64_t busy_ns;	/* 所有 fan-out 里 拷 query + launch + wait 的时间之和 */
+	uint64_t last_ns;	/* 最近一次 fan-out 的时间 */
+};
+
+struct l2_shards_stats {
+	uint64_t batches;
+	uint64_t fanout_ns;	/* 所有 fan-out 的墙钟时间，等最慢的 shard */
+	uint64_t merge_ns;	/* host 上合并结果的时间 */
+	double imbalance;	/* 最近一次 fan-out：最慢 shard / shard 平均，1.0 = 完全均衡 */
+};
+
+struct l2_shards;
+
+/*
+ * Open the devices / backends and allocate every shard's slice and result regions
+ *
+ * @cfg [in]: configuration, copied
+ * @shards [out]: opened shard group
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_shards_open(const struct l2_shards_cfg *cfg, struct l2_shards **shards);
+
+/* Free the shards and close the devices they opened */
+void l2_shards_close(struct l2_shards *shards);
+
+/*
+ * Copy the database into the shards, each gets its own rows
+ *
+ * @vecs [in]: db_size * dim Q16.16 values in host memory
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_shards_load(struct l2_shards *shards, const int32_t *vecs);
+
+/*
+ * k nearest rows of the whole database for each query
+ *
+ * @queries [in]: nq * dim Q16.16 values in host memory, nq <= max_nq
+ * @results [out]: nq * k hits sorted by (dist, id), ids are global row numbers
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_shards_search(struct l2_shards *shards, const int32_t *queries, uint32_t nq,
+			      struct l2_hit *results);
+
+/*
+ * Distance of one query to every row of the database
+ *
+ * @query [in]: dim Q16.16 values in host memory
+ * @out [out]: db_size distances in 2Q(2q), out[i] for global row i
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+doca_error_t l2_shards_distances(struct l2_shards *shards, const int32_t *query, uint64_t *out);
+
+uint32_t l2_shards_count(const struct l2_shards *shards);
+
+/*
+ * Per-shard and group counters
+ *
+ * @shard_stats [out]: l2_shards_count() entries, may be NULL
+ * @stats [out]: group counters, may be NULL
+ */
+void l2_shards_get_stats(const struct l2_shards *shards, struct l2_shard_stats *shard_stats,
+			 struct l2_shards_stats *stats);
@@ -0,0 +1,90 @@
+#pragma once
+/*
+ * Host SIMD kernels for the Q16.16 squared L2 distance.
+ *
+ * Results are bit-identical to l2_cpu_batch(): sum of (a[i] - b[i])^2 over
+ * int64 with wrap-around, returned as uint64_t 2Q(2q). The ISA is picked once
+ * via CPUID (AVX-512F > AVX2 > scalar) and can be forced with the ZSJ_SIMD
+ * environment variable (scalar / avx2 / avx512) for A/B runs.
+ */
+#include <stdint.h>
+
+#include "args.h"
+#include "l2_dispatch.h"
+
+enum l2_simd_isa {
+	L2_SIMD_SCALAR,
+	L2_SIMD_AVX2,
+	L2_SIMD_AVX512,
+	L2_SIMD_MAX,
+};
+
+typedef uint64_t (*l2_sq_fn)(const int32_t *a, const int32_t *b, uint32_t dim);
+
+/*
+ * Early-abandon distance: the partial sum is checked against thresh after
+ * every block dimensions and evaluation stops once it exceeds it. The result
+ * is the full distance when it is <= thresh and some value > thresh
+ * otherwise; dims is incremented by the dimensions actually evaluated.
+ */
+typedef uint64_t (*l2_sq_abandon_fn)(const int32_t *a, const int32_t *b, uint32_t dim, uint32_t block,
+				     uint64_t thresh, uint64_t *dims);
+
+/* ISA chosen for this process */
+enum l2_simd_isa l2_simd_isa(void);
+
+const char *l2_simd_isa_name(enum l2_simd_isa isa);
+
+/* Kernel for a given ISA, NULL if the CPU does not support it */
+l2_sq_fn l2_simd_sq_fn(enum l2_simd_isa isa);
+
+/*
+ * Kernel for a given ISA and variant, NULL if the CPU does not support the ISA.
+ * Specialized variants only read l2_variant_dim(variant) elements.
+ */
+l2_sq_fn l2_simd_kernel(enum l2_simd_isa isa, enum l2_variant variant);
+
+/* Early-abandon kernel for a given ISA, NULL if the CPU does not support it */
+l2_sq_abandon_fn l2_simd_abandon_fn(enum l2_simd_isa isa);
+
+/* ||a - b||^2 of one Q16.16 vector pair, 2Q(2q) */
+uint64_t l2_sq_q16_16(const int32_t *a, const int32_t *b, uint32_t dim);
+
+/*
+ * Same contract as l2_batch_kernel / l2_cpu_batch, single host thread.
+ * variant must be L2_VARIANT_GENERIC or match args->dim (see l2_variant_select).
+ */
+void l2_simd_batch(const struct l2_batch_args *args, enum l2_variant variant);
+
+/* Same contract as l2_cpu_search: global top-k in part 0, other parts empty */
+void l2_simd_search(const struct l2_search_args *args, enum l2_variant variant);
+
+/* Same contract as l2_cpu_ivf */
+void l2_simd_ivf(const struct l2_ivf_args *args, enum l2_variant variant);
+
+/* Same contract as l2_cpu_pq, table lookups gathered 8/16 subspaces at a time */
+void l2_simd_pq(const struct l2_pq_args *args);
+
+/* Part `part` of l2_pq_kernel: the same contiguous 1 / num_parts of the codes as DPA rank `part` */
+void l2_simd_pq_part(const struct l2_pq_args *args, uint32_t part);
+
+/* Same contract as l2_cpu_hamming, popcount with AVX-512 VPOPCNTDQ or an AVX2 pshufb nibble table */
+void l2_simd_hamming(const struct l2_hamming_args *args);
+
+/* Part `part` of l2_hamming_kernel: the same contiguous 1 / num_parts of the codes as DPA rank `part` */
+void l2_simd_hamming_part(const struct l2_hamming_args *args, uint32_t part);
+
+/* Same contract as l2_qbatch_kernel / l2_cpu_qbatch, single host thread */
+void l2_simd_qbatch(const struct l2_qbatch_args *args);
+
+/* Same contract as l2_batch_blocked_kernel / l2_cpu_batch_blocked, single host thread */
+void l2_simd_batch_blocked(const struct l2_batch_blocked_args *args);
+
+/* b rows kept hot per pass of l2_simd_matrix(), sized for a 256 KiB-class L2 */
+#define L2_MATRIX_B_TILE_BYTES (128u << 10)
+
+/* norms[i] = ||v_i||^2 (2Q(2q), int64 wrap-around) for count vectors stride bytes apart */
+void l2_simd_norms(const int32_t *vecs, uint64_t stride, uint32_t count, uint32_t dim, uint64_t *norms);
+
+/* Same contract as l2_matrix_kernel / l2_cpu_matrix, single host thread, 4x4 register-blocked dot products */
+void l2_simd_matrix(const struct l2_matrix_args *args);
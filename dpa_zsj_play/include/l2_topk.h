@@ -0,0 +1,87 @@
+#pragma once
+/*
+ * Fixed-capacity top-k max-heap of struct l2_hit, shared by the DPA kernels,
+ * the emulator and the host paths (no libc). Ordering is (dist, id) so every
+ * backend keeps exactly the same k candidates on ties.
+ */
+#include <stdint.h>
+
+#include "args.h"
+
+#define L2_HIT_EMPTY_ID UINT32_MAX
+
+/* a 排在 b 后面（更差）？ */
+static inline int l2_hit_worse(uint64_t da, uint32_t ia, uint64_t db, uint32_t ib)
+{
+	return da > db || (da == db && ia > ib);
+}
+
+static inline void l2_topk_sift_down(struct l2_hit *heap, uint32_t n, uint32_t i)
+{
+	for (;;) {
+		uint32_t l = 2 * i + 1, r = l + 1, m = i;
+
+		if (l < n && l2_hit_worse(heap[l].dist, heap[l].id, heap[m].dist, heap[m].id))
+			m = l;
+		if (r < n && l2_hit_worse(heap[r].dist, heap[r].id, heap[m].dist, heap[m].id))
+			m = r;
+		if (m == i)
+			return;
+		struct l2_hit t = heap[i];
+		heap[i] = heap[m];
+		heap[m] = t;
+		i = m;
+	}
+}
+
+/*
+ * 插入一个候选，堆满且不比堆顶好时直接丢掉
+ *
+ * @heap [in/out]: k 个元素的数组
+ * @n [in/out]: 当前元素个数
+ * @k: 容量
+ */
+static inline void l2_topk_push(struct l2_hit *heap, uint32_t *n, uint32_t k, uint64_t dist, uint32_t id)
+{
+	uint32_t i;
+
+	if (*n < k) {
+		i = (*n)++;
+		heap[i].dist = dist;
+		heap[i].id = id;
+		heap[i].pad = 0;
+		/* sift up */
+		while (i > 0) {
+			uint32_t p = (i - 1) / 2;
+
+			if (!l2_hit_worse(heap[i].dist, heap[i].id, heap[p].dist, heap[p].id))
+				break;
+			struct l2_hit t = heap[i];
+			heap[i] = heap[p];
+			heap[p] = t;
+			i = p;
+		}
+		return;
+	}
+	if (k == 0 || !l2_hit_worse(heap[0].dist, heap[0].id, dist, id))
+		return;
+	heap[0].dist = dist;
+	heap[0].id = id;
+	l2_topk_sift_down(heap, k, 0);
+}
+
+/* 堆满时的剪枝阈值：dist 必须 <= 这个值才可能进堆 */
+static inline uint64_t l2_topk_bound(const struct l2_hit *heap, uint32_t n, uint32_t k)
+{
+	return n < k ? UINT64_MAX : heap[0].dist;
+}
+
+/* 把 [n, k) 填成空位，写回 out 之前用 */
+static inline void l2_topk_pad(struct l2_hit *heap, uint32_t n, uint32_t k)
+{
+	for (uint32_t i = n; i < k; i++) {
+		heap[i].dist = UINT64_MAX;
+		heap[i].id = L2_HIT_EMPTY_ID;
+		heap[i].pad = 0;
+	}
+}
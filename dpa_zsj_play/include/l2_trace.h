@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * Hot-path tracing, compiled in only with -D ZSJ_TRACE (meson -Dtrace=true).
+ *
+ * Spans (start, duration and an optional count such as bytes or vectors) and
+ * counters are appended to a buffer owned by the recording thread: a chain of
+ * fixed-size chunks that only that thread writes, published with a release
+ * store of the chunk's event count, so recording takes no lock. Each thread's
+ * buffer is linked into a global list once with a CAS.
+ *
+ * l2_trace_dump() writes everything recorded so far as Chrome trace JSON
+ * (chrome://tracing or ui.perfetto.dev) and prints a per-name summary table.
+ * Counters are recorded as increments; the JSON shows their running total.
+ * Without ZSJ_TRACE every macro expands to nothing and l2_trace_dump()
+ * only reports that tracing is not built in.
+ *
+ * Names are stored by pointer and must be string literals.
+ */
+#include <stdint.h>
+
+#include <doca_error.h>
+
+#ifdef ZSJ_TRACE
+
+/* CLOCK_MONOTONIC in ns, the same clock the modules' own timers use */
+uint64_t l2_trace_now(void);
+
+/* Record a finished span [t0, t1) on the calling thread, value 0 if there is nothing to count */
+void l2_trace_span(const char *name, uint64_t t0, uint64_t t1, uint64_t value);
+
+/* Same, for spans that overlap others on the thread (launch -> completion); shown as async slices keyed by id */
+void l2_trace_async(const char *name, uint64_t t0, uint64_t t1, uint64_t id);
+
+/* Add value to counter name */
+void l2_trace_counter(const char *name, uint64_t value);
+
+/* Label the calling thread in the trace viewer */
+void l2_trace_thread_name(const char *name);
+
+struct l2_trace_scope {
+	const char *name;
+	uint64_t t0;
+};
+
+static inline void l2_trace_scope_end(struct l2_trace_scope *scope)
+{
+	l2_trace_span(scope->name, scope->t0, l2_trace_now(), 0);
+}
+
+#define L2_TRACE_CAT2(a, b) a##b
+#define L2_TRACE_CAT(a, b) L2_TRACE_CAT2(a, b)
+
+/* Span from here to the end of the enclosing block */
+#define L2_TRACE_SCOPE(name)                                                                                   \
+	struct l2_trace_scope L2_TRACE_CAT(l2_trace_scope_, __LINE__) __attribute__((cleanup(l2_trace_scope_end))) = \
+		{(name), l2_trace_now()}
+/* Explicit span: BEGIN declares start time t, END records it together with a count */
+#define L2_TRACE_BEGIN(t) uint64_t t = l2_trace_now()
+#define L2_TRACE_END(t, name, value) l2_trace_span((name), (t), l2_trace_now(), (value))
+#define L2_TRACE_COUNTER(name, value) l2_trace_counter((name), (value))
+#define L2_TRACE_THREAD(name) l2_trace_thread_name(name)
+
+#else
+
+#define L2_TRACE_SCOPE(name) do {} while (0)
+#define L2_TRACE_BEGIN(t) do {} while (0)
+#define L2_TRACE_END(t, name, value) do {} while (0)
+#define L2_TRACE_COUNTER(name, value) do {} while (0)
+#define L2_TRACE_THREAD(name) do {} while (0)
+
+#endif
+
+/* 1 if the build records trace events */
+int l2_trace_enabled(void);
+
+/*
+ * Write all events recorded so far as Chrome trace JSON and print the summary table to stdout.
+ * Must not race with threads that are still recording.
+ *
+ * @path [in]: output file
+ * @return: DOCA_SUCCESS on success, DOCA_ERROR_NOT_SUPPORTED if built without ZSJ_TRACE
+ */
+doca_error_t l2_trace_dump(const char *path);
@@ -33,6 +33,30 @@ void double_array_to_q16_16(const double *src, int32_t *dst, size_t len);
 /* 批量 Q16.16 int32[] -> double[] */
 void q16_16_array_to_double(const int32_t *src, double *dst, size_t len);
 
+/*
+ * 批量量化到 Q16.16，直接写进调用方给的 dst（例如 doca_mmap 注册过的 buffer），
+ * 不需要中间数组。舍入同 llround（四舍五入，.5 远离 0），超出 int32 的饱和，NaN -> INT32_MIN。
+ * AVX-512 / AVX2 按 CPU 自动选择，len 足够大时拆给 num_threads 个线程（0 = 所有在线 CPU）。
+ */
+void q16_16_quantize_double(const double *src, int32_t *dst, size_t len, unsigned int num_threads);
+
+void q16_16_quantize_float(const float *src, int32_t *dst, size_t len, unsigned int num_threads);
+
+/*
+ * 按向量量化成 int16 / int8 行（l2_qvec_hdr + code，见 args.h），直接写进 dst（例如 l2_batch 的 a / b）。
+ * 每个向量按自己的 [min, max] 做非对称量化：scale 是 Q(frac_bits) 定点，向上取整保证 code 不越界，
+ * zero-point 让 min 落在最小的 code 上；header 里的 sum / norm 同时算好。
+ * row_stride 是行长（字节），至少 l2_elem_row_bytes()。int16 只用 [-32767, 32767]。
+ */
+void quantize_vectors_int16(const double *src, size_t dim, size_t count, void *dst, size_t row_stride,
+                            unsigned int frac_bits);
+
+void quantize_vectors_int8(const double *src, size_t dim, size_t count, void *dst, size_t row_stride,
+                           unsigned int frac_bits);
+
+/* 一行 int16 / int8（code_bytes = 2 / 1）反量化回 double */
+void dequantize_vector(const void *row, int code_bytes, size_t dim, unsigned int frac_bits, double *dst);
+
 /* 生成 [min, max) 区间的均匀随机 double */
 double rand_double(double min, double max);
 
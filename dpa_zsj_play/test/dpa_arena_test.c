@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+/*
+ * Unit test for the registered memory arena (host/dpa_arena.c). Registration
+ * goes through a fake dpa_arena_reg_ops hook, so no DOCA device is needed.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/dpa_arena.h"
+
+#define FAKE_HANDLE 0x5a5a
+
+#define CHECK(cond)                                                                       \
+	do {                                                                              \
+		if (!(cond)) {                                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			return 1;                                                         \
+		}                                                                         \
+	} while (0)
+
+/* fake 注册 hook：记下调用，handle 固定，reg_obj 指回自己 */
+struct fake_reg {
+	int regs;
+	int unregs;
+	void *addr;
+	size_t len;
+	doca_error_t fail;	/* 非 0 时 reg 直接返回它 */
+};
+
+static doca_error_t fake_reg(void *ctx, void *addr, size_t len, doca_dpa_dev_mmap_t *handle, void **reg_obj)
+{
+	struct fake_reg *f = ctx;
+
+	if (f->fail != DOCA_SUCCESS)
+		return f->fail;
+	f->regs++;
+	f->addr = addr;
+	f->len = len;
+	*handle = FAKE_HANDLE;
+	*reg_obj = f;
+	return DOCA_SUCCESS;
+}
+
+static void fake_unreg(void *ctx, void *reg_obj)
+{
+	struct fake_reg *f = ctx;
+
+	if (reg_obj == f)
+		f->unregs++;
+}
+
+static struct dpa_arena *arena_with(struct fake_reg *f, size_t size, enum dpa_arena_page page, size_t align)
+{
+	struct dpa_arena_cfg cfg = {
+		.size = size,
+		.page = page,
+		.align = align,
+		.reg = {.reg = fake_reg, .unreg = fake_unreg, .ctx = f},
+	};
+	struct dpa_arena *arena = NULL;
+
+	if (dpa_arena_create(&cfg, &arena) != DOCA_SUCCESS)
+		return NULL;
+	return arena;
+}
+
+/* 注册只发生一次、覆盖整个 arena，handle 传到每块子分配上，destroy 时注销 */
+static int test_registration(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_arena_stats st;
+	struct dpa_region r;
+	struct dpa_arena *arena = arena_with(&f, 1 << 20, DPA_ARENA_PAGE_4K, 0);
+
+	CHECK(arena != NULL);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(f.regs == 1);
+	CHECK(f.len == st.capacity);
+	CHECK(dpa_arena_alloc(arena, 100, &r) == DOCA_SUCCESS);
+	CHECK(r.handle == FAKE_HANDLE);
+	CHECK((uint8_t *)r.addr == (uint8_t *)f.addr + r.offset);
+	memset(r.addr, 0xab, r.len);
+	dpa_arena_destroy(arena);
+	CHECK(f.unregs == 1);
+
+	/* 注册失败时 create 失败，不留半成品 */
+	f = (struct fake_reg){.fail = DOCA_ERROR_DRIVER};
+	CHECK(arena_with(&f, 1 << 20, DPA_ARENA_PAGE_4K, 0) == NULL);
+	CHECK(f.unregs == 0);
+	return 0;
+}
+
+/* bump 分配：连续、按默认 64 字节对齐，满了返回 NO_MEMORY */
+static int test_bump(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_arena_stats st;
+	struct dpa_region a, b, c;
+	struct dpa_arena *arena = arena_with(&f, 4096, DPA_ARENA_PAGE_4K, 0);
+
+	CHECK(arena != NULL);
+	CHECK(dpa_arena_alloc(arena, 100, &a) == DOCA_SUCCESS);
+	CHECK(a.offset == 0 && a.len == 128);
+	CHECK(dpa_arena_alloc(arena, 1, &b) == DOCA_SUCCESS);
+	CHECK(b.offset == 128 && b.len == 64);
+	CHECK(dpa_arena_alloc(arena, 0, &c) == DOCA_ERROR_INVALID_VALUE);
+
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.bump == 192 && st.used == 192 && st.peak == 192);
+	CHECK(st.free_blocks == 0);
+
+	CHECK(dpa_arena_alloc(arena, st.capacity - st.bump + 1, &c) == DOCA_ERROR_NO_MEMORY);
+	CHECK(dpa_arena_alloc(arena, st.capacity - st.bump, &c) == DOCA_SUCCESS);
+	CHECK(dpa_arena_alloc(arena, 1, &c) == DOCA_ERROR_NO_MEMORY);
+
+	dpa_arena_reset(arena);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.bump == 0 && st.used == 0 && st.free_blocks == 0);
+	CHECK(dpa_arena_alloc(arena, 1, &a) == DOCA_SUCCESS && a.offset == 0);
+	dpa_arena_destroy(arena);
+	return 0;
+}
+
+/* 自定义对齐：偏移和地址都按它对齐；不是 2 的幂的对齐被拒绝 */
+static int test_alignment(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_region r[8];
+	struct dpa_arena *arena = arena_with(&f, 64 << 10, DPA_ARENA_PAGE_4K, 4096);
+
+	CHECK(arena != NULL);
+	for (int i = 0; i < 8; i++) {
+		CHECK(dpa_arena_alloc(arena, 1 + i * 1000, &r[i]) == DOCA_SUCCESS);
+		CHECK(r[i].offset % 4096 == 0);
+		CHECK((uintptr_t)r[i].addr % 4096 == 0);
+		CHECK(r[i].len % 4096 == 0 && r[i].len >= (size_t)(1 + i * 1000));
+	}
+	dpa_arena_destroy(arena);
+
+	CHECK(arena_with(&f, 64 << 10, DPA_ARENA_PAGE_4K, 48) == NULL);
+	return 0;
+}
+
+/* 释放的块进 free list，之后 first fit 复用；放不下的请求走 bump */
+static int test_reuse(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_arena_stats st;
+	struct dpa_region a, b, c, d, e;
+	struct dpa_arena *arena = arena_with(&f, 64 << 10, DPA_ARENA_PAGE_4K, 0);
+	size_t b_offset;
+
+	CHECK(arena != NULL);
+	CHECK(dpa_arena_alloc(arena, 256, &a) == DOCA_SUCCESS);
+	CHECK(dpa_arena_alloc(arena, 512, &b) == DOCA_SUCCESS);
+	CHECK(dpa_arena_alloc(arena, 256, &c) == DOCA_SUCCESS);
+	b_offset = b.offset;
+	dpa_arena_free(arena, &b);
+	CHECK(b.addr == NULL);
+
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 1 && st.free_bytes == 512);
+	CHECK(st.used == 512 && st.bump == 1024);
+
+	/* 比空洞大：从 bump 拿，空洞不动 */
+	CHECK(dpa_arena_alloc(arena, 1024, &d) == DOCA_SUCCESS);
+	CHECK(d.offset == 1024);
+	/* 比空洞小：切空洞的前面 */
+	CHECK(dpa_arena_alloc(arena, 128, &e) == DOCA_SUCCESS);
+	CHECK(e.offset == b_offset);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 1 && st.free_bytes == 384);
+	/* 刚好填满剩下的空洞：free list 清空 */
+	CHECK(dpa_arena_alloc(arena, 384, &b) == DOCA_SUCCESS);
+	CHECK(b.offset == b_offset + 128);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 0 && st.free_bytes == 0);
+	CHECK(st.peak == st.used);
+	dpa_arena_destroy(arena);
+	return 0;
+}
+
+/* 相邻的空洞合并成一块；bump 下面紧挨的空洞被 bump 吃回去 */
+static int test_coalesce(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_arena_stats st;
+	struct dpa_region r[5];
+	struct dpa_arena *arena = arena_with(&f, 64 << 10, DPA_ARENA_PAGE_4K, 0);
+
+	CHECK(arena != NULL);
+	for (int i = 0; i < 5; i++)
+		CHECK(dpa_arena_alloc(arena, 256, &r[i]) == DOCA_SUCCESS);
+
+	/* 0 和 2 不相邻：两块 */
+	dpa_arena_free(arena, &r[0]);
+	dpa_arena_free(arena, &r[2]);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 2 && st.free_bytes == 512);
+
+	/* 1 把前后两块连起来：[0, 768) 一块 */
+	dpa_arena_free(arena, &r[1]);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 1 && st.free_bytes == 768);
+
+	/* 和后面的空洞合并 */
+	dpa_arena_free(arena, &r[3]);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.free_blocks == 1 && st.free_bytes == 1024);
+	CHECK(st.bump == 1280);
+
+	/* 最后一块紧挨 bump：bump 回退，并吃掉下面的空洞 */
+	dpa_arena_free(arena, &r[4]);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.bump == 0 && st.used == 0);
+	CHECK(st.free_blocks == 0 && st.free_bytes == 0);
+
+	/* 合并后的大块能整块拿出来 */
+	for (int i = 0; i < 3; i++)
+		CHECK(dpa_arena_alloc(arena, 256, &r[i]) == DOCA_SUCCESS);
+	dpa_arena_free(arena, &r[0]);
+	dpa_arena_free(arena, &r[1]);
+	CHECK(dpa_arena_alloc(arena, 512, &r[3]) == DOCA_SUCCESS);
+	CHECK(r[3].offset == 0);
+	dpa_arena_destroy(arena);
+	return 0;
+}
+
+/* 这种大页当前空闲的个数，系统不支持时为 0 */
+static unsigned long hugepages_free(unsigned long size_kb)
+{
+	char path[128];
+	unsigned long n = 0;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/sys/kernel/mm/hugepages/hugepages-%lukB/free_hugepages", size_kb);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+	if (fscanf(fp, "%lu", &n) != 1)
+		n = 0;
+	fclose(fp);
+	return n;
+}
+
+/* 要 1G 页：没有大页时退回 4K，不管拿到哪种页都能正常注册和使用 */
+static int test_page_fallback(void)
+{
+	struct fake_reg f = {0};
+	struct dpa_arena_stats st;
+	struct dpa_region r;
+	struct dpa_arena *arena = arena_with(&f, 4 << 20, DPA_ARENA_PAGE_1G, 0);
+
+	CHECK(arena != NULL);
+	dpa_arena_get_stats(arena, &st);
+	CHECK(st.capacity >= (4 << 20));
+	if (hugepages_free(1UL << 20) == 0 && hugepages_free(2UL << 10) == 0)
+		CHECK(st.page == DPA_ARENA_PAGE_4K);
+	if (st.page == DPA_ARENA_PAGE_4K)
+		CHECK(st.capacity == (4 << 20));
+	CHECK(f.regs == 1 && f.len == st.capacity);
+	CHECK(dpa_arena_alloc(arena, st.capacity, &r) == DOCA_SUCCESS);
+	memset(r.addr, 0x5a, r.len);
+	dpa_arena_destroy(arena);
+	CHECK(f.unregs == 1);
+	return 0;
+}
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(void);
+	} tests[] = {
+		{"registration", test_registration},
+		{"bump", test_bump},
+		{"alignment", test_alignment},
+		{"reuse", test_reuse},
+		{"coalesce", test_coalesce},
+		{"page_fallback", test_page_fallback},
+	};
+	int failed = 0;
+
+	if (doca_log_backend_create_standard() != DOCA_SUCCESS)
+		return EXIT_FAILURE;
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		int ret = tests[i].fn();
+
+		printf("%-14s %s\n", tests[i].name, ret == 0 ? "ok" : "FAILED");
+		failed += ret != 0;
+	}
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
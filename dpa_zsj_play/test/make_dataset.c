@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+/*
+ * Writes a small clustered dataset in the TEXMEX formats for the --base / --queries / --gt
+ * tests: base.fvecs, queries.fvecs and an .ivecs ground truth of the nearest base ids per
+ * query. Every value sits on the Q16.16 grid, so quantization is exact and the ground truth,
+ * computed on the quantized values and ordered by (dist, id) like the search kernels, is the
+ * answer an exact scan must return.
+ *
+ * Usage: make_dataset <base.fvecs> <queries.fvecs> <gt.ivecs>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DIM 32
+#define BASE_COUNT 4096
+#define QUERY_COUNT 200
+#define CLUSTERS 32
+#define GT_K 100
+#define SPREAD 4.0	/* 簇内每维的噪声幅度 */
+
+/* 自带的 xorshift，和 libc 的 rand() 无关，每个平台生成同一份数据 */
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static double rng_unit(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+/* 对到 Q16.16 的格点上，|x| < 256 时 float 能精确表示 */
+static int32_t to_grid(double x)
+{
+	return (int32_t)llround(x * 65536.0);
+}
+
+/* 簇中心 + 近似正态的噪声（4 个均匀分布相加） */
+static void make_rows(const double *centers, uint32_t count, int32_t *rows)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		const double *c = centers + (size_t)(rng_unit() * CLUSTERS) * DIM;
+
+		for (uint32_t d = 0; d < DIM; d++) {
+			double noise = rng_unit() + rng_unit() + rng_unit() + rng_unit() - 2.0;
+
+			rows[(size_t)i * DIM + d] = to_grid(c[d] + SPREAD * noise);
+		}
+	}
+}
+
+static int write_fvecs(const char *path, const int32_t *rows, uint32_t count)
+{
+	FILE *fp = fopen(path, "wb");
+	int32_t dim = DIM;
+	float v[DIM];
+
+	if (fp == NULL) {
+		perror(path);
+		return 1;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		for (uint32_t d = 0; d < DIM; d++)
+			v[d] = (float)(rows[(size_t)i * DIM + d] / 65536.0);
+		if (fwrite(&dim, sizeof(dim), 1, fp) != 1 || fwrite(v, sizeof(v), 1, fp) != 1) {
+			perror(path);
+			fclose(fp);
+			return 1;
+		}
+	}
+	return fclose(fp) != 0;
+}
+
+struct neighbour {
+	uint64_t dist;
+	int32_t id;
+};
+
+static int neighbour_cmp(const void *a, const void *b)
+{
+	const struct neighbour *x = a, *y = b;
+
+	if (x->dist != y->dist)
+		return x->dist < y->dist ? -1 : 1;
+	return (x->id > y->id) - (x->id < y->id);
+}
+
+/* 每个 query 对整个库精确排序，取前 GT_K 个 */
+static int write_gt(const char *path, const int32_t *base, const int32_t *queries)
+{
+	struct neighbour *all = malloc(BASE_COUNT * sizeof(*all));
+	FILE *fp = fopen(path, "wb");
+	int32_t k = GT_K, ids[GT_K];
+	int ret = 1;
+
+	if (all == NULL || fp == NULL) {
+		perror(path);
+		goto out;
+	}
+	for (uint32_t q = 0; q < QUERY_COUNT; q++) {
+		for (uint32_t i = 0; i < BASE_COUNT; i++) {
+			uint64_t dist = 0;
+
+			for (uint32_t d = 0; d < DIM; d++) {
+				int64_t diff = (int64_t)queries[(size_t)q * DIM + d] - base[(size_t)i * DIM + d];
+
+				dist += (uint64_t)(diff * diff);
+			}
+			all[i] = (struct neighbour){dist, (int32_t)i};
+		}
+		qsort(all, BASE_COUNT, sizeof(*all), neighbour_cmp);
+		for (uint32_t j = 0; j < GT_K; j++)
+			ids[j] = all[j].id;
+		if (fwrite(&k, sizeof(k), 1, fp) != 1 || fwrite(ids, sizeof(ids), 1, fp) != 1) {
+			perror(path);
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	if (fp != NULL && fclose(fp) != 0)
+		ret = 1;
+	free(all);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	double centers[CLUSTERS * DIM];
+	int32_t *base, *queries;
+	int ret = EXIT_FAILURE;
+
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s <base.fvecs> <queries.fvecs> <gt.ivecs>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (uint32_t i = 0; i < CLUSTERS * DIM; i++)
+		centers[i] = rng_unit() * 100.0 - 50.0;
+	base = malloc((size_t)BASE_COUNT * DIM * sizeof(*base));
+	queries = malloc((size_t)QUERY_COUNT * DIM * sizeof(*queries));
+	if (base == NULL || queries == NULL)
+		goto out;
+	make_rows(centers, BASE_COUNT, base);
+	make_rows(centers, QUERY_COUNT, queries);
+	if (write_fvecs(argv[1], base, BASE_COUNT) == 0 && write_fvecs(argv[2], queries, QUERY_COUNT) == 0 &&
+	    write_gt(argv[3], base, queries) == 0)
+		ret = EXIT_SUCCESS;
+out:
+	free(queries);
+	free(base);
+	return ret;
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2022 NVIDIA CORPORATION & AFFILIATES, ALL RIGHTS RESERVED.
+ *
+ * This software product is a proprietary product of NVIDIA CORPORATION &
+ * AFFILIATES (the "Company") and all right, title, and interest in and to the
+ * software product, including all associated intellectual property rights, are
+ * and shall remain exclusively with the Company.
+ *
+ * This software product is governed by the End User License Agreement
+ * provided with the software product.
+ *
+ */
+
+/*
+ * Unit test for the bulk Q16.16 quantizers (q16_16_quantize_double/float in
+ * host/utils.c) against the scalar double_to_q16_16() / llround reference:
+ * ties, saturation, NaN, SIMD tails and the multi-threaded split.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "../include/utils.h"
+
+#define ULP (1.0 / 65536.0)
+#define GUARD 0x7e7e7e7e
+/* 量化器每线程至少 65536 个元素，这个长度能拆成 3 个线程，最后一块也不是 64 的倍数 */
+#define THREADED_LEN (3 * 65536 + 37)
+
+#define CHECK(cond)                                                                       \
+	do {                                                                              \
+		if (!(cond)) {                                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			return 1;                                                         \
+		}                                                                         \
+	} while (0)
+
+/* 参考值：NaN -> INT32_MIN，llround 放不下的先饱和，其余交给 double_to_q16_16 */
+static int32_t ref_q16_16(double x)
+{
+	if (isnan(x))
+		return INT32_MIN;
+	if (x > 1e9)
+		return INT32_MAX;
+	if (x < -1e9)
+		return INT32_MIN;
+	return double_to_q16_16(x);
+}
+
+/* 边界值和期望结果 */
+struct special {
+	double x;
+	int32_t want;
+};
+
+static size_t specials(struct special *s)
+{
+	size_t n = 0;
+
+	s[n++] = (struct special){0.0, 0};
+	s[n++] = (struct special){-0.0, 0};
+	/* 正好 .5 ulp：远离 0，不是 banker's rounding */
+	s[n++] = (struct special){0.5 * ULP, 1};
+	s[n++] = (struct special){-0.5 * ULP, -1};
+	s[n++] = (struct special){2.5 * ULP, 3};
+	s[n++] = (struct special){-2.5 * ULP, -3};
+	s[n++] = (struct special){123456789.5 * ULP, 123456790};
+	s[n++] = (struct special){-123456789.5 * ULP, -123456790};
+	/* 差一点到 .5 / 刚过 .5 */
+	s[n++] = (struct special){nextafter(0.5 * ULP, 0.0), 0};
+	s[n++] = (struct special){nextafter(-0.5 * ULP, 0.0), 0};
+	s[n++] = (struct special){nextafter(2.5 * ULP, 0.0), 2};
+	s[n++] = (struct special){nextafter(2.5 * ULP, 1.0), 3};
+	s[n++] = (struct special){nextafter(-2.5 * ULP, 0.0), -2};
+	s[n++] = (struct special){nextafter(-2.5 * ULP, -1.0), -3};
+	s[n++] = (struct special){nextafter(123456789.5 * ULP, 0.0), 123456789};
+	/* ±32768 附近饱和 */
+	s[n++] = (struct special){32768.0 - ULP, INT32_MAX};
+	s[n++] = (struct special){32768.0 - 0.5 * ULP, INT32_MAX};
+	s[n++] = (struct special){nextafter(32768.0 - 0.5 * ULP, 0.0), INT32_MAX};
+	s[n++] = (struct special){nextafter(32768.0 - 1.5 * ULP, 0.0), INT32_MAX - 1};
+	s[n++] = (struct special){32768.0, INT32_MAX};
+	s[n++] = (struct special){40000.0, INT32_MAX};
+	s[n++] = (struct special){-32768.0 + ULP, INT32_MIN + 1};
+	s[n++] = (struct special){nextafter(-32768.0 + 0.5 * ULP, 0.0), INT32_MIN + 1};
+	s[n++] = (struct special){-32768.0 + 0.5 * ULP, INT32_MIN};
+	s[n++] = (struct special){-32768.0, INT32_MIN};
+	s[n++] = (struct special){-32768.0 - 0.5 * ULP, INT32_MIN};
+	s[n++] = (struct special){-40000.0, INT32_MIN};
+	/* 超出 int64 的也不能回绕 */
+	s[n++] = (struct special){1e300, INT32_MAX};
+	s[n++] = (struct special){-1e300, INT32_MIN};
+	s[n++] = (struct special){INFINITY, INT32_MAX};
+	s[n++] = (struct special){-INFINITY, INT32_MIN};
+	s[n++] = (struct special){NAN, INT32_MIN};
+	s[n++] = (struct special){-NAN, INT32_MIN};
+	return n;
+}
+
+/* 边界表本身和 double_to_q16_16 / llround 一致（llround 范围内的部分） */
+static int test_reference(void)
+{
+	struct special s[64];
+	size_t n = specials(s);
+
+	for (size_t i = 0; i < n; i++) {
+		CHECK(ref_q16_16(s[i].x) == s[i].want);
+		if (fabs(s[i].x) < 1e9)
+			CHECK(double_to_q16_16(s[i].x) == s[i].want);
+	}
+	return 0;
+}
+
+/* 每个边界值放在所有可能的 SIMD lane 上：长度 1..200、起点错开，dst[len] 不能被写 */
+static int test_double_specials(void)
+{
+	struct special s[64];
+	size_t n = specials(s);
+	double src[200 + 8];
+	int32_t dst[200 + 8];
+
+	for (size_t len = 1; len <= 200; len++) {
+		for (size_t off = 0; off < 4; off++) {
+			for (size_t i = 0; i < len; i++)
+				src[off + i] = s[(i + len) % n].x;
+			for (size_t i = 0; i < len + 4; i++)
+				dst[off + i] = GUARD;
+			q16_16_quantize_double(src + off, dst + off, len, 1);
+			for (size_t i = 0; i < len; i++)
+				CHECK(dst[off + i] == s[(i + len) % n].want);
+			CHECK(dst[off + len] == GUARD);
+		}
+	}
+	return 0;
+}
+
+/* float 转 double 是精确的，参考值在 double 上算 */
+static int test_float_specials(void)
+{
+	struct special s[64];
+	size_t n = specials(s);
+	float src[200 + 8];
+	int32_t dst[200 + 8];
+
+	/* float 上也是 .5 远离 0 */
+	src[0] = (float)(2.5 * ULP);
+	src[1] = (float)(-2.5 * ULP);
+	src[2] = 32768.0f;
+	src[3] = NAN;
+	q16_16_quantize_float(src, dst, 4, 1);
+	CHECK(dst[0] == 3 && dst[1] == -3 && dst[2] == INT32_MAX && dst[3] == INT32_MIN);
+
+	for (size_t len = 1; len <= 200; len++) {
+		for (size_t off = 0; off < 4; off++) {
+			for (size_t i = 0; i < len; i++)
+				src[off + i] = (float)s[(i + len) % n].x;
+			for (size_t i = 0; i < len + 4; i++)
+				dst[off + i] = GUARD;
+			q16_16_quantize_float(src + off, dst + off, len, 1);
+			for (size_t i = 0; i < len; i++)
+				CHECK(dst[off + i] == ref_q16_16((double)src[off + i]));
+			CHECK(dst[off + len] == GUARD);
+		}
+	}
+	return 0;
+}
+
+/* 随机值，每 7 个插一个 .5 ulp 的 tie，范围略超 ±32768 */
+static void fill_random(double *src, size_t len)
+{
+	srand(1);
+	for (size_t i = 0; i < len; i++) {
+		if (i % 7 == 0)
+			src[i] = ((double)(rand() % 2000001 - 1000000) + 0.5) * ULP;
+		else
+			src[i] = rand_double(-40000.0, 40000.0);
+	}
+}
+
+/* 拆线程的结果和单线程、参考值逐个相同；0 = 所有在线 CPU，线程数多于块数时要收回来 */
+static int test_threads(void)
+{
+	static const unsigned int threads[] = {1, 2, 3, 8, 0};
+	double *src = malloc(THREADED_LEN * sizeof(*src));
+	float *srcf = malloc(THREADED_LEN * sizeof(*srcf));
+	int32_t *dst = malloc((THREADED_LEN + 1) * sizeof(*dst));
+	int ret = 1;
+
+	if (src == NULL || srcf == NULL || dst == NULL)
+		goto out;
+	fill_random(src, THREADED_LEN);
+	for (size_t i = 0; i < THREADED_LEN; i++)
+		srcf[i] = (float)src[i];
+
+	for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+		memset(dst, 0x7e, (THREADED_LEN + 1) * sizeof(*dst));
+		q16_16_quantize_double(src, dst, THREADED_LEN, threads[t]);
+		for (size_t i = 0; i < THREADED_LEN; i++) {
+			if (dst[i] != ref_q16_16(src[i])) {
+				fprintf(stderr, "double threads=%u [%zu] %.17g: %d != %d\n", threads[t], i, src[i],
+					dst[i], ref_q16_16(src[i]));
+				goto out;
+			}
+		}
+		if (dst[THREADED_LEN] != GUARD)
+			goto out;
+
+		memset(dst, 0x7e, (THREADED_LEN + 1) * sizeof(*dst));
+		q16_16_quantize_float(srcf, dst, THREADED_LEN, threads[t]);
+		for (size_t i = 0; i < THREADED_LEN; i++) {
+			if (dst[i] != ref_q16_16((double)srcf[i])) {
+				fprintf(stderr, "float threads=%u [%zu] %.9g: %d != %d\n", threads[t], i,
+					(double)srcf[i], dst[i], ref_q16_16((double)srcf[i]));
+				goto out;
+			}
+		}
+		if (dst[THREADED_LEN] != GUARD)
+			goto out;
+	}
+	ret = 0;
+out:
+	free(src);
+	free(srcf);
+	free(dst);
+	return ret;
+}
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(void);
+	} tests[] = {
+		{"reference", test_reference},
+		{"double", test_double_specials},
+		{"float", test_float_specials},
+		{"threads", test_threads},
+	};
+	int failed = 0;
+
+	if (doca_log_backend_create_standard() != DOCA_SUCCESS)
+		return EXIT_FAILURE;
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		int ret = tests[i].fn();
+
+		printf("%-14s %s\n", tests[i].name, ret == 0 ? "ok" : "FAILED");
+		failed += ret != 0;
+	}
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}